@@ -88,6 +88,7 @@ LOCAL_SRC_FILES := \
            client/s_load.c \
            client/s_main.c \
            client/s_mix.c \
+           client/s_simd.c \
            client/s_mouth.c \
            client/s_stream.c \
            client/s_utils.c \
@@ -106,6 +107,7 @@ LOCAL_SRC_FILES := \
            common/host.c \
            common/hpak.c \
            common/infostring.c \
+           common/inflate.c \
            common/identification.c \
            common/library.c \
            common/masterlist.c \
@@ -123,6 +125,7 @@ LOCAL_SRC_FILES := \
            common/random.c \
            common/sys_con.c \
            common/system.c \
+           common/threads.c \
            common/titles.c \
            common/world.c \
            common/zone.c \
@@ -825,6 +825,9 @@ void CL_SendConnectPacket( void )
 				extensions |= NET_EXT_SPLITHUFF;
 		}
 
+		if( Cvar_VariableInteger( "cl_enable_filelane" ))
+			extensions |= NET_EXT_FILELANE;
+
 		if( !m_ignore->integer )
 			input_devices |= INPUT_DEVICE_MOUSE;
 
@@ -1692,6 +1695,14 @@ void CL_ConnectionlessPacket( netadr_t from, sizebuf_t *msg )
 			cls.netchan.compress = true;
 		}
 
+		if( extensions & NET_EXT_FILELANE )
+		{
+			MsgDev( D_INFO, "^2NET_EXT_FILELANE enabled\n" );
+
+			cls.netchan.filelane.enabled = true;
+			cls.netchan.filelane.key = Q_atoi( Cmd_Argv( 2 ));
+		}
+
 		BF_WriteByte( &cls.netchan.message, clc_stringcmd );
 		BF_WriteString( &cls.netchan.message, "new" );
 		cls.state = ca_connected;
@@ -1871,6 +1882,16 @@ void CL_ReadNetMessage( void )
 			if( !NetSplit_GetLong( &cls.netchan.netsplit, &net_from, net_message_buffer, &curSize, cls.splitcompress ) )
 				continue;
 
+		if( LittleLong( *((int *)&net_message_buffer )) == FILELANE_SIGNATURE )
+		{
+			if( cls.state >= ca_connected && NET_CompareAdr( net_from, cls.netchan.remote_address ))
+			{
+				BF_Init( &net_message, "FileLane", net_message_buffer, curSize );
+				Netchan_ProcessFileLane( &cls.netchan, &net_message );
+			}
+			continue;
+		}
+
 		BF_Init( &net_message, "ServerData", net_message_buffer, curSize );
 
 		// check for connectionless packet (0xffffffff) first
@@ -2035,11 +2056,17 @@ before allowing the client into the server
 void CL_Precache_f( void )
 {
 	int	spawncount;
+	double	start;
 
 	spawncount = Q_atoi( Cmd_Argv( 1 ));
 
+	start = Sys_DoubleTime();
 	CL_PrepSound();
 	CL_PrepVideo();
+	MsgDev( D_INFO, "Client resources loaded in %.2f seconds\n", Sys_DoubleTime() - start );
+
+	// release files that wasn't requested
+	FS_PrefetchFlush();
 
 	if( Cmd_Argc() > 2 )
 	{
@@ -2149,6 +2176,7 @@ void CL_InitLocal( void )
 	Cvar_Get( "cl_enable_compress", "0", CVAR_ARCHIVE, "request huffman compression from server" );
 	Cvar_Get( "cl_enable_split", "1", CVAR_ARCHIVE, "request packet split from server" );
 	Cvar_Get( "cl_enable_splitcompress", "0", CVAR_ARCHIVE, "request compressing all splitpackets" );
+	Cvar_Get( "cl_enable_filelane", "1", CVAR_ARCHIVE, "request sending files over separate paced lane" );
 
 	Cvar_Get( "cl_maxoutpacket", "0", CVAR_ARCHIVE, "max outcoming packet size (equal cl_maxpacket if 0)" );
 
@@ -2233,6 +2261,10 @@ void CL_SendCommand( void )
 	// send intentions now
 	CL_SendCmd ();
 
+	// send file lane blocks and acks
+	if( cls.state >= ca_connected && !cls.demoplayback )
+		Netchan_TransmitFileLane( &cls.netchan );
+
 	// resend a connection request if necessary
 	CL_CheckForResend ();
 }
@@ -1059,6 +1059,11 @@ static ui_textfuncs_t gTextfuncs =
 	Con_UtfMoveRight
 };
 
+static ui_downloadfuncs_t gDownloadfuncs =
+{
+	HTTP_GetDownloadStatus
+};
+
 void UI_UnloadProgs( void )
 {
 	if( !menu.hInstance ) return;
@@ -1075,9 +1080,11 @@ qboolean UI_LoadProgs( void )
 {
 	static ui_enginefuncs_t	gpEngfuncs;
 	static ui_textfuncs_t	gpTextfuncs;
+	static ui_downloadfuncs_t	gpDownloadfuncs;
 	static ui_globalvars_t	gpGlobals;
 	int			i;
         UITEXTAPI GiveTextApi;
+	UIDOWNLOADAPI GiveDownloadApi;
 	if( menu.hInstance ) UI_UnloadProgs();
 
 	// setup globals
@@ -1132,6 +1139,13 @@ qboolean UI_LoadProgs( void )
 			menu.use_text_api = true;
 	}
 
+	if( ( GiveDownloadApi = (UIDOWNLOADAPI)Com_GetProcAddress( menu.hInstance, "GiveDownloadAPI" ) ) )
+	{
+		// make local copy of engfuncs to prevent overwrite it with user dll
+		Q_memcpy( &gpDownloadfuncs, &gDownloadfuncs, sizeof( gpDownloadfuncs ));
+		GiveDownloadApi( &gpDownloadfuncs );
+	}
+
 	pfnAddTouchButtonToList = (ADDTOUCHBUTTONTOLIST)Com_GetProcAddress( menu.hInstance, "AddTouchButtonToList" );
 
 	// setup gameinfo
@@ -1185,6 +1185,20 @@ void CL_ParseResourceList( sizebuf_t *msg )
 
 	if( !downloadcount )
 	{
+		// all resources are present, start reading them
+		// while server sends the rest of signon data
+		for( i = 0; i < reslist.rescount; i++ )
+		{
+			if( reslist.restype[i] == t_sound )
+			{
+				if( reslist.resnames[i][0] == '*' || reslist.resnames[i][0] == '!' )
+					continue;
+				FS_Prefetch( va( "sound/%s", reslist.resnames[i] ));
+			}
+			else if( reslist.restype[i] != t_decal )
+				FS_Prefetch( reslist.resnames[i] );
+		}
+
 		BF_WriteByte( &cls.netchan.message, clc_stringcmd );
 		BF_WriteString( &cls.netchan.message, "continueloading" );
 	}
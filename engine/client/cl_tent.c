@@ -38,11 +38,28 @@ TEMPENTS MANAGEMENT
 #define SHARD_VOLUME		12.0f	// on shard ever n^3 units
 #define SF_FUNNEL_REVERSE		1
 
+// low priority tents in allocation order, oldest is evicted first.
+// Client dll frees tents by itself, so entries are validated
+// by serial when they are taken
+typedef struct
+{
+	TEMPENTITY	*tent;
+	int		serial;
+} tentref_t;
+
 TEMPENTITY	*cl_active_tents;
 TEMPENTITY	*cl_free_tents;
 TEMPENTITY	*cl_tempents = NULL;		// entities pool
 int		cl_muzzleflash[MAX_MUZZLEFLASH];	// muzzle flashes
 
+static int	*cl_tentserial;		// bumped on every allocation
+static tentref_t	*cl_lowtents;		// ring of GI->max_tents * 2
+static int	cl_lowhead;
+static int	cl_lowcount;
+
+static byte	cl_tentpvs[MAX_MAP_LEAFS/8];	// visible from last view
+static qboolean	cl_tentcull;
+
 /*
 ================
 CL_InitTempents
@@ -52,6 +69,8 @@ CL_InitTempents
 void CL_InitTempEnts( void )
 {
 	cl_tempents = Mem_Alloc( cls.mempool, sizeof( TEMPENTITY ) * GI->max_tents );
+	cl_tentserial = Mem_Alloc( cls.mempool, sizeof( int ) * GI->max_tents );
+	cl_lowtents = Mem_Alloc( cls.mempool, sizeof( tentref_t ) * GI->max_tents * 2 );
 	CL_ClearTempEnts();
 }
 
@@ -94,6 +113,7 @@ void CL_ClearTempEnts( void )
 	cl_tempents[GI->max_tents-1].next = NULL;
 	cl_free_tents = cl_tempents;
 	cl_active_tents = NULL;
+	cl_lowhead = cl_lowcount = 0;
 }
 
 /*
@@ -106,7 +126,13 @@ void CL_FreeTempEnts( void )
 {
 	if( cl_tempents )
 		Mem_Free( cl_tempents );
+	if( cl_tentserial )
+		Mem_Free( cl_tentserial );
+	if( cl_lowtents )
+		Mem_Free( cl_lowtents );
 	cl_tempents = NULL;
+	cl_tentserial = NULL;
+	cl_lowtents = NULL;
 }
 
 /*
@@ -123,6 +149,7 @@ void CL_PrepareTEnt( TEMPENTITY *pTemp, model_t *pmodel )
 	int	modelHandle = pTemp->entity.trivial_accept;
 
 	Q_memset( pTemp, 0, sizeof( *pTemp ));
+	cl_tentserial[pTemp - cl_tempents]++;
 
 	// use these to set per-frame and termination conditions / actions
 	pTemp->entity.trivial_accept = modelHandle; // keep unchanged
@@ -240,6 +267,30 @@ void CL_TEntPlaySound( TEMPENTITY *pTemp, float damp )
 	}
 }
 
+/*
+==============
+CL_TEntVisible
+
+view is not set up yet when tents are added,
+so check against PVS from last frame
+==============
+*/
+static qboolean CL_TEntVisible( cl_entity_t *pEntity )
+{
+	vec3_t	mins, maxs;
+	float	radius;
+
+	if( !cl_tentcull ) return true;
+
+	radius = RadiusFromBounds( pEntity->model->mins, pEntity->model->maxs );
+	radius = max( radius, 16.0f ) * max( pEntity->curstate.scale, 1.0f );
+
+	VectorSet( mins, pEntity->origin[0] - radius, pEntity->origin[1] - radius, pEntity->origin[2] - radius );
+	VectorSet( maxs, pEntity->origin[0] + radius, pEntity->origin[1] + radius, pEntity->origin[2] + radius );
+
+	return Mod_BoxVisible( mins, maxs, cl_tentpvs );
+}
+
 /*
 ==============
 CL_TEntAddEntity
@@ -251,6 +302,14 @@ int CL_TEntAddEntity( cl_entity_t *pEntity )
 {
 	ASSERT( pEntity != NULL );
 
+	// culled tent is only not drawn, false would make
+	// TempEntUpdate kill it while it's out of sight
+	if( pEntity->model && !CL_TEntVisible( pEntity ))
+	{
+		r_stats.c_culled_tents_count++;
+		return true;
+	}
+
 	r_stats.c_active_tents_count++;
 
 	return CL_AddVisibleEntity( pEntity, ET_TEMPENTITY );
@@ -258,35 +317,73 @@ int CL_TEntAddEntity( cl_entity_t *pEntity )
 
 /*
 ==============
-CL_TEntAddEntity
+CL_TEntIsLowPriority
+
+ring entry still points to the same allocation
+==============
+*/
+static qboolean CL_TEntIsLowPriority( const tentref_t *ref )
+{
+	return cl_tentserial[ref->tent - cl_tempents] == ref->serial && ref->tent->priority == TENTPRIORITY_LOW;
+}
+
+/*
+==============
+CL_TEntMarkLowPriority
 
-free the first low priority tempent it finds.
+remember low priority tent for eviction
 ==============
 */
-qboolean CL_FreeLowPriorityTempEnt( void )
+static void CL_TEntMarkLowPriority( TEMPENTITY *pTemp )
 {
-	TEMPENTITY	*pActive = cl_active_tents;
-	TEMPENTITY	*pPrev = NULL;
+	int	i, size = GI->max_tents * 2;
+	tentref_t	*ref;
 
-	while( pActive )
+	if( cl_lowcount == size )
 	{
-		if( pActive->priority == TENTPRIORITY_LOW )
+		int	count = 0;
+
+		// drop freed and reallocated ones, at least
+		// half of ring is released because pool is half of it
+		for( i = 0; i < cl_lowcount; i++ )
 		{
-			// remove from the active list.
-			if( pPrev ) pPrev->next = pActive->next;
-			else cl_active_tents = pActive->next;
+			ref = &cl_lowtents[(cl_lowhead + i) % size];
+			if( CL_TEntIsLowPriority( ref ))
+				cl_lowtents[(cl_lowhead + count++) % size] = *ref;
+		}
+		cl_lowcount = count;
+	}
 
-			// add to the free list.
-			pActive->next = cl_free_tents;
-			cl_free_tents = pActive;
+	ref = &cl_lowtents[(cl_lowhead + cl_lowcount) % size];
+	ref->tent = pTemp;
+	ref->serial = cl_tentserial[pTemp - cl_tempents];
+	cl_lowcount++;
+}
 
-			return true;
-		}
+/*
+==============
+CL_EvictLowPriorityTempEnt
 
-		pPrev = pActive;
-		pActive = pActive->next;
+find the oldest low priority tempent, it stays in the active list
+==============
+*/
+static TEMPENTITY *CL_EvictLowPriorityTempEnt( void )
+{
+	int	size = GI->max_tents * 2;
+	tentref_t	*ref;
+
+	while( cl_lowcount > 0 )
+	{
+		ref = &cl_lowtents[cl_lowhead];
+		cl_lowhead = ( cl_lowhead + 1 ) % size;
+		cl_lowcount--;
+
+		// free list is empty, so tent can't be anywhere but in the active list
+		if( CL_TEntIsLowPriority( ref ))
+			return ref->tent;
 	}
-	return false;
+
+	return NULL;
 }
 
 
@@ -303,6 +400,15 @@ void CL_AddTempEnts( void )
 	double	ft = cl.time - cl.oldtime;
 	float	gravity = clgame.movevars.gravity;
 
+	// mirrors see what player's leaf doesn't
+	cl_tentcull = cl.worldmodel && !r_novis->integer && !CL_IsInMenu() && !( gl_allow_mirrors->integer && world.has_mirrors );
+
+	if( cl_tentcull )
+	{
+		mleaf_t	*leaf = Mod_PointInLeaf( cl.refdef.vieworg, cl.worldmodel->nodes );
+		Q_memcpy( cl_tentpvs, Mod_LeafPVS( leaf, cl.worldmodel ), ( cl.worldmodel->numleafs + 7 ) >> 3 );
+	}
+
 	clgame.dllFuncs.pfnTempEntUpdate( ft, cl.time, gravity, &cl_free_tents, &cl_active_tents, CL_TEntAddEntity, CL_TEntPlaySound );	// callbacks
 }
 
@@ -334,6 +440,8 @@ TEMPENTITY *GAME_EXPORT CL_TempEntAlloc( const vec3_t org, model_t *pmodel )
 	pTemp->next = cl_active_tents;
 	cl_active_tents = pTemp;
 
+	CL_TEntMarkLowPriority( pTemp );
+
 	return pTemp;
 }
 
@@ -346,21 +454,30 @@ alloc high priority tempentity
 */
 TEMPENTITY *GAME_EXPORT CL_TempEntAllocHigh( const vec3_t org, model_t *pmodel )
 {
-	TEMPENTITY	*pTemp;
+	TEMPENTITY	*pTemp, *pNext;
 
 	if( !cl_free_tents )
 	{
-		// no temporary ents free, so find the first active low-priority temp ent 
+		// no temporary ents free, so find the oldest active low-priority temp ent 
 		// and overwrite it.
-		CL_FreeLowPriorityTempEnt();
-	}
+		if(( pTemp = CL_EvictLowPriorityTempEnt( )) == NULL )
+		{
+			// didn't find anything? The tent list is either full of high-priority tents
+			// or all tents in the list are still due to live for > 10 seconds. 
+			MsgDev( D_INFO, "Couldn't alloc a high priority TENT!\n" );
+			return NULL;
+		}
 
-	if( !cl_free_tents )
-	{
-		// didn't find anything? The tent list is either full of high-priority tents
-		// or all tents in the list are still due to live for > 10 seconds. 
-		MsgDev( D_INFO, "Couldn't alloc a high priority TENT!\n" );
-		return NULL;
+		// reuse it in place, active list may be walked by client right now
+		pNext = pTemp->next;
+		CL_PrepareTEnt( pTemp, pmodel );
+		pTemp->next = pNext;
+
+		pTemp->priority = TENTPRIORITY_HIGH;
+		if( org ) VectorCopy( org, pTemp->entity.origin );
+		r_stats.c_evicted_tents_count++;
+
+		return pTemp;
 	}
 
 	// Move out of the free list and into the active list.
@@ -89,12 +89,17 @@ void GL_BackendEndFrame( void )
 		r_numStatics, r_numEntities - r_numStatics );
 		break;
 	case 5:
-		Q_snprintf( r_speeds_msg, sizeof( r_speeds_msg ), "%3i tempents\n%3i viewbeams\n%3i particles",
-		r_stats.c_active_tents_count, r_stats.c_view_beams_count, r_stats.c_particle_count );
+		Q_snprintf( r_speeds_msg, sizeof( r_speeds_msg ), "%3i tempents, %3i culled, %3i evicted\n%3i viewbeams\n%3i particles",
+		r_stats.c_active_tents_count, r_stats.c_culled_tents_count, r_stats.c_evicted_tents_count,
+		r_stats.c_view_beams_count, r_stats.c_particle_count );
 		break;
 	case 6:
 		Q_snprintf( r_speeds_msg, sizeof( r_speeds_msg ), "%3i mirrors\n", r_stats.c_mirror_passes );
 		break;
+	case 7:
+		Q_snprintf( r_speeds_msg, sizeof( r_speeds_msg ), "%3i lightmap surfaces rebuilt\n%3i lightmap uploads",
+		r_stats.c_lightmap_surfs, r_stats.c_lightmap_uploads );
+		break;
 	}
 
 	Q_memset( &r_stats, 0, sizeof( r_stats ));
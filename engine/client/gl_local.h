@@ -231,12 +231,17 @@ typedef struct
 
 	uint		c_view_beams_count;
 	uint		c_active_tents_count;
+	uint		c_culled_tents_count;	// outside of PVS
+	uint		c_evicted_tents_count;	// replaced by high priority ones
 	uint		c_studio_models_drawn;
 	uint		c_sprite_models_drawn;
 	uint		c_particle_count;
 
 	uint		c_mirror_passes;
 
+	uint		c_lightmap_surfs;	// surfaces rebuilt for changed lightstyles
+	uint		c_lightmap_uploads;
+
 	uint		c_client_ents;	// entities that moved to client
 } ref_speeds_t;
 
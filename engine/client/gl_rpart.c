@@ -35,6 +35,8 @@ PARTICLES MANAGEMENT
 #define SPARK_COLORCOUNT	9
 #define TRACER_WIDTH	0.5f
 #define SIMSHIFT		10
+#define PARTICLE_SIZE	1.5f
+#define PARTICLE_BATCH	1024	// quads per draw call, keeps indices in 16 bits
 
 // particle velocities
 static const float	cl_avertexnormals[NUMVERTEXNORMALS][3] =
@@ -93,10 +95,27 @@ convar_t		*traceralpha;
 convar_t		*tracerspeed;
 convar_t		*tracerlength;
 convar_t		*traceroffset;
+convar_t		*cl_maxparticles;
 
-particle_t	*cl_active_particles;
-particle_t	*cl_free_particles;
+// NOTE: particle_t is shared with client dlls which keep pointers
+// to it, so particles never move. Active particles are kept packed
+// in cl_active in allocation order, free ones are a stack
 particle_t	*cl_particles = NULL;	// particle pool
+static particle_t	**cl_active;
+static particle_t	**cl_free;
+static int	cl_numactive;
+static int	cl_numfree;
+static int	cl_poolsize;		// may differ from GI->max_particles
+
+// particles are drawn in batches
+static vec3_t	cl_partverts[PARTICLE_BATCH*4];
+static vec2_t	cl_partcoords[PARTICLE_BATCH*4];
+static byte	cl_partcolors[PARTICLE_BATCH*4][4];
+static word	cl_partelems[PARTICLE_BATCH*6];
+static int	cl_numpartquads;
+
+static short	cl_sparkcolors[SPARK_COLORCOUNT];	// gSparkRamp in palette
+static qboolean	cl_sparkcolors_valid;
 static vec3_t	cl_avelocities[NUMVERTEXNORMALS];
 #define		COL_SUM( pal, clr )	(pal - clr) * (pal - clr)
 
@@ -156,7 +175,24 @@ void CL_InitParticles( void )
 {
 	int	i;
 
-	cl_particles = Mem_Alloc( cls.mempool, sizeof( particle_t ) * GI->max_particles );
+	cl_maxparticles = Cvar_Get( "cl_maxparticles", "0", CVAR_ARCHIVE, "particles limit, 0 - use gameinfo value, applied at map change" );
+
+	// corners and indices never change
+	for( i = 0; i < PARTICLE_BATCH; i++ )
+	{
+		Vector2Set( cl_partcoords[i*4+0], 0.0f, 1.0f );
+		Vector2Set( cl_partcoords[i*4+1], 0.0f, 0.0f );
+		Vector2Set( cl_partcoords[i*4+2], 1.0f, 0.0f );
+		Vector2Set( cl_partcoords[i*4+3], 1.0f, 1.0f );
+
+		cl_partelems[i*6+0] = i * 4 + 0;
+		cl_partelems[i*6+1] = i * 4 + 1;
+		cl_partelems[i*6+2] = i * 4 + 2;
+		cl_partelems[i*6+3] = i * 4 + 0;
+		cl_partelems[i*6+4] = i * 4 + 2;
+		cl_partelems[i*6+5] = i * 4 + 3;
+	}
+
 	CL_ClearParticles ();
 
 	// this is used for EF_BRIGHTFIELD
@@ -184,17 +220,33 @@ CL_ClearParticles
 */
 void CL_ClearParticles( void )
 {
-	int	i;
+	int	i, size;
+
+	size = GI->max_particles;
+	if( cl_maxparticles && cl_maxparticles->integer > 0 )
+		size = bound( 1024, cl_maxparticles->integer, 131072 );
+
+	// nothing is alive now, so pool can be resized
+	if( size != cl_poolsize )
+	{
+		CL_FreeParticles();
 
-	if( !cl_particles ) return;
+		cl_particles = Mem_Alloc( cls.mempool, sizeof( particle_t ) * size );
+		cl_active = Mem_Alloc( cls.mempool, sizeof( particle_t* ) * size );
+		cl_free = Mem_Alloc( cls.mempool, sizeof( particle_t* ) * size );
+		cl_poolsize = size;
+	}
 
-	cl_free_particles = cl_particles;
-	cl_active_particles = NULL;
+	// lowest addresses are allocated first
+	for( i = 0; i < cl_poolsize; i++ )
+		cl_free[i] = &cl_particles[cl_poolsize - 1 - i];
 
-	for( i = 0; i < GI->max_particles - 1; i++ )
-		cl_particles[i].next = &cl_particles[i+1];
+	cl_numfree = cl_poolsize;
+	cl_numactive = 0;
+	cl_numpartquads = 0;
 
-	cl_particles[GI->max_particles-1].next = NULL;
+	// palette may be changed with a new game
+	cl_sparkcolors_valid = false;
 }
 
 /*
@@ -207,7 +259,15 @@ void CL_FreeParticles( void )
 {
 	if( cl_particles )
 		Mem_Free( cl_particles );
+	if( cl_active )
+		Mem_Free( cl_active );
+	if( cl_free )
+		Mem_Free( cl_free );
+
 	cl_particles = NULL;
+	cl_active = cl_free = NULL;
+	cl_numactive = cl_numfree = 0;
+	cl_poolsize = 0;
 }
 
 /*
@@ -225,8 +285,27 @@ void CL_FreeParticle( particle_t *p )
 		p->deathfunc( p );
 	}
 
-	p->next = cl_free_particles;
-	cl_free_particles = p;
+	cl_free[cl_numfree++] = p;
+}
+
+/*
+================
+CL_ActivateParticle
+
+take particle from freelist
+================
+*/
+static particle_t *CL_ActivateParticle( void )
+{
+	particle_t	*p;
+
+	if( !cl_numfree )
+		return NULL;
+
+	p = cl_free[--cl_numfree];
+	cl_active[cl_numactive++] = p;
+
+	return p;
 }
 
 /*
@@ -246,17 +325,12 @@ particle_t *GAME_EXPORT CL_AllocParticle( void (*callback)( particle_t*, float )
 	// never alloc particles when we not in game
 	if( !CL_IsInGame( )) return NULL;
 
-	if( !cl_free_particles )
+	if(( p = CL_ActivateParticle( )) == NULL )
 	{
-		MsgDev( D_NOTE, "Overflow %d particles\n", GI->max_particles );
+		MsgDev( D_NOTE, "Overflow %d particles\n", cl_poolsize );
 		return NULL;
 	}
 
-	p = cl_free_particles;
-	cl_free_particles = p->next;
-	p->next = cl_active_particles;
-	cl_active_particles = p;
-
 	// clear old particle
 	p->type = pt_static;
 	VectorClear( p->vel );
@@ -388,6 +462,87 @@ static void CL_BulletTracerDraw( particle_t *p, float frametime )
 	pglEnd();
 }
 
+/*
+================
+CL_FlushParticles
+
+draw batched particle quads
+================
+*/
+static void CL_FlushParticles( void )
+{
+	if( !cl_numpartquads )
+		return;
+
+	GL_SetRenderMode( kRenderTransTexture );
+
+	if( r_oldparticles->integer == 1 )
+		GL_Bind( XASH_TEXTURE0, cls.oldParticleImage );
+	else
+		GL_Bind( XASH_TEXTURE0, cls.particleImage );
+
+	pglEnableClientState( GL_VERTEX_ARRAY );
+	pglVertexPointer( 3, GL_FLOAT, 0, cl_partverts );
+
+	pglEnableClientState( GL_TEXTURE_COORD_ARRAY );
+	pglTexCoordPointer( 2, GL_FLOAT, 0, cl_partcoords );
+
+	pglEnableClientState( GL_COLOR_ARRAY );
+	pglColorPointer( 4, GL_UNSIGNED_BYTE, 0, cl_partcolors );
+
+#if !defined XASH_NANOGL || defined XASH_WES && defined __EMSCRIPTEN__ // WebGL need to know array sizes
+	if( pglDrawRangeElements )
+		pglDrawRangeElements( GL_TRIANGLES, 0, cl_numpartquads * 4 - 1, cl_numpartquads * 6, GL_UNSIGNED_SHORT, cl_partelems );
+	else
+#endif
+		pglDrawElements( GL_TRIANGLES, cl_numpartquads * 6, GL_UNSIGNED_SHORT, cl_partelems );
+
+	pglDisableClientState( GL_VERTEX_ARRAY );
+	pglDisableClientState( GL_TEXTURE_COORD_ARRAY );
+	pglDisableClientState( GL_COLOR_ARRAY );
+	pglColor4ub( 255, 255, 255, 255 );
+
+	cl_numpartquads = 0;
+}
+
+/*
+================
+CL_AddParticleQuad
+
+add the 4 corner vertices into the batch
+================
+*/
+static void CL_AddParticleQuad( particle_t *p, int alpha )
+{
+	float	*v = cl_partverts[cl_numpartquads * 4];
+	byte	*c = cl_partcolors[cl_numpartquads * 4];
+	vec3_t	right, up;
+	int	i;
+
+	// scale the axes by radius
+	VectorScale( RI.vright, PARTICLE_SIZE, right );
+	VectorScale( RI.vup, PARTICLE_SIZE, up );
+
+	for( i = 0; i < 3; i++ )
+	{
+		v[0+i] = p->org[i] - right[i] + up[i];
+		v[3+i] = p->org[i] + right[i] + up[i];
+		v[6+i] = p->org[i] + right[i] - up[i];
+		v[9+i] = p->org[i] - right[i] - up[i];
+	}
+
+	for( i = 0; i < 4; i++, c += 4 )
+	{
+		c[0] = clgame.palette[p->color][0];
+		c[1] = clgame.palette[p->color][1];
+		c[2] = clgame.palette[p->color][2];
+		c[3] = alpha;
+	}
+
+	if( ++cl_numpartquads == PARTICLE_BATCH )
+		CL_FlushParticles();
+}
+
 /*
 ================
 CL_UpdateParticle
@@ -402,10 +557,7 @@ void CL_UpdateParticle( particle_t *p, float ft )
 	float	time1 = 5.0 * ft;
 	float	dvel = 4 * ft;
 	float	grav = ft * clgame.movevars.gravity * 0.05f;
-	float	size = 1.5f;
 	int	i, iRamp, alpha = 255;
-	vec3_t	right, up;
-	rgb_t	color;
 
 	r_stats.c_particle_count++;
 
@@ -455,7 +607,14 @@ void CL_UpdateParticle( particle_t *p, float ft )
 			iRamp = 0;
 		}
 		
-		p->color = CL_LookupColor( gSparkRamp[iRamp][0], gSparkRamp[iRamp][1], gSparkRamp[iRamp][2] );
+		if( !cl_sparkcolors_valid )
+		{
+			for( i = 0; i < SPARK_COLORCOUNT; i++ )
+				cl_sparkcolors[i] = CL_LookupColor( gSparkRamp[i][0], gSparkRamp[i][1], gSparkRamp[i][2] );
+			cl_sparkcolors_valid = true;
+		}
+
+		p->color = cl_sparkcolors[iRamp];
 
 		for( i = 0; i < 2; i++ )		
 			p->vel[i] -= p->vel[i] * 0.5f * ft;
@@ -486,43 +645,10 @@ void CL_UpdateParticle( particle_t *p, float ft )
 		break;
 	}
 
-#if 0
-	// HACKHACK a scale up to keep particles from disappearing
-	size += (p->org[0] - RI.vieworg[0]) * RI.vforward[0];
-	size += (p->org[1] - RI.vieworg[1]) * RI.vforward[1];
-	size += (p->org[2] - RI.vieworg[2]) * RI.vforward[2];
-
-	if( size < 20.0f ) size = 1.0f;
-	else size = 1.0f + size * 0.004f;
-#endif
- 	// scale the axes by radius
-	VectorScale( RI.vright, size, right );
-	VectorScale( RI.vup, size, up );
-
 	p->color = bound( 0, p->color, 255 );
-	VectorSet( color, clgame.palette[p->color][0], clgame.palette[p->color][1], clgame.palette[p->color][2] );
-
-	GL_SetRenderMode( kRenderTransTexture );
-	pglColor4ub( color[0], color[1], color[2], alpha );
 
-	if( r_oldparticles->integer == 1 )
-		GL_Bind( XASH_TEXTURE0, cls.oldParticleImage );
-	else
-		GL_Bind( XASH_TEXTURE0, cls.particleImage );
-
-	// add the 4 corner vertices.
-	pglBegin( GL_QUADS );
-
-	pglTexCoord2f( 0.0f, 1.0f );
-	pglVertex3f( p->org[0] - right[0] + up[0], p->org[1] - right[1] + up[1], p->org[2] - right[2] + up[2] );
-	pglTexCoord2f( 0.0f, 0.0f );
-	pglVertex3f( p->org[0] + right[0] + up[0], p->org[1] + right[1] + up[1], p->org[2] + right[2] + up[2] );
-	pglTexCoord2f( 1.0f, 0.0f );
-	pglVertex3f( p->org[0] + right[0] - up[0], p->org[1] + right[1] - up[1], p->org[2] + right[2] - up[2] );
-	pglTexCoord2f( 1.0f, 1.0f );
-	pglVertex3f( p->org[0] - right[0] - up[0], p->org[1] - right[1] - up[1], p->org[2] - right[2] - up[2] );
-
-	pglEnd();
+	// fully transparent blobs don't need to be drawn
+	if( alpha ) CL_AddParticleQuad( p, alpha );
 
 	if( p->type != pt_clientcustom )
 	{
@@ -533,9 +659,10 @@ void CL_UpdateParticle( particle_t *p, float ft )
 
 void CL_DrawParticles( void )
 {
-	particle_t	*p, *kill;
+	particle_t	*p;
 	float		frametime;
 	static int	framecount = -1;
+	int		i, j, count;
 
 	if( !cl_draw_particles->integer )
 		return;
@@ -557,35 +684,23 @@ void CL_DrawParticles( void )
 		tracerred->modified = tracergreen->modified = tracerblue->modified = false;
 	}
 
-	while( 1 ) 
+	// free time-expired particles and pack the rest,
+	// deathfunc may add new ones at the end, they are kept too
+	for( i = j = 0; i < cl_numactive; i++ )
 	{
-		// free time-expired particles
-		kill = cl_active_particles;
-		if( kill && kill->die < cl.time )
-		{
-			cl_active_particles = kill->next;
-			CL_FreeParticle( kill );
-			continue;
-		}
-		break;
+		p = cl_active[i];
+
+		if( p->die < cl.time )
+			CL_FreeParticle( p );
+		else cl_active[j++] = p;
 	}
+	cl_numactive = j;
 
-	for( p = cl_active_particles; p; p = p->next )
-	{
-		while( 1 )
-		{
-			kill = p->next;
-			if( kill && kill->die < cl.time )
-			{
-				p->next = kill->next;
-				CL_FreeParticle( kill );
-				continue;
-			}
-			break;
-		}
+	// particles spawned by callbacks start next frame
+	for( i = 0, count = cl_numactive; i < count; i++ )
+		CL_UpdateParticle( cl_active[i], frametime );
 
-		CL_UpdateParticle( p, frametime );
-	}
+	CL_FlushParticles();
 }
 
 void CL_DrawParticlesExternal( const float *vieworg, const float *forward, const float *right, const float *up, uint clipFlags )
@@ -1761,18 +1876,13 @@ void CL_ReadPointFile_f( void )
 
 		count++;
 		
-		if( !cl_free_particles )
+		// NOTE: can't use CL_AllocateParticles because running from the console
+		if(( p = CL_ActivateParticle( )) == NULL )
 		{
 			MsgDev( D_ERROR, "CL_ReadPointFile: not enough free particles!\n" );
 			break;
 		}
 
-		// NOTE: can't use CL_AllocateParticles because running from the console
-		p = cl_free_particles;
-		cl_free_particles = p->next;
-		p->next = cl_active_particles;
-		cl_active_particles = p;
-
 		p->ramp = 0;		
 		p->die = 99999;
 		p->color = (-count) & 15;
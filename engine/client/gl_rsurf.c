@@ -20,7 +20,21 @@ GNU General Public License for more details.
 #include "gl_local.h"
 #include "mod_local.h"
 #include "mathlib.h"
-			
+
+#if defined __SSE2__ || defined _M_X64 || ( defined _M_IX86_FP && _M_IX86_FP >= 2 )
+#define XASH_LM_SSE2
+#include <emmintrin.h>
+#elif defined __ARM_NEON || defined __ARM_NEON__
+#define XASH_LM_NEON
+#include <arm_neon.h>
+#endif
+
+typedef struct
+{
+	int		x0, y0;
+	int		x1, y1;		// empty if x1 <= x0
+} lmrect_t;
+
 typedef struct
 {
 	int		allocated[BLOCK_SIZE_MAX];
@@ -29,13 +43,18 @@ typedef struct
 	msurface_t	*lightmap_surfaces[MAX_LIGHTMAPS];
 	byte		lightmap_buffer[BLOCK_SIZE_MAX*BLOCK_SIZE_MAX*4];
 	byte		deluxemap_buffer[BLOCK_SIZE_MAX*BLOCK_SIZE_MAX*4];
+
+	// system copies of lightmaps with animated styles, updated in place
+	byte		*pages[MAX_LIGHTMAPS];
+	lmrect_t		dirty[MAX_LIGHTMAPS];	// changed since last upload
+	qboolean		animated;			// current block has surfaces with lightstyles
 } gllightmapstate_t;
 
 static int		nColinElim; // stats
 static vec2_t		world_orthocenter;
 static vec2_t		world_orthohalf;
 static byte		visbytes[MAX_MAP_LEAFS/8];
-static uint		r_blocklights[BLOCK_SIZE_MAX*BLOCK_SIZE_MAX*3];
+static uint		r_blocklights[BLOCK_SIZE_MAX*BLOCK_SIZE_MAX*4];	// rgb and unused lane
 static int		r_blockdeluxe[BLOCK_SIZE_MAX*BLOCK_SIZE_MAX*3];
 static glpoly_t		*fullbright_polys[MAX_TEXTURES];
 static qboolean		draw_fullbrights = false;
@@ -484,6 +503,114 @@ texture_t *R_TextureAnimation( texture_t *base, int surfacenum )
 	return R_TextureAnim( base );
 }
 
+/*
+=============================================================================
+
+  BLOCKLIGHTS
+
+  every sample takes four lanes in r_blocklights
+  so simd paths can process it as one vector
+
+=============================================================================
+*/
+/*
+===============
+R_AddBlockSample
+
+add lightmap sample scaled by lightstyle
+===============
+*/
+_inline void R_AddBlockSample( uint *bl, const color24 *lm, uint scale )
+{
+#if defined XASH_LM_SSE2
+	__m128i	c = _mm_setr_epi32( TextureToTexGamma( lm->r ), TextureToTexGamma( lm->g ), TextureToTexGamma( lm->b ), 0 );
+	__m128	v;
+
+	// exact in floats: 255 * (256 * 256) < 2^24
+	v = _mm_mul_ps( _mm_cvtepi32_ps( c ), _mm_set1_ps( (float)scale ));
+	_mm_storeu_si128( (__m128i *)bl, _mm_add_epi32( _mm_loadu_si128( (__m128i *)bl ), _mm_cvttps_epi32( v )));
+#elif defined XASH_LM_NEON
+	uint32_t	c[4] = { TextureToTexGamma( lm->r ), TextureToTexGamma( lm->g ), TextureToTexGamma( lm->b ), 0 };
+
+	vst1q_u32( bl, vmlaq_n_u32( vld1q_u32( bl ), vld1q_u32( c ), scale ));
+#else
+	bl[0] += TextureToTexGamma( lm->r ) * scale;
+	bl[1] += TextureToTexGamma( lm->g ) * scale;
+	bl[2] += TextureToTexGamma( lm->b ) * scale;
+#endif
+}
+
+/*
+===============
+R_AddBlockLight
+
+add dynamic light color with given intensity,
+sum is taken in floats and truncated like scalar code does
+===============
+*/
+_inline void R_AddBlockLight( uint *bl, float scale, const float *color )
+{
+#if defined XASH_LM_SSE2
+	__m128	v = _mm_mul_ps( _mm_loadu_ps( color ), _mm_set1_ps( scale ));
+
+	v = _mm_add_ps( _mm_cvtepi32_ps( _mm_loadu_si128( (__m128i *)bl )), v );
+	_mm_storeu_si128( (__m128i *)bl, _mm_cvttps_epi32( v ));
+#elif defined XASH_LM_NEON
+	float32x4_t	v = vmulq_n_f32( vld1q_f32( color ), scale );
+
+	v = vaddq_f32( vcvtq_f32_u32( vld1q_u32( bl )), v );
+	vst1q_u32( bl, vcvtq_u32_f32( v ));
+#else
+	bl[0] += color[0] * scale;
+	bl[1] += color[1] * scale;
+	bl[2] += color[2] * scale;
+#endif
+}
+
+/*
+===============
+R_PackBlockLights
+
+put row of samples into texture format
+===============
+*/
+static void R_PackBlockLights( byte *dest, const uint *bl, int count )
+{
+	int	i = 0;
+#if defined XASH_LM_SSE2
+	const __m128i	alpha = _mm_set1_epi32( (int)0xFF000000 );
+
+	// shifted values are positive, so signed pack saturates as min( x, 255 )
+	for( ; i + 4 <= count; i += 4, bl += 16, dest += 16 )
+	{
+		__m128i	a = _mm_srli_epi32( _mm_loadu_si128( (const __m128i *)bl + 0 ), 7 );
+		__m128i	b = _mm_srli_epi32( _mm_loadu_si128( (const __m128i *)bl + 1 ), 7 );
+		__m128i	c = _mm_srli_epi32( _mm_loadu_si128( (const __m128i *)bl + 2 ), 7 );
+		__m128i	d = _mm_srli_epi32( _mm_loadu_si128( (const __m128i *)bl + 3 ), 7 );
+
+		a = _mm_packus_epi16( _mm_packs_epi32( a, b ), _mm_packs_epi32( c, d ));
+		_mm_storeu_si128( (__m128i *)dest, _mm_or_si128( a, alpha ));
+	}
+#elif defined XASH_LM_NEON
+	const uint8x16_t	alpha = vreinterpretq_u8_u32( vdupq_n_u32( 0xFF000000 ));
+
+	for( ; i + 4 <= count; i += 4, bl += 16, dest += 16 )
+	{
+		uint16x8_t	a = vcombine_u16( vqshrn_n_u32( vld1q_u32( bl + 0 ), 7 ), vqshrn_n_u32( vld1q_u32( bl + 4 ), 7 ));
+		uint16x8_t	b = vcombine_u16( vqshrn_n_u32( vld1q_u32( bl + 8 ), 7 ), vqshrn_n_u32( vld1q_u32( bl + 12 ), 7 ));
+
+		vst1q_u8( dest, vorrq_u8( vcombine_u8( vqmovn_u16( a ), vqmovn_u16( b )), alpha ));
+	}
+#endif
+	for( ; i < count; i++, bl += 4, dest += 4 )
+	{
+		dest[0] = min((bl[0] >> 7), 255 );
+		dest[1] = min((bl[1] >> 7), 255 );
+		dest[2] = min((bl[2] >> 7), 255 );
+		dest[3] = 255;
+	}
+}
+
 /*
 ===============
 R_AddDynamicLights
@@ -494,6 +621,7 @@ void R_AddDynamicLights( msurface_t *surf )
 	float		dist, rad, minlight;
 	int		lnum, s, t, sd, td, smax, tmax;
 	float		sl, tl, sacc, tacc;
+	float		color[4];
 	vec3_t		impact, origin_l;
 	mtexinfo_t	*tex;
 	dlight_t		*dl;
@@ -539,13 +667,18 @@ void R_AddDynamicLights( msurface_t *surf )
 		sl = DotProduct( impact, tex->vecs[0] ) + tex->vecs[0][3] - surf->texturemins[0];
 		tl = DotProduct( impact, tex->vecs[1] ) + tex->vecs[1][3] - surf->texturemins[1];
 
+		color[0] = TextureToTexGamma( dl->color.r );
+		color[1] = TextureToTexGamma( dl->color.g );
+		color[2] = TextureToTexGamma( dl->color.b );
+		color[3] = 0.0f;
+
 		bl = r_blocklights;
 		for( t = 0, tacc = 0; t < tmax; t++, tacc += LM_SAMPLE_SIZE )
 		{
 			td = tl - tacc;
 			if( td < 0 ) td = -td;
 
-			for( s = 0, sacc = 0; s < smax; s++, sacc += LM_SAMPLE_SIZE, bl += 3 )
+			for( s = 0, sacc = 0; s < smax; s++, sacc += LM_SAMPLE_SIZE, bl += 4 )
 			{
 				sd = sl - sacc;
 				if( sd < 0 ) sd = -sd;
@@ -554,11 +687,7 @@ void R_AddDynamicLights( msurface_t *surf )
 				else dist = td + (sd >> 1);
 
 				if( dist < minlight )
-				{
-					bl[0] += ( rad - dist ) * TextureToTexGamma( dl->color.r );
-					bl[1] += ( rad - dist ) * TextureToTexGamma( dl->color.g );
-					bl[2] += ( rad - dist ) * TextureToTexGamma( dl->color.b );
-				}
+					R_AddBlockLight( bl, rad - dist, color );
 			}
 		}
 	}
@@ -692,11 +821,98 @@ static void LM_UploadBlock( qboolean dynamic )
 			tr.deluxemapTextures[i] = GL_LoadTextureInternal( lmName, &r_deluxemap, TF_FONT, false );
 		}
 
+		// keep system copy to update animated lightstyles in place
+		if( gl_lms.animated && !tr.deluxemap )
+		{
+			gl_lms.pages[i] = Mem_Alloc( r_temppool, BLOCK_SIZE * BLOCK_SIZE * 4 );
+			Q_memcpy( gl_lms.pages[i], gl_lms.lightmap_buffer, BLOCK_SIZE * BLOCK_SIZE * 4 );
+		}
+		gl_lms.animated = false;
+
 		if( ++gl_lms.current_lightmap_texture == MAX_LIGHTMAPS )
 			Host_Error( "AllocBlock: full\n" );
 	}
 }
 
+static void LM_FreePages( void )
+{
+	int	i;
+
+	for( i = 0; i < MAX_LIGHTMAPS; i++ )
+	{
+		if( gl_lms.pages[i] )
+			Mem_Free( gl_lms.pages[i] );
+	}
+
+	Q_memset( gl_lms.pages, 0, sizeof( gl_lms.pages ));
+	Q_memset( gl_lms.dirty, 0, sizeof( gl_lms.dirty ));
+	gl_lms.animated = false;
+}
+
+static void LM_MarkDirty( int lightmap, int x, int y, int w, int h )
+{
+	lmrect_t	*rect = &gl_lms.dirty[lightmap];
+
+	if( rect->x1 <= rect->x0 )
+	{
+		rect->x0 = x;
+		rect->y0 = y;
+		rect->x1 = x + w;
+		rect->y1 = y + h;
+	}
+	else
+	{
+		rect->x0 = min( rect->x0, x );
+		rect->y0 = min( rect->y0, y );
+		rect->x1 = max( rect->x1, x + w );
+		rect->y1 = max( rect->y1, y + h );
+	}
+}
+
+/*
+=================
+LM_UploadDirtyPages
+
+one upload per changed lightmap instead of one per surface
+=================
+*/
+static void LM_UploadDirtyPages( void )
+{
+	lmrect_t	*rect;
+	int	i, y, w, h;
+	byte	*data;
+
+	for( i = 0; i < gl_lms.current_lightmap_texture; i++ )
+	{
+		rect = &gl_lms.dirty[i];
+
+		if( rect->x1 <= rect->x0 )
+			continue;
+
+		w = rect->x1 - rect->x0;
+		h = rect->y1 - rect->y0;
+		data = gl_lms.pages[i] + ( rect->y0 * BLOCK_SIZE + rect->x0 ) * 4;
+
+		if( w != BLOCK_SIZE )
+		{
+			// GLES have no GL_UNPACK_ROW_LENGTH, gather rows
+			// NOTE: dynamic block is always rebuilt after this
+			for( y = 0; y < h; y++ )
+				Q_memcpy( gl_lms.lightmap_buffer + y * w * 4, data + y * BLOCK_SIZE * 4, w * 4 );
+			data = gl_lms.lightmap_buffer;
+		}
+
+		GL_Bind( XASH_TEXTURE0, tr.lightmapTextures[i] );
+#ifdef XASH_WES
+		pglTexParameteri( GL_TEXTURE_2D, GL_GENERATE_MIPMAP_SGIS, GL_TRUE );
+#endif
+		pglTexSubImage2D( GL_TEXTURE_2D, 0, rect->x0, rect->y0, w, h, GL_RGBA, GL_UNSIGNED_BYTE, data );
+
+		rect->x0 = rect->y0 = rect->x1 = rect->y1 = 0;
+		r_stats.c_lightmap_uploads++;
+	}
+}
+
 /*
 =================
 R_BuildLightmap
@@ -709,7 +925,7 @@ static void R_BuildLightMap( msurface_t *surf, byte *dest, int stride, qboolean
 {
 	int	smax, tmax;
 	uint	*bl, scale;
-	int	i, map, size, s, t;
+	int	i, map, size, t;
 	color24	*lm;
 
 	smax = ( surf->extents[0] / LM_SAMPLE_SIZE ) + 1;
@@ -718,19 +934,15 @@ static void R_BuildLightMap( msurface_t *surf, byte *dest, int stride, qboolean
 
 	lm = surf->samples;
 
-	Q_memset( r_blocklights, 0, sizeof( uint ) * size * 3 );
+	Q_memset( r_blocklights, 0, sizeof( uint ) * size * 4 );
 
 	// add all the lightmaps
 	for( map = 0; map < MAXLIGHTMAPS && surf->styles[map] != 255 && lm; map++ )
 	{
 		scale = RI.lightstylevalue[surf->styles[map]];
 
-		for( i = 0, bl = r_blocklights; i < size; i++, bl += 3, lm++ )
-		{
-			bl[0] += TextureToTexGamma( lm->r ) * scale;
-			bl[1] += TextureToTexGamma( lm->g ) * scale;
-			bl[2] += TextureToTexGamma( lm->b ) * scale;
-		}
+		for( i = 0, bl = r_blocklights; i < size; i++, bl += 4, lm++ )
+			R_AddBlockSample( bl, lm, scale );
 	}
 
 	// add all the dynamic lights
@@ -738,22 +950,38 @@ static void R_BuildLightMap( msurface_t *surf, byte *dest, int stride, qboolean
 		R_AddDynamicLights( surf );
 
 	// Put into texture format
-	stride -= (smax << 2);
-	bl = r_blocklights;
+	for( t = 0, bl = r_blocklights; t < tmax; t++, bl += smax * 4, dest += stride )
+		R_PackBlockLights( dest, bl, smax );
+}
 
-	for( t = 0; t < tmax; t++, dest += stride )
-	{
-		for( s = 0; s < smax; s++ )
-		{
-			dest[0] = min((bl[0] >> 7), 255 );
-			dest[1] = min((bl[1] >> 7), 255 );
-			dest[2] = min((bl[2] >> 7), 255 );
-			dest[3] = 255;
+/*
+=================
+R_UpdateLightmapPage
 
-			bl += 3;
-			dest += 4;
-		}
-	}
+lightstyles of the surface were changed, rebuild it
+in the system copy and upload later with its neighbours
+=================
+*/
+static qboolean R_UpdateLightmapPage( msurface_t *fa )
+{
+	byte	*base = gl_lms.pages[fa->lightmaptexturenum];
+	int	smax, tmax;
+
+	// dlighted surfaces are going to dynamic block anyway
+	if( !base || fa->dlightframe == tr.framecount )
+		return false;
+
+	smax = ( fa->extents[0] / LM_SAMPLE_SIZE ) + 1;
+	tmax = ( fa->extents[1] / LM_SAMPLE_SIZE ) + 1;
+
+	base += ( fa->light_t * BLOCK_SIZE + fa->light_s ) * 4;
+	R_BuildLightMap( fa, base, BLOCK_SIZE * 4, false );
+	R_SetCacheState( fa );
+
+	LM_MarkDirty( fa->lightmaptexturenum, fa->light_s, fa->light_t, smax, tmax );
+	r_stats.c_lightmap_surfs++;
+
+	return true;
 }
 
 static void R_BuildDeluxeMap( msurface_t *surf, byte *dest, int stride )
@@ -949,6 +1177,8 @@ void R_BlendLightmaps( void )
 			return;	// disabled by user
 	}
 
+	LM_UploadDirtyPages();
+
 	if( !r_lightmap->integer )
 	{
 		pglEnable( GL_BLEND );
@@ -1320,7 +1550,12 @@ dynamic:
 
 	if( is_dynamic )
 	{
-		if(( fa->styles[maps] >= 32 || fa->styles[maps] == 0 ) && ( fa->dlightframe != tr.framecount ))
+		if( R_UpdateLightmapPage( fa ))
+		{
+			fa->lightmapchain = gl_lms.lightmap_surfaces[fa->lightmaptexturenum];
+			gl_lms.lightmap_surfaces[fa->lightmaptexturenum] = fa;
+		}
+		else if(( fa->styles[maps] >= 32 || fa->styles[maps] == 0 ) && ( fa->dlightframe != tr.framecount ))
 		{
 			byte	temp[132*132*4];
 			int	smax, tmax;
@@ -2905,6 +3140,9 @@ void R_DrawVBO( qboolean drawlightmap, qboolean drawtextures )
 	if( !r_vbo->integer )
 		return;
 
+	if( drawlightmap )
+		LM_UploadDirtyPages();
+
 	// bind array
 	pglBindBufferARB( GL_ARRAY_BUFFER_ARB, vbo->glindex );
 	pglEnableClientState( GL_VERTEX_ARRAY );
@@ -3217,6 +3455,10 @@ static qboolean R_CheckLightMap( msurface_t *fa )
 	if( !is_dynamic && ( fa->dlightframe != tr.framecount || maps == MAX_LIGHTMAPS ) )
 		return false;
 
+	// any lightstyle, uploaded at R_DrawVBO
+	if( R_UpdateLightmapPage( fa ))
+		return false;
+
 	// build lightmap
 	if(( fa->styles[maps] >= 32 || fa->styles[maps] == 0 ) && ( fa->dlightframe != tr.framecount ))
 	{
@@ -3727,9 +3969,7 @@ void R_MarkLeaves( void )
 
 		Q_memcpy( visbytes, vis, longs << 2 );
 		vis = Mod_LeafPVS( r_viewleaf2, cl.worldmodel );
-
-		for( i = 0; i < longs; i++ )
-			((int *)visbytes)[i] |= ((int *)vis)[i];
+		Mod_OrVis( visbytes, vis, longs << 2 );
 
 		vis = visbytes;
 	}
@@ -3757,7 +3997,7 @@ GL_CreateSurfaceLightmap
 */
 void GL_CreateSurfaceLightmap( msurface_t *surf )
 {
-	int	smax, tmax;
+	int	smax, tmax, map;
 	byte	*base;
 
 	if( !cl.worldmodel->lightdata ) return;
@@ -3778,6 +4018,12 @@ void GL_CreateSurfaceLightmap( msurface_t *surf )
 
 	surf->lightmaptexturenum = gl_lms.current_lightmap_texture;
 
+	for( map = 0; map < MAXLIGHTMAPS && surf->styles[map] != 255; map++ )
+	{
+		if( surf->styles[map] != 0 )
+			gl_lms.animated = true;
+	}
+
 	if( tr.deluxemap )
 	{
 		base = gl_lms.deluxemap_buffer;
@@ -3881,6 +4127,7 @@ void GL_RebuildLightmaps( void )
 	Q_memset( tr.lightmapTextures, 0, sizeof( tr.lightmapTextures ));
 	Q_memset( tr.deluxemapTextures, 0, sizeof( tr.deluxemapTextures ));
 	gl_lms.current_lightmap_texture = 0;
+	LM_FreePages();
 
 	// setup all the lightstyles
 	R_AnimateLight();
@@ -3953,6 +4200,7 @@ void GL_BuildLightmaps( void )
 
 	tr.framecount = tr.visframecount = 1;	// no dlight cache
 	gl_lms.current_lightmap_texture = 0;
+	LM_FreePages();
 	tr.num_mirror_entities = 0;
 	tr.num_mirrors_used = 0;
 	nColinElim = 0;
@@ -116,6 +116,9 @@ enum
 
 #define MAX_ROOM_TYPES ARRAYSIZE(rgsxpre)
 
+#define DSP_BLOCK_SIZE	256	// max samples per block pass
+#define DSP_BENCH_PASSES	256
+
 
 // cvars
 convar_t *dsp_off;        // disable dsp
@@ -154,8 +157,10 @@ static int speed;  // dma sample speed (private to dsp)
 static portable_samplepair_t *paintto = NULL;
 static dly_t rgsxdly[MAXDLY]; // stereo is last
 static int   rgsxlp[10];
+static qboolean sxblocks = true; // process delay lines by blocks, per-sample path is a reference
 
 void SX_Profiling_f( void );
+void SX_Benchmark_f( void );
 
 /*
 ============
@@ -219,6 +224,7 @@ void SX_Init( void )
 
 
 	Cmd_AddCommand( "dsp_profile", SX_Profiling_f, "dsp stress-test, first argument is room_type" );
+	Cmd_AddCommand( "dsp_bench", SX_Benchmark_f, "measure all room presets, block path against per-sample reference" );
 
 	// for compatibility
 	dsp_room         = room_type;
@@ -255,6 +261,7 @@ void SX_Free( )
 		DLY_Free( i );
 
 	Cmd_RemoveCommand( "dsp_profile" );
+	Cmd_RemoveCommand( "dsp_bench" );
 }
 
 
@@ -316,6 +323,160 @@ _inline void DLY_MovePointer(dly_t *dly)
 		dly->idelayoutput = 0;
 }
 
+/*
+============
+DLY_BlockSize
+
+How many samples can be processed at once:
+both pointers must not wrap, and block must not read
+anything it has written itself
+============
+*/
+static int DLY_BlockSize( const dly_t *dly, int count )
+{
+	int dist = (int)dly->idelayinput - (int)dly->idelayoutput;
+
+	if( dist <= 0 )
+		dist += dly->cdelaysamplesmax;
+
+	count = min( count, dist );
+	count = min( count, dly->cdelaysamplesmax - (int)dly->idelayinput );
+	count = min( count, dly->cdelaysamplesmax - (int)dly->idelayoutput );
+
+	return min( count, DSP_BLOCK_SIZE );
+}
+
+/*
+============
+DLY_MoveBlock
+
+Same as DLY_MovePointer, but for a block
+============
+*/
+static void DLY_MoveBlock( dly_t *dly, int count )
+{
+	if(( dly->idelayinput += count ) >= dly->cdelaysamplesmax )
+		dly->idelayinput -= dly->cdelaysamplesmax;
+
+	if(( dly->idelayoutput += count ) >= dly->cdelaysamplesmax )
+		dly->idelayoutput -= dly->cdelaysamplesmax;
+
+	// modulation counter is restarted from mod every mod + 1 samples
+	if(( dly->modcur -= count ) < 0 )
+		dly->modcur = dly->mod - (( -dly->modcur - 1 ) % ( dly->mod + 1 ));
+}
+
+/*
+============
+DLY_DelayBlock
+
+Mono delay for a block of samples, scalar reference for SIMD kernels.
+When delay line and input are silent, lowpass is reset, so
+history holds zeroes anyway and only output needs to be masked
+============
+*/
+void DLY_DelayBlock( portable_samplepair_t *paint, const int *rd, int *wr, int count, int feedback, int lp, int *plp0, int *plp1 )
+{
+	int lp0 = *plp0, lp1 = *plp1;
+	int i, val, newval;
+
+	for( i = 0; i < count; i++, paint++ )
+	{
+		if( rd[i] || paint->left || paint->right )
+		{
+			val = (( paint->left + paint->right ) >> 1 ) + (( feedback * rd[i] ) >> 8 );
+			val = CLIP( val );
+
+			if( lp )
+			{
+				newval = ( lp0 + lp1 + ( val << 1 )) >> 2;
+				lp0 = lp1;
+				lp1 = val;
+				val = newval;
+			}
+
+			wr[i] = val;
+			val >>= 2;
+
+			paint->left = CLIP( paint->left + val );
+			paint->right = CLIP( paint->right + val );
+		}
+		else
+		{
+			wr[i] = 0;
+			lp0 = lp1 = 0;
+		}
+	}
+
+	*plp0 = lp0;
+	*plp1 = lp1;
+}
+
+/*
+============
+RVB_ReverbBlock
+
+Reverb for one dly, block of samples, no crossfade.
+Output is accumulated into acc
+============
+*/
+void RVB_ReverbBlock( int *acc, const portable_samplepair_t *paint, const int *rd, int *wr, int count, int feedback, int lp, int *plp0 )
+{
+	int lp0 = *plp0;
+	int i, val, vlr;
+
+	for( i = 0; i < count; i++, paint++ )
+	{
+		if( rd[i] || paint->left || paint->right )
+		{
+			vlr = ( paint->left + paint->right ) >> 1;
+
+			if( rd[i] )
+			{
+				val = vlr + (( feedback * rd[i] ) >> 8 );
+				val = CLIP( val );
+			}
+			else val = vlr;
+
+			if( lp )
+			{
+				wr[i] = ( lp0 + val ) >> 1;
+				lp0 = val;
+			}
+			else wr[i] = val;
+		}
+		else
+		{
+			wr[i] = 0;
+			lp0 = 0;
+		}
+
+		acc[i] += wr[i];
+	}
+
+	*plp0 = lp0;
+}
+
+/*
+============
+RVB_ReverbMix
+
+Add accumulated reverb output to paintbuffer
+============
+*/
+void RVB_ReverbMix( portable_samplepair_t *paint, const int *acc, int count )
+{
+	int i, voutm;
+
+	for( i = 0; i < count; i++, paint++ )
+	{
+		voutm = ( 11 * acc[i] ) >> 6;
+
+		paint->left = CLIP( paint->left + voutm );
+		paint->right = CLIP( paint->right + voutm );
+	}
+}
+
 
 
 /*
@@ -366,6 +527,62 @@ void DLY_CheckNewStereoDelayVal( )
 	}
 }
 
+/*
+=============
+DLY_DoStereoDelaySample
+
+Do stereo processing for one sample
+=============
+*/
+static void DLY_DoStereoDelaySample( dly_t *dly, portable_samplepair_t *paint )
+{
+	int delay;
+	int samplexf;
+
+	if( dly->mod && --dly->modcur < 0 )
+		dly->modcur = dly->mod;
+
+	delay = dly->lpdelayline[dly->idelayoutput];
+
+	// process only if crossfading, active left value or delayline
+	if( delay || paint->left || dly->xfade )
+	{
+		// set up new crossfade, if not crossfading, not modulating, but going to
+		if( !dly->xfade && !dly->modcur && dly->mod )
+		{
+			dly->idelayoutputxf = dly->idelayoutput +
+					((Com_RandomLong( 0, 255 ) * dly->delaysamples ) >> 9 );
+
+			dly->xfade = 128;
+		}
+
+		dly->idelayoutputxf %= dly->cdelaysamplesmax;
+
+		// modify delay, if crossfading
+		if( dly->xfade )
+		{
+			samplexf = dly->lpdelayline[dly->idelayoutputxf] * (128 - dly->xfade) >> 7;
+			delay = samplexf + ((delay * dly->xfade) >> 7);
+			if( ++dly->idelayoutputxf >= dly->cdelaysamplesmax )
+				dly->idelayoutputxf = 0;
+
+			if( --dly->xfade == 0 )
+				dly->idelayoutput = dly->idelayoutputxf;
+		}
+
+		// save left value to delay line
+		dly->lpdelayline[dly->idelayinput] = CLIP(paint->left);
+
+		// paint new delay value
+		paint->left = delay;
+	}
+	else // clear delay line
+		dly->lpdelayline[dly->idelayinput] = 0;
+
+	DLY_MovePointer( dly );
+}
+
+
 /*
 =============
 DLY_DoStereoDelay
@@ -376,59 +593,43 @@ Do stereo processing
 void DLY_DoStereoDelay( int count )
 {
 	int delay;
-	int samplexf;
 	dly_t *const dly = &rgsxdly[STEREODLY];
 	portable_samplepair_t *paint = paintto;
 
 	if( !dly->lpdelayline )
 		return; // inactive
 
-	for( ; count; count--, paint++ )
+	// without modulation and crossfade stereo delay is just a copy
+	if( sxblocks && !dly->mod )
 	{
-		if( dly->mod && --dly->modcur < 0 )
-			dly->modcur = dly->mod;
-
-		delay = dly->lpdelayline[dly->idelayoutput];
+		// finish crossfade first
+		for( ; count && dly->xfade; count--, paint++ )
+			DLY_DoStereoDelaySample( dly, paint );
 
-		// process only if crossfading, active left value or delayline
-		if( delay || paint->left || dly->xfade )
+		while( count > 0 )
 		{
-			// set up new crossfade, if not crossfading, not modulating, but going to
-			if( !dly->xfade && !dly->modcur && dly->mod )
-			{
-				dly->idelayoutputxf = dly->idelayoutput +
-						((Com_RandomLong( 0, 255 ) * dly->delaysamples ) >> 9 );
+			int n = DLY_BlockSize( dly, count );
+			const int *rd = dly->lpdelayline + dly->idelayoutput;
+			int *wr = dly->lpdelayline + dly->idelayinput;
+			int i;
 
-				dly->xfade = 128;
-			}
-
-			dly->idelayoutputxf %= dly->cdelaysamplesmax;
-
-			// modify delay, if crossfading
-			if( dly->xfade )
+			for( i = 0; i < n; i++ )
 			{
-				samplexf = dly->lpdelayline[dly->idelayoutputxf] * (128 - dly->xfade) >> 7;
-				delay = samplexf + ((delay * dly->xfade) >> 7);
-				if( ++dly->idelayoutputxf >= dly->cdelaysamplesmax )
-					dly->idelayoutputxf = 0;
-
-				if( --dly->xfade == 0 )
-					dly->idelayoutput = dly->idelayoutputxf;
+				delay = rd[i];
+				wr[i] = CLIP( paint[i].left );
+				paint[i].left = delay;
 			}
 
-			// save left value to delay line
-			dly->lpdelayline[dly->idelayinput] = CLIP(paint->left);
-
-			// paint new delay value
-			paint->left = delay;
+			DLY_MoveBlock( dly, n );
+			paint += n;
+			count -= n;
 		}
-		else // clear delay line
-			dly->lpdelayline[dly->idelayinput] = 0;
-
-		DLY_MovePointer( dly );
+		return;
 	}
-}
 
+	for( ; count; count--, paint++ )
+		DLY_DoStereoDelaySample( dly, paint );
+}
 
 /*
 =============
@@ -491,6 +692,22 @@ void DLY_DoDelay( int count )
 	if( !dly->lpdelayline )
 		return; // inactive
 
+	if( sxblocks )
+	{
+		while( count > 0 )
+		{
+			int n = DLY_BlockSize( dly, count );
+
+			mixfuncs->DelayBlock( paint, dly->lpdelayline + dly->idelayoutput,
+				dly->lpdelayline + dly->idelayinput, n, dly->delayfeedback, dly->lp, &dly->lp0, &dly->lp1 );
+
+			DLY_MoveBlock( dly, n );
+			paint += n;
+			count -= n;
+		}
+		return;
+	}
+
 	for( ; count; count--, paint++ )
 	{
 		delay = dly->lpdelayline[dly->idelayoutput];
@@ -693,6 +910,38 @@ void RVB_DoReverb( int count )
 	if( !dly1->lpdelayline )
 		return;
 
+	if( sxblocks )
+	{
+		int acc[DSP_BLOCK_SIZE];
+
+		// crossfade and random modulation are done per-sample
+		for( ; count && ( dly1->xfade || dly2->xfade || !dly1->mod || !dly2->mod ); count--, paint++ )
+		{
+			vlr = ( paint->left + paint->right ) >> 1;
+			acc[0] = RVB_DoReverbForOneDly( dly1, vlr, paint );
+			acc[0] += RVB_DoReverbForOneDly( dly2, vlr, paint );
+			RVB_ReverbMix( paint, acc, 1 );
+		}
+
+		while( count > 0 )
+		{
+			int n = DLY_BlockSize( dly2, DLY_BlockSize( dly1, count ));
+
+			Q_memset( acc, 0, n * sizeof( int ));
+			mixfuncs->ReverbBlock( acc, paint, dly1->lpdelayline + dly1->idelayoutput,
+				dly1->lpdelayline + dly1->idelayinput, n, dly1->delayfeedback, dly1->lp, &dly1->lp0 );
+			mixfuncs->ReverbBlock( acc, paint, dly2->lpdelayline + dly2->idelayoutput,
+				dly2->lpdelayline + dly2->idelayinput, n, dly2->delayfeedback, dly2->lp, &dly2->lp0 );
+			mixfuncs->ReverbMix( paint, acc, n );
+
+			DLY_MoveBlock( dly1, n );
+			DLY_MoveBlock( dly2, n );
+			paint += n;
+			count -= n;
+		}
+		return;
+	}
+
 	for( ; count; count--, paint++ )
 	{
 		int voutm = 0;
@@ -784,6 +1033,23 @@ void RVB_DoAMod( int count )
 }
 
 
+/*
+===========
+DSP_ProcessInternal
+
+Run all processors over buffer
+===========
+*/
+static void DSP_ProcessInternal( portable_samplepair_t *pbfront, int sampleCount )
+{
+	paintto = pbfront;
+
+	RVB_DoAMod( sampleCount );
+	RVB_DoReverb( sampleCount );
+	DLY_DoDelay( sampleCount );
+	DLY_DoStereoDelay( sampleCount );
+}
+
 /*
 ===========
 DSP_Process
@@ -804,12 +1070,7 @@ void DSP_Process(int idsp, portable_samplepair_t *pbfront, int sampleCount)
 		return;
 
 	// preset is already installed by CheckNewDspPresets
-	paintto = pbfront;
-
-	RVB_DoAMod( sampleCount );
-	RVB_DoReverb( sampleCount );
-	DLY_DoDelay( sampleCount );
-	DLY_DoStereoDelay( sampleCount );
+	DSP_ProcessInternal( pbfront, sampleCount );
 }
 
 
@@ -944,4 +1205,120 @@ void SX_Profiling_f( void )
 		CheckNewDspPresets();
 	}
 }
+/*
+===========
+SX_ResetState
+
+Drop all delay lines and install room preset from scratch
+===========
+*/
+static void SX_ResetState( int room )
+{
+	int i;
+
+	for( i = 0; i < MAXDLY; i++ )
+		DLY_Free( i );
+
+	Q_memset( rgsxdly, 0, sizeof( rgsxdly ));
+	Q_memset( rgsxlp, 0, sizeof( rgsxlp ));
+
+	Cvar_SetFloat( "room_type", room );
+	sxrvb_size->modified = true;
+	sxdly_delay->modified = true;
+	sxste_delay->modified = true;
+	room_typeprev = -1;
+
+	CheckNewDspPresets();
+}
+
+/*
+===========
+SX_BenchmarkPass
+
+Run all passes over same input, returns elapsed time and output crc
+===========
+*/
+static double SX_BenchmarkPass( const portable_samplepair_t *src, int room, qboolean blocks, dword *crc )
+{
+	portable_samplepair_t buf[512];
+	double start, total = 0.0;
+	int i;
+
+	SX_ResetState( room );
+	sxblocks = blocks;
+	CRC32_Init( crc );
+
+	for( i = 0; i < DSP_BENCH_PASSES; i++ )
+	{
+		Q_memcpy( buf, src, sizeof( buf ));
+
+		start = Sys_DoubleTime();
+		DSP_ProcessInternal( buf, ARRAYSIZE( buf ));
+		total += Sys_DoubleTime() - start;
+
+		CRC32_ProcessBuffer( crc, buf, sizeof( buf ));
+	}
+
+	CRC32_Final( crc );
+	sxblocks = true;
+
+	return total;
+}
+
+/*
+===========
+SX_Benchmark_f
+
+Measure every room preset on both paths
+===========
+*/
+void SX_Benchmark_f( void )
+{
+	portable_samplepair_t src[512];
+	float oldroom = room_type->value;
+	double tref, tblock, scale;
+	int i, mismatches = 0;
+	dword crcref, crcblock;
+
+	if( dsp_off->integer )
+	{
+		Msg( "dsp is disabled\n" );
+		return;
+	}
+
+	// noise with silent gaps, so inactive paths are measured too
+	for( i = 0; i < ARRAYSIZE( src ); i++ )
+	{
+		if(( i >> 6 ) & 3 )
+		{
+			src[i].left = Com_RandomLong( -8000, 8000 );
+			src[i].right = Com_RandomLong( -8000, 8000 );
+		}
+		else src[i].left = src[i].right = 0;
+	}
+
+	scale = 1e9 / ( DSP_BENCH_PASSES * ARRAYSIZE( src ));
+
+	Msg( "room  reference  %-9s  speedup\n", mixfuncs->name );
+
+	S_LockMixer();
+
+	for( i = 0; i < MAX_ROOM_TYPES; i++ )
+	{
+		tref = SX_BenchmarkPass( src, i, false, &crcref );
+		tblock = SX_BenchmarkPass( src, i, true, &crcblock );
+
+		if( crcref != crcblock )
+			mismatches++;
+
+		Msg( "%4i  %6.2f ns  %6.2f ns  %5.2fx%s\n", i, tref * scale, tblock * scale,
+			tblock > 0.0 ? tref / tblock : 0.0, crcref != crcblock ? "  MISMATCH" : "" );
+	}
+
+	SX_ResetState( oldroom );
+
+	S_UnlockMixer();
+
+	Msg( "%i presets, %i mismatches, ns per sample\n", (int)MAX_ROOM_TYPES, mismatches );
+}
 #endif // XASH_DEDICATED
@@ -24,6 +24,24 @@ GNU General Public License for more details.
 // sure we won't need it.
 #define MAX_SFX		8192
 #define MAX_SFX_HASH	(MAX_SFX/4)
+#define MAX_PENDING_SFX	256	// sounds waiting for background load
+#define SND_LOAD_TIME	0.002	// seconds per frame to spend on queued loads
+
+// decoded sounds cache, all fields are owned by main thread
+typedef struct
+{
+	int		sequence;		// bumped every frame, used as LRU clock
+	size_t		size;		// decoded bytes in memory
+	size_t		peak;
+	size_t		budget;		// snd_cache_mb at last eviction
+	qboolean		grown;		// sounds were loaded since last eviction
+	int		hits;
+	int		misses;
+	int		evicted;
+	int		queued;
+	sfx_t		*pending[MAX_PENDING_SFX];
+	int		numpending;
+} sndcache_t;
 
 static int	s_numSfx = 0;
 static sfx_t	s_knownSfx[MAX_SFX];
@@ -31,6 +49,7 @@ static sfx_t	*s_sfxHashList[MAX_SFX_HASH];
 static string	s_sentenceImmediateName;	// keep dummy sentence name
 qboolean		s_registering = false;
 int		s_registration_sequence = 0;
+static sndcache_t	s_cache;
 
 /*
 =================
@@ -64,6 +83,11 @@ void S_SoundList_f( void )
 	Msg( "-------------------------------------------\n" );
 	Msg( "%i total sounds\n", totalSfx );
 	Msg( "%s total memory\n", Q_memprint( totalSize ));
+	Msg( "cache: %s", Q_memprint( s_cache.size ));
+	Msg( " of %s,", snd_cache_mb->value > 0.0f ? Q_memprint( snd_cache_mb->value * 1024 * 1024 ) : "unlimited" );
+	Msg( " peak %s\n", Q_memprint( s_cache.peak ));
+	Msg( "%i hits, %i misses, %i evicted, %i loaded in background, %i pending\n",
+		s_cache.hits, s_cache.misses, s_cache.evicted, s_cache.queued, s_cache.numpending );
 	Msg( "\n" );
 }
 
@@ -129,7 +153,18 @@ wavdata_t *S_LoadSound( sfx_t *sfx )
 	wavdata_t	*sc = NULL;
 
 	if( !sfx ) return NULL;
-	if( sfx->cache ) return sfx->cache; // see if still in memory
+
+	sfx->lastUsed = s_cache.sequence;
+
+	if( sfx->cache )
+	{
+		// see if still in memory
+		s_cache.hits++;
+		return sfx->cache;
+	}
+
+	s_cache.misses++;
+	sfx->pending = false;
 
 	if( Q_stricmp( sfx->name, "*default" ))
 	{
@@ -141,7 +176,9 @@ wavdata_t *S_LoadSound( sfx_t *sfx )
 
 	if( !sc ) sc = S_CreateDefaultSound();
 
-	if( sc->rate < SOUND_11k ) // some bad sounds
+	if( snd_resample_quality->integer > 0 && sc->rate != SOUND_DMA_SPEED )
+		Sound_Process( &sc, SOUND_DMA_SPEED, sc->width, SOUND_RESAMPLE ); // mixer won't need to upsample it
+	else if( sc->rate < SOUND_11k ) // some bad sounds
 		Sound_Process( &sc, SOUND_11k, sc->width, SOUND_RESAMPLE );
 #if SOUND_DMA_SPEED > SOUND_11k
 	else if( sc->rate > SOUND_11k && sc->rate < SOUND_22k ) // some bad sounds
@@ -154,9 +191,164 @@ wavdata_t *S_LoadSound( sfx_t *sfx )
 #endif
 	sfx->cache = sc;
 
+	s_cache.size += sc->size;
+	s_cache.peak = max( s_cache.peak, s_cache.size );
+	s_cache.grown = true;
+
 	return sfx->cache;
 }
 
+/*
+=================
+S_QueueSound
+
+Start reading sound in background, it will be
+decoded by S_UpdateCache or on first play
+=================
+*/
+static void S_QueueSound( sfx_t *sfx )
+{
+	const char	*name = sfx->name;
+	const char	*ext;
+
+	if( sfx->cache || sfx->pending )
+		return;
+
+	if( s_cache.numpending == MAX_PENDING_SFX )
+	{
+		S_LoadSound( sfx );
+		return;
+	}
+
+	if( name[0] == '*' ) name++;
+
+	// only file formats that soundlib takes by extension can be prefetched
+	ext = FS_FileExtension( name );
+	if( !Q_stricmp( ext, "wav" ) || !Q_stricmp( ext, "mp3" ))
+		FS_Prefetch( va( "sound/%s", name ));
+
+	sfx->pending = true;
+	s_cache.pending[s_cache.numpending++] = sfx;
+}
+
+/*
+=================
+S_UnloadSound
+
+Drop decoded data but keep sfx registered
+=================
+*/
+static void S_UnloadSound( sfx_t *sfx )
+{
+	if( !sfx->cache ) return;
+
+	s_cache.size -= sfx->cache->size;
+	FS_FreeSound( sfx->cache );
+	sfx->cache = NULL;
+}
+
+static int S_CompareLastUsed( const void *a, const void *b )
+{
+	return (*(const sfx_t **)a)->lastUsed - (*(const sfx_t **)b)->lastUsed;
+}
+
+/*
+=================
+S_EvictSounds
+
+Free least recently used sounds until cache fits in budget.
+Sounds referenced by any channel were touched this frame
+and are never freed
+=================
+*/
+static void S_EvictSounds( size_t budget )
+{
+	static sfx_t	*list[MAX_SFX];
+	sfx_t		*sfx;
+	int		i, count = 0;
+
+	for( i = 1, sfx = s_knownSfx + 1; i < s_numSfx; i++, sfx++ )
+	{
+		if( sfx->cache && sfx->lastUsed != s_cache.sequence )
+			list[count++] = sfx;
+	}
+
+	// everything is playing
+	if( !count ) return;
+
+	qsort( list, count, sizeof( sfx_t * ), S_CompareLastUsed );
+
+	for( i = 0; i < count && s_cache.size > budget; i++ )
+	{
+		S_UnloadSound( list[i] );
+		s_cache.evicted++;
+	}
+}
+
+/*
+=================
+S_UpdateCache
+
+Called every frame with mixer locked and command queue flushed
+=================
+*/
+void S_UpdateCache( void )
+{
+	double	start = Sys_DoubleTime();
+	channel_t	*ch;
+	size_t	budget;
+	int	i, j;
+
+	s_cache.sequence++;
+
+	// decode queued sounds, their files are already read by workers
+	for( i = 0; i < s_cache.numpending; i++ )
+	{
+		if( i > 0 && Sys_DoubleTime() - start > SND_LOAD_TIME )
+			break;
+
+		if( s_cache.pending[i]->pending )
+		{
+			S_LoadSound( s_cache.pending[i] );
+			s_cache.queued++;
+		}
+	}
+
+	if( i > 0 )
+	{
+		s_cache.numpending -= i;
+		memmove( s_cache.pending, s_cache.pending + i, s_cache.numpending * sizeof( sfx_t * ));
+	}
+
+	if( snd_cache_mb->value <= 0.0f )
+		return;
+
+	budget = snd_cache_mb->value * 1024 * 1024;
+
+	// nothing could be freed since last pass, don't scan again
+	// until a new sound is loaded or the budget is lowered
+	if( s_cache.size <= budget || ( !s_cache.grown && budget >= s_cache.budget ))
+		return;
+
+	s_cache.grown = false;
+	s_cache.budget = budget;
+
+	// mark everything that is playing
+	for( i = 0, ch = channels; i < total_channels; i++, ch++ )
+	{
+		if( !ch->sfx ) continue;
+
+		ch->sfx->lastUsed = s_cache.sequence;
+
+		if( !ch->isSentence ) continue;
+
+		for( j = 0; j < CVOXWORDMAX && ch->words[j].sfx; j++ )
+			ch->words[j].sfx->lastUsed = s_cache.sequence;
+	}
+
+	S_EvictSounds( budget );
+}
+
 // =======================================================================
 // Load a sound
 // =======================================================================
@@ -259,7 +451,7 @@ void S_FreeSound( sfx_t *sfx )
 		prev = &hashSfx->hashNext;
 	}
 
-	if( sfx->cache ) FS_FreeSound( sfx->cache );
+	S_UnloadSound( sfx );
 	Q_memset( sfx, 0, sizeof( *sfx ));
 }
 
@@ -308,12 +500,21 @@ void S_EndRegistration( void )
 	if( !dma.initialized ) return;
 	
 	// free any sounds not from this registration sequence
+	S_LockMixer();
 	for( i = 0, sfx = s_knownSfx; i < s_numSfx; i++, sfx++ )
 	{
 		if( !sfx->name[0] ) continue;
 		if( sfx->touchFrame != s_registration_sequence )
 			S_FreeSound( sfx ); // don't need this sound
 	}
+	S_UnlockMixer();
+
+	// let workers read everything first
+	for( i = 0, sfx = s_knownSfx; i < s_numSfx; i++, sfx++ )
+	{
+		if( !sfx->name[0] || sfx->cache ) continue;
+		FS_Prefetch( va( "sound/%s", sfx->name[0] == '*' ? sfx->name + 1 : sfx->name ));
+	}
 
 	// load everything in
 	for( i = 0, sfx = s_knownSfx; i < s_numSfx; i++, sfx++ )
@@ -321,6 +522,7 @@ void S_EndRegistration( void )
 		if( !sfx->name[0] ) continue;
 		S_LoadSound( sfx );
 	}
+	s_cache.numpending = 0;
 	s_registering = false;
 }
 
@@ -350,7 +552,7 @@ sound_t S_RegisterSound( const char *name )
 	if( !sfx ) return -1;
 
 	sfx->touchFrame = s_registration_sequence;
-	if( !s_registering ) S_LoadSound( sfx );
+	if( !s_registering ) S_QueueSound( sfx );
 
 	return sfx - s_knownSfx;
 }
@@ -396,6 +598,7 @@ void S_FreeSounds( void )
 
 	Q_memset( s_knownSfx, 0, sizeof( s_knownSfx ));
 	Q_memset( s_sfxHashList, 0, sizeof( s_sfxHashList ));
+	s_cache.numpending = 0;
 
 	s_numSfx = 0;
 }
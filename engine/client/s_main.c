@@ -37,6 +37,29 @@ int   		paintedtime; 	// sample PAIRS
 static int	trace_count = 0;
 static int	last_trace_chan = 0;
 
+// occlusion results are shared by sources at the same spot during one frame
+typedef struct
+{
+	int		frame;		// valid only for the frame it was traced in
+	int		bucket[3];	// origin snapped to SND_TRACE_BUCKET grid
+	int		radius;
+	float		gain;
+} sndtrace_t;
+
+typedef struct
+{
+	int		frame;
+	int		leafnum;
+	qboolean		audible;
+} sndphs_t;
+
+static sndtrace_t	trace_cache[SND_TRACE_CACHE_SIZE];
+static sndphs_t	phs_cache[SND_TRACE_CACHE_SIZE];
+static int	trace_frame = 1;
+static int	listener_leaf = -1;	// leaf index for PHS tests, updated once per frame
+static int	trace_shared, phs_count;	// counters for current frame
+static int	trace_stats[3];	// traces, shared and PHS lookups of last frame
+
 convar_t		*s_volume;
 convar_t		*s_musicvolume;
 convar_t		*s_show;
@@ -56,8 +79,60 @@ convar_t		*s_refdb;
 convar_t		*s_cull;		// cull sounds by geometry
 convar_t		*s_test;		// cvar for testing new effects
 convar_t		*s_phs;
+convar_t		*snd_cache_mb;
 convar_t		*s_reverse_channels;
 convar_t		*s_samplecount;
+convar_t		*s_mixthread;
+convar_t		*s_simd;
+
+/*
+=============================================================================
+
+		MIXER THREAD
+
+main thread loads and spatializes sounds into a prepared channel and posts it
+into the single-producer command ring. Ring is drained by the mixer thread
+right before painting, so starting a sound never waits for the mixer.
+Everything else that touches the channel array from the main thread
+must hold the mixer lock.
+=============================================================================
+*/
+#define MAX_SND_COMMANDS		64		// must be power of two
+#define MAX_SND_COMMANDS_MASK		( MAX_SND_COMMANDS - 1 )
+#define MIXER_THREAD_MSEC		5		// mixer wakeup interval
+
+typedef enum
+{
+	SND_CMD_START = 0,	// alter playing sound or start a new one
+	SND_CMD_AMBIENT,	// alter playing sound or start a new static one
+	SND_CMD_ALTER,	// alter playing sound, never start
+} sndcmdtype_t;
+
+typedef struct
+{
+	sndcmdtype_t	type;
+	sfx_t		*sfx;		// as requested by caller (may be a sentence)
+	int		entnum;
+	int		entchannel;
+	int		vol;
+	int		pitch;
+	int		flags;
+	channel_t		chan;		// loaded and spatialized, for START and AMBIENT
+} sndcmd_t;
+
+static struct
+{
+	sys_mutex_t	*lock;
+	sys_thread_t	*thread;
+	volatile qboolean	running;
+	sndcmd_t		cmds[MAX_SND_COMMANDS];
+	volatile int	head;		// advanced by main thread only
+	volatile int	tail;		// advanced under the lock only
+	sndcmd_t		direct;		// executed in place when thread is off or ring is full
+	int		dropped;		// sounds without free channel, reported by main thread
+	int		overflows;	// commands executed in place because ring was full
+} s_mixer;
+
 /*
 =============================================================================
 
@@ -204,6 +279,7 @@ SND_ChannelOkToTrace
 All new sounds must traceline once,
 but cap the max number of tracelines performed per frame
 for longer or looping sounds to SND_TRACE_UPDATE_MAX.
+Shared results from trace cache are not counted
 =================
 */
 qboolean SND_ChannelOkToTrace( channel_t *ch )
@@ -257,12 +333,60 @@ void SND_ChannelTraceReset( void )
 	if( last_trace_chan >= total_channels )
 		last_trace_chan = last_trace_chan - total_channels;
 
+	// keep stats for s_info
+	trace_stats[0] = trace_count;
+	trace_stats[1] = trace_shared;
+	trace_stats[2] = phs_count;
+
 	// reset traceline counter
-	trace_count = 0;
+	trace_count = trace_shared = phs_count = 0;
 
 	// reset channel traceline flag
 	for( i = 0; i < total_channels; i++ )
 		channels[i].bTraced = false; 
+
+	// listener has moved, drop cached traces and PHS results
+	trace_frame++;
+	listener_leaf = Mod_PointLeafnum( s_listener.origin ) - 1;
+}
+
+/*
+=================
+SND_FindTrace
+
+returns traced entry for this spot if we have one,
+otherwise a slot to store new result, or NULL if cache is full here
+=================
+*/
+static sndtrace_t *SND_FindTrace( const vec3_t origin, int radius )
+{
+	sndtrace_t	*trace;
+	int		bucket[3];
+	uint		hash;
+	int		i;
+
+	for( i = 0; i < 3; i++ )
+		bucket[i] = (int)floor( origin[i] / SND_TRACE_BUCKET );
+
+	hash = (uint)bucket[0] * 73856093U ^ (uint)bucket[1] * 19349663U ^ (uint)bucket[2] * 83492791U ^ (uint)radius;
+
+	for( i = 0; i < 4; i++ )
+	{
+		trace = &trace_cache[( hash + i ) & ( SND_TRACE_CACHE_SIZE - 1 )];
+
+		if( trace->frame != trace_frame )
+		{
+			// stale slot, reuse it
+			VectorCopy( bucket, trace->bucket );
+			trace->radius = radius;
+			return trace;
+		}
+
+		if( VectorCompare( trace->bucket, bucket ) && trace->radius == radius )
+			return trace;
+	}
+
+	return NULL;
 }
 
 /*
@@ -380,11 +504,9 @@ channel_t *SND_PickStaticChannel( const vec3_t pos, sfx_t *sfx )
 	else
 	{
 		// no empty slots, alloc a new static sound channel
+		// NOTE: may be called from mixer thread, caller reports the drop
 		if( total_channels == MAX_CHANNELS )
-		{
-			MsgDev( D_ERROR, "S_PickChannel: no free channels\n" );
 			return NULL;
-		}
 		// get a channel for the static sound
 		ch = &channels[total_channels];
 		total_channels++;
@@ -510,48 +632,17 @@ float SND_FadeToNewGain( channel_t *ch, float gain_new )
 
 /*
 =================
-SND_GetGainObscured
+SND_TraceGain
 
-drop gain on channel if sound emitter obscured by
-world, unbroken windows, closed doors, large solid entities etc.
+trace center and extents of sound source of given radius
 =================
 */
-float SND_GetGainObscured( channel_t *ch, qboolean fplayersound, qboolean flooping )
+static float SND_TraceGain( vec3_t endpoint, float radius )
 {
 	float	gain = 1.0f;
-	vec3_t	endpoint;
 	int	count = 1;
 	pmtrace_t	tr;
 
-	if( fplayersound ) return gain; // unchanged
-
-	// during signon just apply regular state machine since world hasn't been
-	// created or settled yet...
-	if( !CL_Active( ))
-	{
-		gain = SND_FadeToNewGain( ch, -1.0f );
-		return gain;
-	}
-
-	// don't do gain obscuring more than once on short one-shot sounds
-	if( !ch->bfirstpass && !ch->isSentence && !flooping && ( ch->entchannel != CHAN_STREAM ))
-	{
-		gain = SND_FadeToNewGain( ch, -1.0f );
-		return gain;
-	}
-
-	// if long or looping sound, process N channels per frame - set 'processed' flag, clear by
-	// cycling through all channels - this maintains a cap on traces per frame
-	if( !SND_ChannelOkToTrace( ch ))
-	{
-		// just keep updating fade to existing target gain - no new trace checking
-		gain = SND_FadeToNewGain( ch, -1.0 );
-		return gain;
-	}
-
-	// set up traceline from player eyes to sound emitting entity origin
-	VectorCopy( ch->origin, endpoint );
-
 	tr = CL_TraceLine( s_listener.origin, endpoint, PM_STUDIO_IGNORE );
 
 	if(( tr.fraction < 1.0f || tr.allsolid || tr.startsolid ) && tr.fraction < 0.99f )
@@ -561,17 +652,12 @@ float SND_GetGainObscured( channel_t *ch, qboolean fplayersound, qboolean floopi
 		// test to see how many extents are visible,
 		// drop gain by g_snd_obscured_loss_db per extent hidden
 		vec3_t	endpoints[4];
-		int	i, sndlvl = DIST_MULT_TO_SNDLVL( ch->dist_mult );
 		vec3_t	vecl, vecr, vecl2, vecr2;
 		vec3_t	vsrc_forward;
 		vec3_t	vsrc_right;
 		vec3_t	vsrc_up;
-		float	radius;
+		int	i;
 
-		// get radius
-		if( ch->radius > 0 ) radius = ch->radius;
-		else radius = dB_To_Radius( sndlvl ); // approximate radius from soundlevel
-		
 		// set up extent endpoints - on upward or downward diagonals, facing player
 		for( i = 0; i < 4; i++ ) VectorCopy( endpoint, endpoints[i] );
 
@@ -616,6 +702,71 @@ float SND_GetGainObscured( channel_t *ch, qboolean fplayersound, qboolean floopi
 		}
 	}
 
+	return gain;
+}
+
+/*
+=================
+SND_GetGainObscured
+
+drop gain on channel if sound emitter obscured by
+world, unbroken windows, closed doors, large solid entities etc.
+=================
+*/
+float SND_GetGainObscured( channel_t *ch, qboolean fplayersound, qboolean flooping )
+{
+	float	gain = 1.0f;
+	sndtrace_t	*trace;
+	float	radius;
+
+	if( fplayersound ) return gain; // unchanged
+
+	// during signon just apply regular state machine since world hasn't been
+	// created or settled yet...
+	if( !CL_Active( ))
+	{
+		gain = SND_FadeToNewGain( ch, -1.0f );
+		return gain;
+	}
+
+	// don't do gain obscuring more than once on short one-shot sounds
+	if( !ch->bfirstpass && !ch->isSentence && !flooping && ( ch->entchannel != CHAN_STREAM ))
+	{
+		gain = SND_FadeToNewGain( ch, -1.0f );
+		return gain;
+	}
+
+	// get radius
+	if( ch->radius > 0 ) radius = ch->radius;
+	else radius = dB_To_Radius( DIST_MULT_TO_SNDLVL( ch->dist_mult )); // approximate radius from soundlevel
+
+	// some other source at the same spot was already traced this frame
+	trace = SND_FindTrace( ch->origin, (int)radius );
+
+	if( trace && trace->frame == trace_frame )
+	{
+		trace_shared++;
+		return SND_FadeToNewGain( ch, trace->gain );
+	}
+
+	// if long or looping sound, process N channels per frame - set 'processed' flag, clear by
+	// cycling through all channels - this maintains a cap on traces per frame
+	if( !SND_ChannelOkToTrace( ch ))
+	{
+		// just keep updating fade to existing target gain - no new trace checking
+		gain = SND_FadeToNewGain( ch, -1.0 );
+		return gain;
+	}
+
+	// set up traceline from player eyes to sound emitting entity origin
+	gain = SND_TraceGain( ch->origin, radius );
+
+	if( trace )
+	{
+		trace->frame = trace_frame;
+		trace->gain = gain;
+	}
+
 	// crossfade to new gain
 	gain = SND_FadeToNewGain( ch, gain );
 
@@ -697,27 +848,39 @@ float SND_GetGain( channel_t *ch, qboolean fplayersound, qboolean flooping, floa
 	return gain; 
 }
 
+/*
+=================
+SND_CheckPHS
+
+PHS row is fetched once per source leaf each frame
+=================
+*/
 qboolean SND_CheckPHS( channel_t *ch )
 {
 	mleaf_t	*leaf;
+	sndphs_t	*phs;
 	int	leafnum;
-	byte	*mask = NULL;
+	byte	*mask;
 
 	// cull sounds by PHS
-	if( !s_phs->integer )
+	if( !s_phs->integer || listener_leaf == -1 )
 		return true;
 
 	leaf = Mod_PointInLeaf( ch->origin, cl.worldmodel->nodes );
-	mask = Mod_LeafPHS( leaf, cl.worldmodel );
+	leafnum = leaf - cl.worldmodel->leafs;
+	phs = &phs_cache[leafnum & ( SND_TRACE_CACHE_SIZE - 1 )];
 
-	if( mask )
+	if( phs->frame != trace_frame || phs->leafnum != leafnum )
 	{
-		leafnum = Mod_PointLeafnum( s_listener.origin ) - 1;
+		mask = Mod_LeafPHS( leaf, cl.worldmodel );
 
-		if( leafnum != -1 && (!(mask[leafnum>>3] & (1U << ( leafnum & 7 )))))
-			return false;
+		phs->frame = trace_frame;
+		phs->leafnum = leafnum;
+		phs->audible = !mask || ( mask[listener_leaf>>3] & ( 1U << ( listener_leaf & 7 )));
+		phs_count++;
 	}
-	return true;
+
+	return phs->audible;
 }
 
 /*
@@ -840,6 +1003,210 @@ void SND_Spatialize( channel_t *ch )
 	if( CL_Active( )) ch->bfirstpass = false;
 }
 
+/*
+=================
+S_LockMixer
+
+recursive, can be safely called from the mixer itself
+=================
+*/
+void S_LockMixer( void )
+{
+	if( s_mixer.lock )
+		Sys_LockMutex( s_mixer.lock );
+}
+
+/*
+=================
+S_UnlockMixer
+=================
+*/
+void S_UnlockMixer( void )
+{
+	if( s_mixer.lock )
+		Sys_UnlockMutex( s_mixer.lock );
+}
+
+/*
+=================
+S_MixerLoadSound
+
+mixer thread never touches the filesystem:
+all the sounds are cached by main thread before posting.
+Playing sounds are not cache lookups, they don't count as hits
+=================
+*/
+wavdata_t *S_MixerLoadSound( sfx_t *sfx )
+{
+	if( !sfx ) return NULL;
+
+	if( s_mixer.running || sfx->cache )
+		return sfx->cache;
+
+	return S_LoadSound( sfx );
+}
+
+/*
+=================
+S_ExecuteCommand
+
+mixer lock must be held.
+returns false if sound was dropped
+=================
+*/
+static qboolean S_ExecuteCommand( sndcmd_t *cmd )
+{
+	channel_t	*target_chan, *check;
+	qboolean	bIgnore = false;
+	mixer_t	mixer;
+	sfx_t	*sfx;
+	int	ch_idx;
+
+	if( cmd->flags & ( SND_STOP|SND_CHANGE_VOL|SND_CHANGE_PITCH ))
+	{
+		if( S_AlterChannel( cmd->entnum, cmd->entchannel, cmd->sfx, cmd->vol, cmd->pitch, cmd->flags ))
+			return true;
+
+		if( cmd->flags & SND_STOP ) return true;
+		// fall through - if we're not trying to stop the sound,
+		// and we didn't find it (it's not playing), go ahead and start it up
+	}
+
+	if( cmd->type == SND_CMD_ALTER )
+		return true;
+
+	// pick a channel to play on
+	if( cmd->entchannel == CHAN_STATIC ) target_chan = SND_PickStaticChannel( cmd->chan.origin, cmd->sfx );
+	else target_chan = SND_PickDynamicChannel( cmd->entnum, cmd->entchannel, cmd->sfx, &bIgnore );
+
+	if( !target_chan )
+		return bIgnore;
+
+	// static sound restarted at the same spot keeps the playing position
+	if( cmd->type == SND_CMD_AMBIENT && !cmd->chan.isSentence && target_chan->sfx == cmd->chan.sfx )
+		mixer = target_chan->pMixer;
+	else mixer = cmd->chan.pMixer;
+
+	*target_chan = cmd->chan;
+	target_chan->pMixer = mixer;
+
+	if( target_chan->currentWord )
+		target_chan->currentWord = &target_chan->pMixer;
+
+	if( cmd->type != SND_CMD_START )
+		return true;
+
+	sfx = target_chan->sfx;
+
+	for( ch_idx = NUM_AMBIENTS, check = channels + NUM_AMBIENTS; ch_idx < MAX_DYNAMIC_CHANNELS; ch_idx++, check++)
+	{
+		if( check == target_chan ) continue;
+
+		if( check->sfx == sfx && !check->pMixer.sample )
+		{
+			// skip up to 0.1 seconds of audio
+			int skip = Com_RandomLong( 0, (int)( 0.1f * check->sfx->cache->rate ));
+
+			S_SetSampleStart( check, sfx->cache, skip );
+			break;
+		}
+	}
+
+	return true;
+}
+
+/*
+=================
+S_FlushCommands
+
+mixer lock must be held
+=================
+*/
+static void S_FlushCommands( void )
+{
+	while( s_mixer.tail != s_mixer.head )
+	{
+		// don't read the command before it was published
+		Sys_MemoryBarrier();
+
+		if( !S_ExecuteCommand( &s_mixer.cmds[s_mixer.tail & MAX_SND_COMMANDS_MASK] ))
+			s_mixer.dropped++;
+
+		// don't release the slot before we done with it
+		Sys_MemoryBarrier();
+		s_mixer.tail++;
+	}
+}
+
+/*
+=================
+S_AllocCommand
+
+grab next free slot in the ring
+=================
+*/
+static sndcmd_t *S_AllocCommand( sfx_t *sfx, int entnum, int entchannel, int vol, int pitch, int flags )
+{
+	sndcmd_t	*cmd = &s_mixer.direct;
+
+	if( s_mixer.running )
+	{
+		if( s_mixer.head - s_mixer.tail < MAX_SND_COMMANDS )
+			cmd = &s_mixer.cmds[s_mixer.head & MAX_SND_COMMANDS_MASK];
+		else s_mixer.overflows++;
+	}
+
+	cmd->type = SND_CMD_START;
+	cmd->sfx = sfx;
+	cmd->entnum = entnum;
+	cmd->entchannel = entchannel;
+	cmd->vol = vol;
+	cmd->pitch = pitch;
+	cmd->flags = flags;
+
+	return cmd;
+}
+
+/*
+=================
+S_SubmitCommand
+=================
+*/
+static void S_SubmitCommand( sndcmd_t *cmd )
+{
+	if( cmd != &s_mixer.direct )
+	{
+		// make the command visible to the mixer
+		Sys_MemoryBarrier();
+		s_mixer.head++;
+		return;
+	}
+
+	S_LockMixer();
+	S_FlushCommands(); // keep the order
+
+	if( !S_ExecuteCommand( cmd ))
+		MsgDev( D_NOTE, "^1Error: ^7dropped sound \"sound/%s\"\n", cmd->sfx->name );
+	S_UnlockMixer();
+}
+
+/*
+=================
+S_CancelCommand
+
+sound will not be started, but volume or pitch change
+still should be applied to already playing instance
+=================
+*/
+static void S_CancelCommand( sndcmd_t *cmd )
+{
+	if( cmd->flags & ( SND_STOP|SND_CHANGE_VOL|SND_CHANGE_PITCH ))
+	{
+		cmd->type = SND_CMD_ALTER;
+		S_SubmitCommand( cmd );
+	}
+}
+
 /*
 ====================
 S_StartSound
@@ -860,9 +1227,9 @@ void S_StartSound( const vec3_t pos, int ent, int chan, sound_t handle, float fv
 {
 	wavdata_t	*pSource;
 	sfx_t	*sfx = NULL;
-	channel_t	*target_chan, *check;
-	int	vol, ch_idx;
-	qboolean bIgnore = false;
+	channel_t	*target_chan;
+	sndcmd_t	*cmd;
+	int	vol;
 
 	if( !dma.initialized ) return;
 	sfx = S_GetSfxByHandle( handle );
@@ -871,14 +1238,11 @@ void S_StartSound( const vec3_t pos, int ent, int chan, sound_t handle, float fv
 	vol = bound( 0, fvol * 255, 255 );
 	if( pitch <= 1 ) pitch = PITCH_NORM; // Invasion issues
 
-	if( flags & ( SND_STOP|SND_CHANGE_VOL|SND_CHANGE_PITCH ))
+	if( flags & SND_STOP )
 	{
-		if( S_AlterChannel( ent, chan, sfx, vol, pitch, flags ))
-			return;
-
-		if( flags & SND_STOP ) return;
-		// fall through - if we're not trying to stop the sound, 
-		// and we didn't find it (it's not playing), go ahead and start it up
+		cmd = S_AllocCommand( sfx, ent, chan, vol, pitch, flags );
+		S_CancelCommand( cmd );
+		return;
 	}
 
 	if( pitch == 0 )
@@ -889,16 +1253,9 @@ void S_StartSound( const vec3_t pos, int ent, int chan, sound_t handle, float fv
 
 	if( !pos ) pos = cl.refdef.vieworg;
 
-	// pick a channel to play on
-	if( chan == CHAN_STATIC ) target_chan = SND_PickStaticChannel( pos, sfx );
-	else target_chan = SND_PickDynamicChannel( ent, chan, sfx, &bIgnore );
-
-	if( !target_chan )
-	{
-		if( !bIgnore )
-			MsgDev( D_NOTE, "^1Error: ^7dropped sound \"sound/%s\"\n", sfx->name );
-		return;
-	}
+	// channel will be picked by the mixer
+	cmd = S_AllocCommand( sfx, ent, chan, vol, pitch, flags );
+	target_chan = &cmd->chan;
 
 	// spatialize
 	Q_memset( target_chan, 0, sizeof( *target_chan ));
@@ -947,11 +1304,14 @@ void S_StartSound( const vec3_t pos, int ent, int chan, sound_t handle, float fv
 
 	if( !pSource )
 	{
-		S_FreeChannel( target_chan );
+		S_CancelCommand( cmd );
 		return;
 	}
 
+	// trace and phs caches are shared with S_Update
+	S_LockMixer();
 	SND_Spatialize( target_chan );
+	S_UnlockMixer();
 
 	// If a client can't hear a sound when they FIRST receive the StartSound message,
 	// the client will never be able to hear that sound. This is so that out of 
@@ -964,7 +1324,7 @@ void S_StartSound( const vec3_t pos, int ent, int chan, sound_t handle, float fv
 			// if this is a streaming sound, play the whole thing.
 			if( chan != CHAN_STREAM )
 			{
-				S_FreeChannel( target_chan );
+				S_CancelCommand( cmd );
 				return; // not audible at all
 			}
 		}
@@ -973,19 +1333,7 @@ void S_StartSound( const vec3_t pos, int ent, int chan, sound_t handle, float fv
 	// Init client entity mouth movement vars
 	SND_InitMouth( ent, chan );
 
-	for( ch_idx = NUM_AMBIENTS, check = channels + NUM_AMBIENTS; ch_idx < MAX_DYNAMIC_CHANNELS; ch_idx++, check++)
-	{
-		if( check == target_chan ) continue;
-
-		if( check->sfx == sfx && !check->pMixer.sample )
-		{
-			// skip up to 0.1 seconds of audio
-			int skip = Com_RandomLong( 0, (int)( 0.1f * check->sfx->cache->rate ));
-
-			S_SetSampleStart( check, sfx->cache, skip );
-			break;
-		}
-	}
+	S_SubmitCommand( cmd );
 }
 
 /*
@@ -995,7 +1343,7 @@ S_RestoreSound
 Restore a sound effect for the given entity on the given channel
 ====================
 */
-void S_RestoreSound( const vec3_t pos, int ent, int chan, sound_t handle, float fvol, float attn, int pitch, int flags, double sample, double end, int wordIndex )
+static void S_RestoreSoundInternal( const vec3_t pos, int ent, int chan, sound_t handle, float fvol, float attn, int pitch, int flags, double sample, double end, int wordIndex )
 {
 	wavdata_t	*pSource;
 	sfx_t	*sfx = NULL;
@@ -1110,6 +1458,14 @@ void S_RestoreSound( const vec3_t pos, int ent, int chan, sound_t handle, float
 	SND_InitMouth( ent, chan );
 }
 
+void S_RestoreSound( const vec3_t pos, int ent, int chan, sound_t handle, float fvol, float attn, int pitch, int flags, double sample, double end, int wordIndex )
+{
+	S_LockMixer();
+	S_FlushCommands();
+	S_RestoreSoundInternal( pos, ent, chan, handle, fvol, attn, pitch, flags, sample, end, wordIndex );
+	S_UnlockMixer();
+}
+
 /*
 =================
 S_AmbientSound
@@ -1129,6 +1485,7 @@ void S_AmbientSound( const vec3_t pos, int ent, sound_t handle, float fvol, floa
 	channel_t	*ch;
 	wavdata_t	*pSource = NULL;
 	sfx_t	*sfx = NULL;
+	sndcmd_t	*cmd;
 	int	vol, fvox = 0;
 	float	radius = SND_RADIUS_MAX;
 
@@ -1139,11 +1496,13 @@ void S_AmbientSound( const vec3_t pos, int ent, sound_t handle, float fvol, floa
 	vol = bound( 0, fvol * 255, 255 );
 	if( pitch <= 1 ) pitch = PITCH_NORM; // Invasion issues
 
-	if( flags & (SND_STOP|SND_CHANGE_VOL|SND_CHANGE_PITCH))
+	cmd = S_AllocCommand( sfx, ent, CHAN_STATIC, vol, pitch, flags );
+	cmd->type = SND_CMD_AMBIENT;
+
+	if( flags & SND_STOP )
 	{
-		if( S_AlterChannel( ent, CHAN_STATIC, sfx, vol, pitch, flags ))
-			return;
-		if( flags & SND_STOP ) return;
+		S_CancelCommand( cmd );
+		return;
 	}
 	
 	if( pitch == 0 )
@@ -1152,9 +1511,9 @@ void S_AmbientSound( const vec3_t pos, int ent, sound_t handle, float fvol, floa
 		return;
 	}
 
-	// pick a channel to play on from the static area
-	ch = SND_PickStaticChannel( pos, sfx );
-	if( !ch ) return;
+	// channel will be picked by the mixer from the static area
+	ch = &cmd->chan;
+	Q_memset( ch, 0, sizeof( *ch ));
 
 	VectorCopy( pos, ch->origin );
 	ch->entnum = ent;
@@ -1171,8 +1530,7 @@ void S_AmbientSound( const vec3_t pos, int ent, sound_t handle, float fvol, floa
 		// link all words and load the first word
 		VOX_LoadSound( ch, S_SkipSoundChar( sfx->name ));
 		Q_strncpy( ch->name, sfx->name, sizeof( ch->name ));
-		sfx = ch->sfx;
-		pSource = sfx->cache;
+		if( ch->sfx ) pSource = ch->sfx->cache;
 		fvox = 1;
 	}
 	else
@@ -1186,7 +1544,7 @@ void S_AmbientSound( const vec3_t pos, int ent, sound_t handle, float fvol, floa
 
 	if( !pSource )
 	{
-		S_FreeChannel( ch );
+		S_CancelCommand( cmd );
 		return;
 	}
 
@@ -1208,7 +1566,11 @@ void S_AmbientSound( const vec3_t pos, int ent, sound_t handle, float fvol, floa
 	ch->ob_gain_target = 0.0;
 	ch->bTraced = false;
 
+	S_LockMixer();
 	SND_Spatialize( ch );
+	S_UnlockMixer();
+
+	S_SubmitCommand( cmd );
 }
 
 /*
@@ -1244,6 +1606,9 @@ int S_GetCurrentStaticSounds( soundlist_t *pout, int size )
 	if( !dma.initialized )
 		return 0;
 
+	S_LockMixer();
+	S_FlushCommands();
+
 	for( i = MAX_DYNAMIC_CHANNELS; i < total_channels && sounds_left; i++ )
 	{
 		if( channels[i].entchannel == CHAN_STATIC && channels[i].sfx && channels[i].sfx->name[0] )
@@ -1267,6 +1632,8 @@ int S_GetCurrentStaticSounds( soundlist_t *pout, int size )
 		}
 	}
 
+	S_UnlockMixer();
+
 	return ( size - sounds_left );
 }
 
@@ -1285,6 +1652,9 @@ int S_GetCurrentDynamicSounds( soundlist_t *pout, int size )
 	if( !dma.initialized )
 		return 0;
 
+	S_LockMixer();
+	S_FlushCommands();
+
 	for( i = 0; i < MAX_CHANNELS && sounds_left; i++ )
 	{
 		if( !channels[i].sfx || !channels[i].sfx->name[0] || !Q_stricmp( channels[i].sfx->name, "*default" ))
@@ -1313,6 +1683,8 @@ int S_GetCurrentDynamicSounds( soundlist_t *pout, int size )
 		pout++;
 	}
 
+	S_UnlockMixer();
+
 	return ( size - sounds_left );
 }
 
@@ -1397,6 +1769,7 @@ S_ClearBuffer
 */
 void S_ClearBuffer( void )
 {
+	S_LockMixer();
 	s_rawend = 0;
 
 	SNDDMA_BeginPainting ();
@@ -1404,6 +1777,7 @@ void S_ClearBuffer( void )
 	SNDDMA_Submit ();
 
 	MIX_ClearAllPaintBuffers( PAINTBUFFER_SIZE, true );
+	S_UnlockMixer();
 }
 
 /*
@@ -1419,7 +1793,9 @@ void GAME_EXPORT S_StopSound( int entnum, int channel, const char *soundname )
 
 	if( !dma.initialized ) return;
 	sfx = S_FindName( soundname, NULL );
-	S_AlterChannel( entnum, channel, sfx, 0, 0, SND_STOP );
+	if( !sfx ) return;
+
+	S_CancelCommand( S_AllocCommand( sfx, entnum, channel, 0, 0, SND_STOP ));
 }
 
 /*
@@ -1432,6 +1808,11 @@ void S_StopAllSounds( void )
 	int	i;
 
 	if( !dma.initialized ) return;
+
+	S_LockMixer();
+
+	// drop all pending commands
+	s_mixer.tail = s_mixer.head;
 	total_channels = MAX_DYNAMIC_CHANNELS;	// no statics
 
 	for( i = 0; i < MAX_CHANNELS; i++ ) 
@@ -1452,6 +1833,8 @@ void S_StopAllSounds( void )
 
 	// clear any remaining soundfade
 	Q_memset( &soundfade, 0, sizeof( soundfade ));
+
+	S_UnlockMixer();
 }
 
 //=============================================================================
@@ -1497,10 +1880,69 @@ Don't let sound skip if going slow
 */
 void S_ExtraUpdate( void )
 {
-	if( !dma.initialized ) return;
+	if( !dma.initialized || s_mixer.running )
+		return;
 	S_UpdateChannels ();
 }
 
+/*
+=================
+S_MixerThread
+
+keep painting while main thread is busy
+=================
+*/
+static void S_MixerThread( void *unused )
+{
+	while( s_mixer.running )
+	{
+		S_LockMixer();
+		S_FlushCommands();
+		S_UpdateChannels();
+		S_UnlockMixer();
+
+		Sys_Sleep( MIXER_THREAD_MSEC );
+	}
+}
+
+/*
+=================
+S_StartMixerThread
+=================
+*/
+static void S_StartMixerThread( void )
+{
+	if( s_mixer.thread ) return;
+
+	s_mixer.head = s_mixer.tail = 0;
+	s_mixer.running = true;
+	s_mixer.thread = Sys_CreateThread( S_MixerThread, NULL );
+
+	if( !s_mixer.thread )
+	{
+		MsgDev( D_NOTE, "S_StartMixerThread: threads are not available, mixing in main loop\n" );
+		s_mixer.running = false;
+	}
+}
+
+/*
+=================
+S_StopMixerThread
+
+main thread owns the channels again
+=================
+*/
+static void S_StopMixerThread( void )
+{
+	if( !s_mixer.thread ) return;
+
+	s_mixer.running = false;
+	Sys_JoinThread( s_mixer.thread );
+	s_mixer.thread = NULL;
+
+	S_FlushCommands();
+}
+
 /*
 ============
 S_RenderFrame
@@ -1517,17 +1959,38 @@ void S_RenderFrame( ref_params_t *fd )
 	if( !dma.initialized ) return;
 	if( !fd ) return; // too early
 
+	if( s_mixthread->modified )
+	{
+		if( s_mixthread->integer ) S_StartMixerThread();
+		else S_StopMixerThread();
+		s_mixthread->modified = false;
+	}
+
+	if( s_simd->modified )
+	{
+		MIX_SelectFuncs( s_simd->integer );
+		s_simd->modified = false;
+	}
+
 	// if the loading plaque is up, clear everything
 	// out to make sure we aren't looping a dirty
 	// dma buffer while loading
 	// update any client side sound fade
 	S_UpdateSoundFade();
 
+	S_LockMixer();
+	S_FlushCommands();
+
+	// all channels are settled, finish queued loads and trim decoded sounds
+	S_UpdateCache();
+
 	s_listener.entnum = fd->viewentity;	// can be camera entity too
 	s_listener.frametime = fd->frametime;
 	s_listener.waterlevel = fd->waterlevel;
 	s_listener.active = CL_IsInGame();
 	s_listener.inmenu = CL_IsInMenu();
+	s_listener.inconsole = ( cls.key_dest == key_console );
+	s_listener.background = cl.background;
 	s_listener.paused = fd->paused;
 
 	VectorCopy( fd->vieworg, s_listener.origin );
@@ -1537,6 +2000,9 @@ void S_RenderFrame( ref_params_t *fd )
 	// update general area ambient sound sources
 	S_UpdateAmbientSounds();
 
+	// new listener position, restart occlusion traces
+	SND_ChannelTraceReset();
+
 	combine = NULL;
 
 	// update spatialization for static and dynamic sounds	
@@ -1619,8 +2085,17 @@ void S_RenderFrame( ref_params_t *fd )
 	S_StreamBackgroundTrack ();
 	S_StreamSoundTrack ();
 
+	if( s_mixer.dropped )
+	{
+		MsgDev( D_NOTE, "^1Error: ^7dropped %i sound(s)\n", s_mixer.dropped );
+		s_mixer.dropped = 0;
+	}
+
+	S_UnlockMixer();
+
 	// mix some sound
-	S_UpdateChannels ();
+	if( !s_mixer.running )
+		S_UpdateChannels ();
 }
 
 /*
@@ -1782,6 +2257,12 @@ void S_SoundInfo_f( void )
 	Msg( "%5d bytes/sec\n", SOUND_DMA_SPEED );
 	Msg( "%5d total_channels\n", total_channels );
 
+	if( s_mixer.running )
+		Msg( "mixer thread: %i queued, %i overflows\n", s_mixer.head - s_mixer.tail, s_mixer.overflows );
+	else Msg( "mixer thread: off\n" );
+
+	Msg( "occlusion: %i traces, %i shared, %i PHS lookups last frame\n", trace_stats[0], trace_stats[1], trace_stats[2] );
+
 	S_PrintBackgroundTrackState ();
 }
 
@@ -1809,10 +2290,13 @@ qboolean S_Init( void )
 	s_refdb = Cvar_Get( "s_refdb", "60", 0, "soundlevel refernce dB" );
 	snd_gain = Cvar_Get( "snd_gain", "1", 0, "sound default gain" );
 	s_cull = Cvar_Get( "s_cull", "0", CVAR_ARCHIVE, "cull sounds by geometry" );
+	snd_cache_mb = Cvar_Get( "snd_cache_mb", "64", CVAR_ARCHIVE, "memory budget for decoded sounds in megabytes, 0 is unlimited" );
 	s_test = Cvar_Get( "s_test", "0", 0, "engine developer cvar for quick testing of new features" );
 	s_phs = Cvar_Get( "s_phs", "0", CVAR_ARCHIVE, "cull sounds by PHS" );
 	s_reverse_channels = Cvar_Get( "s_reverse_channels", "0", CVAR_ARCHIVE, "reverse left and right channels" );
 	s_samplecount = Cvar_Get( "s_samplecount", "0", CVAR_ARCHIVE, "sample count (0 for default value)" );
+	s_mixthread = Cvar_Get( "s_mixthread", "1", CVAR_ARCHIVE, "mix sound in a separate thread" );
+	s_simd = Cvar_Get( "s_simd", "1", CVAR_ARCHIVE, "use SSE2/NEON mixing kernels when available" );
 
 #if XASH_SOUND != SOUND_NULL
 	if( Sys_CheckParm( "-nosound" ))
@@ -1831,6 +2315,7 @@ qboolean S_Init( void )
 	Cmd_AddCommand( "-voicerecord", Cmd_Null_f, "stop voice recording (non-implemented)" );
 	Cmd_AddCommand( "spk", S_SayReliable_f, "reliable play of a specified sentence" );
 	Cmd_AddCommand( "speak", S_Say_f, "play a specified sentence" );
+	Cmd_AddCommand( "s_mixbench", S_MixBench_f, "compare SIMD mixer against scalar reference" );
 
 	if( !SNDDMA_Init( host.hWnd ))
 	{
@@ -1848,10 +2333,19 @@ qboolean S_Init( void )
 	MIX_InitAllPaintbuffers ();
 
 	S_InitScaletable ();
+	MIX_SelectFuncs( s_simd->integer );
+	s_simd->modified = false;
 	S_StopAllSounds ();
 	VOX_Init ();
 	AllocDsps ();
 
+	Q_memset( &s_mixer, 0, sizeof( s_mixer ));
+	s_mixer.lock = Sys_CreateMutex();
+
+	if( s_mixthread->integer )
+		S_StartMixerThread();
+	s_mixthread->modified = false;
+
 	return true;
 #else // XASH_SOUND != SOUND_NULL
 	MsgDev( D_INFO, "Audio: Not supported in this build\n" );
@@ -1876,7 +2370,10 @@ void S_Shutdown( void )
 	Cmd_RemoveCommand( "-voicerecord" );
 	Cmd_RemoveCommand( "spk" );
 	Cmd_RemoveCommand( "speak" );
+	Cmd_RemoveCommand( "s_mixbench" );
 
+	S_StopMixerThread ();
+	S_StopBackgroundTrack ();
 	S_StopAllSounds ();
 	S_FreeSounds ();
 	VOX_Shutdown ();
@@ -1886,5 +2383,8 @@ void S_Shutdown( void )
 	MIX_FreeAllPaintbuffers ();
 	Mem_FreePool( &sndpool );
 	dsp_room = NULL;
+
+	Sys_DestroyMutex( s_mixer.lock );
+	s_mixer.lock = NULL;
 }
 #endif // XASH_DEDICATED
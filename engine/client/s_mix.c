@@ -33,6 +33,8 @@ GNU General Public License for more details.
 #define SND_SCALE_SHIFT	(8 - SND_SCALE_BITS)
 #define SND_SCALE_LEVELS	(1U << SND_SCALE_BITS)
 
+#define MIX_GATHER_SIZE	256	// resampled frames per pass of the vectorized painters
+
 
 portable_samplepair_t	*g_curpaintbuffer;
 portable_samplepair_t	streambuffer[(PAINTBUFFER_SIZE+1)];
@@ -43,6 +45,7 @@ portable_samplepair_t	temppaintbuffer[(PAINTBUFFER_SIZE+1)];
 paintbuffer_t		paintbuffers[CPAINTBUFFERS];
 
 int			snd_scaletable[SND_SCALE_LEVELS][256];
+const mixfuncs_t		*mixfuncs = &mix_reference;
 
 
 void S_InitScaletable( void )
@@ -308,6 +311,51 @@ void S_PaintStereoFrom16( portable_samplepair_t *pbuf, int *volume, short *pData
 	}
 }
 
+/*
+===================
+S_PaintResampled
+
+gather pitch shifted frames into temp buffer and
+feed them to the painters, used with SIMD kernels only
+===================
+*/
+static void S_PaintResampled( portable_samplepair_t *pbuf, int *volume, void *pData, int width, int channels, uint sampleFrac, uint rateScale, int outCount )
+{
+	short	frames[MIX_GATHER_SIZE * 2];
+	int	framesize = width * channels;
+	byte	*in, *out, *src = (byte *)pData;
+	int	i, j, k, count, sampleIndex = 0;
+
+	for( i = 0; i < outCount; i += count )
+	{
+		count = min( outCount - i, MIX_GATHER_SIZE );
+		out = (byte *)frames;
+
+		for( j = 0; j < count; j++, out += framesize )
+		{
+			in = src + sampleIndex * framesize;
+
+			for( k = 0; k < framesize; k++ )
+				out[k] = in[k];
+
+			sampleFrac += rateScale;
+			sampleIndex += FIX_INTPART( sampleFrac );
+			sampleFrac = FIX_FRACPART( sampleFrac );
+		}
+
+		if( width == 1 )
+		{
+			if( channels == 1 ) mixfuncs->PaintMonoFrom8( pbuf + i, volume, (byte *)frames, count );
+			else mixfuncs->PaintStereoFrom8( pbuf + i, volume, (byte *)frames, count );
+		}
+		else
+		{
+			if( channels == 1 ) mixfuncs->PaintMonoFrom16( pbuf + i, volume, frames, count );
+			else mixfuncs->PaintStereoFrom16( pbuf + i, volume, frames, count );
+		}
+	}
+}
+
 void S_Mix8Mono( portable_samplepair_t *pbuf, int *volume, byte *pData, int inputOffset, uint rateScale, int outCount )
 {
 	int	i, sampleIndex = 0;
@@ -317,7 +365,13 @@ void S_Mix8Mono( portable_samplepair_t *pbuf, int *volume, byte *pData, int inpu
 	// Not using pitch shift?
 	if( rateScale == FIX( 1 ))
 	{
-		S_PaintMonoFrom8( pbuf, volume, pData, outCount );
+		mixfuncs->PaintMonoFrom8( pbuf, volume, pData, outCount );
+		return;
+	}
+
+	if( mixfuncs != &mix_reference )
+	{
+		S_PaintResampled( pbuf, volume, pData, 1, 1, inputOffset, rateScale, outCount );
 		return;
 	}
 
@@ -343,7 +397,13 @@ void S_Mix8Stereo( portable_samplepair_t *pbuf, int *volume, byte *pData, int in
 	// Not using pitch shift?
 	if( rateScale == FIX( 1 ))
 	{
-		S_PaintStereoFrom8( pbuf, volume, pData, outCount );
+		mixfuncs->PaintStereoFrom8( pbuf, volume, pData, outCount );
+		return;
+	}
+
+	if( mixfuncs != &mix_reference )
+	{
+		S_PaintResampled( pbuf, volume, pData, 1, 2, inputOffset, rateScale, outCount );
 		return;
 	}
 
@@ -368,7 +428,13 @@ void S_Mix16Mono( portable_samplepair_t *pbuf, int *volume, short *pData, int in
 	// Not using pitch shift?
 	if( rateScale == FIX( 1 ))
 	{
-		S_PaintMonoFrom16( pbuf, volume, pData, outCount );
+		mixfuncs->PaintMonoFrom16( pbuf, volume, pData, outCount );
+		return;
+	}
+
+	if( mixfuncs != &mix_reference )
+	{
+		S_PaintResampled( pbuf, volume, pData, 2, 1, inputOffset, rateScale, outCount );
 		return;
 	}
 
@@ -390,7 +456,13 @@ void S_Mix16Stereo( portable_samplepair_t *pbuf, int *volume, short *pData, int
 	// Not using pitch shift?
 	if( rateScale == FIX( 1 ))
 	{
-		S_PaintStereoFrom16( pbuf, volume, pData, outCount );
+		mixfuncs->PaintStereoFrom16( pbuf, volume, pData, outCount );
+		return;
+	}
+
+	if( mixfuncs != &mix_reference )
+	{
+		S_PaintResampled( pbuf, volume, pData, 2, 2, inputOffset, rateScale, outCount );
 		return;
 	}
 
@@ -575,9 +647,9 @@ void MIX_MixChannelsToPaintbuffer( int endtime, int rate, int outputRate )
 		if( !ch->sfx ) continue;
 
 		// NOTE: background map is allow both type sounds: menu and game
-		if( !cl.background )
+		if( !s_listener.background )
 		{
-			if( cls.key_dest == key_console && ch->localsound )
+			if( s_listener.inconsole && ch->localsound )
 			{
 				// play, playvol
 			}
@@ -592,10 +664,10 @@ void MIX_MixChannelsToPaintbuffer( int endtime, int rate, int outputRate )
 				continue;
 			}
 		}
-		else if( cls.key_dest == key_console )
+		else if( s_listener.inconsole )
 			continue;	// silent mode in console
 
-		pSource = S_LoadSound( ch->sfx );
+		pSource = S_MixerLoadSound( ch->sfx );
 
 		// Don't mix sound data for sounds with zero volume. If it's a non-looping sound, 
 		// just remove the sound when its volume goes to zero.
@@ -816,7 +888,7 @@ void S_MixBufferUpsample2x( int count, portable_samplepair_t *pbuffer, portable_
 	switch( filtertype )
 	{
 	case FILTERTYPE_LINEAR:
-		S_Interpolate2xLinear( pbuffer, pfiltermem, cfltmem, count );
+		mixfuncs->Interpolate2xLinear( pbuffer, pfiltermem, cfltmem, count );
 		break;
 	case FILTERTYPE_CUBIC:
 		S_Interpolate2xCubic( pbuffer, pfiltermem, cfltmem, count );
@@ -886,15 +958,10 @@ void MIX_MixPaintbuffers( int ibuf1, int ibuf2, int ibuf3, int count, float fgai
 	}
 }
 
-void MIX_CompressPaintbuffer( int ipaint, int count )
+void S_ClipSamples( portable_samplepair_t *pbuf, int count )
 {
-	portable_samplepair_t	*pbuf;
-	paintbuffer_t		*ppaint;
-	int			i;
+	int	i;
 
-	ppaint = MIX_GetPPaintFromIPaint( ipaint );
-	pbuf = ppaint->pbuf;
-	
 	for( i = 0; i < count; i++, pbuf++ )
 	{
 		pbuf->left = CLIP( pbuf->left );
@@ -902,6 +969,48 @@ void MIX_CompressPaintbuffer( int ipaint, int count )
 	}
 }
 
+void MIX_CompressPaintbuffer( int ipaint, int count )
+{
+	paintbuffer_t	*ppaint;
+
+	ppaint = MIX_GetPPaintFromIPaint( ipaint );
+	mixfuncs->ClipSamples( ppaint->pbuf, count );
+}
+
+// scalar reference, all the SIMD variants must produce bit-exact output
+const mixfuncs_t mix_reference =
+{
+	"scalar",
+	S_PaintMonoFrom8,
+	S_PaintStereoFrom8,
+	S_PaintMonoFrom16,
+	S_PaintStereoFrom16,
+	S_Interpolate2xLinear,
+	S_ClipSamples,
+	DLY_DelayBlock,
+	RVB_ReverbBlock,
+	RVB_ReverbMix,
+};
+
+/*
+===================
+MIX_SelectFuncs
+
+pick the mixing kernels at runtime
+===================
+*/
+void MIX_SelectFuncs( qboolean simd )
+{
+	const mixfuncs_t	*funcs = NULL;
+
+	if( simd ) funcs = MIX_GetSIMDFuncs();
+	if( !funcs ) funcs = &mix_reference;
+
+	if( funcs != mixfuncs )
+		MsgDev( D_INFO, "Audio: using %s mixer\n", funcs->name );
+	mixfuncs = funcs;
+}
+
 void S_MixUpsample( int sampleCount, int filtertype )
 {
 	paintbuffer_t	*ppaint = MIX_GetCurrentPaintbufferPtr();
@@ -988,8 +1097,36 @@ void MIX_MixStreamBuffer( int end )
 // IROOMBUFFER, IFACINGBUFFER, IFACINGAWAY, IDRYBUFFER
 // dsp fx are then applied to these buffers by the caller.
 // caller also remixes all into final IPAINTBUFFER output.
+
+// rate pass does nothing if no channel plays a sound at that rate,
+// which is the usual case when sounds are resampled at load time.
+// Unloaded sounds may turn out to be any rate, so keep the pass for them.
+// Filter memory from previous pass must run out too
+static qboolean MIX_NeedRatePass( int rate, int ifilter )
+{
+	portable_samplepair_t	*fltmem = paintbuffers[IROOMBUFFER].fltmem[ifilter];
+	channel_t			*ch;
+	int			i;
+
+	for( i = 0, ch = channels; i < total_channels; i++, ch++ )
+	{
+		if( ch->sfx && ( !ch->sfx->cache || ch->sfx->cache->rate == rate ))
+			return true;
+	}
+
+	for( i = 0; i < CPAINTFILTERMEM; i++ )
+	{
+		if( fltmem[i].left || fltmem[i].right )
+			return true;
+	}
+
+	return false;
+}
+
 void MIX_UpsampleAllPaintbuffers( int end, int count )
 {
+	qboolean	need11k, need22k;
+
 	// process stream buffer
 	MIX_MixStreamBuffer( end );
 
@@ -1010,23 +1147,34 @@ void MIX_UpsampleAllPaintbuffers( int end, int count )
 	// only mix to roombuffer if dsp fx are on KDB: perf
 	MIX_ActivatePaintbuffer( IROOMBUFFER );	// operates on MIX_MixChannelsToPaintbuffer
 
-	// mix 11khz sounds: 
-	MIX_MixChannelsToPaintbuffer( end, SOUND_11k, SOUND_11k );
+	// 11khz data goes through both upsample passes
+	need11k = MIX_NeedRatePass( SOUND_11k, 0 );
+	need22k = need11k || MIX_NeedRatePass( SOUND_22k, 1 );
 
-	// upsample all 11khz buffers by 2x
-	// only upsample roombuffer if dsp fx are on KDB: perf
-	MIX_SetCurrentPaintbuffer( IROOMBUFFER ); // operates on MixUpSample
-	S_MixUpsample( count / (SOUND_DMA_SPEED / SOUND_11k), s_lerping->integer );
+	if( need11k )
+	{
+		// mix 11khz sounds: 
+		MIX_MixChannelsToPaintbuffer( end, SOUND_11k, SOUND_11k );
 
-	// mix 22khz sounds: 
-	MIX_MixChannelsToPaintbuffer( end, SOUND_22k, SOUND_22k );
+		// upsample all 11khz buffers by 2x
+		// only upsample roombuffer if dsp fx are on KDB: perf
+		MIX_SetCurrentPaintbuffer( IROOMBUFFER ); // operates on MixUpSample
+		S_MixUpsample( count / (SOUND_DMA_SPEED / SOUND_11k), s_lerping->integer );
+	}
+	else paintbuffers[IROOMBUFFER].ifilter++; // 22khz pass keeps its own filter memory
+
+	if( need22k )
+	{
+		// mix 22khz sounds: 
+		MIX_MixChannelsToPaintbuffer( end, SOUND_22k, SOUND_22k );
 	
-	// upsample all 22khz buffers by 2x
+		// upsample all 22khz buffers by 2x
 #if (SOUND_DMA_SPEED > SOUND_22k)
-	// only upsample roombuffer if dsp fx are on KDB: perf
-	MIX_SetCurrentPaintbuffer( IROOMBUFFER );
-	S_MixUpsample( count / ( SOUND_DMA_SPEED / SOUND_22k ), s_lerping->integer );
+		// only upsample roombuffer if dsp fx are on KDB: perf
+		MIX_SetCurrentPaintbuffer( IROOMBUFFER );
+		S_MixUpsample( count / ( SOUND_DMA_SPEED / SOUND_22k ), s_lerping->integer );
 #endif
+	}
 	// mix all 44khz sounds to all active paintbuffers
 	MIX_MixChannelsToPaintbuffer( end, SOUND_44k, SOUND_DMA_SPEED );
 
@@ -1075,4 +1223,141 @@ void MIX_PaintChannels( int endtime )
 		paintedtime = end;
 	}
 }
+
+/*
+===============================================================================
+
+MIXER BENCHMARK
+
+===============================================================================
+*/
+#define MIXBENCH_PASSES	64
+
+typedef struct
+{
+	byte	*data;
+	int	width;
+	int	channels;
+	int	volume[CCHANVOLUMES];
+	uint	rateScale;
+	uint	inputOffset;
+} mixbenchchan_t;
+
+/*
+===================
+S_MixBenchPass
+
+paint all the channels, upsample and clip like the real mixer does
+===================
+*/
+static void S_MixBenchPass( const mixfuncs_t *funcs, mixbenchchan_t *chans, int numchans, portable_samplepair_t *out )
+{
+	portable_samplepair_t	fltmem = { 1234, -1234 };
+	int			i, count = PAINTBUFFER_SIZE / 2;
+	mixbenchchan_t		*ch;
+
+	mixfuncs = funcs;
+	Q_memset( out, 0, PAINTBUFFER_SIZE * sizeof( portable_samplepair_t ));
+
+	for( i = 0, ch = chans; i < numchans; i++, ch++ )
+	{
+		if( ch->channels == 1 )
+		{
+			if( ch->width == 1 )
+				S_Mix8Mono( out, ch->volume, ch->data, ch->inputOffset, ch->rateScale, count );
+			else S_Mix16Mono( out, ch->volume, (short *)ch->data, ch->inputOffset, ch->rateScale, count );
+		}
+		else
+		{
+			if( ch->width == 1 )
+				S_Mix8Stereo( out, ch->volume, ch->data, ch->inputOffset, ch->rateScale, count );
+			else S_Mix16Stereo( out, ch->volume, (short *)ch->data, ch->inputOffset, ch->rateScale, count );
+		}
+	}
+
+	// NOTE: buffer is not doubled here, but kernels doesn't care
+	funcs->Interpolate2xLinear( out, &fltmem, 1, count );
+	funcs->ClipSamples( out, PAINTBUFFER_SIZE );
+}
+
+/*
+===================
+S_MixBench_f
+
+compare SIMD mixer against scalar reference on synthetic channels
+===================
+*/
+void S_MixBench_f( void )
+{
+	const mixfuncs_t		*simd = MIX_GetSIMDFuncs();
+	const mixfuncs_t		*saved = mixfuncs;
+	portable_samplepair_t	*ref, *test;
+	double			start, reftime, simdtime = 0.0;
+	int			i, j, numchans, datasize;
+	mixbenchchan_t		*chans;
+	byte			*pool;
+
+	numchans = ( Cmd_Argc() > 1 ) ? Q_atoi( Cmd_Argv( 1 )) : MAX_CHANNELS;
+	numchans = bound( 1, numchans, 1024 );
+
+	// pitch shift may read up to 2x frames
+	datasize = ( PAINTBUFFER_SIZE + 4 ) * 4;
+	pool = Mem_AllocPool( "Mixer Bench" );
+	chans = Mem_Alloc( pool, numchans * sizeof( mixbenchchan_t ));
+	ref = Mem_Alloc( pool, ( PAINTBUFFER_SIZE + 1 ) * sizeof( portable_samplepair_t ));
+	test = Mem_Alloc( pool, ( PAINTBUFFER_SIZE + 1 ) * sizeof( portable_samplepair_t ));
+
+	for( i = 0; i < numchans; i++ )
+	{
+		mixbenchchan_t	*ch = &chans[i];
+
+		ch->data = Mem_Alloc( pool, datasize );
+		for( j = 0; j < datasize; j++ )
+			ch->data[j] = Com_RandomLong( 0, 255 );
+
+		ch->width = ( i & 1 ) ? 2 : 1;
+		ch->channels = ( i & 2 ) ? 2 : 1;
+		ch->volume[0] = Com_RandomLong( 0, 255 );
+		ch->volume[1] = Com_RandomLong( 0, 255 );
+
+		// every other pair of channels is pitch shifted
+		if( i & 4 ) ch->rateScale = Com_RandomLong( FIX( 1 ) / 2, FIX( 2 ) - 1 );
+		else ch->rateScale = FIX( 1 );
+		ch->inputOffset = Com_RandomLong( 0, FIX_MASK );
+	}
+
+	// mixer thread is using the kernels too
+	S_LockMixer();
+
+	start = Sys_DoubleTime();
+	for( i = 0; i < MIXBENCH_PASSES; i++ )
+		S_MixBenchPass( &mix_reference, chans, numchans, ref );
+	reftime = Sys_DoubleTime() - start;
+
+	if( simd )
+	{
+		start = Sys_DoubleTime();
+		for( i = 0; i < MIXBENCH_PASSES; i++ )
+			S_MixBenchPass( simd, chans, numchans, test );
+		simdtime = Sys_DoubleTime() - start;
+	}
+
+	mixfuncs = saved;
+	S_UnlockMixer();
+
+	Msg( "%i channels, %i samples per pass\n", numchans, PAINTBUFFER_SIZE / 2 );
+	Msg( "%s: %.3f ms per pass\n", mix_reference.name, reftime * 1000.0 / MIXBENCH_PASSES );
+
+	if( simd )
+	{
+		Msg( "%s: %.3f ms per pass (%.2fx)\n", simd->name, simdtime * 1000.0 / MIXBENCH_PASSES, reftime / max( simdtime, 0.000001 ));
+
+		if( !memcmp( ref, test, PAINTBUFFER_SIZE * sizeof( portable_samplepair_t )))
+			Msg( "output is bit-exact\n" );
+		else Msg( "^1output mismatch!\n" );
+	}
+	else Msg( "SIMD mixer is not available\n" );
+
+	Mem_FreePool( &pool );
+}
 #endif // XASH_DEDICATED
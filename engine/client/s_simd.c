@@ -0,0 +1,723 @@
+/*
+s_simd.c - vectorized inner mixing and dsp loops
+Copyright (C) 2018 FWGS
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+*/
+
+#ifndef XASH_DEDICATED
+
+#include "common.h"
+#include "sound.h"
+
+// NOTE: every kernel here must give bit-exact output against scalar
+// reference in s_mix.c and s_dsp.c, use s_mixbench and dsp_bench
+// to verify after changes.
+// 8-bit painters don't need snd_scaletable: entry [vol >> 1][x] is
+// exactly (signed char)x * ( vol & ~1 ), which fits in 16 bits
+
+#if defined __i386__ && defined __GNUC__ && !defined __SSE2__
+// x86 builds don't assume SSE2, compile kernels for it and check CPU at runtime
+#define XASH_MIX_SSE2
+#define XASH_MIX_SSE2_CPUID
+#elif defined __SSE2__ || defined _M_X64 || ( defined _M_IX86_FP && _M_IX86_FP >= 2 )
+#define XASH_MIX_SSE2
+#elif defined __ARM_NEON || defined __ARM_NEON__
+#define XASH_MIX_NEON
+#endif
+
+#if defined XASH_MIX_SSE2
+#ifdef XASH_MIX_SSE2_CPUID
+#pragma GCC push_options
+#pragma GCC target( "sse2" )
+#endif
+#include <emmintrin.h>
+
+/*
+===============================================================================
+
+SSE2 KERNELS
+
+===============================================================================
+*/
+// accumulate eight 16-bit products as 32-bit values into four stereo pairs
+_inline void S_Accumulate16_SSE2( portable_samplepair_t *pbuf, __m128i lo, __m128i hi, int shift )
+{
+	__m128i	*out = (__m128i *)pbuf;
+	__m128i	p0 = _mm_unpacklo_epi16( lo, hi );
+	__m128i	p1 = _mm_unpackhi_epi16( lo, hi );
+
+	if( shift )
+	{
+		p0 = _mm_srai_epi32( p0, 8 );
+		p1 = _mm_srai_epi32( p1, 8 );
+	}
+	else
+	{
+		// products already fit in 16 bits, just sign extend them
+		p0 = _mm_srai_epi32( p0, 16 );
+		p1 = _mm_srai_epi32( p1, 16 );
+	}
+
+	_mm_storeu_si128( out + 0, _mm_add_epi32( _mm_loadu_si128( out + 0 ), p0 ));
+	_mm_storeu_si128( out + 1, _mm_add_epi32( _mm_loadu_si128( out + 1 ), p1 ));
+}
+
+static void S_PaintMonoFrom8_SSE2( portable_samplepair_t *pbuf, int *volume, byte *pData, int outCount )
+{
+	__m128i	vol = _mm_set_epi16( volume[1] & ~1, volume[0] & ~1, volume[1] & ~1, volume[0] & ~1,
+		volume[1] & ~1, volume[0] & ~1, volume[1] & ~1, volume[0] & ~1 );
+	__m128i	zero = _mm_setzero_si128();
+	int	i;
+
+	for( i = 0; i + 8 <= outCount; i += 8 )
+	{
+		__m128i	s = _mm_loadl_epi64( (const __m128i *)( pData + i ));
+		__m128i	d0, d1;
+
+		s = _mm_srai_epi16( _mm_unpacklo_epi8( zero, s ), 8 );
+		d0 = _mm_mullo_epi16( _mm_unpacklo_epi16( s, s ), vol );
+		d1 = _mm_mullo_epi16( _mm_unpackhi_epi16( s, s ), vol );
+		S_Accumulate16_SSE2( pbuf + i + 0, d0, d0, false );
+		S_Accumulate16_SSE2( pbuf + i + 4, d1, d1, false );
+	}
+
+	if( i < outCount )
+		mix_reference.PaintMonoFrom8( pbuf + i, volume, pData + i, outCount - i );
+}
+
+static void S_PaintStereoFrom8_SSE2( portable_samplepair_t *pbuf, int *volume, byte *pData, int outCount )
+{
+	__m128i	vol = _mm_set_epi16( volume[1] & ~1, volume[0] & ~1, volume[1] & ~1, volume[0] & ~1,
+		volume[1] & ~1, volume[0] & ~1, volume[1] & ~1, volume[0] & ~1 );
+	__m128i	zero = _mm_setzero_si128();
+	int	i;
+
+	for( i = 0; i + 8 <= outCount; i += 8 )
+	{
+		__m128i	s = _mm_loadu_si128( (const __m128i *)( pData + i * 2 ));
+		__m128i	d0 = _mm_srai_epi16( _mm_unpacklo_epi8( zero, s ), 8 );
+		__m128i	d1 = _mm_srai_epi16( _mm_unpackhi_epi8( zero, s ), 8 );
+
+		d0 = _mm_mullo_epi16( d0, vol );
+		d1 = _mm_mullo_epi16( d1, vol );
+		S_Accumulate16_SSE2( pbuf + i + 0, d0, d0, false );
+		S_Accumulate16_SSE2( pbuf + i + 4, d1, d1, false );
+	}
+
+	if( i < outCount )
+		mix_reference.PaintStereoFrom8( pbuf + i, volume, pData + i * 2, outCount - i );
+}
+
+static void S_PaintMonoFrom16_SSE2( portable_samplepair_t *pbuf, int *volume, short *pData, int outCount )
+{
+	__m128i	vol = _mm_set_epi16( volume[1], volume[0], volume[1], volume[0], volume[1], volume[0], volume[1], volume[0] );
+	int	i;
+
+	for( i = 0; i + 8 <= outCount; i += 8 )
+	{
+		__m128i	s = _mm_loadu_si128( (const __m128i *)( pData + i ));
+		__m128i	d0 = _mm_unpacklo_epi16( s, s );
+		__m128i	d1 = _mm_unpackhi_epi16( s, s );
+
+		S_Accumulate16_SSE2( pbuf + i + 0, _mm_mullo_epi16( d0, vol ), _mm_mulhi_epi16( d0, vol ), true );
+		S_Accumulate16_SSE2( pbuf + i + 4, _mm_mullo_epi16( d1, vol ), _mm_mulhi_epi16( d1, vol ), true );
+	}
+
+	if( i < outCount )
+		mix_reference.PaintMonoFrom16( pbuf + i, volume, pData + i, outCount - i );
+}
+
+static void S_PaintStereoFrom16_SSE2( portable_samplepair_t *pbuf, int *volume, short *pData, int outCount )
+{
+	__m128i	vol = _mm_set_epi16( volume[1], volume[0], volume[1], volume[0], volume[1], volume[0], volume[1], volume[0] );
+	int	i;
+
+	for( i = 0; i + 4 <= outCount; i += 4 )
+	{
+		__m128i	s = _mm_loadu_si128( (const __m128i *)( pData + i * 2 ));
+
+		S_Accumulate16_SSE2( pbuf + i, _mm_mullo_epi16( s, vol ), _mm_mulhi_epi16( s, vol ), true );
+	}
+
+	if( i < outCount )
+		mix_reference.PaintStereoFrom16( pbuf + i, volume, pData + i * 2, outCount - i );
+}
+
+static void S_Interpolate2xLinear_SSE2( portable_samplepair_t *pbuffer, portable_samplepair_t *pfiltermem, int cfltmem, int count )
+{
+	int	i, upCount = count << 1;
+
+	ASSERT( upCount <= PAINTBUFFER_SIZE );
+	ASSERT( cfltmem >= 1 );
+
+	// use interpolation value from previous mix
+	pbuffer[0].left = (pfiltermem->left + pbuffer[0].left) >> 1;
+	pbuffer[0].right = (pfiltermem->right + pbuffer[0].right) >> 1;
+
+	// two even slots per pass, each one averaged with preceding odd slot
+	for( i = 2; i + 2 < upCount; i += 4 )
+	{
+		__m128i	a = _mm_loadu_si128( (const __m128i *)&pbuffer[i - 1] );
+		__m128i	b = _mm_loadu_si128( (const __m128i *)&pbuffer[i + 1] );
+		__m128i	odd = _mm_unpacklo_epi64( a, b );
+		__m128i	even = _mm_unpackhi_epi64( a, b );
+		__m128i	res = _mm_srai_epi32( _mm_add_epi32( odd, even ), 1 );
+
+		_mm_storel_epi64( (__m128i *)&pbuffer[i + 0], res );
+		_mm_storel_epi64( (__m128i *)&pbuffer[i + 2], _mm_unpackhi_epi64( res, res ));
+	}
+
+	for( ; i < upCount; i += 2 )
+	{
+		pbuffer[i].left = (pbuffer[i].left + pbuffer[i-1].left) >> 1;
+		pbuffer[i].right = (pbuffer[i].right + pbuffer[i-1].right) >> 1;
+	}
+
+	// save last value to be played out in buffer
+	*pfiltermem = pbuffer[upCount - 1];
+}
+
+static void S_ClipSamples_SSE2( portable_samplepair_t *pbuf, int count )
+{
+	__m128i	hi = _mm_set1_epi32( 32760 );
+	__m128i	lo = _mm_set1_epi32( -32760 );
+	int	i;
+
+	// SSE2 has no 32-bit min/max, select by compare masks
+	for( i = 0; i + 2 <= count; i += 2 )
+	{
+		__m128i	*p = (__m128i *)( pbuf + i );
+		__m128i	x = _mm_loadu_si128( p );
+		__m128i	m = _mm_cmpgt_epi32( x, hi );
+
+		x = _mm_or_si128( _mm_and_si128( m, hi ), _mm_andnot_si128( m, x ));
+		m = _mm_cmplt_epi32( x, lo );
+		x = _mm_or_si128( _mm_and_si128( m, lo ), _mm_andnot_si128( m, x ));
+		_mm_storeu_si128( p, x );
+	}
+
+	if( i < count )
+		mix_reference.ClipSamples( pbuf + i, count - i );
+}
+
+// 32-bit clip to CLIP() range, SSE2 has no 32-bit min/max
+_inline __m128i S_Clip32_SSE2( __m128i x )
+{
+	__m128i	hi = _mm_set1_epi32( 32760 );
+	__m128i	lo = _mm_set1_epi32( -32760 );
+	__m128i	m = _mm_cmpgt_epi32( x, hi );
+
+	x = _mm_or_si128( _mm_and_si128( m, hi ), _mm_andnot_si128( m, x ));
+	m = _mm_cmplt_epi32( x, lo );
+	return _mm_or_si128( _mm_and_si128( m, lo ), _mm_andnot_si128( m, x ));
+}
+
+// low 32 bits of 32x32 product, same for signed and unsigned
+_inline __m128i S_MulLo32_SSE2( __m128i a, __m128i b )
+{
+	__m128i	even = _mm_mul_epu32( a, b );
+	__m128i	odd = _mm_mul_epu32( _mm_srli_si128( a, 4 ), _mm_srli_si128( b, 4 ));
+
+	return _mm_unpacklo_epi32( _mm_shuffle_epi32( even, _MM_SHUFFLE( 0, 0, 2, 0 )),
+		_mm_shuffle_epi32( odd, _MM_SHUFFLE( 0, 0, 2, 0 )));
+}
+
+// split four stereo pairs into left and right vectors
+_inline void S_LoadPairs_SSE2( const portable_samplepair_t *paint, __m128i *l, __m128i *r )
+{
+	__m128	p0 = _mm_castsi128_ps( _mm_loadu_si128( (const __m128i *)paint + 0 ));
+	__m128	p1 = _mm_castsi128_ps( _mm_loadu_si128( (const __m128i *)paint + 1 ));
+
+	*l = _mm_castps_si128( _mm_shuffle_ps( p0, p1, _MM_SHUFFLE( 2, 0, 2, 0 )));
+	*r = _mm_castps_si128( _mm_shuffle_ps( p0, p1, _MM_SHUFFLE( 3, 1, 3, 1 )));
+}
+
+// samples where delay line, left and right are all zero
+_inline __m128i S_SilentMask_SSE2( __m128i d, __m128i l, __m128i r )
+{
+	__m128i	zero = _mm_setzero_si128();
+
+	return _mm_and_si128( _mm_cmpeq_epi32( d, zero ),
+		_mm_and_si128( _mm_cmpeq_epi32( l, zero ), _mm_cmpeq_epi32( r, zero )));
+}
+
+static void S_DelayBlock_SSE2( portable_samplepair_t *paint, const int *rd, int *wr, int count, int feedback, int lp, int *plp0, int *plp1 )
+{
+	__m128i	fb = _mm_set1_epi32( feedback );
+	__m128i	first = _mm_cvtsi32_si128( -1 );
+	int	lp0 = *plp0, lp1 = *plp1;
+	int	i;
+
+	for( i = 0; i + 4 <= count; i += 4 )
+	{
+		__m128i	*p = (__m128i *)( paint + i );
+		__m128i	l, r, d, silent, val, out;
+
+		S_LoadPairs_SSE2( paint + i, &l, &r );
+		d = _mm_loadu_si128( (const __m128i *)( rd + i ));
+		silent = S_SilentMask_SSE2( d, l, r );
+
+		val = _mm_add_epi32( _mm_srai_epi32( _mm_add_epi32( l, r ), 1 ),
+			_mm_srai_epi32( S_MulLo32_SSE2( fb, d ), 8 ));
+		val = S_Clip32_SSE2( val );
+
+		if( lp )
+		{
+			// silent sample resets history, so older value is kept only after an active one
+			__m128i	h1 = _mm_or_si128( _mm_slli_si128( val, 4 ), _mm_cvtsi32_si128( lp1 ));
+			__m128i	h0 = _mm_or_si128( _mm_slli_si128( val, 8 ), _mm_set_epi32( 0, 0, lp1, lp0 ));
+			__m128i	keep = _mm_or_si128( _mm_slli_si128( _mm_xor_si128( silent, _mm_set1_epi32( -1 )), 4 ), first );
+
+			h0 = _mm_and_si128( h0, keep );
+			out = _mm_srai_epi32( _mm_add_epi32( _mm_add_epi32( h0, h1 ), _mm_slli_epi32( val, 1 )), 2 );
+
+			lp1 = _mm_cvtsi128_si32( _mm_shuffle_epi32( val, _MM_SHUFFLE( 3, 3, 3, 3 )));
+			if( _mm_movemask_ps( _mm_castsi128_ps( silent )) & 8 )
+				lp0 = 0;
+			else lp0 = _mm_cvtsi128_si32( _mm_shuffle_epi32( val, _MM_SHUFFLE( 2, 2, 2, 2 )));
+		}
+		else
+		{
+			out = val;
+			if( _mm_movemask_ps( _mm_castsi128_ps( silent )))
+				lp0 = lp1 = 0;
+		}
+
+		out = _mm_andnot_si128( silent, out );
+		_mm_storeu_si128( (__m128i *)( wr + i ), out );
+
+		// silent samples are zero anyway, so they can be painted too
+		out = _mm_srai_epi32( out, 2 );
+		l = S_Clip32_SSE2( _mm_add_epi32( l, out ));
+		r = S_Clip32_SSE2( _mm_add_epi32( r, out ));
+		_mm_storeu_si128( p + 0, _mm_unpacklo_epi32( l, r ));
+		_mm_storeu_si128( p + 1, _mm_unpackhi_epi32( l, r ));
+	}
+
+	if( i < count )
+		mix_reference.DelayBlock( paint + i, rd + i, wr + i, count - i, feedback, lp, &lp0, &lp1 );
+
+	*plp0 = lp0;
+	*plp1 = lp1;
+}
+
+static void S_ReverbBlock_SSE2( int *acc, const portable_samplepair_t *paint, const int *rd, int *wr, int count, int feedback, int lp, int *plp0 )
+{
+	__m128i	fb = _mm_set1_epi32( feedback );
+	__m128i	zero = _mm_setzero_si128();
+	int	lp0 = *plp0;
+	int	i;
+
+	for( i = 0; i + 4 <= count; i += 4 )
+	{
+		__m128i	*a = (__m128i *)( acc + i );
+		__m128i	l, r, d, silent, nodelay, val, out;
+
+		S_LoadPairs_SSE2( paint + i, &l, &r );
+		d = _mm_loadu_si128( (const __m128i *)( rd + i ));
+		silent = S_SilentMask_SSE2( d, l, r );
+		nodelay = _mm_cmpeq_epi32( d, zero );
+
+		// feedback is clipped only if delay line has something
+		val = _mm_add_epi32( _mm_srai_epi32( _mm_add_epi32( l, r ), 1 ),
+			_mm_srai_epi32( S_MulLo32_SSE2( fb, d ), 8 ));
+		val = _mm_or_si128( _mm_and_si128( nodelay, val ), _mm_andnot_si128( nodelay, S_Clip32_SSE2( val )));
+
+		if( lp )
+		{
+			__m128i	prev = _mm_or_si128( _mm_slli_si128( val, 4 ), _mm_cvtsi32_si128( lp0 ));
+
+			out = _mm_srai_epi32( _mm_add_epi32( prev, val ), 1 );
+			lp0 = _mm_cvtsi128_si32( _mm_shuffle_epi32( val, _MM_SHUFFLE( 3, 3, 3, 3 )));
+		}
+		else
+		{
+			out = val;
+			if( _mm_movemask_ps( _mm_castsi128_ps( silent )))
+				lp0 = 0;
+		}
+
+		out = _mm_andnot_si128( silent, out );
+		_mm_storeu_si128( (__m128i *)( wr + i ), out );
+		_mm_storeu_si128( a, _mm_add_epi32( _mm_loadu_si128( a ), out ));
+	}
+
+	if( i < count )
+		mix_reference.ReverbBlock( acc + i, paint + i, rd + i, wr + i, count - i, feedback, lp, &lp0 );
+
+	*plp0 = lp0;
+}
+
+static void S_ReverbMix_SSE2( portable_samplepair_t *paint, const int *acc, int count )
+{
+	int	i;
+
+	for( i = 0; i + 4 <= count; i += 4 )
+	{
+		__m128i	*p = (__m128i *)( paint + i );
+		__m128i	v = _mm_loadu_si128( (const __m128i *)( acc + i ));
+
+		// 11 * v >> 6
+		v = _mm_add_epi32( _mm_add_epi32( _mm_slli_epi32( v, 3 ), _mm_slli_epi32( v, 1 )), v );
+		v = _mm_srai_epi32( v, 6 );
+
+		_mm_storeu_si128( p + 0, S_Clip32_SSE2( _mm_add_epi32( _mm_loadu_si128( p + 0 ), _mm_unpacklo_epi32( v, v ))));
+		_mm_storeu_si128( p + 1, S_Clip32_SSE2( _mm_add_epi32( _mm_loadu_si128( p + 1 ), _mm_unpackhi_epi32( v, v ))));
+	}
+
+	if( i < count )
+		mix_reference.ReverbMix( paint + i, acc + i, count - i );
+}
+
+static const mixfuncs_t mix_sse2 =
+{
+	"SSE2",
+	S_PaintMonoFrom8_SSE2,
+	S_PaintStereoFrom8_SSE2,
+	S_PaintMonoFrom16_SSE2,
+	S_PaintStereoFrom16_SSE2,
+	S_Interpolate2xLinear_SSE2,
+	S_ClipSamples_SSE2,
+	S_DelayBlock_SSE2,
+	S_ReverbBlock_SSE2,
+	S_ReverbMix_SSE2,
+};
+
+#ifdef XASH_MIX_SSE2_CPUID
+#pragma GCC pop_options
+#endif
+
+#elif defined XASH_MIX_NEON
+#include <arm_neon.h>
+
+/*
+===============================================================================
+
+NEON KERNELS
+
+===============================================================================
+*/
+// widen four products and accumulate them into two stereo pairs
+_inline void S_Accumulate32_NEON( portable_samplepair_t *pbuf, int32x4_t p )
+{
+	int32_t	*out = (int32_t *)pbuf;
+
+	vst1q_s32( out, vaddq_s32( vld1q_s32( out ), p ));
+}
+
+static void S_PaintMonoFrom8_NEON( portable_samplepair_t *pbuf, int *volume, byte *pData, int outCount )
+{
+	const int16_t	v[8] = { volume[0] & ~1, volume[1] & ~1, volume[0] & ~1, volume[1] & ~1,
+		volume[0] & ~1, volume[1] & ~1, volume[0] & ~1, volume[1] & ~1 };
+	int16x8_t		vol = vld1q_s16( v );
+	int		i;
+
+	for( i = 0; i + 8 <= outCount; i += 8 )
+	{
+		int16x8_t		s = vmovl_s8( vld1_s8( (const int8_t *)( pData + i )));
+		int16x8x2_t	d = vzipq_s16( s, s );
+		int16x8_t		d0 = vmulq_s16( d.val[0], vol );
+		int16x8_t		d1 = vmulq_s16( d.val[1], vol );
+
+		S_Accumulate32_NEON( pbuf + i + 0, vmovl_s16( vget_low_s16( d0 )));
+		S_Accumulate32_NEON( pbuf + i + 2, vmovl_s16( vget_high_s16( d0 )));
+		S_Accumulate32_NEON( pbuf + i + 4, vmovl_s16( vget_low_s16( d1 )));
+		S_Accumulate32_NEON( pbuf + i + 6, vmovl_s16( vget_high_s16( d1 )));
+	}
+
+	if( i < outCount )
+		mix_reference.PaintMonoFrom8( pbuf + i, volume, pData + i, outCount - i );
+}
+
+static void S_PaintStereoFrom8_NEON( portable_samplepair_t *pbuf, int *volume, byte *pData, int outCount )
+{
+	const int16_t	v[8] = { volume[0] & ~1, volume[1] & ~1, volume[0] & ~1, volume[1] & ~1,
+		volume[0] & ~1, volume[1] & ~1, volume[0] & ~1, volume[1] & ~1 };
+	int16x8_t		vol = vld1q_s16( v );
+	int		i;
+
+	for( i = 0; i + 4 <= outCount; i += 4 )
+	{
+		int16x8_t		s = vmovl_s8( vld1_s8( (const int8_t *)( pData + i * 2 )));
+		int16x8_t		d = vmulq_s16( s, vol );
+
+		S_Accumulate32_NEON( pbuf + i + 0, vmovl_s16( vget_low_s16( d )));
+		S_Accumulate32_NEON( pbuf + i + 2, vmovl_s16( vget_high_s16( d )));
+	}
+
+	if( i < outCount )
+		mix_reference.PaintStereoFrom8( pbuf + i, volume, pData + i * 2, outCount - i );
+}
+
+static void S_PaintMonoFrom16_NEON( portable_samplepair_t *pbuf, int *volume, short *pData, int outCount )
+{
+	const int16_t	v[4] = { volume[0], volume[1], volume[0], volume[1] };
+	int16x4_t		vol = vld1_s16( v );
+	int		i;
+
+	for( i = 0; i + 8 <= outCount; i += 8 )
+	{
+		int16x8_t		s = vld1q_s16( pData + i );
+		int16x8x2_t	d = vzipq_s16( s, s );
+
+		S_Accumulate32_NEON( pbuf + i + 0, vshrq_n_s32( vmull_s16( vget_low_s16( d.val[0] ), vol ), 8 ));
+		S_Accumulate32_NEON( pbuf + i + 2, vshrq_n_s32( vmull_s16( vget_high_s16( d.val[0] ), vol ), 8 ));
+		S_Accumulate32_NEON( pbuf + i + 4, vshrq_n_s32( vmull_s16( vget_low_s16( d.val[1] ), vol ), 8 ));
+		S_Accumulate32_NEON( pbuf + i + 6, vshrq_n_s32( vmull_s16( vget_high_s16( d.val[1] ), vol ), 8 ));
+	}
+
+	if( i < outCount )
+		mix_reference.PaintMonoFrom16( pbuf + i, volume, pData + i, outCount - i );
+}
+
+static void S_PaintStereoFrom16_NEON( portable_samplepair_t *pbuf, int *volume, short *pData, int outCount )
+{
+	const int16_t	v[4] = { volume[0], volume[1], volume[0], volume[1] };
+	int16x4_t		vol = vld1_s16( v );
+	int		i;
+
+	for( i = 0; i + 4 <= outCount; i += 4 )
+	{
+		int16x8_t		s = vld1q_s16( pData + i * 2 );
+
+		S_Accumulate32_NEON( pbuf + i + 0, vshrq_n_s32( vmull_s16( vget_low_s16( s ), vol ), 8 ));
+		S_Accumulate32_NEON( pbuf + i + 2, vshrq_n_s32( vmull_s16( vget_high_s16( s ), vol ), 8 ));
+	}
+
+	if( i < outCount )
+		mix_reference.PaintStereoFrom16( pbuf + i, volume, pData + i * 2, outCount - i );
+}
+
+static void S_Interpolate2xLinear_NEON( portable_samplepair_t *pbuffer, portable_samplepair_t *pfiltermem, int cfltmem, int count )
+{
+	int	i, upCount = count << 1;
+
+	ASSERT( upCount <= PAINTBUFFER_SIZE );
+	ASSERT( cfltmem >= 1 );
+
+	// use interpolation value from previous mix
+	pbuffer[0].left = (pfiltermem->left + pbuffer[0].left) >> 1;
+	pbuffer[0].right = (pfiltermem->right + pbuffer[0].right) >> 1;
+
+	// two even slots per pass, each one averaged with preceding odd slot
+	for( i = 2; i + 2 < upCount; i += 4 )
+	{
+		int32x4_t	a = vld1q_s32( (const int32_t *)&pbuffer[i - 1] );
+		int32x4_t	b = vld1q_s32( (const int32_t *)&pbuffer[i + 1] );
+		int32x4_t	odd = vcombine_s32( vget_low_s32( a ), vget_low_s32( b ));
+		int32x4_t	even = vcombine_s32( vget_high_s32( a ), vget_high_s32( b ));
+		int32x4_t	res = vshrq_n_s32( vaddq_s32( odd, even ), 1 );
+
+		vst1_s32( (int32_t *)&pbuffer[i + 0], vget_low_s32( res ));
+		vst1_s32( (int32_t *)&pbuffer[i + 2], vget_high_s32( res ));
+	}
+
+	for( ; i < upCount; i += 2 )
+	{
+		pbuffer[i].left = (pbuffer[i].left + pbuffer[i-1].left) >> 1;
+		pbuffer[i].right = (pbuffer[i].right + pbuffer[i-1].right) >> 1;
+	}
+
+	// save last value to be played out in buffer
+	*pfiltermem = pbuffer[upCount - 1];
+}
+
+static void S_ClipSamples_NEON( portable_samplepair_t *pbuf, int count )
+{
+	int32x4_t	hi = vdupq_n_s32( 32760 );
+	int32x4_t	lo = vdupq_n_s32( -32760 );
+	int	i;
+
+	for( i = 0; i + 2 <= count; i += 2 )
+	{
+		int32_t	*p = (int32_t *)( pbuf + i );
+
+		vst1q_s32( p, vminq_s32( vmaxq_s32( vld1q_s32( p ), lo ), hi ));
+	}
+
+	if( i < count )
+		mix_reference.ClipSamples( pbuf + i, count - i );
+}
+
+_inline int32x4_t S_Clip32_NEON( int32x4_t x )
+{
+	return vminq_s32( vmaxq_s32( x, vdupq_n_s32( -32760 )), vdupq_n_s32( 32760 ));
+}
+
+// samples where delay line, left and right are all zero
+_inline uint32x4_t S_SilentMask_NEON( int32x4_t d, int32x4_t l, int32x4_t r )
+{
+	int32x4_t	zero = vdupq_n_s32( 0 );
+
+	return vandq_u32( vceqq_s32( d, zero ), vandq_u32( vceqq_s32( l, zero ), vceqq_s32( r, zero )));
+}
+
+_inline qboolean S_AnyLane_NEON( uint32x4_t m )
+{
+	uint32x2_t	x = vorr_u32( vget_low_u32( m ), vget_high_u32( m ));
+
+	return ( vget_lane_u32( x, 0 ) | vget_lane_u32( x, 1 )) != 0;
+}
+
+static void S_DelayBlock_NEON( portable_samplepair_t *paint, const int *rd, int *wr, int count, int feedback, int lp, int *plp0, int *plp1 )
+{
+	int32x4_t	fb = vdupq_n_s32( feedback );
+	int	lp0 = *plp0, lp1 = *plp1;
+	int	i;
+
+	for( i = 0; i + 4 <= count; i += 4 )
+	{
+		int32_t	*p = (int32_t *)( paint + i );
+		int32x4x2_t	lr = vld2q_s32( p );
+		int32x4_t	d = vld1q_s32( rd + i );
+		uint32x4_t	silent = S_SilentMask_NEON( d, lr.val[0], lr.val[1] );
+		int32x4_t	val, out;
+
+		val = vaddq_s32( vshrq_n_s32( vaddq_s32( lr.val[0], lr.val[1] ), 1 ), vshrq_n_s32( vmulq_s32( fb, d ), 8 ));
+		val = S_Clip32_NEON( val );
+
+		if( lp )
+		{
+			// silent sample resets history, so older value is kept only after an active one
+			int32x4_t	h1 = vextq_s32( vdupq_n_s32( lp1 ), val, 3 );
+			int32x4_t	h0 = vextq_s32( vsetq_lane_s32( lp0, vdupq_n_s32( lp1 ), 2 ), val, 2 );
+			uint32x4_t	keep = vextq_u32( vdupq_n_u32( ~0U ), vmvnq_u32( silent ), 3 );
+
+			h0 = vandq_s32( h0, vreinterpretq_s32_u32( keep ));
+			out = vshrq_n_s32( vaddq_s32( vaddq_s32( h0, h1 ), vshlq_n_s32( val, 1 )), 2 );
+
+			lp1 = vgetq_lane_s32( val, 3 );
+			lp0 = vgetq_lane_u32( silent, 3 ) ? 0 : vgetq_lane_s32( val, 2 );
+		}
+		else
+		{
+			out = val;
+			if( S_AnyLane_NEON( silent ))
+				lp0 = lp1 = 0;
+		}
+
+		out = vbicq_s32( out, vreinterpretq_s32_u32( silent ));
+		vst1q_s32( wr + i, out );
+
+		// silent samples are zero anyway, so they can be painted too
+		out = vshrq_n_s32( out, 2 );
+		lr.val[0] = S_Clip32_NEON( vaddq_s32( lr.val[0], out ));
+		lr.val[1] = S_Clip32_NEON( vaddq_s32( lr.val[1], out ));
+		vst2q_s32( p, lr );
+	}
+
+	if( i < count )
+		mix_reference.DelayBlock( paint + i, rd + i, wr + i, count - i, feedback, lp, &lp0, &lp1 );
+
+	*plp0 = lp0;
+	*plp1 = lp1;
+}
+
+static void S_ReverbBlock_NEON( int *acc, const portable_samplepair_t *paint, const int *rd, int *wr, int count, int feedback, int lp, int *plp0 )
+{
+	int32x4_t	fb = vdupq_n_s32( feedback );
+	int	lp0 = *plp0;
+	int	i;
+
+	for( i = 0; i + 4 <= count; i += 4 )
+	{
+		int32x4x2_t	lr = vld2q_s32( (const int32_t *)( paint + i ));
+		int32x4_t	d = vld1q_s32( rd + i );
+		uint32x4_t	silent = S_SilentMask_NEON( d, lr.val[0], lr.val[1] );
+		uint32x4_t	nodelay = vceqq_s32( d, vdupq_n_s32( 0 ));
+		int32x4_t	val, out;
+
+		// feedback is clipped only if delay line has something
+		val = vaddq_s32( vshrq_n_s32( vaddq_s32( lr.val[0], lr.val[1] ), 1 ), vshrq_n_s32( vmulq_s32( fb, d ), 8 ));
+		val = vbslq_s32( nodelay, val, S_Clip32_NEON( val ));
+
+		if( lp )
+		{
+			out = vshrq_n_s32( vaddq_s32( vextq_s32( vdupq_n_s32( lp0 ), val, 3 ), val ), 1 );
+			lp0 = vgetq_lane_s32( val, 3 );
+		}
+		else
+		{
+			out = val;
+			if( S_AnyLane_NEON( silent ))
+				lp0 = 0;
+		}
+
+		out = vbicq_s32( out, vreinterpretq_s32_u32( silent ));
+		vst1q_s32( wr + i, out );
+		vst1q_s32( acc + i, vaddq_s32( vld1q_s32( acc + i ), out ));
+	}
+
+	if( i < count )
+		mix_reference.ReverbBlock( acc + i, paint + i, rd + i, wr + i, count - i, feedback, lp, &lp0 );
+
+	*plp0 = lp0;
+}
+
+static void S_ReverbMix_NEON( portable_samplepair_t *paint, const int *acc, int count )
+{
+	int	i;
+
+	for( i = 0; i + 4 <= count; i += 4 )
+	{
+		int32_t	*p = (int32_t *)( paint + i );
+		int32x4x2_t	lr = vld2q_s32( p );
+		int32x4_t	v = vshrq_n_s32( vmulq_n_s32( vld1q_s32( acc + i ), 11 ), 6 );
+
+		lr.val[0] = S_Clip32_NEON( vaddq_s32( lr.val[0], v ));
+		lr.val[1] = S_Clip32_NEON( vaddq_s32( lr.val[1], v ));
+		vst2q_s32( p, lr );
+	}
+
+	if( i < count )
+		mix_reference.ReverbMix( paint + i, acc + i, count - i );
+}
+
+static const mixfuncs_t mix_neon =
+{
+	"NEON",
+	S_PaintMonoFrom8_NEON,
+	S_PaintStereoFrom8_NEON,
+	S_PaintMonoFrom16_NEON,
+	S_PaintStereoFrom16_NEON,
+	S_Interpolate2xLinear_NEON,
+	S_ClipSamples_NEON,
+	S_DelayBlock_NEON,
+	S_ReverbBlock_NEON,
+	S_ReverbMix_NEON,
+};
+#endif
+
+/*
+===================
+MIX_GetSIMDFuncs
+
+returns NULL if CPU or build has no vector unit we know
+===================
+*/
+const mixfuncs_t *MIX_GetSIMDFuncs( void )
+{
+#if defined XASH_MIX_SSE2
+#if defined XASH_MIX_SSE2_CPUID
+	__builtin_cpu_init();
+	if( !__builtin_cpu_supports( "sse2" ))
+		return NULL;
+#endif
+	return &mix_sse2;
+#elif defined XASH_MIX_NEON
+	return &mix_neon;
+#else
+	return NULL;
+#endif
+}
+
+#endif // XASH_DEDICATED
@@ -19,11 +19,30 @@ GNU General Public License for more details.
 #include "sound.h"
 #include "client.h"
 
+#define STREAM_RING_SIZE		(1<<17)		// decoded bytes, must be power of two
+#define STREAM_RING_MASK		( STREAM_RING_SIZE - 1 )
+#define STREAM_DECODE_CHUNK		4096		// bytes decoded per step
+#define STREAM_THREAD_MSEC		10		// decoder wakeup interval when ring is full
+
 portable_samplepair_t	s_rawsamples[MAX_RAW_SAMPLES];
 static bg_track_t		s_bgTrack;
 static musicfade_t		musicfade;	// controlled by game dlls
 int			s_rawend;
 
+// background track is decoded ahead of playback,
+// main thread only copies ready pcm from the ring
+static struct
+{
+	sys_mutex_t	*lock;		// held while stream is used by decoder
+	sys_thread_t	*thread;
+	volatile qboolean	running;
+	volatile qboolean	eof;		// decoder reached end of the track
+	int		frame;		// bytes per sample of current stream
+	volatile uint	head;		// advanced by decoder under the lock
+	volatile uint	tail;		// advanced by main thread
+	byte		ring[STREAM_RING_SIZE];
+} s_decoder;
+
 void S_PrintBackgroundTrackState( void )
 {
 	if( s_bgTrack.current[0] && s_bgTrack.loopName[0] )
@@ -73,6 +92,215 @@ float S_GetMusicVolume( void )
 	return s_musicvolume->value * scale;
 }
 
+/*
+=================
+S_LockDecoder
+=================
+*/
+static void S_LockDecoder( void )
+{
+	if( s_decoder.lock )
+		Sys_LockMutex( s_decoder.lock );
+}
+
+/*
+=================
+S_UnlockDecoder
+=================
+*/
+static void S_UnlockDecoder( void )
+{
+	if( s_decoder.lock )
+		Sys_UnlockMutex( s_decoder.lock );
+}
+
+/*
+=================
+S_DecodeBackgroundTrack
+
+decode next chunk into the ring,
+returns false if there is nothing to do
+=================
+*/
+static qboolean S_DecodeBackgroundTrack( void )
+{
+	byte	chunk[STREAM_DECODE_CHUNK];
+	uint	head, ofs, len;
+	int	r;
+
+	S_LockDecoder();
+
+	head = s_decoder.head;
+
+	if( !s_bgTrack.stream || s_decoder.eof || STREAM_RING_SIZE - ( head - s_decoder.tail ) < sizeof( chunk ))
+	{
+		S_UnlockDecoder();
+		return false;
+	}
+
+	r = FS_ReadStream( s_bgTrack.stream, sizeof( chunk ), chunk );
+
+	// keep the ring aligned to whole samples
+	if( s_decoder.frame > 0 ) r -= r % s_decoder.frame;
+
+	if( r <= 0 )
+	{
+		s_decoder.eof = true;
+		S_UnlockDecoder();
+		return false;
+	}
+
+	ofs = head & STREAM_RING_MASK;
+	len = min( r, STREAM_RING_SIZE - ofs );
+	Q_memcpy( &s_decoder.ring[ofs], chunk, len );
+	Q_memcpy( s_decoder.ring, chunk + len, r - len );
+
+	// pcm must be visible before the new head
+	Sys_MemoryBarrier();
+	s_decoder.head = head + r;
+
+	S_UnlockDecoder();
+
+	return true;
+}
+
+/*
+=================
+S_DecoderThread
+=================
+*/
+static void S_DecoderThread( void *unused )
+{
+	while( s_decoder.running )
+	{
+		if( !S_DecodeBackgroundTrack( ))
+			Sys_Sleep( STREAM_THREAD_MSEC );
+	}
+}
+
+/*
+=================
+S_SetDecoderStream
+
+main thread only, stream can't be opened by decoder
+because soundlib is not thread-safe
+=================
+*/
+static void S_SetDecoderStream( stream_t *stream )
+{
+	wavdata_t	*info = FS_StreamInfo( stream );
+
+	S_LockDecoder();
+	if( s_bgTrack.stream && s_bgTrack.stream != stream )
+		FS_FreeStream( s_bgTrack.stream );
+	s_bgTrack.stream = stream;
+	s_decoder.frame = info ? info->width * info->channels : 0;
+	s_decoder.eof = false;
+	S_UnlockDecoder();
+}
+
+/*
+=================
+S_StartDecoder
+=================
+*/
+static void S_StartDecoder( void )
+{
+	if( s_decoder.thread ) return;
+
+	s_decoder.head = s_decoder.tail = 0;
+	s_decoder.eof = false;
+
+	if( !s_decoder.lock )
+		s_decoder.lock = Sys_CreateMutex();
+
+	s_decoder.running = true;
+	s_decoder.thread = Sys_CreateThread( S_DecoderThread, NULL );
+
+	// decode in place then
+	if( !s_decoder.thread )
+		s_decoder.running = false;
+}
+
+/*
+=================
+S_StopDecoder
+=================
+*/
+static void S_StopDecoder( void )
+{
+	if( s_decoder.thread )
+	{
+		s_decoder.running = false;
+		Sys_JoinThread( s_decoder.thread );
+		s_decoder.thread = NULL;
+	}
+
+	if( s_decoder.lock )
+	{
+		Sys_DestroyMutex( s_decoder.lock );
+		s_decoder.lock = NULL;
+	}
+
+	s_decoder.head = s_decoder.tail = 0;
+	s_decoder.eof = false;
+}
+
+/*
+=================
+S_ReadBackgroundTrack
+
+copy decoded pcm from the ring, whole samples only
+=================
+*/
+static int S_ReadBackgroundTrack( int bytes, byte *buffer, int frame )
+{
+	uint	tail = s_decoder.tail;
+	uint	avail, ofs, len;
+
+	// no decoder thread, fill the ring right now
+	if( !s_decoder.thread )
+	{
+		while( s_decoder.head - tail < (uint)bytes )
+		{
+			if( !S_DecodeBackgroundTrack( ))
+				break;
+		}
+	}
+
+	avail = s_decoder.head - tail;
+	Sys_MemoryBarrier();
+
+	if( (uint)bytes > avail )
+		bytes = avail;
+	bytes -= bytes % frame;
+	if( bytes <= 0 ) return 0;
+
+	ofs = tail & STREAM_RING_MASK;
+	len = min( bytes, STREAM_RING_SIZE - ofs );
+	Q_memcpy( buffer, &s_decoder.ring[ofs], len );
+	Q_memcpy( buffer + len, s_decoder.ring, bytes - len );
+	s_decoder.tail = tail + bytes;
+
+	return bytes;
+}
+
+/*
+=================
+S_SetBackgroundTrackPos
+
+seek decoder and drop everything that was decoded ahead
+=================
+*/
+static void S_SetBackgroundTrackPos( int position )
+{
+	S_LockDecoder();
+	FS_SetStreamPos( s_bgTrack.stream, position );
+	s_decoder.tail = s_decoder.head;
+	s_decoder.eof = false;
+	S_UnlockDecoder();
+}
+
 /*
 =================
 S_StartBackgroundTrack
@@ -112,10 +340,16 @@ void S_StartBackgroundTrack( const char *introTrack, const char *mainTrack, int
 	Q_memset( &musicfade, 0, sizeof( musicfade )); // clear any soundfade
 	s_bgTrack.source = cls.key_dest;
 
-	if( position != 0 )
+	if( s_bgTrack.stream )
 	{
-		// restore message, update song position
-		FS_SetStreamPos( s_bgTrack.stream, position );
+		if( position != 0 )
+		{
+			// restore message, update song position
+			S_SetBackgroundTrackPos( position );
+		}
+
+		S_SetDecoderStream( s_bgTrack.stream );
+		S_StartDecoder();
 	}
 
 	S_CheckLerpingState();
@@ -125,14 +359,21 @@ void S_StopBackgroundTrack( void )
 {
 	s_listener.stream_paused = false;
 
+	// decoder may outlive the stream after failed loop
+	S_StopDecoder();
+
 	if( !dma.initialized ) return;
 	if( !s_bgTrack.stream ) return;
 
 	FS_FreeStream( s_bgTrack.stream );
+
+	// mixer reads raw samples up to s_rawend
+	S_LockMixer();
 	Q_memset( &s_bgTrack, 0, sizeof( bg_track_t ));
 	Q_memset( &musicfade, 0, sizeof( musicfade ));
 	s_listener.lerping = false;
 	s_rawend = 0;
+	S_UnlockMixer();
 }
 
 void S_StreamSetPause( int pause )
@@ -167,7 +408,21 @@ qboolean S_StreamGetCurrentState( char *currentTrack, char *loopTrack, fs_offset
 	}
 
 	if( position )
+	{
+		wavdata_t	*info = FS_StreamInfo( s_bgTrack.stream );
+		int	buffered;
+
+		S_LockDecoder();
 		*position = FS_GetStreamPos( s_bgTrack.stream );
+		buffered = s_decoder.head - s_decoder.tail;
+		S_UnlockDecoder();
+
+		// decoder runs ahead, return what is actually heard
+		// NOTE: mpeg stream position is in samples, wav in bytes
+		if( info->type == WF_MPGDATA )
+			buffered /= ( info->width * info->channels );
+		*position = max( *position - buffered, 0 );
+	}
 
 	return true;
 }
@@ -224,8 +479,8 @@ void S_StreamBackgroundTrack( void )
 			fileSamples = fileBytes / ( info->width * info->channels );
 		}
 
-		// read
-		r = FS_ReadStream( s_bgTrack.stream, fileBytes, raw );
+		// read what decoder has prepared
+		r = S_ReadBackgroundTrack( fileBytes, raw, info->width * info->channels );
 
 		if( r < fileBytes )
 		{
@@ -238,17 +493,24 @@ void S_StreamBackgroundTrack( void )
 			// add to raw buffer
 			S_StreamRawSamples( fileSamples, info->rate, info->width, info->channels, raw );
 		}
+		else if( !s_decoder.eof )
+		{
+			// decoder is behind, try next frame
+			return;
+		}
 		else
 		{
 			// loop
 			if( s_bgTrack.loopName[0] )
 			{
-				FS_FreeStream( s_bgTrack.stream );
-				s_bgTrack.stream = FS_OpenStream( va( "media/%s", s_bgTrack.loopName ));
+				stream_t	*stream;
+
+				stream = FS_OpenStream( va( "media/%s", s_bgTrack.loopName ));
 
 				// HACKHACK: see S_StartBackgroundTrack
-				if( !s_bgTrack.stream )
-					s_bgTrack.stream = FS_OpenStream( s_bgTrack.loopName );
+				if( !stream ) stream = FS_OpenStream( s_bgTrack.loopName );
+
+				S_SetDecoderStream( stream );
 
 				Q_strncpy( s_bgTrack.current, s_bgTrack.loopName, sizeof( s_bgTrack.current ));
 
@@ -273,9 +535,12 @@ S_StartStreaming
 void S_StartStreaming( void )
 {
 	if( !dma.initialized ) return;
+
 	// begin streaming movie soundtrack
+	S_LockMixer();
 	s_listener.streaming = true;
 	s_listener.lerping = false;
+	S_UnlockMixer();
 }
 
 /*
@@ -286,9 +551,12 @@ S_StopStreaming
 void S_StopStreaming( void )
 {
 	if( !dma.initialized ) return;
+
+	S_LockMixer();
 	s_listener.streaming = false;
 	s_listener.lerping = false;
 	s_rawend = 0;
+	S_UnlockMixer();
 }
 
 /*
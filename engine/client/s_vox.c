@@ -362,7 +362,7 @@ void VOX_LoadWord( channel_t *pchan )
 {
 	if( pchan->words[pchan->wordIndex].sfx )
 	{
-		wavdata_t	*pSource = S_LoadSound( pchan->words[pchan->wordIndex].sfx );
+		wavdata_t	*pSource = S_MixerLoadSound( pchan->words[pchan->wordIndex].sfx );
 
 		if( pSource )
 		{
@@ -531,6 +531,10 @@ void VOX_LoadSound( channel_t *pchan, const char *pszin )
 		i++;
 	}
 
+	// cache all the words now, mixer thread can't load them on demand
+	for( i = 0; i < cword; i++ )
+		S_LoadSound( rgvoxword[i].sfx );
+
 	VOX_LoadFirstWord( pchan, rgvoxword );
 
 	pchan->isSentence = true;
@@ -32,7 +32,9 @@ extern byte *sndpool;
 #define SOUND_44k		44100	// 44khz sample rate
 #define SOUND_DMA_SPEED	SOUND_44k	// hardware playback rate
 
-#define SND_TRACE_UPDATE_MAX  	2	// max of N channels may be checked for obscured source per frame
+#define SND_TRACE_UPDATE_MAX  	8	// max of N channels may be checked for obscured source per frame
+#define SND_TRACE_CACHE_SIZE		64	// shared occlusion results per frame, must be power of two
+#define SND_TRACE_BUCKET		16.0f	// sources closer than this share one trace
 #define SND_RADIUS_MAX		240.0f	// max sound source radius
 #define SND_RADIUS_MIN		24.0f	// min sound source radius
 #define SND_OBSCURED_LOSS_DB		-2.70f	// dB loss due to obscured sound source
@@ -94,12 +96,29 @@ typedef struct
 	portable_samplepair_t	fltmem[CPAINTFILTERS][CPAINTFILTERMEM];
 } paintbuffer_t;
 
+// inner mixing loops, scalar reference lives in s_mix.c
+typedef struct mixfuncs_s
+{
+	const char	*name;
+	void		(*PaintMonoFrom8)( portable_samplepair_t *pbuf, int *volume, byte *pData, int outCount );
+	void		(*PaintStereoFrom8)( portable_samplepair_t *pbuf, int *volume, byte *pData, int outCount );
+	void		(*PaintMonoFrom16)( portable_samplepair_t *pbuf, int *volume, short *pData, int outCount );
+	void		(*PaintStereoFrom16)( portable_samplepair_t *pbuf, int *volume, short *pData, int outCount );
+	void		(*Interpolate2xLinear)( portable_samplepair_t *pbuffer, portable_samplepair_t *pfiltermem, int cfltmem, int count );
+	void		(*ClipSamples)( portable_samplepair_t *pbuf, int count );
+	void		(*DelayBlock)( portable_samplepair_t *paint, const int *rd, int *wr, int count, int feedback, int lp, int *lp0, int *lp1 );
+	void		(*ReverbBlock)( int *acc, const portable_samplepair_t *paint, const int *rd, int *wr, int count, int feedback, int lp, int *lp0 );
+	void		(*ReverbMix)( portable_samplepair_t *paint, const int *acc, int count );
+} mixfuncs_t;
+
 typedef struct sfx_s
 {
 	string 		name;
 	wavdata_t		*cache;
 
 	int		touchFrame;
+	int		lastUsed;		// cache sequence of last play, for LRU
+	qboolean		pending;		// queued for background load
 	uint		hashValue;
 	struct sfx_s	*hashNext;
 } sfx_t;
@@ -202,6 +221,8 @@ typedef struct
 	float		frametime;	// used for sound fade
 	qboolean		active;
 	qboolean		inmenu;		// listener in-menu ?
+	qboolean		inconsole;	// key_dest for the mixer thread
+	qboolean		background;	// playing background map
 	qboolean		paused;
 	qboolean		streaming;	// playing AVI-file
 	qboolean		lerping;		// lerp stream ?
@@ -258,6 +279,7 @@ extern convar_t	*s_phs;
 extern convar_t *s_reverse_channels;
 extern convar_t	*dsp_room;
 extern convar_t *s_samplecount;
+extern convar_t	*snd_cache_mb;
 extern portable_samplepair_t		s_rawsamples[MAX_RAW_SAMPLES];
 
 void S_InitScaletable( void );
@@ -271,6 +293,9 @@ void S_Activate( qboolean active );
 // s_main.c
 //
 void S_FreeChannel( channel_t *ch );
+void S_LockMixer( void );
+void S_UnlockMixer( void );
+wavdata_t *S_MixerLoadSound( sfx_t *sfx );
 
 //
 // s_mix.c
@@ -280,6 +305,15 @@ void MIX_ClearAllPaintBuffers( int SampleCount, qboolean clearFilters );
 void MIX_InitAllPaintbuffers( void );
 void MIX_FreeAllPaintbuffers( void );
 void MIX_PaintChannels( int endtime );
+void MIX_SelectFuncs( qboolean simd );
+void S_MixBench_f( void );
+extern const mixfuncs_t	mix_reference;
+extern const mixfuncs_t	*mixfuncs;
+
+//
+// s_simd.c
+//
+const mixfuncs_t *MIX_GetSIMDFuncs( void );
 
 // s_load.c
 qboolean S_TestSoundChar( const char *pch, char c );
@@ -287,6 +321,7 @@ char *S_SkipSoundChar( const char *pch );
 sfx_t *S_FindName( const char *name, int *pfInCache );
 sound_t S_RegisterSound( const char *name );
 void S_FreeSound( sfx_t *sfx );
+void S_UpdateCache( void );
 
 // s_dsp.c
 qboolean AllocDsps( void );
@@ -294,6 +329,9 @@ void FreeDsps( void );
 void CheckNewDspPresets( void );
 void DSP_Process( int idsp, portable_samplepair_t *pbfront, int sampleCount );
 void DSP_ClearState( void );
+void DLY_DelayBlock( portable_samplepair_t *paint, const int *rd, int *wr, int count, int feedback, int lp, int *lp0, int *lp1 );
+void RVB_ReverbBlock( int *acc, const portable_samplepair_t *paint, const int *rd, int *wr, int count, int feedback, int lp, int *lp0 );
+void RVB_ReverbMix( portable_samplepair_t *paint, const int *acc, int count );
 
 qboolean S_Init( void );
 void S_Shutdown( void );
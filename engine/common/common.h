@@ -480,6 +480,8 @@ struct searchpath_s *FS_GetSearchPaths( void );
 file_t *FS_OpenFile( const char *path, fs_offset_t *filesizeptr, qboolean gamedironly );
 byte *FS_LoadFile( const char *path, fs_offset_t *filesizeptr, qboolean gamedironly );
 byte *FS_LoadDirectFile( const char *path, fs_offset_t *filesizeptr );
+void FS_Prefetch( const char *path );
+void FS_PrefetchFlush( void );
 qboolean FS_WriteFile( const char *filename, const void *data, fs_offset_t len );
 int COM_FileSize( const char *filename );
 void COM_FixSlashes( char *pname );
@@ -508,6 +510,7 @@ int FS_Close( file_t *file );
 int FS_Getc( file_t *file );
 qboolean FS_Eof( file_t *file );
 fs_offset_t FS_FileLength( file_t *f );
+qboolean FS_FileCompressed( file_t *f );
 void FS_Rescan( void );
 qboolean FS_SysFileExists( const char *path, qboolean caseinsensitive );
 void FS_CreatePath( char *path );
@@ -744,6 +747,7 @@ int FS_SetStreamPos( stream_t *stream, int newpos );
 int FS_GetStreamPos( stream_t *stream );
 void FS_FreeStream( stream_t *stream );
 qboolean Sound_Process( wavdata_t **wav, int rate, int width, uint flags );
+extern convar_t *snd_resample_quality;
 uint Sound_GetApproxWavePlayLen( const char *filepath );
 
 //
@@ -875,6 +879,51 @@ void MD5Final( byte digest[16], MD5Context_t *ctx );
 qboolean MD5_HashFile( byte digest[16], const char *pszFileName, uint seed[4] );
 uint Com_HashKey( const char *string, uint hashSize );
 
+//
+// inflate.c
+//
+typedef struct inflate_s inflate_t;
+typedef int (*pfnInflateRead)( void *handle, byte *buffer, int size );
+void Inflate_Init( void );
+inflate_t *Inflate_Create( byte *mempool, pfnInflateRead pfnRead, void *handle );
+void Inflate_Reset( inflate_t *inf );
+int Inflate_Read( inflate_t *inf, byte *out, int size );
+void Inflate_Free( inflate_t *inf );
+
+//
+// threads.c
+//
+typedef struct sys_mutex_s sys_mutex_t;
+typedef struct sys_semaphore_s sys_semaphore_t;
+typedef struct sys_thread_s sys_thread_t;
+typedef void (*pfnThreadFunc)( void *arg );
+typedef void (*pfnJobFunc)( void *data );
+
+typedef struct jobgroup_s
+{
+	int		pending;	// queued or running jobs
+	qboolean		waiting;	// main thread sleeps in Job_Wait
+} jobgroup_t;
+
+sys_mutex_t *Sys_CreateMutex( void );
+void Sys_LockMutex( sys_mutex_t *mutex );
+void Sys_UnlockMutex( sys_mutex_t *mutex );
+void Sys_DestroyMutex( sys_mutex_t *mutex );
+sys_semaphore_t *Sys_CreateSemaphore( int count );
+void Sys_PostSemaphore( sys_semaphore_t *sem );
+void Sys_WaitSemaphore( sys_semaphore_t *sem );
+void Sys_DestroySemaphore( sys_semaphore_t *sem );
+sys_thread_t *Sys_CreateThread( pfnThreadFunc func, void *arg );
+void Sys_JoinThread( sys_thread_t *thread );
+void Sys_MemoryBarrier( void );
+int Sys_NumCPUs( void );
+void Job_Init( void );
+void Job_Shutdown( void );
+int Job_NumWorkers( void );
+void Job_Add( jobgroup_t *group, pfnJobFunc func, void *data );
+void Job_Wait( jobgroup_t *group );
+qboolean Job_IsDone( jobgroup_t *group );
+
 //
 // hpak.c
 //
@@ -1060,6 +1109,12 @@ void HTTP_Shutdown( void );
 void HTTP_Run( void );
 void HTTP_ClearCustomServers( void );
 void HTTP_Clear_f( void );
+struct ui_downloadstatus_s;
+int HTTP_GetDownloadStatus( struct ui_downloadstatus_s *status );
+void HTTP_ServerFrame( void );
+void HTTP_ServerShutdown( void );
+const char *HTTP_ServerURL( void );
+qboolean SV_IsResourceListed( const char *path );
 void CL_ProcessFile( qboolean successfully_received, const char *filename );
 
 typedef struct autocomplete_list_s
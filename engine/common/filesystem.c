@@ -46,6 +46,9 @@ GNU General Public License for more details.
 #define PAK_LOAD_NO_FILES		5
 #define PAK_LOAD_CORRUPTED		6
 
+#define MAX_PREFETCH_FILES		1024
+#define PREFETCH_HASH_SIZE		256
+
 typedef struct stringlist_s
 {
 	// maxstrings changes as needed, causing reallocation of strings[] array
@@ -54,6 +57,36 @@ typedef struct stringlist_s
 	char		**strings;
 } stringlist_t;
 
+typedef struct
+{
+	inflate_t		*inf;
+	fs_offset_t	comp_length;		// length of the compressed data
+	fs_offset_t	in_position;		// position in the compressed data
+} ztoolkit_t;
+
+typedef enum
+{
+	PREFETCH_QUEUED = 0,
+	PREFETCH_LOADING,
+	PREFETCH_DONE,
+	PREFETCH_FAILED,
+	PREFETCH_TAKEN,
+} prefetchstate_t;
+
+typedef struct prefetch_s
+{
+	char		name[MAX_PACKFILE_NAME];
+	int		handle;			// private descriptor, owned by worker
+	fs_offset_t	offset;			// data offset in the disk file
+	fs_offset_t	packsize;			// compressed size for deflated entries
+	fs_offset_t	realsize;
+	fs_offset_t	in_position;		// position in the compressed data
+	inflate_t		*inf;			// decoder for deflated zip entries
+	byte		*buffer;			// allocated by main thread, filled by worker
+	prefetchstate_t	state;			// guarded by fs_prefetch.lock
+	struct prefetch_s	*nexthash;		// next free slot when released
+} prefetch_t;
+
 typedef struct wadtype_s
 {
 	char		*ext;
@@ -68,6 +101,7 @@ struct file_s
 	fs_offset_t	offset;			// offset into the package (0 if external file)
 	int		ungetc;			// single stored character from ungetc, cleared to EOF when read
 	time_t		filetime;			// pak, wad or real filetime
+	ztoolkit_t	*ztk;			// deflated zip entries only
 						// Contents buffer
 	fs_offset_t	buff_ind, buff_len;		// buffer current index and length
 	byte		buff[FILE_BUFF_SIZE];	// intermediate buffer
@@ -83,12 +117,27 @@ char		fs_gamedir[MAX_SYSPATH];	// game current directory
 char		gs_basedir[MAX_SYSPATH];	// initial dir before loading gameinfo.txt (used for compilers too)
 
 qboolean		fs_ext_path = false;	// attempt to read\write from ./ or ../ paths
+convar_t		*fs_prefetch;
+
+static struct
+{
+	sys_mutex_t	*lock;
+	jobgroup_t	group;
+	prefetch_t	files[MAX_PREFETCH_FILES];
+	prefetch_t	*hash[PREFETCH_HASH_SIZE];
+	prefetch_t	*freeslots;		// slots released by take
+	int		numslots;			// slots ever used since flush
+	int		numqueued;		// for stats
+	int		numtaken;
+	fs_offset_t	totalsize;		// buffers held, limited by fs_prefetch
+	fs_offset_t	queuedsize;		// for stats
+} fs_prefetch_state;
 #ifndef _WIN32
 qboolean		fs_caseinsensitive = true; // try to search missing files
 #endif
 static void FS_InitMemory( void );
 static dlumpinfo_t *W_FindLump( wfile_t *wad, const char *name, const signed char matchtype );
-static packfile_t* FS_AddFileToPack( const char* name, pack_t *pack, fs_offset_t offset, fs_offset_t size );
+static packfile_t* FS_AddFileToPack( const char* name, pack_t *pack, fs_offset_t offset, fs_offset_t packsize, fs_offset_t realsize, int flags );
 static byte *W_LoadFile( const char *path, fs_offset_t *filesizeptr, qboolean gamedironly );
 static qboolean FS_SysFolderExists( const char *path );
 static int FS_SysFileTime( const char *filename );
@@ -398,7 +447,7 @@ FS_AddFileToPack
 Add a file to the list of files contained into a package
 ====================
 */
-static packfile_t* FS_AddFileToPack( const char* name, pack_t* pack, fs_offset_t offset, fs_offset_t size )
+static packfile_t* FS_AddFileToPack( const char* name, pack_t* pack, fs_offset_t offset, fs_offset_t packsize, fs_offset_t realsize, int flags )
 {
 	int		left, right, middle;
 	packfile_t	*pfile;
@@ -427,8 +476,10 @@ static packfile_t* FS_AddFileToPack( const char* name, pack_t* pack, fs_offset_t
 	pack->numfiles++;
 
 	Q_strncpy( pfile->name, name, sizeof( pfile->name ));
+	pfile->flags = flags;
 	pfile->offset = offset;
-	pfile->realsize = size;
+	pfile->packsize = packsize;
+	pfile->realsize = realsize;
 
 	return pfile;
 }
@@ -711,7 +762,8 @@ pack_t *FS_LoadPackPAK( const char *packfile, int *error )
 	// parse the directory
 	for( i = 0; i < numpackfiles; i++ )
 	{
-		FS_AddFileToPack( info[i].name, pack, LittleLong(info[i].filepos), LittleLong(info[i].filelen) );
+		fs_offset_t size = LittleLong( info[i].filelen );
+		FS_AddFileToPack( info[i].name, pack, LittleLong( info[i].filepos ), size, size, PACKFILE_TRUEOFFS );
 	}
 
 	MsgDev( D_NOTE, "Adding packfile: %s (%i files)\n", packfile, numpackfiles );
@@ -721,6 +773,273 @@ pack_t *FS_LoadPackPAK( const char *packfile, int *error )
 	return pack;
 }
 
+/*
+=================
+FS_ZipShort
+
+zip headers are unaligned little-endian
+=================
+*/
+static uint FS_ZipShort( const byte *p )
+{
+	return p[0] | ( p[1] << 8 );
+}
+
+/*
+=================
+FS_ZipLong
+=================
+*/
+static uint FS_ZipLong( const byte *p )
+{
+	return p[0] | ( p[1] << 8 ) | ( p[2] << 16 ) | ((uint)p[3] << 24 );
+}
+
+/*
+=================
+FS_LoadPackZIP
+
+Takes an explicit (not game tree related) path to a pk3 or zip file.
+
+Central directory is indexed once into the same sorted list that
+pak files use, local headers are resolved on first open
+=================
+*/
+pack_t *FS_LoadPackZIP( const char *zipfile, int *error )
+{
+	int		i, numdirentries;
+	int		ziphandle;
+	uint		dirofs, dirlen;
+	fs_offset_t	filesize, maxback;
+	byte		*buffer, *info, *ptr, *end;
+	int		ofs;
+	pack_t		*pack;
+
+	ziphandle = open( zipfile, O_RDONLY|O_BINARY );
+
+#ifndef _WIN32
+	if( ziphandle < 0 )
+	{
+		const char *fzipfile = FS_FixFileCase( zipfile );
+		if( fzipfile != zipfile )
+			ziphandle = open( fzipfile, O_RDONLY|O_BINARY );
+	}
+#endif
+
+	if( ziphandle < 0 )
+	{
+		MsgDev( D_NOTE, "%s couldn't open\n", zipfile );
+		if( error ) *error = PAK_LOAD_COULDNT_OPEN;
+		return NULL;
+	}
+
+	filesize = lseek( ziphandle, 0, SEEK_END );
+
+	if( filesize < ZIP_ENDHEADER_SIZE )
+	{
+		MsgDev( D_NOTE, "%s is not a zip file. Ignored.\n", zipfile );
+		if( error ) *error = PAK_LOAD_BAD_HEADER;
+		close( ziphandle );
+		return NULL;
+	}
+
+	// end of central directory is followed by a comment of unknown length
+	maxback = min( filesize, ZIP_ENDHEADER_SIZE + ZIP_MAX_COMMENT );
+	buffer = (byte *)Mem_Alloc( fs_mempool, maxback );
+	lseek( ziphandle, filesize - maxback, SEEK_SET );
+
+	if( read( ziphandle, buffer, maxback ) != maxback )
+	{
+		MsgDev( D_NOTE, "%s couldn't read\n", zipfile );
+		if( error ) *error = PAK_LOAD_COULDNT_OPEN;
+		close( ziphandle );
+		Mem_Free( buffer );
+		return NULL;
+	}
+
+	for( ofs = maxback - ZIP_ENDHEADER_SIZE; ofs >= 0; ofs-- )
+	{
+		if( FS_ZipLong( buffer + ofs ) == IDZIPENDHEADER )
+			break;
+	}
+
+	if( ofs < 0 )
+	{
+		MsgDev( D_NOTE, "%s is not a zip file. Ignored.\n", zipfile );
+		if( error ) *error = PAK_LOAD_BAD_HEADER;
+		close( ziphandle );
+		Mem_Free( buffer );
+		return NULL;
+	}
+
+	ptr = buffer + ofs;
+
+	// multi-volume archives are not supported
+	if( FS_ZipShort( ptr + 4 ) != 0 || FS_ZipShort( ptr + 6 ) != 0 || FS_ZipShort( ptr + 8 ) != FS_ZipShort( ptr + 10 ))
+	{
+		MsgDev( D_ERROR, "%s is a multi-volume zip. Ignored.\n", zipfile );
+		if( error ) *error = PAK_LOAD_BAD_HEADER;
+		close( ziphandle );
+		Mem_Free( buffer );
+		return NULL;
+	}
+
+	numdirentries = FS_ZipShort( ptr + 10 );
+	dirlen = FS_ZipLong( ptr + 12 );
+	dirofs = FS_ZipLong( ptr + 16 );
+	Mem_Free( buffer );
+
+	if( numdirentries > MAX_FILES_IN_PACK )
+	{
+		MsgDev( D_ERROR, "%s has too many files ( %i ). Ignored.\n", zipfile, numdirentries );
+		if( error ) *error = PAK_LOAD_TOO_MANY_FILES;
+		close( ziphandle );
+		return NULL;
+	}
+
+	if( numdirentries <= 0 )
+	{
+		MsgDev( D_NOTE, "%s has no files. Ignored.\n", zipfile );
+		if( error ) *error = PAK_LOAD_NO_FILES;
+		close( ziphandle );
+		return NULL;
+	}
+
+	if( (fs_offset_t)dirofs + dirlen > filesize || dirlen < ZIP_CENTRALHEADER_SIZE )
+	{
+		MsgDev( D_ERROR, "%s has an invalid central directory. Ignored.\n", zipfile );
+		if( error ) *error = PAK_LOAD_BAD_FOLDERS;
+		close( ziphandle );
+		return NULL;
+	}
+
+	info = (byte *)Mem_Alloc( fs_mempool, dirlen );
+	lseek( ziphandle, dirofs, SEEK_SET );
+
+	if( dirlen != read( ziphandle, info, dirlen ))
+	{
+		MsgDev( D_NOTE, "%s is an incomplete ZIP, not loading\n", zipfile );
+		if( error ) *error = PAK_LOAD_CORRUPTED;
+		close( ziphandle );
+		Mem_Free( info );
+		return NULL;
+	}
+
+	pack = (pack_t *)Mem_Alloc( fs_mempool, sizeof( pack_t ));
+	Q_strncpy( pack->filename, zipfile, sizeof( pack->filename ));
+	pack->handle = ziphandle;
+	pack->numfiles = 0;
+	pack->files = (packfile_t *)Mem_Alloc( fs_mempool, numdirentries * sizeof( packfile_t ));
+	pack->filetime = FS_SysFileTime( zipfile );
+
+	// parse the central directory
+	for( i = 0, ptr = info, end = info + dirlen; i < numdirentries; i++ )
+	{
+		char	name[MAX_PACKFILE_NAME];
+		uint	flags, method, packsize, realsize;
+		uint	namelen, extralen, commentlen;
+
+		if( ptr + ZIP_CENTRALHEADER_SIZE > end || FS_ZipLong( ptr ) != IDZIPCENTRALHEADER )
+			break;
+
+		flags = FS_ZipShort( ptr + 8 );
+		method = FS_ZipShort( ptr + 10 );
+		packsize = FS_ZipLong( ptr + 20 );
+		realsize = FS_ZipLong( ptr + 24 );
+		namelen = FS_ZipShort( ptr + 28 );
+		extralen = FS_ZipShort( ptr + 30 );
+		commentlen = FS_ZipShort( ptr + 32 );
+
+		if( ptr + ZIP_CENTRALHEADER_SIZE + namelen > end )
+			break;
+
+		// directories are stored as empty entries with trailing slash
+		if( !namelen || ptr[ZIP_CENTRALHEADER_SIZE + namelen - 1] == '/' || ptr[ZIP_CENTRALHEADER_SIZE + namelen - 1] == '\\' )
+		{
+			ptr += ZIP_CENTRALHEADER_SIZE + namelen + extralen + commentlen;
+			continue;
+		}
+
+		if( namelen >= sizeof( name ))
+		{
+			MsgDev( D_WARN, "%s: entry name is too long, skipped\n", zipfile );
+		}
+		else
+		{
+			Q_memcpy( name, ptr + ZIP_CENTRALHEADER_SIZE, namelen );
+			name[namelen] = '\0';
+
+			if( flags & ZIP_FLAG_ENCRYPTED )
+				MsgDev( D_WARN, "%s: %s is encrypted, skipped\n", zipfile, name );
+			else if( method != ZIP_COMPRESSION_STORED && method != ZIP_COMPRESSION_DEFLATED )
+				MsgDev( D_WARN, "%s: %s has unsupported compression method %i, skipped\n", zipfile, name, method );
+			else if( packsize == 0xFFFFFFFF || realsize == 0xFFFFFFFF )
+				MsgDev( D_WARN, "%s: %s requires zip64, skipped\n", zipfile, name );
+			else if( method == ZIP_COMPRESSION_STORED && packsize != realsize )
+				MsgDev( D_WARN, "%s: %s has invalid size, skipped\n", zipfile, name );
+			else FS_AddFileToPack( name, pack, FS_ZipLong( ptr + 42 ), packsize, realsize, ( method == ZIP_COMPRESSION_DEFLATED ) ? PACKFILE_DEFLATED : 0 );
+		}
+
+		ptr += ZIP_CENTRALHEADER_SIZE + namelen + extralen + commentlen;
+	}
+
+	Mem_Free( info );
+
+	if( i != numdirentries )
+	{
+		MsgDev( D_NOTE, "%s has a corrupted central directory, not loading\n", zipfile );
+		if( error ) *error = PAK_LOAD_CORRUPTED;
+		close( ziphandle );
+		Mem_Free( pack->files );
+		Mem_Free( pack );
+		return NULL;
+	}
+
+	if( pack->numfiles <= 0 )
+	{
+		MsgDev( D_NOTE, "%s has no files. Ignored.\n", zipfile );
+		if( error ) *error = PAK_LOAD_NO_FILES;
+		close( ziphandle );
+		Mem_Free( pack->files );
+		Mem_Free( pack );
+		return NULL;
+	}
+
+	MsgDev( D_NOTE, "Adding zipfile: %s (%i files)\n", zipfile, pack->numfiles );
+	if( error ) *error = PAK_LOAD_OK;
+
+	return pack;
+}
+
+/*
+=================
+FS_ZipTrueOffset
+
+Skip the zip local header, its extra field may differ from central directory
+=================
+*/
+static qboolean FS_ZipTrueOffset( pack_t *pack, packfile_t *pfile )
+{
+	byte	header[ZIP_LOCALHEADER_SIZE];
+
+	if( lseek( pack->handle, pfile->offset, SEEK_SET ) == -1 )
+		return false;
+
+	if( read( pack->handle, header, sizeof( header )) != sizeof( header ))
+		return false;
+
+	if( FS_ZipLong( header ) != IDZIPLOCALHEADER )
+	{
+		MsgDev( D_ERROR, "%s: %s has a bad local header\n", pack->filename, pfile->name );
+		return false;
+	}
+
+	pfile->offset += ZIP_LOCALHEADER_SIZE + FS_ZipShort( header + 26 ) + FS_ZipShort( header + 28 );
+	pfile->flags |= PACKFILE_TRUEOFFS;
+
+	return true;
+}
+
 /*
 ================
 FS_AddPack_Fullpath
@@ -754,6 +1073,7 @@ static qboolean FS_AddPack_Fullpath( const char *pakfile, qboolean *already_load
 	if( already_loaded ) *already_loaded = false;
 
 	if( !Q_stricmp( ext, "pak" )) pak = FS_LoadPackPAK( pakfile, &errorcode );
+	else if( !Q_stricmp( ext, "pk3" ) || !Q_stricmp( ext, "zip" )) pak = FS_LoadPackZIP( pakfile, &errorcode );
 	else MsgDev( D_ERROR, "\"%s\" does not have a pack extension\n", pakfile );
 
 	if( pak )
@@ -914,8 +1234,10 @@ void FS_AddGameDirectory( const char *dir, int flags )
 	// For priority files, first is unpacked, then WAD and last PAK
 	for( i = 0; i < list.numstrings; i++ )
 	{
-		// add any PAK package in the directory
-		if( !Q_stricmp( FS_FileExtension( list.strings[i] ), "pak" ))
+		const char *ext = FS_FileExtension( list.strings[i] );
+
+		// add any PAK or PK3 package in the directory
+		if( !Q_stricmp( ext, "pak" ) || !Q_stricmp( ext, "pk3" ))
 		{
 			Q_sprintf( fullpath, "%s%s", dir, list.strings[i] );
 			FS_AddPack_Fullpath( fullpath, NULL, false, flags );
@@ -1061,6 +1383,9 @@ FS_ClearSearchPath
 */
 void FS_ClearSearchPath( void )
 {
+	// prefetched data may come from paths being removed
+	FS_PrefetchFlush();
+
 	while( fs_searchpaths )
 	{
 		searchpath_t	*search = fs_searchpaths;
@@ -1835,6 +2160,7 @@ void FS_Init( void )
 	Cmd_AddCommand( "fs_clearpaths", FS_ClearPaths_f, "clear filesystem search paths" );
 	Cmd_AddCommand( "crc32", FS_Crc32_f, "print crc32 of for file" );
 	Cmd_AddCommand( "md5", FS_MD5_f, "print md5 of for file" );
+	fs_prefetch = Cvar_Get( "fs_prefetch", "128", CVAR_ARCHIVE, "megabytes of level resources to read ahead in background, 0 disables" );
 
 #ifndef _WIN32
 	if( Sys_CheckParm( "-casesensitive" ) )
@@ -1977,6 +2303,8 @@ void FS_Shutdown( void )
 	Q_memset( &SI, 0, sizeof( sysinfo_t ));
 
 	FS_ClearSearchPath(); // release all wad files too
+	Sys_DestroyMutex( fs_prefetch_state.lock );
+	fs_prefetch_state.lock = NULL;
 	Mem_FreePool( &fs_mempool );
 }
 
@@ -2107,37 +2435,98 @@ static file_t* FS_SysOpen( const char* filepath, const char* mode )
 }
 
 
+/*
+===========
+FS_ZipRead
+
+Feed compressed data of the zip entry to the decoder
+===========
+*/
+static int FS_ZipRead( void *handle, byte *buffer, int size )
+{
+	file_t		*file = (file_t *)handle;
+	ztoolkit_t	*ztk = file->ztk;
+	fs_offset_t	count;
+
+	count = ztk->comp_length - ztk->in_position;
+	if( count > size ) count = size;
+	if( count <= 0 ) return 0;
+
+	if( lseek( file->handle, file->offset + ztk->in_position, SEEK_SET ) == -1 )
+		return 0;
+
+	count = read( file->handle, buffer, count );
+	if( count > 0 ) ztk->in_position += count;
+
+	return count;
+}
+
+/*
+===========
+FS_OpenReadHandle
+
+Private read-only descriptor with its own file offset,
+so files can be read from other threads
+===========
+*/
+static int FS_OpenReadHandle( const char *path )
+{
+	int	handle = open( path, O_RDONLY|O_BINARY );
+
+#ifndef _WIN32
+	if( handle < 0 )
+	{
+		const char *fpath = FS_FixFileCase( path );
+		if( fpath != path )
+			handle = open( fpath, O_RDONLY|O_BINARY );
+	}
+#endif
+	return handle;
+}
+
 /*
 ===========
 FS_OpenPackedFile
 
-Open a packed file using its package file descriptor
+Open a packed file with its own descriptor of the package
 ===========
 */
 file_t *FS_OpenPackedFile( pack_t *pack, int pack_ind )
 {
 	packfile_t	*pfile;
-	int		dup_handle;
+	int		handle;
 	file_t		*file;
 
 	pfile = &pack->files[pack_ind];
 
-	if( lseek( pack->handle, pfile->offset, SEEK_SET ) == -1 )
+	// zip entries point to the local header until first open
+	if( !( pfile->flags & PACKFILE_TRUEOFFS ) && !FS_ZipTrueOffset( pack, pfile ))
 		return NULL;
 
-	dup_handle = dup( pack->handle );
+	// not a dup() of pack handle, that would share the offset with
+	// every other file of the pack, e.g. music decoded on its own thread
+	handle = FS_OpenReadHandle( pack->filename );
 
-	if( dup_handle < 0 )
+	if( handle < 0 )
 		return NULL;
 
 	file = (file_t *)Mem_Alloc( fs_mempool, sizeof( *file ));
 	Q_memset( file, 0, sizeof( *file ));
-	file->handle = dup_handle;
+	file->handle = handle;
 	file->real_length = pfile->realsize;
 	file->offset = pfile->offset;
 	file->position = 0;
 	file->ungetc = EOF;
 
+	// stored entries are read in-place, deflated are streamed through decoder
+	if( pfile->flags & PACKFILE_DEFLATED )
+	{
+		file->ztk = (ztoolkit_t *)Mem_Alloc( fs_mempool, sizeof( ztoolkit_t ));
+		file->ztk->comp_length = pfile->packsize;
+		file->ztk->in_position = 0;
+		file->ztk->inf = Inflate_Create( fs_mempool, FS_ZipRead, file );
+	}
+
 	return file;
 }
 
@@ -2461,6 +2850,12 @@ int FS_Close( file_t *file )
 	if( close( file->handle ))
 		return EOF;
 
+	if( file->ztk )
+	{
+		Inflate_Free( file->ztk->inf );
+		Mem_Free( file->ztk );
+	}
+
 	Mem_Free( file );
 	return 0;
 }
@@ -2496,6 +2891,22 @@ fs_offset_t FS_Write( file_t *file, const void *data, size_t datasize )
 	return result;
 }
 
+/*
+====================
+FS_ReadRaw
+
+Read bytes at the current position bypassing the read buffer
+====================
+*/
+static fs_offset_t FS_ReadRaw( file_t *file, byte *buffer, fs_offset_t count )
+{
+	if( file->ztk )
+		return Inflate_Read( file->ztk->inf, buffer, count );
+
+	lseek( file->handle, file->offset + file->position, SEEK_SET );
+	return read( file->handle, buffer, count );
+}
+
 /*
 ====================
 FS_Read
@@ -2545,8 +2956,7 @@ fs_offset_t FS_Read( file_t *file, void *buffer, size_t buffersize )
 	{
 		if( count > (fs_offset_t)buffersize )
 			count = (fs_offset_t)buffersize;
-		lseek( file->handle, file->offset + file->position, SEEK_SET );
-		nb = read (file->handle, &((byte *)buffer)[done], count );
+		nb = FS_ReadRaw( file, &((byte *)buffer)[done], count );
 
 		if( nb > 0 )
 		{
@@ -2560,8 +2970,7 @@ fs_offset_t FS_Read( file_t *file, void *buffer, size_t buffersize )
 	{
 		if( count > (fs_offset_t)sizeof( file->buff ))
 			count = (fs_offset_t)sizeof( file->buff );
-		lseek( file->handle, file->offset + file->position, SEEK_SET );
-		nb = read( file->handle, file->buff, count );
+		nb = FS_ReadRaw( file, file->buff, count );
 
 		if( nb > 0 )
 		{
@@ -2711,6 +3120,29 @@ int FS_Seek( file_t *file, fs_offset_t offset, int whence )
 	// Purge cached data
 	FS_Purge( file );
 
+	if( file->ztk )
+	{
+		// deflate can't seek, restart the stream if we need to go back
+		if( offset < file->position )
+		{
+			file->ztk->in_position = 0;
+			file->position = 0;
+			Inflate_Reset( file->ztk->inf );
+		}
+
+		// and skip data up to the requested position
+		while( file->position < offset )
+		{
+			fs_offset_t	count = min( offset - file->position, (fs_offset_t)sizeof( file->buff ));
+			fs_offset_t	nb = Inflate_Read( file->ztk->inf, file->buff, count );
+
+			if( nb <= 0 ) return -1;
+			file->position += nb;
+		}
+
+		return 0;
+	}
+
 	if( lseek( file->handle, file->offset + offset, SEEK_SET ) == -1 )
 		return -1;
 	file->position = offset;
@@ -2758,6 +3190,331 @@ void FS_Purge( file_t* file )
 	file->ungetc = EOF;
 }
 
+/*
+=============================================================================
+
+FILE PREFETCHING
+
+Level resources are read and decompressed by worker threads
+while main thread is busy with parsing already loaded files.
+Workers only fill buffers which were allocated by main thread,
+any engine state (search paths, mempools) stays on main thread
+
+=============================================================================
+*/
+/*
+============
+FS_PrefetchRead
+
+inflate callback, worker thread
+============
+*/
+static int FS_PrefetchRead( void *handle, byte *buffer, int size )
+{
+	prefetch_t	*pf = (prefetch_t *)handle;
+	fs_offset_t	count;
+
+	count = pf->packsize - pf->in_position;
+	if( count > size ) count = size;
+	if( count <= 0 ) return 0;
+
+	count = read( pf->handle, buffer, count );
+	if( count > 0 ) pf->in_position += count;
+
+	return count;
+}
+
+/*
+============
+FS_PrefetchJob
+
+worker thread
+============
+*/
+static void FS_PrefetchJob( void *data )
+{
+	prefetch_t	*pf = (prefetch_t *)data;
+	qboolean		success = false;
+
+	Sys_LockMutex( fs_prefetch_state.lock );
+	if( pf->state != PREFETCH_QUEUED )
+	{
+		// main thread has already done it
+		Sys_UnlockMutex( fs_prefetch_state.lock );
+		return;
+	}
+	pf->state = PREFETCH_LOADING;
+	Sys_UnlockMutex( fs_prefetch_state.lock );
+
+	if( lseek( pf->handle, pf->offset, SEEK_SET ) != -1 )
+	{
+		if( pf->inf )
+		{
+			success = ( Inflate_Read( pf->inf, pf->buffer, pf->realsize ) == pf->realsize );
+		}
+		else
+		{
+			fs_offset_t	done = 0, nb;
+
+			while( done < pf->realsize )
+			{
+				nb = read( pf->handle, pf->buffer + done, pf->realsize - done );
+				if( nb <= 0 ) break;
+				done += nb;
+			}
+			success = ( done == pf->realsize );
+		}
+	}
+
+	close( pf->handle );
+	pf->handle = -1;
+
+	Sys_LockMutex( fs_prefetch_state.lock );
+	pf->state = success ? PREFETCH_DONE : PREFETCH_FAILED;
+	Sys_UnlockMutex( fs_prefetch_state.lock );
+}
+
+/*
+============
+FS_PrefetchFind
+============
+*/
+static prefetch_t *FS_PrefetchFind( const char *path )
+{
+	prefetch_t	*pf;
+
+	for( pf = fs_prefetch_state.hash[Com_HashKey( path, PREFETCH_HASH_SIZE )]; pf; pf = pf->nexthash )
+	{
+		if( !Q_stricmp( pf->name, path ))
+			return pf;
+	}
+
+	return NULL;
+}
+
+/*
+============
+FS_Prefetch
+
+Queue file for background reading, it will
+be picked up by the next FS_LoadFile call
+============
+*/
+void FS_Prefetch( const char *path )
+{
+	searchpath_t	*search;
+	prefetch_t	*pf;
+	fs_offset_t	offset, packsize, realsize;
+	qboolean		deflated = false;
+	int		index, handle;
+	uint		hash;
+
+	if( !fs_prefetch || fs_prefetch->value <= 0.0f || !Job_NumWorkers( ))
+		return;
+
+	if( !path || !path[0] || path[0] == '*' || path[0] == '!' )
+		return;
+
+	if( !fs_prefetch_state.freeslots && fs_prefetch_state.numslots >= MAX_PREFETCH_FILES )
+		return;
+
+	if( Q_strlen( path ) >= MAX_PACKFILE_NAME )
+		return;
+
+	if( FS_CheckNastyPath( path, false ) || FS_PrefetchFind( path ))
+		return;
+
+	search = FS_FindFile( path, &index, false );
+
+	// wad lumps are small and cached by wad code anyway
+	if( !search || search->wad )
+		return;
+
+	if( search->pack )
+	{
+		packfile_t	*pfile = &search->pack->files[index];
+
+		if( !( pfile->flags & PACKFILE_TRUEOFFS ) && !FS_ZipTrueOffset( search->pack, pfile ))
+			return;
+
+		offset = pfile->offset;
+		packsize = pfile->packsize;
+		realsize = pfile->realsize;
+		deflated = ( pfile->flags & PACKFILE_DEFLATED ) ? true : false;
+		handle = FS_OpenReadHandle( search->pack->filename );
+	}
+	else
+	{
+		char	netpath[MAX_SYSPATH];
+
+		Q_snprintf( netpath, sizeof( netpath ), "%s%s", search->filename, path );
+		handle = FS_OpenReadHandle( netpath );
+		offset = 0;
+		realsize = packsize = ( handle >= 0 ) ? lseek( handle, 0, SEEK_END ) : 0;
+	}
+
+	if( handle < 0 )
+		return;
+
+	if( realsize <= 0 || fs_prefetch_state.totalsize + realsize > fs_prefetch->value * 1024 * 1024 )
+	{
+		close( handle );
+		return;
+	}
+
+	if( !fs_prefetch_state.lock )
+		fs_prefetch_state.lock = Sys_CreateMutex();
+
+	if( fs_prefetch_state.freeslots )
+	{
+		pf = fs_prefetch_state.freeslots;
+		fs_prefetch_state.freeslots = pf->nexthash;
+	}
+	else pf = &fs_prefetch_state.files[fs_prefetch_state.numslots++];
+
+	// released slot may still have a stale job queued, it does nothing until QUEUED is set
+	Q_strncpy( pf->name, path, sizeof( pf->name ));
+	pf->handle = handle;
+	pf->offset = offset;
+	pf->packsize = packsize;
+	pf->realsize = realsize;
+	pf->in_position = 0;
+	pf->buffer = (byte *)Mem_Alloc( fs_mempool, realsize + 1 );
+	pf->inf = deflated ? Inflate_Create( fs_mempool, FS_PrefetchRead, pf ) : NULL;
+
+	Sys_LockMutex( fs_prefetch_state.lock );
+	pf->state = PREFETCH_QUEUED;
+	Sys_UnlockMutex( fs_prefetch_state.lock );
+
+	hash = Com_HashKey( path, PREFETCH_HASH_SIZE );
+	pf->nexthash = fs_prefetch_state.hash[hash];
+	fs_prefetch_state.hash[hash] = pf;
+	fs_prefetch_state.totalsize += realsize;
+	fs_prefetch_state.queuedsize += realsize;
+	fs_prefetch_state.numqueued++;
+
+	Job_Add( &fs_prefetch_state.group, FS_PrefetchJob, pf );
+}
+
+/*
+============
+FS_PrefetchRelease
+
+Give slot and its share of the budget back,
+worker must be done with it
+============
+*/
+static void FS_PrefetchRelease( prefetch_t *pf )
+{
+	prefetch_t	**prev;
+
+	for( prev = &fs_prefetch_state.hash[Com_HashKey( pf->name, PREFETCH_HASH_SIZE )]; *prev; prev = &(*prev)->nexthash )
+	{
+		if( *prev == pf )
+		{
+			*prev = pf->nexthash;
+			break;
+		}
+	}
+
+	if( pf->buffer ) Mem_Free( pf->buffer );
+	Inflate_Free( pf->inf );
+	pf->buffer = NULL;
+	pf->inf = NULL;
+
+	fs_prefetch_state.totalsize -= pf->realsize;
+	pf->nexthash = fs_prefetch_state.freeslots;
+	fs_prefetch_state.freeslots = pf;
+}
+
+/*
+============
+FS_PrefetchTake
+
+Hand prefetched buffer over to the caller, loads it right
+now if nobody started yet or waits for unfinished read
+============
+*/
+static byte *FS_PrefetchTake( const char *path, fs_offset_t *filesizeptr )
+{
+	prefetch_t	*pf;
+	byte		*buf = NULL;
+
+	if( !fs_prefetch_state.numslots )
+		return NULL;
+
+	if( path[0] == '/' || path[0] == '\\' ) path++;
+	if( path[0] == '/' || path[0] == '\\' ) path++;
+
+	if(( pf = FS_PrefetchFind( path )) == NULL )
+		return NULL;
+
+	// still in queue, do it here
+	FS_PrefetchJob( pf );
+
+	Sys_LockMutex( fs_prefetch_state.lock );
+	while( pf->state == PREFETCH_LOADING )
+	{
+		Sys_UnlockMutex( fs_prefetch_state.lock );
+		Sys_Sleep( 0 );
+		Sys_LockMutex( fs_prefetch_state.lock );
+	}
+
+	if( pf->state == PREFETCH_DONE )
+	{
+		buf = pf->buffer;
+		buf[pf->realsize] = '\0';
+		if( filesizeptr ) *filesizeptr = pf->realsize;
+		pf->buffer = NULL;
+		fs_prefetch_state.numtaken++;
+	}
+
+	// failed reads are discarded too, caller loads the file itself
+	pf->state = PREFETCH_TAKEN;
+	Sys_UnlockMutex( fs_prefetch_state.lock );
+
+	FS_PrefetchRelease( pf );
+
+	return buf;
+}
+
+/*
+============
+FS_PrefetchFlush
+
+Wait for workers and release unclaimed buffers
+============
+*/
+void FS_PrefetchFlush( void )
+{
+	int	i;
+
+	if( !fs_prefetch_state.numslots )
+		return;
+
+	Job_Wait( &fs_prefetch_state.group );
+
+	for( i = 0; i < fs_prefetch_state.numslots; i++ )
+	{
+		prefetch_t	*pf = &fs_prefetch_state.files[i];
+
+		if( pf->buffer ) Mem_Free( pf->buffer );
+		Inflate_Free( pf->inf );
+	}
+
+	MsgDev( D_NOTE, "FS_PrefetchFlush: %i files prefetched (%s), %i used\n", fs_prefetch_state.numqueued,
+		Q_memprint( fs_prefetch_state.queuedsize ), fs_prefetch_state.numtaken );
+
+	Q_memset( fs_prefetch_state.files, 0, sizeof( fs_prefetch_state.files ));
+	Q_memset( fs_prefetch_state.hash, 0, sizeof( fs_prefetch_state.hash ));
+	fs_prefetch_state.freeslots = NULL;
+	fs_prefetch_state.numslots = 0;
+	fs_prefetch_state.numqueued = 0;
+	fs_prefetch_state.numtaken = 0;
+	fs_prefetch_state.totalsize = 0;
+	fs_prefetch_state.queuedsize = 0;
+}
+
 /*
 ============
 FS_LoadFile
@@ -2772,6 +3529,9 @@ byte *FS_LoadFile( const char *path, fs_offset_t *filesizeptr, qboolean gamediro
 	byte		*buf = NULL;
 	fs_offset_t	filesize = 0;
 
+	if( !gamedironly && path && ( buf = FS_PrefetchTake( path, filesizeptr )) != NULL )
+		return buf;
+
 	file = FS_Open( path, "rb", gamedironly );
 
 #ifndef _WIN32
@@ -3125,6 +3885,20 @@ fs_offset_t FS_FileLength( file_t *f )
 	return f->real_length;
 }
 
+/*
+==================
+FS_FileCompressed
+
+deflated pack entry, seeking back in
+it restarts inflate from the beginning
+==================
+*/
+qboolean FS_FileCompressed( file_t *f )
+{
+	if( !f ) return false;
+	return ( f->ztk != NULL );
+}
+
 /*
 ==================
 FS_FileTime
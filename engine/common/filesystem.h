@@ -42,6 +42,27 @@ typedef struct
 	int		filelen;
 } dpackfile_t;
 
+/*
+========================================================================
+ZIP FILES
+
+.pk3 and .zip archives, only stored and deflated entries are supported.
+Headers are parsed bytewise because zip doesn't align its fields
+========================================================================
+*/
+#define IDZIPLOCALHEADER	(('\4'<<24)+('\3'<<16)+('K'<<8)+'P')	// little-endian "PK\3\4"
+#define IDZIPCENTRALHEADER	(('\2'<<24)+('\1'<<16)+('K'<<8)+'P')	// little-endian "PK\1\2"
+#define IDZIPENDHEADER	(('\6'<<24)+('\5'<<16)+('K'<<8)+'P')	// little-endian "PK\5\6"
+
+#define ZIP_LOCALHEADER_SIZE	30
+#define ZIP_CENTRALHEADER_SIZE	46
+#define ZIP_ENDHEADER_SIZE	22
+#define ZIP_MAX_COMMENT	65535
+
+#define ZIP_COMPRESSION_STORED	0
+#define ZIP_COMPRESSION_DEFLATED	8
+#define ZIP_FLAG_ENCRYPTED	BIT( 0 )
+
 /*
 ========================================================================
 .WAD archive format	(WhereAllData - WAD)
@@ -103,10 +124,18 @@ struct wfile_s
 	time_t		filetime;
 };
 
+#define MAX_PACKFILE_NAME	128	// zip allows long paths, pak names are limited by 56
+
+// packfile flags
+#define PACKFILE_DEFLATED	BIT( 0 )	// file must be decompressed on read
+#define PACKFILE_TRUEOFFS	BIT( 1 )	// offset points to the data, not to the zip local header
+
 typedef struct packfile_s
 {
-	char		name[56];
+	char		name[MAX_PACKFILE_NAME];
+	int		flags;
 	fs_offset_t	offset;
+	fs_offset_t	packsize;	// size in the package
 	fs_offset_t	realsize;	// real file size (uncompressed)
 } packfile_t;
 
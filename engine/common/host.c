@@ -1189,6 +1189,9 @@ void Host_InitCommon( int argc, const char** argv, const char *progname, qboolea
 
 	Cmd_AddCommand( "clear", Host_Clear_f, "clear console history" );
 
+	Inflate_Init();
+	Job_Init();
+
 	// share developer level across all dlls
 	Q_snprintf( dev_level, sizeof( dev_level ), "%i", host.developer );
 	Cvar_Get( "developer", dev_level, CVAR_INIT, "current developer level" );
@@ -1227,6 +1230,7 @@ void Host_FreeCommon( void )
 	Sound_Shutdown();
 	Netchan_Shutdown();
 	FS_Shutdown();
+	Job_Shutdown();
 
 	Mem_FreePool( &host.mempool );
 }
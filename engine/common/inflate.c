@@ -0,0 +1,654 @@
+/*
+inflate.c - streaming deflate decoder (RFC 1951) for zip archives
+Copyright (C) 2018 FWGS
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+*/
+
+#include "common.h"
+
+#define INF_MAXBITS		15	// maximum bits in a code
+#define INF_MAXLCODES	288	// maximum number of literal/length codes
+#define INF_MAXDCODES	30	// maximum number of distance codes
+#define INF_FIXLCODES	288	// number of fixed literal/length codes
+#define INF_FASTBITS	9	// bits resolved by a single table lookup
+#define INF_WINDOWSIZE	32768	// deflate sliding window
+#define INF_WINDOWMASK	(INF_WINDOWSIZE - 1)
+#define INF_INPUTSIZE	4096
+
+typedef enum
+{
+	INF_STATE_HEADER = 0,	// expecting a block header
+	INF_STATE_STORED,		// inside stored block
+	INF_STATE_CODES,		// inside huffman coded block
+	INF_STATE_COPY,		// unfinished match copy
+	INF_STATE_DONE,		// final block was processed
+} infstate_t;
+
+typedef struct
+{
+	short		count[INF_MAXBITS+1];	// number of symbols of each length
+	short		symbol[INF_MAXLCODES];	// canonically ordered symbols
+	word		fast[1<<INF_FASTBITS];	// ( length << 9 ) | symbol, zero when code is longer
+} infhuff_t;
+
+struct inflate_s
+{
+	pfnInflateRead	pfnRead;
+	void		*handle;
+
+	// input
+	byte		input[INF_INPUTSIZE];
+	int		in_ind, in_len;
+	qboolean		in_eof;
+	uint		bitbuf;
+	int		bitcnt;
+
+	// block state
+	infstate_t	state;
+	qboolean		final;
+	qboolean		error;
+	int		stored_left;
+	int		copy_len;
+	int		copy_dist;
+	infhuff_t		*lencode;
+	infhuff_t		*distcode;
+	infhuff_t		dynlen;
+	infhuff_t		dyndist;
+
+	// output
+	byte		window[INF_WINDOWSIZE];
+	size_t		total_out;
+};
+
+static const short inf_lbase[29] =
+{
+3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31,
+35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258
+};
+
+static const short inf_lext[29] =
+{
+0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2,
+3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0
+};
+
+static const short inf_dbase[30] =
+{
+1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193,
+257, 385, 513, 769, 1025, 1537, 2049, 3073, 4097, 6145,
+8193, 12289, 16385, 24577
+};
+
+static const short inf_dext[30] =
+{
+0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6,
+7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13
+};
+
+static const byte inf_clorder[19] =
+{
+16, 17, 18, 0, 8, 7, 9, 6, 10, 5, 11, 4, 12, 3, 13, 2, 14, 1, 15
+};
+
+static infhuff_t	inf_fixedlen;
+static infhuff_t	inf_fixeddist;
+
+/*
+=================
+Inf_BuildHuffman
+
+Build canonical decoding tables from the code lengths.
+Incomplete codes are allowed, over-subscribed are not
+=================
+*/
+static qboolean Inf_BuildHuffman( infhuff_t *h, const byte *length, int n )
+{
+	short	offs[INF_MAXBITS+1];
+	int	len, sym, left;
+	int	code, index, i;
+
+	Q_memset( h->count, 0, sizeof( h->count ));
+	for( sym = 0; sym < n; sym++ )
+		h->count[length[sym]]++;
+
+	Q_memset( h->fast, 0, sizeof( h->fast ));
+
+	// no codes at all, decoding will fail if something is requested
+	if( h->count[0] == n )
+		return true;
+
+	left = 1;
+	for( len = 1; len <= INF_MAXBITS; len++ )
+	{
+		left <<= 1;
+		left -= h->count[len];
+		if( left < 0 ) return false; // over-subscribed
+	}
+
+	offs[1] = 0;
+	for( len = 1; len < INF_MAXBITS; len++ )
+		offs[len + 1] = offs[len] + h->count[len];
+
+	for( sym = 0; sym < n; sym++ )
+	{
+		if( length[sym] )
+			h->symbol[offs[length[sym]]++] = sym;
+	}
+
+	// fill lookup table with the short codes,
+	// deflate stores codes MSB first so table index is bit-reversed
+	for( len = 1, code = 0, index = 0; len <= INF_FASTBITS; len++ )
+	{
+		for( i = 0; i < h->count[len]; i++, index++, code++ )
+		{
+			int	rev = 0, bit, fill;
+
+			for( bit = 0; bit < len; bit++ )
+				rev |= (( code >> bit ) & 1 ) << ( len - 1 - bit );
+
+			for( fill = rev; fill < ( 1 << INF_FASTBITS ); fill += ( 1 << len ))
+				h->fast[fill] = ( len << 9 ) | h->symbol[index];
+		}
+		code <<= 1;
+	}
+
+	return true;
+}
+
+/*
+=================
+Inflate_Init
+
+build fixed tables once, before any thread
+can decode, they are read-only after that
+=================
+*/
+void Inflate_Init( void )
+{
+	byte	lengths[INF_FIXLCODES];
+	int	sym;
+
+	for( sym = 0; sym < 144; sym++ ) lengths[sym] = 8;
+	for( ; sym < 256; sym++ ) lengths[sym] = 9;
+	for( ; sym < 280; sym++ ) lengths[sym] = 7;
+	for( ; sym < INF_FIXLCODES; sym++ ) lengths[sym] = 8;
+	Inf_BuildHuffman( &inf_fixedlen, lengths, INF_FIXLCODES );
+
+	for( sym = 0; sym < INF_MAXDCODES; sym++ ) lengths[sym] = 5;
+	Inf_BuildHuffman( &inf_fixeddist, lengths, INF_MAXDCODES );
+}
+
+/*
+=================
+Inf_GetByte
+
+returns -1 when compressed stream is over
+=================
+*/
+static int Inf_GetByte( inflate_t *inf )
+{
+	if( inf->in_ind >= inf->in_len )
+	{
+		if( inf->in_eof ) return -1;
+
+		inf->in_len = inf->pfnRead( inf->handle, inf->input, sizeof( inf->input ));
+		inf->in_ind = 0;
+
+		if( inf->in_len <= 0 )
+		{
+			inf->in_len = 0;
+			inf->in_eof = true;
+			return -1;
+		}
+	}
+
+	return inf->input[inf->in_ind++];
+}
+
+/*
+=================
+Inf_FillBits
+
+try to have at least count bits in the bit buffer
+=================
+*/
+static void Inf_FillBits( inflate_t *inf, int count )
+{
+	while( inf->bitcnt < count )
+	{
+		int	c = Inf_GetByte( inf );
+
+		if( c < 0 ) return;
+		inf->bitbuf |= (uint)c << inf->bitcnt;
+		inf->bitcnt += 8;
+	}
+}
+
+/*
+=================
+Inf_Bits
+=================
+*/
+static int Inf_Bits( inflate_t *inf, int count )
+{
+	int	val;
+
+	if( !count ) return 0;
+
+	Inf_FillBits( inf, count );
+
+	if( inf->bitcnt < count )
+	{
+		inf->error = true;
+		return 0;
+	}
+
+	val = inf->bitbuf & (( 1U << count ) - 1 );
+	inf->bitbuf >>= count;
+	inf->bitcnt -= count;
+
+	return val;
+}
+
+/*
+=================
+Inf_Decode
+
+decode one symbol, returns -1 on error
+=================
+*/
+static int Inf_Decode( inflate_t *inf, const infhuff_t *h )
+{
+	int	code, first, count, index, len;
+	word	entry;
+
+	Inf_FillBits( inf, INF_FASTBITS );
+	entry = h->fast[inf->bitbuf & (( 1 << INF_FASTBITS ) - 1 )];
+	len = entry >> 9;
+
+	if( entry && len <= inf->bitcnt )
+	{
+		inf->bitbuf >>= len;
+		inf->bitcnt -= len;
+		return entry & 511;
+	}
+
+	// long code, walk it bit by bit
+	code = first = index = 0;
+	for( len = 1; len <= INF_MAXBITS; len++ )
+	{
+		code |= Inf_Bits( inf, 1 );
+		if( inf->error ) return -1;
+
+		count = h->count[len];
+		if( code - count < first )
+			return h->symbol[index + ( code - first )];
+
+		index += count;
+		first += count;
+		first <<= 1;
+		code <<= 1;
+	}
+
+	return -1;
+}
+
+/*
+=================
+Inf_StoredHeader
+=================
+*/
+static void Inf_StoredHeader( inflate_t *inf )
+{
+	int	len, nlen;
+
+	// discard leftover bits of the current byte
+	inf->bitbuf >>= ( inf->bitcnt & 7 );
+	inf->bitcnt -= ( inf->bitcnt & 7 );
+
+	len = Inf_Bits( inf, 16 );
+	nlen = Inf_Bits( inf, 16 );
+
+	if( inf->error || len != ( ~nlen & 0xFFFF ))
+	{
+		inf->error = true;
+		return;
+	}
+
+	inf->stored_left = len;
+	inf->state = INF_STATE_STORED;
+}
+
+/*
+=================
+Inf_DynamicHeader
+=================
+*/
+static void Inf_DynamicHeader( inflate_t *inf )
+{
+	byte	lengths[INF_MAXLCODES + INF_MAXDCODES];
+	int	nlen, ndist, ncode;
+	int	index, sym, len;
+
+	nlen = Inf_Bits( inf, 5 ) + 257;
+	ndist = Inf_Bits( inf, 5 ) + 1;
+	ncode = Inf_Bits( inf, 4 ) + 4;
+
+	if( inf->error || nlen > INF_MAXLCODES || ndist > INF_MAXDCODES )
+	{
+		inf->error = true;
+		return;
+	}
+
+	// code lengths for the code length alphabet
+	for( index = 0; index < ncode; index++ )
+		lengths[inf_clorder[index]] = Inf_Bits( inf, 3 );
+	for( ; index < 19; index++ )
+		lengths[inf_clorder[index]] = 0;
+
+	if( inf->error || !Inf_BuildHuffman( &inf->dynlen, lengths, 19 ))
+	{
+		inf->error = true;
+		return;
+	}
+
+	// literal/length and distance code lengths
+	for( index = 0; index < nlen + ndist; )
+	{
+		sym = Inf_Decode( inf, &inf->dynlen );
+
+		if( sym < 0 )
+		{
+			inf->error = true;
+			return;
+		}
+
+		if( sym < 16 )
+		{
+			lengths[index++] = sym;
+			continue;
+		}
+
+		len = 0;
+
+		if( sym == 16 )
+		{
+			if( !index )
+			{
+				inf->error = true;
+				return;
+			}
+
+			len = lengths[index - 1];
+			sym = 3 + Inf_Bits( inf, 2 );
+		}
+		else if( sym == 17 ) sym = 3 + Inf_Bits( inf, 3 );
+		else sym = 11 + Inf_Bits( inf, 7 );
+
+		if( inf->error || index + sym > nlen + ndist )
+		{
+			inf->error = true;
+			return;
+		}
+
+		while( sym-- ) lengths[index++] = len;
+	}
+
+	// end of block code is mandatory
+	if( !lengths[256] )
+	{
+		inf->error = true;
+		return;
+	}
+
+	if( !Inf_BuildHuffman( &inf->dynlen, lengths, nlen ) || !Inf_BuildHuffman( &inf->dyndist, lengths + nlen, ndist ))
+	{
+		inf->error = true;
+		return;
+	}
+
+	inf->lencode = &inf->dynlen;
+	inf->distcode = &inf->dyndist;
+	inf->state = INF_STATE_CODES;
+}
+
+/*
+=================
+Inf_BlockHeader
+=================
+*/
+static void Inf_BlockHeader( inflate_t *inf )
+{
+	if( inf->final )
+	{
+		inf->state = INF_STATE_DONE;
+		return;
+	}
+
+	inf->final = Inf_Bits( inf, 1 );
+
+	switch( Inf_Bits( inf, 2 ))
+	{
+	case 0:
+		Inf_StoredHeader( inf );
+		break;
+	case 1:
+		inf->lencode = &inf_fixedlen;
+		inf->distcode = &inf_fixeddist;
+		inf->state = INF_STATE_CODES;
+		break;
+	case 2:
+		Inf_DynamicHeader( inf );
+		break;
+	default:
+		inf->error = true;
+		break;
+	}
+}
+
+/*
+=================
+Inflate_Create
+
+allocate decoder that pulls compressed data through pfnRead
+=================
+*/
+inflate_t *Inflate_Create( byte *mempool, pfnInflateRead pfnRead, void *handle )
+{
+	inflate_t	*inf = (inflate_t *)Mem_Alloc( mempool, sizeof( inflate_t ));
+
+	inf->pfnRead = pfnRead;
+	inf->handle = handle;
+	Inflate_Reset( inf );
+
+	return inf;
+}
+
+/*
+=================
+Inflate_Reset
+
+restart decoding from the beginning of the stream,
+caller must rewind the compressed data source too
+=================
+*/
+void Inflate_Reset( inflate_t *inf )
+{
+	inf->in_ind = inf->in_len = 0;
+	inf->in_eof = false;
+	inf->bitbuf = 0;
+	inf->bitcnt = 0;
+	inf->state = INF_STATE_HEADER;
+	inf->final = false;
+	inf->error = false;
+	inf->stored_left = 0;
+	inf->copy_len = 0;
+	inf->copy_dist = 0;
+	inf->total_out = 0;
+}
+
+/*
+=================
+Inflate_Read
+
+decompress up to size bytes, returns count of decompressed bytes,
+zero at the end of stream and -1 on corrupted data
+=================
+*/
+int Inflate_Read( inflate_t *inf, byte *out, int size )
+{
+	int	done = 0;
+
+	while( done < size )
+	{
+		if( inf->error )
+			return -1;
+
+		switch( inf->state )
+		{
+		case INF_STATE_HEADER:
+			Inf_BlockHeader( inf );
+			break;
+		case INF_STATE_STORED:
+			if( !inf->stored_left )
+			{
+				inf->state = INF_STATE_HEADER;
+				break;
+			}
+
+			// whole bytes can still sit in the bit buffer
+			while( inf->bitcnt >= 8 && inf->stored_left && done < size )
+			{
+				byte	b = inf->bitbuf & 0xFF;
+
+				inf->bitbuf >>= 8;
+				inf->bitcnt -= 8;
+				inf->window[inf->total_out++ & INF_WINDOWMASK] = out[done++] = b;
+				inf->stored_left--;
+			}
+
+			while( inf->stored_left && done < size )
+			{
+				int	count, pos, chunk;
+
+				if( inf->in_ind >= inf->in_len )
+				{
+					int	c = Inf_GetByte( inf );
+
+					if( c < 0 )
+					{
+						inf->error = true;
+						break;
+					}
+					inf->in_ind--; // leave it in the buffer
+				}
+
+				count = min( inf->in_len - inf->in_ind, inf->stored_left );
+				count = min( count, size - done );
+
+				Q_memcpy( out + done, inf->input + inf->in_ind, count );
+
+				// update window, it may wrap around
+				for( pos = 0; pos < count; pos += chunk )
+				{
+					int	wpos = inf->total_out & INF_WINDOWMASK;
+
+					chunk = min( count - pos, INF_WINDOWSIZE - wpos );
+					Q_memcpy( inf->window + wpos, out + done + pos, chunk );
+					inf->total_out += chunk;
+				}
+
+				inf->in_ind += count;
+				inf->stored_left -= count;
+				done += count;
+			}
+			break;
+		case INF_STATE_COPY:
+			while( inf->copy_len && done < size )
+			{
+				byte	b = inf->window[( inf->total_out - inf->copy_dist ) & INF_WINDOWMASK];
+
+				inf->window[inf->total_out++ & INF_WINDOWMASK] = out[done++] = b;
+				inf->copy_len--;
+			}
+
+			if( !inf->copy_len )
+				inf->state = INF_STATE_CODES;
+			break;
+		case INF_STATE_CODES:
+			while( done < size )
+			{
+				int	sym = Inf_Decode( inf, inf->lencode );
+
+				if( sym < 0 )
+				{
+					inf->error = true;
+					break;
+				}
+
+				if( sym < 256 )
+				{
+					inf->window[inf->total_out++ & INF_WINDOWMASK] = out[done++] = sym;
+					continue;
+				}
+
+				if( sym == 256 )
+				{
+					inf->state = INF_STATE_HEADER;
+					break;
+				}
+
+				sym -= 257;
+				if( sym >= 29 )
+				{
+					inf->error = true;
+					break;
+				}
+
+				inf->copy_len = inf_lbase[sym] + Inf_Bits( inf, inf_lext[sym] );
+
+				sym = Inf_Decode( inf, inf->distcode );
+				if( sym < 0 || sym >= 30 )
+				{
+					inf->error = true;
+					break;
+				}
+
+				inf->copy_dist = inf_dbase[sym] + Inf_Bits( inf, inf_dext[sym] );
+
+				if( inf->error || (size_t)inf->copy_dist > inf->total_out )
+				{
+					inf->error = true;
+					break;
+				}
+
+				inf->state = INF_STATE_COPY;
+				break;
+			}
+			break;
+		case INF_STATE_DONE:
+			return done;
+		}
+	}
+
+	return done;
+}
+
+/*
+=================
+Inflate_Free
+=================
+*/
+void Inflate_Free( inflate_t *inf )
+{
+	if( inf ) Mem_Free( inf );
+}
@@ -47,6 +47,19 @@ GNU General Public License for more details.
 #define MODEL_HAS_ORIGIN		BIT( 1 )
 #define MODEL_LIQUID		BIT( 2 )	// model has only point hull
 
+// precomputed PHS stored next to the map
+#define IDPHSHEADER			(('S'<<24)+('H'<<16)+('P'<<8)+'X') // little-endian "XPHS"
+#define PHS_VERSION			1
+
+typedef struct
+{
+	int		ident;
+	int		version;
+	dword		checksum;		// crc of the visibility and leafs
+	int		numleafs;
+	int		datasize;		// compressed PHS size
+} dphsheader_t;			// followed by int visofs[numleafs] and data
+
 typedef struct wadlist_s
 {
 	char		wadnames[256][32];
@@ -128,6 +141,8 @@ void Mod_BuildSurfacePolygons( msurface_t *surf, mextrasurf_t *info );
 void Mod_AmbientLevels( const vec3_t p, byte *pvolumes );
 byte *Mod_CompressVis( const byte *in, size_t *size );
 byte *Mod_DecompressVis( const byte *in );
+void Mod_OrVis( byte *dst, const byte *src, size_t size );
+void Mod_AndVis( byte *dst, const byte *src, size_t size );
 modtype_t Mod_GetType( int handle );
 model_t *Mod_Handle( int handle );
 struct wadlist_s *Mod_WadList( void );
@@ -24,6 +24,8 @@ GNU General Public License for more details.
 #include "client.h"
 
 #define MAX_SIDE_VERTS		512	// per one polygon
+#define MAX_LOAD_JOBS		256	// max surface batches per model
+#define MIN_SURF_BATCH		256	// don't split surface work into smaller pieces
 
 world_static_t	world;
 
@@ -38,7 +40,48 @@ char		modelname[64];		// short model name (without path and ext)
 convar_t		*mod_studiocache;
 convar_t		*mod_allow_materials;
 convar_t		*r_wadtextures;
+convar_t		*mod_parallel;
+convar_t		*mod_phscache;
+convar_t		*mod_viscache;
 static wadlist_t	wadlist;
+
+// parallel lump processing
+typedef struct
+{
+	model_t		*mod;
+	const void	*in;		// source lump data
+	void		*out;		// converted data
+	int		first;		// first item to process
+	int		count;		// item count
+	int		errors;		// map design errors reported by main thread
+} modjob_t;
+
+static jobgroup_t	mod_loadgroup;
+static modjob_t	mod_lumpjobs[6];
+static modjob_t	mod_surfjobs[MAX_LOAD_JOBS];
+static int	mod_numlumpjobs;
+
+// uncompressed visibility rows
+typedef struct visrow_s
+{
+	struct visrow_s	*prev;		// LRU links
+	struct visrow_s	*next;
+	struct visrow_s	**owner;		// leaf slot that points to this row
+	byte		*data;
+} visrow_t;
+
+static struct
+{
+	model_t		*model;		// world that owns the cache
+	visrow_t		**slots;		// PVS rows for each leaf, then PHS rows
+	visrow_t		*rows;
+	visrow_t		lru;		// most recently used is lru.next
+	int		rowsize;
+	int		numrows;
+	int		maxrows;
+	int		hits;
+	int		misses;
+} viscache;
 		
 model_t		*loadmodel;
 model_t		*worldmodel;
@@ -160,6 +203,9 @@ void Mod_PrintBSPFileSizes_f( void )
 
 	Msg( "=== Total BSP file data space used: %s ===\n", Q_memprint( totalmemory ));
 	Msg( "World size ( %g %g %g ) units\n", world.size[0], world.size[1], world.size[2] );
+	if( viscache.model == w )
+		Msg( "Vis cache: %i / %i rows (%s), %i hits, %i misses\n", viscache.numrows, w->numleafs * 2,
+		Q_memprint( viscache.maxrows * viscache.rowsize ), viscache.hits, viscache.misses );
 	Msg( "Original name: ^1%s\n", worldmodel->name );
 	Msg( "Internal name: %s\n", (world.message[0]) ? va( "^2%s", world.message ) : "none" );
 }
@@ -245,35 +291,22 @@ byte *Mod_CompressVis( const byte *in, size_t *size )
 
 /*
 ===================
-Mod_DecompressVis
+Mod_DecompressVisTo
 ===================
 */
-byte *Mod_DecompressVis( const byte *in )
+static byte *Mod_DecompressVisTo( const byte *in, byte *out, int row )
 {
-	int	c, row;
-	byte	*out;
-
-	if( !worldmodel )
-	{
-		Host_MapDesignError( "Mod_DecompressVis: no worldmodel\n" );
-		return NULL;
-	}
-
-	row = (worldmodel->numleafs + 7) >> 3;	
-	out = visdata;
+	byte	*end = out + row;
+	int	c;
 
 	if( !in )
-	{	
+	{
 		// no vis info, so make all visible
-		while( row )
-		{
-			*out++ = 0xff;
-			row--;
-		}
-		return visdata;
+		Q_memset( out, 0xff, row );
+		return out;
 	}
 
-	do
+	while( out < end )
 	{
 		if( *in )
 		{
@@ -281,17 +314,191 @@ byte *Mod_DecompressVis( const byte *in )
 			continue;
 		}
 
-		c = in[1];
+		// don't run out of the row on broken vis data
+		c = min( in[1], end - out );
 		in += 2;
 
-		while( c )
+		Q_memset( out, 0, c );
+		out += c;
+	}
+
+	return end - row;
+}
+
+/*
+===================
+Mod_DecompressVis
+===================
+*/
+byte *Mod_DecompressVis( const byte *in )
+{
+	if( !worldmodel )
+	{
+		Host_MapDesignError( "Mod_DecompressVis: no worldmodel\n" );
+		return NULL;
+	}
+
+	return Mod_DecompressVisTo( in, visdata, (worldmodel->numleafs + 7) >> 3 );
+}
+
+/*
+===================
+Mod_FreeVisCache
+===================
+*/
+static void Mod_FreeVisCache( void )
+{
+	if( viscache.slots ) Mem_Free( viscache.slots );
+	if( viscache.rows ) Mem_Free( viscache.rows );
+	Q_memset( &viscache, 0, sizeof( viscache ));
+}
+
+/*
+===================
+Mod_InitVisCache
+
+rows are allocated up to mod_viscache megabytes,
+when the whole matrix doesn't fit LRU rows are reused
+===================
+*/
+static qboolean Mod_InitVisCache( model_t *model )
+{
+	size_t	limit;
+	int	i, numslots;
+
+	if( viscache.model == model )
+		return viscache.maxrows != 0;
+
+	Mod_FreeVisCache();
+	viscache.model = model;
+
+	if( !mod_viscache || mod_viscache->value <= 0.0f )
+		return false;
+
+	// dword aligned and large enough for fat pvs readers
+	viscache.rowsize = (( model->numleafs + 63 ) >> 5 ) << 2;
+	numslots = model->numleafs * 2;
+	limit = mod_viscache->value * 1024 * 1024;
+	viscache.maxrows = min( numslots, limit / ( viscache.rowsize + sizeof( visrow_t )));
+
+	// too small cache is useless
+	if( viscache.maxrows < 64 )
+	{
+		viscache.maxrows = 0;
+		return false;
+	}
+
+	viscache.slots = Mem_Alloc( model->mempool, numslots * sizeof( visrow_t* ));
+	viscache.rows = Mem_Alloc( model->mempool, viscache.maxrows * ( sizeof( visrow_t ) + viscache.rowsize ));
+	viscache.lru.next = viscache.lru.prev = &viscache.lru;
+
+	for( i = 0; i < viscache.maxrows; i++ )
+		viscache.rows[i].data = (byte *)( viscache.rows + viscache.maxrows ) + i * viscache.rowsize;
+
+	MsgDev( D_NOTE, "Vis cache: %i of %i rows (%s)\n", viscache.maxrows, numslots, Q_memprint( viscache.maxrows * viscache.rowsize ));
+
+	return true;
+}
+
+/*
+===================
+Mod_CachedVis
+
+returns uncompressed row which stays valid
+until it is evicted from the cache
+===================
+*/
+static byte *Mod_CachedVis( model_t *model, int slot, const byte *in )
+{
+	visrow_t	*row;
+
+	if( !in || model != worldmodel || !Mod_InitVisCache( model ))
+		return Mod_DecompressVis( in );
+
+	row = viscache.slots[slot];
+
+	if( row )
+	{
+		viscache.hits++;
+
+		if( viscache.lru.next == row )
+			return row->data;
+
+		// unlink
+		row->prev->next = row->next;
+		row->next->prev = row->prev;
+	}
+	else
+	{
+		viscache.misses++;
+
+		if( viscache.numrows < viscache.maxrows )
+		{
+			row = &viscache.rows[viscache.numrows++];
+		}
+		else
 		{
-			*out++ = 0;
-			c--;
+			// evict least recently used row
+			row = viscache.lru.prev;
+			row->prev->next = row->next;
+			row->next->prev = row->prev;
+			*row->owner = NULL;
 		}
-	} while( out - visdata < row );
 
-	return visdata;
+		row->owner = &viscache.slots[slot];
+		*row->owner = row;
+		Mod_DecompressVisTo( in, row->data, (model->numleafs + 7) >> 3 );
+	}
+
+	// link as most recently used
+	row->next = viscache.lru.next;
+	row->prev = &viscache.lru;
+	viscache.lru.next->prev = row;
+	viscache.lru.next = row;
+
+	return row->data;
+}
+
+/*
+===================
+Mod_OrVis
+
+merge visibility rows
+===================
+*/
+void Mod_OrVis( byte *dst, const byte *src, size_t size )
+{
+	size_t	i = 0;
+
+	if( !((size_t)dst & 3 ) && !((size_t)src & 3 ))
+	{
+		for( ; i + 4 <= size; i += 4 )
+			*(uint *)(dst + i) |= *(const uint *)(src + i);
+	}
+
+	for( ; i < size; i++ )
+		dst[i] |= src[i];
+}
+
+/*
+===================
+Mod_AndVis
+
+intersect visibility rows
+===================
+*/
+void Mod_AndVis( byte *dst, const byte *src, size_t size )
+{
+	size_t	i = 0;
+
+	if( !((size_t)dst & 3 ) && !((size_t)src & 3 ))
+	{
+		for( ; i + 4 <= size; i += 4 )
+			*(uint *)(dst + i) &= *(const uint *)(src + i);
+	}
+
+	for( ; i < size; i++ )
+		dst[i] &= src[i];
 }
 
 /*
@@ -325,7 +532,7 @@ byte *Mod_LeafPVS( mleaf_t *leaf, model_t *model )
 {
 	if( !model || !leaf || leaf == model->leafs || !model->visdata )
 		return Mod_DecompressVis( NULL );
-	return Mod_DecompressVis( leaf->compressed_vis );
+	return Mod_CachedVis( model, leaf - model->leafs, leaf->compressed_vis );
 }
 
 /*
@@ -338,7 +545,7 @@ byte *Mod_LeafPHS( mleaf_t *leaf, model_t *model )
 {
 	if( !model || !leaf || leaf == model->leafs || !model->visdata )
 		return Mod_DecompressVis( NULL );
-	return Mod_DecompressVis( leaf->compressed_pas );
+	return Mod_CachedVis( model, model->numleafs + ( leaf - model->leafs ), leaf->compressed_pas );
 }
 
 /*
@@ -479,6 +686,171 @@ void Mod_AmbientLevels( const vec3_t p, byte *pvolumes )
 	*(int *)pvolumes = *(int *)leaf->ambient_sound_level;
 }
 
+/*
+================
+Mod_AddLoadJob
+
+run lump conversion on worker threads
+while main thread loads other lumps
+================
+*/
+static void Mod_AddLoadJob( pfnJobFunc func, modjob_t *job )
+{
+	if( mod_parallel && mod_parallel->integer )
+		Job_Add( &mod_loadgroup, func, job );
+	else func( job );
+}
+
+/*
+================
+Mod_WaitLoadJobs
+================
+*/
+static void Mod_WaitLoadJobs( void )
+{
+	if( !Job_IsDone( &mod_loadgroup ))
+		Job_Wait( &mod_loadgroup );
+}
+
+/*
+================
+Mod_LoadChecksum
+
+checksum of converted map data to compare
+serial and parallel loading results
+================
+*/
+static dword Mod_LoadChecksum( model_t *mod )
+{
+	mextrasurf_t	*info = mod->cache.data;
+	msurface_t	*surf = mod->surfaces;
+	dword		crc;
+	int		i;
+
+	CRC32_Init( &crc );
+	CRC32_ProcessBuffer( &crc, mod->vertexes, mod->numvertexes * sizeof( mvertex_t ));
+	CRC32_ProcessBuffer( &crc, mod->edges, mod->numedges * sizeof( medge_t ));
+	CRC32_ProcessBuffer( &crc, mod->surfedges, mod->numsurfedges * sizeof( int ));
+	CRC32_ProcessBuffer( &crc, world.mins, sizeof( vec3_t ));
+	CRC32_ProcessBuffer( &crc, world.maxs, sizeof( vec3_t ));
+
+	for( i = 1; i < MAX_MAP_HULLS; i++ )
+	{
+		hull_t	*hull = &mod->hulls[i];
+
+		if( !hull->clipnodes ) continue;
+		CRC32_ProcessBuffer( &crc, hull->clipnodes, ( hull->lastclipnode + 1 ) * sizeof( dclipnode_t ));
+	}
+
+	for( i = 0; i < mod->numsurfaces; i++, surf++, info++ )
+	{
+		CRC32_ProcessBuffer( &crc, &surf->flags, sizeof( surf->flags ));
+		CRC32_ProcessBuffer( &crc, surf->texturemins, sizeof( surf->texturemins ));
+		CRC32_ProcessBuffer( &crc, surf->extents, sizeof( surf->extents ));
+		CRC32_ProcessBuffer( &crc, info->mins, sizeof( vec3_t ));
+		CRC32_ProcessBuffer( &crc, info->maxs, sizeof( vec3_t ));
+		CRC32_ProcessBuffer( &crc, info->origin, sizeof( vec3_t ));
+	}
+
+	CRC32_Final( &crc );
+
+	return crc;
+}
+
+/*
+================
+Mod_BenchmarkMap
+
+returns load time in milliseconds
+================
+*/
+static double Mod_BenchmarkMap( const char *name, qboolean parallel, dword *checksum )
+{
+	model_t	*mod;
+	double	start;
+
+	Cvar_SetFloat( "mod_parallel", parallel );
+	Mod_ClearAll( false );
+
+	start = Sys_DoubleTime();
+	world.loading = true;
+	mod = Mod_ForName( name, false );
+	world.loading = false;
+	start = Sys_DoubleTime() - start;
+
+	*checksum = mod ? Mod_LoadChecksum( mod ) : 0;
+	Mod_ClearAll( false );
+
+	return mod ? start * 1000.0 : -1.0;
+}
+
+/*
+================
+Mod_LoadBenchmark_f
+
+load maps with serial and parallel lump
+processing, without args loads all maps
+================
+*/
+static void Mod_LoadBenchmark_f( void )
+{
+	double	serial, parallel;
+	double	total_serial = 0.0, total_parallel = 0.0;
+	float	oldvalue = mod_parallel->value;
+	dword	crc1, crc2;
+	search_t	*t = NULL;
+	int	i, j, count;
+	string	name;
+
+	if( SV_Active() || CL_Active( ))
+	{
+		Msg( "mod_loadbench: disconnect first\n" );
+		return;
+	}
+
+	if( Cmd_Argc() < 2 )
+	{
+		t = FS_Search( "maps/*.bsp", true, false );
+		if( !t )
+		{
+			Msg( "mod_loadbench: no maps found\n" );
+			return;
+		}
+		count = t->numfilenames;
+	}
+	else count = Cmd_Argc() - 1;
+
+	Msg( "%i worker threads\n", Job_NumWorkers( ));
+	Msg( "map                       serial   parallel  result\n" );
+	Msg( "------------------------  -------  --------  ------\n" );
+
+	for( i = 0; i < count; i++ )
+	{
+		if( t ) Q_strncpy( name, t->filenames[i], sizeof( name ));
+		else Q_snprintf( name, sizeof( name ), "maps/%s.bsp", Cmd_Argv( i + 1 ));
+
+		// first load is warming up the file cache
+		if( Mod_BenchmarkMap( name, true, &crc1 ) < 0.0 )
+			continue;
+
+		// best of three passes
+		for( j = 0, serial = parallel = 1e10; j < 3; j++ )
+		{
+			serial = min( serial, Mod_BenchmarkMap( name, false, &crc1 ));
+			parallel = min( parallel, Mod_BenchmarkMap( name, true, &crc2 ));
+		}
+
+		total_serial += serial;
+		total_parallel += parallel;
+
+		Msg( "%-24s  %7.1f  %8.1f  %s\n", name, serial, parallel, ( crc1 == crc2 ) ? "ok" : "^1MISMATCH^7" );
+	}
+
+	Msg( "total: %.1f ms serial, %.1f ms parallel\n", total_serial, total_parallel );
+	Cvar_SetFloat( "mod_parallel", oldvalue );
+	if( t ) Mem_Free( t );
+}
+
 /*
 ================
 Mod_FreeUserData
@@ -509,6 +881,9 @@ static void Mod_FreeModel( model_t *mod )
 	if( !mod || !mod->name[0] )
 		return;
 
+	// jobs may still write into model memory after Host_Error
+	Mod_WaitLoadJobs();
+
 	Mod_FreeUserData( mod );
 
 	// select the properly unloader
@@ -541,6 +916,9 @@ void Mod_Init( void )
 	com_studiocache = Mem_AllocPool( "Studio Cache" );
 	mod_studiocache = Cvar_Get( "r_studiocache", "1", CVAR_ARCHIVE, "enables studio cache for speedup tracing hitboxes" );
 	r_wadtextures = Cvar_Get( "r_wadtextures", "1", CVAR_ARCHIVE, "completely ignore textures in the wad-files if disabled" );
+	mod_parallel = Cvar_Get( "mod_parallel", "1", CVAR_ARCHIVE, "process independent map lumps on worker threads" );
+	mod_phscache = Cvar_Get( "mod_phscache", "1", CVAR_ARCHIVE, "store precomputed PHS in maps/*.phs files" );
+	mod_viscache = Cvar_Get( "mod_viscache", "16", CVAR_ARCHIVE, "memory limit in megabytes for uncompressed PVS and PHS rows" );
 
 	if( !Host_IsDedicated() )
 		mod_allow_materials = Cvar_Get( "host_allow_materials", "0", CVAR_LATCH|CVAR_ARCHIVE, "allow HD textures" );
@@ -548,6 +926,7 @@ void Mod_Init( void )
 
 	Cmd_AddCommand( "mapstats", Mod_PrintBSPFileSizes_f, "show stats for currently loaded map" );
 	Cmd_AddCommand( "modellist", Mod_Modellist_f, "display loaded models list" );
+	Cmd_AddCommand( "mod_loadbench", Mod_LoadBenchmark_f, "measure map loading time, serial versus parallel" );
 
 	Mod_ResetStudioAPI ();
 	Mod_InitStudioHull ();
@@ -1311,33 +1690,31 @@ static void Mod_LoadLighting( const dlump_t *l )
 Mod_CalcSurfaceExtents
 
 Fills in surf->texturemins[] and surf->extents[]
+returns count of bad edges
 =================
 */
-static void Mod_CalcSurfaceExtents( msurface_t *surf )
+static int Mod_CalcSurfaceExtents( model_t *mod, msurface_t *surf )
 {
 	float		mins[2], maxs[2], val;
 	int		bmins[2], bmaxs[2];
-	int		i, j, e;
-	mtexinfo_t	*tex;
+	int		i, j, e, errors = 0;
 	mvertex_t		*v;
 
-	tex = surf->texinfo;
-
 	mins[0] = mins[1] = 999999;
 	maxs[0] = maxs[1] = -999999;
 
 	for( i = 0; i < surf->numedges; i++ )
 	{
-		e = loadmodel->surfedges[surf->firstedge + i];
+		e = mod->surfedges[surf->firstedge + i];
 
-		if( e >= loadmodel->numedges || e <= -loadmodel->numedges )
+		if( e >= mod->numedges || e <= -mod->numedges )
 		{
-			Host_MapDesignError( "Mod_CalcSurfaceBounds: bad edge\n" );
+			errors++;
 			continue;
 		}
 
-		if( e >= 0 ) v = &loadmodel->vertexes[loadmodel->edges[e].v[0]];
-		else v = &loadmodel->vertexes[loadmodel->edges[-e].v[1]];
+		if( e >= 0 ) v = &mod->vertexes[mod->edges[e].v[0]];
+		else v = &mod->vertexes[mod->edges[-e].v[1]];
 
 		for( j = 0; j < 2; j++ )
 		{
@@ -1354,10 +1731,9 @@ static void Mod_CalcSurfaceExtents( msurface_t *surf )
 
 		surf->texturemins[i] = bmins[i] * LM_SAMPLE_SIZE;
 		surf->extents[i] = (bmaxs[i] - bmins[i]) * LM_SAMPLE_SIZE;
-
-		if(!( tex->flags & TEX_SPECIAL ) && surf->extents[i] > 4096 )
-			MsgDev( D_ERROR, "Bad surface extents %i\n", surf->extents[i] );
 	}
+
+	return errors;
 }
 
 /*
@@ -1367,7 +1743,7 @@ Mod_CalcSurfaceBounds
 fills in surf->mins and surf->maxs
 =================
 */
-static void Mod_CalcSurfaceBounds( msurface_t *surf, mextrasurf_t *info )
+static qboolean Mod_CalcSurfaceBounds( model_t *mod, msurface_t *surf, mextrasurf_t *info )
 {
 	int	i, e;
 	mvertex_t	*v;
@@ -1376,20 +1752,44 @@ static void Mod_CalcSurfaceBounds( msurface_t *surf, mextrasurf_t *info )
 
 	for( i = 0; i < surf->numedges; i++ )
 	{
-		e = loadmodel->surfedges[surf->firstedge + i];
+		e = mod->surfedges[surf->firstedge + i];
 
-		if( e >= loadmodel->numedges || e <= -loadmodel->numedges )
-		{
-			Host_MapDesignError( "Mod_CalcSurfaceBounds: bad edge\n" );
-			return;
-		}
+		if( e >= mod->numedges || e <= -mod->numedges )
+			return false;
 
-		if( e >= 0 ) v = &loadmodel->vertexes[loadmodel->edges[e].v[0]];
-		else v = &loadmodel->vertexes[loadmodel->edges[-e].v[1]];
+		if( e >= 0 ) v = &mod->vertexes[mod->edges[e].v[0]];
+		else v = &mod->vertexes[mod->edges[-e].v[1]];
 		AddPointToBounds( v->position, info->mins, info->maxs );
 	}
 
 	VectorAverage( info->mins, info->maxs, info->origin );
+
+	return true;
+}
+
+/*
+=================
+Mod_CalcSurfaceJob
+
+job for a range of surfaces, can't
+report errors directly
+=================
+*/
+static void Mod_CalcSurfaceJob( void *data )
+{
+	modjob_t		*job = (modjob_t *)data;
+	msurface_t	*surf = job->mod->surfaces + job->first;
+	mextrasurf_t	*info = (mextrasurf_t *)job->mod->cache.data + job->first;
+	int		i;
+
+	for( i = 0; i < job->count; i++, surf++, info++ )
+	{
+		if( !surf->texinfo ) continue; // bad surface, skipped by loader
+
+		if( !Mod_CalcSurfaceBounds( job->mod, surf, info ))
+			job->errors++;
+		job->errors += Mod_CalcSurfaceExtents( job->mod, surf );
+	}
 }
 
 /*
@@ -1896,8 +2296,8 @@ static void Mod_LoadSurfaces( const dlump_t *l )
 	dface_t		*in;
 	msurface_t	*out;
 	mextrasurf_t	*info;
-	int		i, j;
-	int		count;
+	int		i, j, batch;
+	int		count, numjobs;
 
 	in = (void *)(mod_base + l->fileofs);
 	if( l->filelen % sizeof( *in ))
@@ -1968,9 +2368,6 @@ static void Mod_LoadSurfaces( const dlump_t *l )
 		if( out->texinfo->flags & TEX_SPECIAL )
 			out->flags |= SURF_DRAWTILED;
 
-		Mod_CalcSurfaceBounds( out, info );
-		Mod_CalcSurfaceExtents( out );
-
 		lightofs = LittleLong(in->lightofs);
 
 		if( loadmodel->lightdata && lightofs != -1 )
@@ -1986,6 +2383,46 @@ static void Mod_LoadSurfaces( const dlump_t *l )
 
 		for( j = 0; j < MAXLIGHTMAPS; j++ )
 			out->styles[j] = in->styles[j];
+	}
+
+	// vertexes, edges and surfedges must be converted
+	Mod_WaitLoadJobs();
+
+	// bounds and extents are calculated per surface, split them into batches
+	batch = max( MIN_SURF_BATCH, ( count + MAX_LOAD_JOBS - 1 ) / MAX_LOAD_JOBS );
+	numjobs = ( count + batch - 1 ) / batch;
+
+	for( i = 0; i < numjobs; i++ )
+	{
+		modjob_t	*job = &mod_surfjobs[i];
+
+		job->mod = loadmodel;
+		job->first = i * batch;
+		job->count = min( batch, count - job->first );
+		job->errors = 0;
+		Mod_AddLoadJob( Mod_CalcSurfaceJob, job );
+	}
+
+	Mod_WaitLoadJobs();
+
+	for( i = 0; i < numjobs; i++ )
+	{
+		for( j = 0; j < mod_surfjobs[i].errors; j++ )
+			Host_MapDesignError( "Mod_CalcSurfaceBounds: bad edge\n" );
+	}
+
+	out = loadmodel->surfaces;
+	info = loadmodel->cache.data;
+
+	for( i = 0; i < count; i++, out++, info++ )
+	{
+		if( !out->texinfo ) continue; // bad surface
+
+		for( j = 0; j < 2; j++ )
+		{
+			if(!( out->texinfo->flags & TEX_SPECIAL ) && out->extents[j] > 4096 )
+				MsgDev( D_ERROR, "Bad surface extents %i\n", out->extents[j] );
+		}
 
 		// build polygons for non-lightmapped surfaces
 		if( host.features & ENGINE_BUILD_SURFMESHES && (( out->flags & SURF_DRAWTILED ) || !out->samples ))
@@ -2001,22 +2438,15 @@ static void Mod_LoadSurfaces( const dlump_t *l )
 
 /*
 =================
-Mod_LoadVertexes
+Mod_ConvertVertexes
 =================
 */
-static void Mod_LoadVertexes( const dlump_t *l )
+static void Mod_ConvertVertexes( void *data )
 {
-	dvertex_t	*in;
-	mvertex_t	*out;
-	int	i, count;
-
-	in = (void *)( mod_base + l->fileofs );
-	if( l->filelen % sizeof( *in ))
-		Host_Error( "Mod_LoadVertexes: funny lump size in %s\n", loadmodel->name );
-	count = l->filelen / sizeof( *in );
-
-	loadmodel->numvertexes = count;
-	out = loadmodel->vertexes = Mem_Alloc( loadmodel->mempool, count * sizeof( mvertex_t ));
+	modjob_t	*job = (modjob_t *)data;
+	dvertex_t	*in = (dvertex_t *)job->in;
+	mvertex_t	*out = (mvertex_t *)job->out;
+	int	i, count = job->count;
 
 	if( world.loading ) ClearBounds( world.mins, world.maxs );
 
@@ -2040,6 +2470,51 @@ static void Mod_LoadVertexes( const dlump_t *l )
 	}
 }
 
+/*
+=================
+Mod_LoadVertexes
+=================
+*/
+static void Mod_LoadVertexes( const dlump_t *l )
+{
+	dvertex_t	*in;
+	modjob_t	*job;
+	int	count;
+
+	in = (void *)( mod_base + l->fileofs );
+	if( l->filelen % sizeof( *in ))
+		Host_Error( "Mod_LoadVertexes: funny lump size in %s\n", loadmodel->name );
+	count = l->filelen / sizeof( *in );
+
+	loadmodel->numvertexes = count;
+	loadmodel->vertexes = Mem_Alloc( loadmodel->mempool, count * sizeof( mvertex_t ));
+
+	job = &mod_lumpjobs[mod_numlumpjobs++];
+	job->in = in;
+	job->out = loadmodel->vertexes;
+	job->count = count;
+	Mod_AddLoadJob( Mod_ConvertVertexes, job );
+}
+
+/*
+=================
+Mod_ConvertEdges
+=================
+*/
+static void Mod_ConvertEdges( void *data )
+{
+	modjob_t	*job = (modjob_t *)data;
+	dedge_t	*in = (dedge_t *)job->in;
+	medge_t	*out = (medge_t *)job->out;
+	int	i, count = job->count;
+
+	for( i = 0; i < count; i++, in++, out++ )
+	{
+		out->v[0] = (unsigned short)LittleShort(in->v[0]);
+		out->v[1] = (unsigned short)LittleShort(in->v[1]);
+	}
+}
+
 /*
 =================
 Mod_LoadEdges
@@ -2048,22 +2523,38 @@ Mod_LoadEdges
 static void Mod_LoadEdges( const dlump_t *l )
 {
 	dedge_t	*in;
-	medge_t	*out;
-	int	i, count;
+	modjob_t	*job;
+	int	count;
 
 	in = (void *)( mod_base + l->fileofs );	
 	if( l->filelen % sizeof( *in ))
 		Host_Error( "Mod_LoadEdges: funny lump size in %s\n", loadmodel->name );
 
 	count = l->filelen / sizeof( *in );
-	loadmodel->edges = out = Mem_Alloc( loadmodel->mempool, count * sizeof( medge_t ));
+	loadmodel->edges = Mem_Alloc( loadmodel->mempool, count * sizeof( medge_t ));
 	loadmodel->numedges = count;
 
-	for( i = 0; i < count; i++, in++, out++ )
-	{
-		out->v[0] = (unsigned short)LittleShort(in->v[0]);
-		out->v[1] = (unsigned short)LittleShort(in->v[1]);
-	}
+	job = &mod_lumpjobs[mod_numlumpjobs++];
+	job->in = in;
+	job->out = loadmodel->edges;
+	job->count = count;
+	Mod_AddLoadJob( Mod_ConvertEdges, job );
+}
+
+/*
+=================
+Mod_ConvertSurfEdges
+=================
+*/
+static void Mod_ConvertSurfEdges( void *data )
+{
+	modjob_t		*job = (modjob_t *)data;
+	dsurfedge_t	*in = (dsurfedge_t *)job->in;
+	dsurfedge_t	*out = (dsurfedge_t *)job->out;
+	int		i, count = job->count;
+
+	for( i = 0; i < count; i++ )
+		out[i] = LittleLong( in[i] );
 }
 
 /*
@@ -2073,21 +2564,23 @@ Mod_LoadSurfEdges
 */
 static void Mod_LoadSurfEdges( const dlump_t *l )
 {
-	dsurfedge_t	*in, *out;
-	int		count, i;
+	dsurfedge_t	*in;
+	modjob_t		*job;
+	int		count;
 
 	in = (void *)( mod_base + l->fileofs );	
 	if( l->filelen % sizeof( *in ))
 		Host_Error( "Mod_LoadSurfEdges: funny lump size in %s\n", loadmodel->name );
 
 	count = l->filelen / sizeof( dsurfedge_t );
-	loadmodel->surfedges = out = Mem_Alloc( loadmodel->mempool, count * sizeof( dsurfedge_t ));
+	loadmodel->surfedges = Mem_Alloc( loadmodel->mempool, count * sizeof( dsurfedge_t ));
 	loadmodel->numsurfedges = count;
 
-	//Q_memcpy( loadmodel->surfedges, in, count * sizeof( dsurfedge_t ));
-	for( i = 0; i < count; i++)
-		out[i] = LittleLong (in[i]);
-
+	job = &mod_lumpjobs[mod_numlumpjobs++];
+	job->in = in;
+	job->out = loadmodel->surfedges;
+	job->count = count;
+	Mod_AddLoadJob( Mod_ConvertSurfEdges, job );
 }
 
 /*
@@ -2367,6 +2860,41 @@ static void Mod_LoadEntities( const dlump_t *l )
 	return;	// all done
 }
 
+/*
+=================
+Mod_ConvertClipnodes
+=================
+*/
+static void Mod_ConvertClipnodes( void *data )
+{
+	modjob_t		*job = (modjob_t *)data;
+	dclipnode_t	*in = (dclipnode_t *)job->in;
+	dclipnode_t	*out = (dclipnode_t *)job->out;
+	int		i;
+
+	for( i = 0; i < job->count; i++, out++, in++ )
+	{
+		out->planenum = LittleLong(in->planenum);
+		out->children[0] = LittleShort(in->children[0]);
+		out->children[1] = LittleShort(in->children[1]);
+	}
+}
+
+/*
+================
+Mod_AddClipnodesJob
+================
+*/
+static void Mod_AddClipnodesJob( const dclipnode_t *in, dclipnode_t *out, int count )
+{
+	modjob_t	*job = &mod_lumpjobs[mod_numlumpjobs++];
+
+	job->in = in;
+	job->out = out;
+	job->count = count;
+	Mod_AddLoadJob( Mod_ConvertClipnodes, job );
+}
+
 /*
 =================
 Mod_LoadClipnodes
@@ -2375,7 +2903,7 @@ Mod_LoadClipnodes
 static void Mod_LoadClipnodes( const dlump_t *l )
 {
 	dclipnode_t	*in, *out;
-	int		i, count;
+	int		count;
 	hull_t		*hull;
 
 	in = (void *)(mod_base + l->fileofs);
@@ -2415,12 +2943,7 @@ static void Mod_LoadClipnodes( const dlump_t *l )
 	VectorCopy( GI->client_maxs[3], hull->clip_maxs );
 	VectorSubtract( hull->clip_maxs, hull->clip_mins, world.hull_sizes[3] );
 
-	for( i = 0; i < count; i++, out++, in++ )
-	{
-		out->planenum = LittleLong(in->planenum);
-		out->children[0] = LittleShort(in->children[0]);
-		out->children[1] = LittleShort(in->children[1]);
-	}
+	Mod_AddClipnodesJob( in, out, count );
 }
 
 /*
@@ -2431,7 +2954,7 @@ Mod_LoadClipnodes31
 static void Mod_LoadClipnodes31( const dlump_t *l, const dlump_t *l2, const dlump_t *l3 )
 {
 	dclipnode_t	*in, *in2, *in3, *out, *out2, *out3;
-	int		i, count, count2, count3;
+	int		count, count2, count3;
 	hull_t		*hull;
 
 	in = (void *)(mod_base + l->fileofs);
@@ -2481,26 +3004,9 @@ static void Mod_LoadClipnodes31( const dlump_t *l, const dlump_t *l2, const dlum
 	VectorCopy( GI->client_maxs[3], hull->clip_maxs );
 	VectorSubtract( hull->clip_maxs, hull->clip_mins, world.hull_sizes[3] );
 
-	for( i = 0; i < count; i++, out++, in++ )
-	{
-		out->planenum = LittleLong(in->planenum);
-		out->children[0] = LittleShort(in->children[0]);
-		out->children[1] = LittleShort(in->children[1]);
-	}
-
-	for( i = 0; i < count2; i++, out2++, in2++ )
-	{
-		out2->planenum = LittleLong(in2->planenum);
-		out2->children[0] = LittleShort(in2->children[0]);
-		out2->children[1] = LittleShort(in2->children[1]);
-	}
-
-	for( i = 0; i < count3; i++, out3++, in3++ )
-	{
-		out3->planenum = LittleLong(in3->planenum);
-		out3->children[0] = LittleShort(in3->children[0]);
-		out3->children[1] = LittleShort(in3->children[1]);
-	}
+	Mod_AddClipnodesJob( in, out, count );
+	Mod_AddClipnodesJob( in2, out2, count2 );
+	Mod_AddClipnodesJob( in3, out3, count3 );
 }
 
 /*
@@ -2601,6 +3107,199 @@ static void Mod_MakeHull0( void )
 	}
 }
 
+/*
+=================
+Mod_PHSChecksum
+
+PHS depends only on visibility and leafs
+=================
+*/
+static dword Mod_PHSChecksum( void )
+{
+	dword	crc;
+	int	i, ofs;
+
+	CRC32_Init( &crc );
+	CRC32_ProcessBuffer( &crc, worldmodel->visdata, world.visdatasize );
+
+	for( i = 0; i < worldmodel->numleafs; i++ )
+	{
+		mleaf_t	*leaf = &worldmodel->leafs[i];
+
+		ofs = leaf->compressed_vis ? leaf->compressed_vis - worldmodel->visdata : -1;
+		CRC32_ProcessBuffer( &crc, &ofs, sizeof( ofs ));
+	}
+
+	CRC32_Final( &crc );
+
+	return crc;
+}
+
+/*
+=================
+Mod_PHSCacheName
+=================
+*/
+static void Mod_PHSCacheName( char *name, size_t size )
+{
+	Q_strncpy( name, worldmodel->name, size );
+	FS_StripExtension( name );
+	Q_strncat( name, ".phs", size );
+}
+
+/*
+=================
+Mod_CheckVisRow
+
+compressed row must decompress
+without running out of the data
+=================
+*/
+static qboolean Mod_CheckVisRow( const byte *in, const byte *end, int row )
+{
+	while( row > 0 )
+	{
+		if( in >= end )
+			return false;
+
+		if( *in )
+		{
+			in++;
+			row--;
+			continue;
+		}
+
+		// empty runs are never written by Mod_CalcPHS
+		if( in + 1 >= end || !in[1] )
+			return false;
+
+		row -= in[1];
+		in += 2;
+	}
+
+	return true;
+}
+
+/*
+=================
+Mod_LoadPHSCache
+
+read PHS that was built on previous map load
+=================
+*/
+static qboolean Mod_LoadPHSCache( dword checksum )
+{
+	dphsheader_t	hdr;
+	string		name;
+	byte		*compressed_pas;
+	int		*visofs;
+	file_t		*f;
+	int		i, num;
+
+	if( !mod_phscache->integer )
+		return false;
+
+	Mod_PHSCacheName( name, sizeof( name ));
+	f = FS_Open( name, "rb", false );
+	if( !f ) return false;
+
+	num = worldmodel->numleafs;
+
+	if( FS_Read( f, &hdr, sizeof( hdr )) != sizeof( hdr ))
+	{
+		FS_Close( f );
+		return false;
+	}
+
+	LittleLongSW( hdr.ident );
+	LittleLongSW( hdr.version );
+	LittleLongSW( hdr.checksum );
+	LittleLongSW( hdr.numleafs );
+	LittleLongSW( hdr.datasize );
+
+	if( hdr.ident != IDPHSHEADER || hdr.version != PHS_VERSION || hdr.checksum != checksum || hdr.numleafs != num || hdr.datasize <= 0 )
+	{
+		MsgDev( D_NOTE, "%s is outdated\n", name );
+		FS_Close( f );
+		return false;
+	}
+
+	visofs = Mem_Alloc( worldmodel->mempool, num * sizeof( int ));
+	compressed_pas = Mem_Alloc( worldmodel->mempool, hdr.datasize );
+
+	if( FS_Read( f, visofs, num * sizeof( int )) != num * sizeof( int ) || FS_Read( f, compressed_pas, hdr.datasize ) != hdr.datasize )
+	{
+		MsgDev( D_ERROR, "Mod_LoadPHSCache: %s is truncated\n", name );
+		Mem_Free( compressed_pas );
+		Mem_Free( visofs );
+		FS_Close( f );
+		return false;
+	}
+
+	FS_Close( f );
+
+	for( i = 0; i < num; i++ )
+	{
+		LittleLongSW( visofs[i] );
+
+		if( visofs[i] < 0 || visofs[i] >= hdr.datasize || !Mod_CheckVisRow( compressed_pas + visofs[i], compressed_pas + hdr.datasize, ( num + 7 ) >> 3 ))
+		{
+			MsgDev( D_ERROR, "Mod_LoadPHSCache: %s is corrupted\n", name );
+			Mem_Free( compressed_pas );
+			Mem_Free( visofs );
+			return false;
+		}
+	}
+
+	// apply leaf pointers
+	for( i = 0; i < num; i++ )
+		worldmodel->leafs[i].compressed_pas = compressed_pas + visofs[i];
+	Mem_Free( visofs );
+
+	return true;
+}
+
+/*
+=================
+Mod_SavePHSCache
+=================
+*/
+static void Mod_SavePHSCache( dword checksum, int *visofs, byte *compressed_pas, int datasize )
+{
+	dphsheader_t	hdr;
+	string		name;
+	file_t		*f;
+	int		i, ofs;
+
+	if( !mod_phscache->integer )
+		return;
+
+	Mod_PHSCacheName( name, sizeof( name ));
+	f = FS_Open( name, "wb", true );
+
+	if( !f )
+	{
+		MsgDev( D_WARN, "Mod_SavePHSCache: couldn't write %s\n", name );
+		return;
+	}
+
+	hdr.ident = LittleLong( IDPHSHEADER );
+	hdr.version = LittleLong( PHS_VERSION );
+	hdr.checksum = LittleLong( checksum );
+	hdr.numleafs = LittleLong( worldmodel->numleafs );
+	hdr.datasize = LittleLong( datasize );
+	FS_Write( f, &hdr, sizeof( hdr ));
+
+	for( i = 0; i < worldmodel->numleafs; i++ )
+	{
+		ofs = LittleLong( visofs[i] );
+		FS_Write( f, &ofs, sizeof( ofs ));
+	}
+
+	FS_Write( f, compressed_pas, datasize );
+	FS_Close( f );
+}
+
 /*
 =================
 Mod_CalcPHS
@@ -2621,13 +3320,22 @@ void Mod_CalcPHS( void )
 	uint	*dest, *src;
 	double	timestart;
 	size_t	phsdatasize;
+	dword	checksum;
 
 	// no worldmodel or no visdata
 	if( !world.loading || !worldmodel || !worldmodel->visdata )
 		return;
 
-	MsgDev( D_NOTE, "Building PAS...\n" );
 	timestart = Sys_DoubleTime();
+	checksum = Mod_PHSChecksum();
+
+	if( Mod_LoadPHSCache( checksum ))
+	{
+		MsgDev( D_NOTE, "PAS loading time: %g secs\n", Sys_DoubleTime() - timestart );
+		return;
+	}
+
+	MsgDev( D_NOTE, "Building PAS...\n" );
 
 	// NOTE: first leaf is skipped becuase is a outside leaf. Now all leafs have shift up by 1.
 	// and last leaf (which equal worldmodel->numleafs) has no visdata! Add one extra leaf
@@ -2719,6 +3427,8 @@ void Mod_CalcPHS( void )
 	for( i = 0; i < worldmodel->numleafs; i++ )
 		worldmodel->leafs[i].compressed_pas = compressed_pas + visofs[i];
 
+	Mod_SavePHSCache( checksum, visofs, compressed_pas, total_size );
+
 	// release uncompressed data
 	Mem_Free( uncompressed_vis );
 	Mem_Free( visofs );	// release vis offsets
@@ -2760,6 +3470,10 @@ void Mod_UnloadBrushModel( model_t *mod )
 			GL_FreeTexture( tx->fb_texturenum );	// luma texture
 		}
 #endif
+		// cache is allocated in the model mempool
+		if( viscache.model == mod )
+			Q_memset( &viscache, 0, sizeof( viscache ));
+
 		Mem_FreePool( &mod->mempool );
 	}
 
@@ -2825,6 +3539,7 @@ static void Mod_LoadBrushModel( model_t *mod, const void *buffer, qboolean *load
 #endif
 
 	loadmodel->mempool = Mem_AllocPool( va( "^2%s^7", loadmodel->name ));
+	mod_numlumpjobs = 0;
 
 	// load into heap
 	if( header->lumps[LUMP_ENTITIES].fileofs <= 1024 && (header->lumps[LUMP_ENTITIES].filelen % sizeof( dplane_t )) == 0 )
@@ -2862,6 +3577,9 @@ static void Mod_LoadBrushModel( model_t *mod, const void *buffer, qboolean *load
 	Mod_LoadSubmodels( &header->lumps[LUMP_MODELS] );
 
 	Mod_MakeHull0 ();
+
+	// clipnodes are converted in background
+	Mod_WaitLoadJobs();
 	
 	loadmodel->numframes = 2;	// regular and alternate animation
 	ents = loadmodel->entities;
@@ -32,6 +32,9 @@ GNU General Public License for more details.
 // forward declarations
 void Netchan_FlushIncoming( netchan_t *chan, int stream );
 void Netchan_AddBufferToList( fragbuf_t **pplist, fragbuf_t *pbuf );
+void Netchan_ClearFileLane( netchan_t *chan );
+void Netchan_FreeWaiting( fragbufwaiting_t *wait );
+void Netchan_UpdateFileLaneRate( netchan_t *chan );
 
 /*
 packet header ( size in bits )
@@ -428,7 +431,7 @@ Netchan_ClearFragments
 */
 void Netchan_ClearFragments( netchan_t *chan )
 {
-	fragbufwaiting_t	*wait;
+	fragbufwaiting_t	*wait, *next;
 	int		i;
 
 	for( i = 0; i < MAX_STREAMS; i++ )
@@ -437,11 +440,18 @@ void Netchan_ClearFragments( netchan_t *chan )
 
 		while( wait )
 		{
-			Netchan_ClearFragbufs( &wait->fragbufs );
-			wait = wait->next;
+			next = wait->next;
+			Netchan_FreeWaiting( wait );
+			wait = next;
 		}
 		chan->waitlist[i] = NULL;
 
+		if( chan->fragsource[i] )
+		{
+			Netchan_FreeWaiting( chan->fragsource[i] );
+			chan->fragsource[i] = NULL;
+		}
+
 		Netchan_ClearFragbufs( &chan->fragbufs[i] );
 		Netchan_FlushIncoming( chan, i );
 	}
@@ -458,6 +468,7 @@ void Netchan_Clear( netchan_t *chan )
 	int	i;
 
 	Netchan_ClearFragments( chan );
+	Netchan_ClearFileLane( chan );
 
 	chan->cleartime = 0.0;
 	chan->reliable_length = 0;
@@ -563,6 +574,244 @@ void Netchan_AddFragbufToTail( fragbufwaiting_t *wait, fragbuf_t *buf )
 	p->next = buf;
 }
 
+static fragfile_t	*net_fragfiles;	// files that are being sent
+
+/*
+==============================
+Netchan_OpenFragFile
+
+files are opened once for all transfers,
+compressed pack entries are inflated once
+because every seek back would restart inflate
+==============================
+*/
+static fragfile_t *Netchan_OpenFragFile( const char *filename )
+{
+	fragfile_t	*ff;
+	file_t		*handle;
+
+	for( ff = net_fragfiles; ff != NULL; ff = ff->next )
+	{
+		if( !Q_stricmp( ff->filename, filename ))
+		{
+			ff->refcount++;
+			return ff;
+		}
+	}
+
+	handle = FS_Open( filename, "rb", false );
+	if( !handle ) return NULL;
+
+	ff = (fragfile_t *)Mem_Alloc( net_mempool, sizeof( fragfile_t ));
+	Q_strncpy( ff->filename, filename, sizeof( ff->filename ));
+	ff->handle = handle;
+	ff->size = FS_FileLength( handle );
+	ff->refcount = 1;
+
+	if( FS_FileCompressed( handle ))
+	{
+		ff->data = Mem_Alloc( net_mempool, ff->size );
+
+		if( FS_Read( handle, ff->data, ff->size ) != ff->size )
+		{
+			MsgDev( D_ERROR, "Netchan_OpenFragFile: couldn't read %s\n", filename );
+			FS_Close( handle );
+			Mem_Free( ff->data );
+			Mem_Free( ff );
+			return NULL;
+		}
+	}
+	ff->next = net_fragfiles;
+	net_fragfiles = ff;
+
+	return ff;
+}
+
+/*
+==============================
+Netchan_ReleaseFragFile
+
+==============================
+*/
+static void Netchan_ReleaseFragFile( fragfile_t *ff )
+{
+	fragfile_t	**prev;
+
+	if( --ff->refcount > 0 )
+		return;
+
+	for( prev = &net_fragfiles; *prev != NULL; prev = &(*prev)->next )
+	{
+		if( *prev == ff )
+		{
+			*prev = ff->next;
+			break;
+		}
+	}
+
+	FS_Close( ff->handle );
+	if( ff->data ) Mem_Free( ff->data );
+	Mem_Free( ff );
+}
+
+/*
+==============================
+Netchan_FreeWaiting
+
+==============================
+*/
+void Netchan_FreeWaiting( fragbufwaiting_t *wait )
+{
+	Netchan_ClearFragbufs( &wait->fragbufs );
+
+	if( wait->file ) Netchan_ReleaseFragFile( wait->file );
+	if( wait->data ) Mem_Free( wait->data );
+	if( wait->window ) Mem_Free( wait->window );
+	Mem_Free( wait );
+}
+
+/*
+==============================
+Netchan_GetFileChunk
+
+==============================
+*/
+static void Netchan_GetFileChunk( fragbufwaiting_t *wait, int index, int *offset, int *length )
+{
+	if( index == 0 )
+	{
+		*offset = 0;
+		*length = wait->firstsize;
+		return;
+	}
+
+	*offset = wait->firstsize + ( index - 1 ) * wait->chunksize;
+	*length = min( wait->chunksize, wait->size - *offset );
+}
+
+/*
+==============================
+Netchan_GetFileData
+
+returns pointer to file data, either in the memory
+buffer or in the read window of the file, NULL when
+the file can't be read
+==============================
+*/
+static const byte *Netchan_GetFileData( fragbufwaiting_t *wait, int offset, int length )
+{
+	if( wait->data )
+		return wait->data + offset;
+
+	if( wait->file->data )
+		return wait->file->data + offset;
+
+	if( offset < wait->winoffset || offset + length > wait->winoffset + wait->winlength )
+	{
+		if( !wait->window )
+			wait->window = Mem_Alloc( net_mempool, FRAGFILE_WINDOW );
+
+		wait->winoffset = offset;
+		wait->winlength = min( FRAGFILE_WINDOW, wait->size - offset );
+
+		FS_Seek( wait->file->handle, offset, SEEK_SET );
+
+		if( FS_Read( wait->file->handle, wait->window, wait->winlength ) < length )
+		{
+			MsgDev( D_ERROR, "Netchan_GetFileData: couldn't read %s\n", wait->file->filename );
+			wait->winlength = 0;
+			return NULL;
+		}
+	}
+
+	return wait->window + ( offset - wait->winoffset );
+}
+
+/*
+==============================
+Netchan_WriteFileChunk
+
+returns false if file data couldn't be read
+==============================
+*/
+static qboolean Netchan_WriteFileChunk( fragbufwaiting_t *wait, int index, sizebuf_t *msg )
+{
+	const byte	*data = NULL;
+	int		offset, length;
+
+	Netchan_GetFileChunk( wait, index, &offset, &length );
+
+	if( length > 0 && !( data = Netchan_GetFileData( wait, offset, length )))
+		return false;
+
+	if( index == 0 )
+		BF_WriteString( msg, wait->filename );
+
+	if( length > 0 )
+		BF_WriteBytes( msg, data, length );
+
+	return true;
+}
+
+/*
+==============================
+Netchan_FileChunkSize
+
+size of chunk with filename
+==============================
+*/
+static int Netchan_FileChunkSize( fragbufwaiting_t *wait, int index )
+{
+	int	offset, length;
+
+	Netchan_GetFileChunk( wait, index, &offset, &length );
+
+	if( index == 0 )
+		length += Q_strlen( wait->filename ) + 1;
+
+	return length;
+}
+
+/*
+==============================
+Netchan_BuildFileFragment
+
+==============================
+*/
+static qboolean Netchan_BuildFileFragment( netchan_t *chan, int stream )
+{
+	fragbufwaiting_t	*wait = chan->fragsource[stream];
+	fragbuf_t		*buf;
+
+	if( !wait ) return false;
+
+	if( wait->nextfrag >= wait->fragbufcount )
+	{
+		Netchan_FreeWaiting( wait );
+		chan->fragsource[stream] = NULL;
+		return false;
+	}
+
+	buf = Netchan_AllocFragbuf();
+	buf->bufferid = wait->nextfrag + 1;
+	buf->isfile = true;
+
+	// don't send garbage, rest of the file is dropped
+	if( !Netchan_WriteFileChunk( wait, wait->nextfrag, &buf->frag_message ))
+	{
+		Mem_Free( buf );
+		Netchan_FreeWaiting( wait );
+		chan->fragsource[stream] = NULL;
+		return false;
+	}
+
+	wait->nextfrag++;
+
+	chan->fragbufs[stream] = buf;
+
+	return true;
+}
+
 /*
 ==============================
 Netchan_UpdateFlow
@@ -579,6 +828,8 @@ void Netchan_UpdateFlow( netchan_t *chan )
 
 	if( !chan ) return;
 
+	Netchan_UpdateFileLaneRate( chan );
+
 	for( flow = 0; flow < 2; flow++ )
 	{
 		pflow = &chan->flow[flow];
@@ -639,12 +890,24 @@ void Netchan_FragSend( netchan_t *chan )
 			continue;
 		}
 
+		// build next buffer of current file
+		if( Netchan_BuildFileFragment( chan, i ))
+		{
+			continue;
+		}
+
 		// nothing to queue?
 		if( !chan->waitlist[i] )
 		{
 			continue;
 		}
 
+		// files are sent by Netchan_TransmitFileLane
+		if( i == FRAG_FILE_STREAM && chan->filelane.enabled )
+		{
+			continue;
+		}
+
 		wait = chan->waitlist[i] ;
 		chan->waitlist[i] = chan->waitlist[i]->next;
 
@@ -654,6 +917,14 @@ void Netchan_FragSend( netchan_t *chan )
 		chan->fragbufs[i] = wait->fragbufs;
 		chan->fragbufcount[i] = wait->fragbufcount;
 
+		// file buffers are built one at a time
+		if( wait->file || wait->data )
+		{
+			chan->fragsource[i] = wait;
+			Netchan_BuildFileFragment( chan, i );
+			continue;
+		}
+
 		// throw away wait list
 		Mem_Free( wait );
 	}
@@ -676,7 +947,9 @@ void Netchan_AddBufferToList( fragbuf_t **pplist, fragbuf_t *pbuf )
 	if( !pplist )
 		return;
 
-	if( !*pplist )
+	id2 = FRAG_GETID( pbuf->bufferid );
+
+	if( !*pplist || FRAG_GETID( (*pplist)->bufferid ) > id2 )
 	{
 		pbuf->next = *pplist;
 		*pplist = pbuf;
@@ -688,12 +961,11 @@ void Netchan_AddBufferToList( fragbuf_t **pplist, fragbuf_t *pbuf )
 	{
 		n = pprev->next; // next item in list
 		id1 = FRAG_GETID( n->bufferid );
-		id2 = FRAG_GETID( pbuf->bufferid );
 
 		if( id1 > id2 )
 		{
 			// insert here
-			pbuf->next = n->next;
+			pbuf->next = n;
 			pprev->next = pbuf;
 			return;
 		}
@@ -856,59 +1128,39 @@ void Netchan_CheckForCompletion( netchan_t *chan, int stream, int intotalbuffers
 
 /*
 ==============================
-Netchan_CreateFileFragmentsFromBuffer
+Netchan_AddFileToWaitlist
 
+splits the file into chunks, buffers are
+built from them when they are sent
 ==============================
 */
-void Netchan_CreateFileFragmentsFromBuffer( qboolean server, netchan_t *chan, char *filename, byte *pbuf, int size )
+static qboolean Netchan_AddFileToWaitlist( netchan_t *chan, fragbufwaiting_t *wait )
 {
-	int		chunksize;
-	int		send, pos;
-	int		remaining;
-	int		bufferid = 1;
-	qboolean		firstfragment = true;
-	fragbufwaiting_t	*wait, *p;
-	fragbuf_t 	*buf;
+	fragbufwaiting_t	*p;
 
-	if( !size ) return;
+	if( chan->filelane.enabled )
+		wait->chunksize = FILELANE_BLOCKSIZE;
+	else wait->chunksize = bound( 16, net_blocksize->integer, 512 );
 
-	chunksize = bound( 16, net_blocksize->integer, 512 );
-	wait = ( fragbufwaiting_t * )Mem_Alloc( net_mempool, sizeof( fragbufwaiting_t ));
-	remaining = size;
-	pos = 0;
+	// send a bit less on first package
+	wait->firstsize = wait->chunksize - ( Q_strlen( wait->filename ) + 1 );
+	wait->firstsize = bound( 0, wait->firstsize, wait->size );
+	wait->fragbufcount = 1 + ( wait->size - wait->firstsize + wait->chunksize - 1 ) / wait->chunksize;
 
-	while( remaining > 0 )
+	// filename has to fit into the first fragment
+	if( Netchan_FileChunkSize( wait, 0 ) > FRAGMENT_SIZE )
 	{
-		send = min( remaining, chunksize );
-
-		buf = Netchan_AllocFragbuf();
-		buf->bufferid = bufferid++;
-
-		// copy in data
-		BF_Clear( &buf->frag_message );
-
-		if( firstfragment )
-		{
-			firstfragment = false;
-
-			// write filename
-			BF_WriteString( &buf->frag_message, filename );
-
-			// send a bit less on first package
-			send -= BF_GetNumBytesWritten( &buf->frag_message );
-		}
-
-		buf->isbuffer = true;
-		buf->isfile = true;
-		buf->size = send;
-		buf->foffset = pos;
-
-		BF_WriteBits( &buf->frag_message, pbuf + pos, send << 3 );
-
-		pos += send;
-		remaining -= send;
+		MsgDev( D_ERROR, "%s has too long name for transfer\n", wait->filename );
+		Netchan_FreeWaiting( wait );
+		return false;
+	}
 
-		Netchan_AddFragbufToTail( wait, buf );
+	// fragment ids are 16 bit
+	if( wait->fragbufcount > 0xffff )
+	{
+		MsgDev( D_ERROR, "%s is too big for transfer\n", wait->filename );
+		Netchan_FreeWaiting( wait );
+		return false;
 	}
 
 	// now add waiting list item to end of buffer queue
@@ -926,87 +1178,57 @@ void Netchan_CreateFileFragmentsFromBuffer( qboolean server, netchan_t *chan, ch
 		}
 		p->next = wait;
 	}
+
+	return true;
 }
 
 /*
 ==============================
-Netchan_CreateFileFragments
+Netchan_CreateFileFragmentsFromBuffer
 
 ==============================
 */
-int Netchan_CreateFileFragments( qboolean server, netchan_t *chan, const char *filename )
+void Netchan_CreateFileFragmentsFromBuffer( qboolean server, netchan_t *chan, char *filename, byte *pbuf, int size )
 {
-	int		chunksize;
-	int		send, pos;
-	int		remaining;
-	int		bufferid = 1;
-	int		filesize = 0;
-	qboolean		firstfragment = true;
-	fragbufwaiting_t	*wait, *p;
-	fragbuf_t		*buf;
-
-	chunksize = bound( 16, net_blocksize->integer, 512 );
-	filesize = FS_FileSize( filename, false );
+	fragbufwaiting_t	*wait;
 
-	if( filesize <= 0 )
-	{
-		MsgDev( D_WARN, "Unable to open %s for transfer\n", filename );
-		return 0;
-	}
+	if( !size ) return;
 
 	wait = (fragbufwaiting_t *)Mem_Alloc( net_mempool, sizeof( fragbufwaiting_t ));
-	remaining = filesize;
-	pos = 0;
-
-	while( remaining > 0 )
-	{
-		send = min( remaining, chunksize );
-
-		buf = Netchan_AllocFragbuf();
-		buf->bufferid = bufferid++;
-
-		// copy in data
-		BF_Clear( &buf->frag_message );
-
-		if( firstfragment )
-		{
-			firstfragment = false;
-
-			// Write filename
-			BF_WriteString( &buf->frag_message, filename );
+	Q_strncpy( wait->filename, filename, sizeof( wait->filename ));
+	wait->data = Mem_Alloc( net_mempool, size );
+	Q_memcpy( wait->data, pbuf, size );
+	wait->size = size;
 
-			// Send a bit less on first package
-			send -= BF_GetNumBytesWritten( &buf->frag_message );
-		}
+	Netchan_AddFileToWaitlist( chan, wait );
+}
 
-		buf->isfile = true;
-		buf->size = send;
-		buf->foffset = pos;
-		Q_strncpy( buf->filename, filename, sizeof( buf->filename ));
+/*
+==============================
+Netchan_CreateFileFragments
 
-		pos += send;
-		remaining -= send;
+==============================
+*/
+int Netchan_CreateFileFragments( qboolean server, netchan_t *chan, const char *filename )
+{
+	fragbufwaiting_t	*wait;
+	fragfile_t	*file;
 
-		Netchan_AddFragbufToTail( wait, buf );
-	}
+	file = Netchan_OpenFragFile( filename );
 
-	// now add waiting list item to end of buffer queue
-	if( !chan->waitlist[FRAG_FILE_STREAM] )
+	if( !file || file->size <= 0 )
 	{
-		chan->waitlist[FRAG_FILE_STREAM] = wait;
+		MsgDev( D_WARN, "Unable to open %s for transfer\n", filename );
+		if( file ) Netchan_ReleaseFragFile( file );
+		return 0;
 	}
-	else
-	{
-		p = chan->waitlist[FRAG_FILE_STREAM];
-		while( p->next )
-		{
-			p = p->next;
-		}
 
-		p->next = wait;
-	}
+	wait = (fragbufwaiting_t *)Mem_Alloc( net_mempool, sizeof( fragbufwaiting_t ));
+	Q_strncpy( wait->filename, filename, sizeof( wait->filename ));
+	wait->file = file;
+	wait->size = file->size;
 
-	return 1;
+	return Netchan_AddFileToWaitlist( chan, wait );
 }
 
 /*
@@ -1265,6 +1487,17 @@ void Netchan_UpdateProgress( netchan_t *chan )
 				*out = '\0';
 			}
 		}
+		else if( i == FRAG_FILE_STREAM && chan->filelane.blocks )	// Sending data over file lane
+		{
+			float	percent;
+
+			percent = 100.0f * (float)chan->filelane.numacked / (float)chan->filelane.numblocks;
+
+			if( percent > bestpercent )
+			{
+				bestpercent = percent;
+			}
+		}
 		else if( chan->fragbufs[i] )	// Sending data
 		{
 			if( chan->fragbufcount[i] )
@@ -1415,12 +1648,6 @@ void Netchan_TransmitBits( netchan_t *chan, int length, byte *data )
 			if( pbuf )
 			{
 				fragment_size = BF_GetNumBytesWritten( &pbuf->frag_message );
-
-				// files set size a bit differently.
-				if( pbuf->isfile && !pbuf->isbuffer )
-				{
-					fragment_size = pbuf->size;
-				}
 			}
 
 			newpayloadsize = (( chan->reliable_length + ( fragment_size << 3 )) + 7 ) >> 3;
@@ -1433,20 +1660,6 @@ void Netchan_TransmitBits( netchan_t *chan, int length, byte *data )
 				// which buffer are we sending ?
 				chan->reliable_fragid[i] = MAKE_FRAGID( pbuf->bufferid, chan->fragbufcount[i] );
 
-				// if it's not in-memory, then we'll need to copy it in frame the file handle.
-				if( pbuf->isfile && !pbuf->isbuffer )
-				{
-					byte	filebuffer[2048];
-					file_t	*hfile;
-
-					hfile = FS_Open( pbuf->filename, "rb", false );
-					FS_Seek( hfile, pbuf->foffset, SEEK_SET );
-					FS_Read( hfile, filebuffer, pbuf->size );
-
-					BF_WriteBits( &pbuf->frag_message, filebuffer, pbuf->size << 3 );
-					FS_Close( hfile );
-				}
-
 				// copy frag stuff on top of current buffer
 				BF_StartWriting( &temp, chan->reliable_buf, sizeof( chan->reliable_buf ), chan->reliable_length, -1 );
 
@@ -1838,3 +2051,634 @@ qboolean Netchan_Process( netchan_t *chan, sizebuf_t *msg )
 	}
 	return true;
 }
+
+/*
+==============================================================
+
+FILE LANE
+
+files are sent outside of the sequenced channel in blocks of
+FILELANE_BLOCKSIZE bytes, so they never hold back reliable game
+data. Every block is acknowledged on its own and the sender paces
+blocks with a rate estimated in Netchan_UpdateFileLaneRate.
+Packets without the key given by server on connect are dropped,
+so blocks can't be spoofed by anyone who knows only the address.
+
+data packet ( size in bits )
+-------------
+32	FILELANE_SIGNATURE
+8	LANE_DATA
+32	lane key
+32	transfer id
+16	block index
+16	total blocks
+*	block data, first block starts with the filename
+
+ack packet
+-------------
+32	FILELANE_SIGNATURE
+8	LANE_ACK
+32	lane key
+32	transfer id
+16	number of blocks received in order
+8	count of selective acks
+16	index of received block ( repeated count times )
+==============================================================
+*/
+#define LANE_DATA			1
+#define LANE_ACK			2
+#define LANE_HEADER_SIZE		17
+#define LANE_BURST			0.02	// allowed burst over a frame worth of credit, in seconds
+#define LANE_MIN_RTO		0.1
+#define LANE_MAX_RTO		3.0
+
+/*
+==============================
+Netchan_AddFlowSample
+
+==============================
+*/
+static void Netchan_AddFlowSample( netchan_t *chan, int flow, int size )
+{
+	flow_t	*pflow = &chan->flow[flow];
+
+	pflow->stats[pflow->current & ( MAX_LATENT - 1 )].size = size;
+	pflow->stats[pflow->current & ( MAX_LATENT - 1 )].time = host.realtime;
+	pflow->totalbytes += size;
+	pflow->current++;
+}
+
+/*
+==============================
+Netchan_SendLanePacket
+
+==============================
+*/
+static void Netchan_SendLanePacket( netchan_t *chan, sizebuf_t *send )
+{
+	int	size = BF_GetNumBytesWritten( send );
+
+	Netchan_AddFlowSample( chan, FLOW_OUTGOING, size + UDP_HEADER_SIZE );
+	chan->total_sended += size;
+	chan->total_sended_uncompressed += size;
+
+	if( !CL_IsPlaybackDemo( ))
+		NET_SendPacket( chan->sock, size, BF_GetData( send ), chan->remote_address );
+}
+
+/*
+==============================
+Netchan_LaneBlockSize
+
+size of block on the wire
+==============================
+*/
+static int Netchan_LaneBlockSize( netchan_t *chan, int index )
+{
+	return Netchan_FileChunkSize( chan->filelane.source, index ) + LANE_HEADER_SIZE + UDP_HEADER_SIZE;
+}
+
+/*
+==============================
+Netchan_FinishFileLane
+
+release current outgoing transfer
+==============================
+*/
+static void Netchan_FinishFileLane( netchan_t *chan )
+{
+	filelane_t	*lane = &chan->filelane;
+
+	if( lane->blocks )
+	{
+		Mem_Free( lane->blocks );
+		lane->blocks = NULL;
+	}
+
+	if( lane->source )
+	{
+		Netchan_FreeWaiting( lane->source );
+		lane->source = NULL;
+	}
+
+	lane->numblocks = 0;
+	lane->numacked = 0;
+	lane->cumacked = 0;
+	lane->nextblock = 0;
+}
+
+/*
+==============================
+Netchan_ClearFileLane
+
+==============================
+*/
+void Netchan_ClearFileLane( netchan_t *chan )
+{
+	filelane_t	*lane = &chan->filelane;
+
+	Netchan_FinishFileLane( chan );
+
+	// transfer ids are kept, so late blocks are still recognized
+	if( lane->inmask )
+	{
+		Mem_Free( lane->inmask );
+		lane->inmask = NULL;
+	}
+
+	lane->intotal = 0;
+	lane->inreceived = 0;
+	lane->incum = 0;
+	lane->indone = false;
+	lane->intail = NULL;
+	lane->numacks = 0;
+	lane->ackpending = false;
+}
+
+/*
+==============================
+Netchan_StartFileLane
+
+move next file from waiting list to the lane
+==============================
+*/
+static qboolean Netchan_StartFileLane( netchan_t *chan )
+{
+	filelane_t	*lane = &chan->filelane;
+	fragbufwaiting_t	*wait;
+
+	while(( wait = chan->waitlist[FRAG_FILE_STREAM] ) != NULL )
+	{
+		chan->waitlist[FRAG_FILE_STREAM] = wait->next;
+		wait->next = NULL;
+
+		// blocks are built from the file when they are sent
+		if( !wait->file && !wait->data )
+		{
+			MsgDev( D_ERROR, "Netchan_StartFileLane: no file to send\n" );
+			Netchan_FreeWaiting( wait );
+			continue;
+		}
+
+		lane->source = wait;
+		lane->numblocks = wait->fragbufcount;
+		lane->blocks = (laneblock_t *)Mem_Alloc( net_mempool, sizeof( laneblock_t ) * lane->numblocks );
+
+		// first transfer on this channel
+		if( !lane->rate )
+		{
+			lane->rate = FILELANE_MINRATE * 4;
+			lane->rto = 1.0;
+		}
+
+		lane->outid++;
+		lane->credit = 0.0;
+		lane->lastcredit = host.realtime;
+		lane->lastestimate = host.realtime;
+		lane->ackedsendtime = 0.0;
+		lane->ackedbytes = 0;
+		lane->lost = 0;
+		lane->limited = false;
+
+		MsgDev( D_NOTE, "Netchan_StartFileLane: sending %i blocks\n", lane->numblocks );
+		return true;
+	}
+
+	return false;
+}
+
+/*
+==============================
+Netchan_SendLaneBlock
+
+returns number of bytes sent, zero
+if transfer was aborted on read error
+==============================
+*/
+static int Netchan_SendLaneBlock( netchan_t *chan, int index )
+{
+	filelane_t	*lane = &chan->filelane;
+	byte		send_buf[LANE_HEADER_SIZE + FRAGMENT_SIZE];
+	sizebuf_t		send;
+
+	BF_Init( &send, "FileLane", send_buf, sizeof( send_buf ));
+
+	BF_WriteLong( &send, FILELANE_SIGNATURE );
+	BF_WriteByte( &send, LANE_DATA );
+	BF_WriteLong( &send, lane->key );
+	BF_WriteLong( &send, lane->outid );
+	BF_WriteWord( &send, index );
+	BF_WriteWord( &send, lane->numblocks );
+
+	if( !Netchan_WriteFileChunk( lane->source, index, &send ))
+	{
+		Netchan_FinishFileLane( chan );
+		return 0;
+	}
+
+	Netchan_SendLanePacket( chan, &send );
+	lane->blocks[index].sendtime = host.realtime;
+
+	return BF_GetNumBytesWritten( &send ) + UDP_HEADER_SIZE;
+}
+
+/*
+==============================
+Netchan_FlushLaneAcks
+
+==============================
+*/
+static void Netchan_FlushLaneAcks( netchan_t *chan )
+{
+	filelane_t	*lane = &chan->filelane;
+	byte		send_buf[LANE_HEADER_SIZE + FILELANE_MAX_ACKS * 2];
+	sizebuf_t		send;
+	int		i;
+
+	if( !lane->ackpending )
+		return;
+
+	BF_Init( &send, "FileLaneAck", send_buf, sizeof( send_buf ));
+
+	BF_WriteLong( &send, FILELANE_SIGNATURE );
+	BF_WriteByte( &send, LANE_ACK );
+	BF_WriteLong( &send, lane->key );
+	BF_WriteLong( &send, lane->inid );
+	BF_WriteWord( &send, lane->indone ? lane->intotal : lane->incum );
+	BF_WriteByte( &send, lane->numacks );
+
+	for( i = 0; i < lane->numacks; i++ )
+		BF_WriteWord( &send, lane->acks[i] );
+
+	Netchan_SendLanePacket( chan, &send );
+
+	lane->numacks = 0;
+	lane->ackpending = false;
+}
+
+/*
+==============================
+Netchan_AckLaneBlock
+
+==============================
+*/
+static void Netchan_AckLaneBlock( netchan_t *chan, int index )
+{
+	filelane_t	*lane = &chan->filelane;
+	laneblock_t	*block = &lane->blocks[index];
+	double		rtt;
+
+	if( block->acked )
+		return;
+
+	block->acked = true;
+	lane->numacked++;
+	lane->ackedbytes += Netchan_LaneBlockSize( chan, index );
+
+	if( block->sendtime )
+	{
+		// Karn's algorithm: retransmitted blocks give ambiguous samples
+		if( !block->retries )
+		{
+			rtt = host.realtime - block->sendtime;
+
+			if( !lane->srtt )
+			{
+				lane->srtt = rtt;
+				lane->rttvar = rtt * 0.5;
+			}
+			else
+			{
+				lane->rttvar = 0.75 * lane->rttvar + 0.25 * fabs( lane->srtt - rtt );
+				lane->srtt = 0.875 * lane->srtt + 0.125 * rtt;
+			}
+
+			lane->rto = bound( LANE_MIN_RTO, lane->srtt + 4.0 * lane->rttvar, LANE_MAX_RTO );
+		}
+
+		lane->ackedsendtime = max( lane->ackedsendtime, block->sendtime );
+	}
+
+	while( lane->cumacked < lane->numblocks && lane->blocks[lane->cumacked].acked )
+		lane->cumacked++;
+}
+
+/*
+==============================
+Netchan_ProcessLaneData
+
+==============================
+*/
+static void Netchan_ProcessLaneData( netchan_t *chan, sizebuf_t *msg, uint id )
+{
+	filelane_t	*lane = &chan->filelane;
+	int		index, total, length;
+	fragbuf_t		*buf;
+
+	index = BF_ReadWord( msg );
+	total = BF_ReadWord( msg );
+	length = BF_GetNumBytesLeft( msg );
+
+	if( BF_CheckOverflow( msg ) || index >= total || length <= 0 || length > FRAGMENT_SIZE )
+	{
+		MsgDev( D_WARN, "Netchan_ProcessFileLane: malformed block from %s\n", NET_AdrToString( chan->remote_address ));
+		return;
+	}
+
+	if( id != lane->inid || ( !lane->inmask && !lane->indone ))
+	{
+		// late block of an older transfer
+		if( id != lane->inid && (int)( id - lane->inid ) < 0 )
+			return;
+
+		// previous file wasn't picked up yet, sender will retry
+		if( chan->incomingready[FRAG_FILE_STREAM] )
+			return;
+
+		Netchan_ClearFragbufs( &chan->incomingbufs[FRAG_FILE_STREAM] );
+		if( lane->inmask ) Mem_Free( lane->inmask );
+
+		lane->inid = id;
+		lane->intotal = total;
+		lane->inmask = Mem_Alloc( net_mempool, total );
+		lane->inreceived = 0;
+		lane->incum = 0;
+		lane->indone = false;
+		lane->intail = NULL;
+		lane->numacks = 0;
+	}
+
+	lane->ackpending = true;
+
+	if( lane->indone || lane->intotal != total )
+		return;
+
+	if( !lane->inmask[index] )
+	{
+		buf = Netchan_AllocFragbuf();
+		buf->bufferid = MAKE_FRAGID( ( index + 1 ), total );
+		BF_WriteBytes( &buf->frag_message, BF_GetData( msg ) + BF_GetNumBytesRead( msg ), length );
+
+		// blocks mostly arrive in order
+		if( lane->intail && FRAG_GETID( lane->intail->bufferid ) < index + 1 )
+		{
+			lane->intail->next = buf;
+			lane->intail = buf;
+		}
+		else
+		{
+			Netchan_AddBufferToList( &chan->incomingbufs[FRAG_FILE_STREAM], buf );
+			if( !buf->next ) lane->intail = buf;
+		}
+
+		lane->inmask[index] = 1;
+		lane->inreceived++;
+
+		while( lane->incum < lane->intotal && lane->inmask[lane->incum] )
+			lane->incum++;
+	}
+
+	// duplicates are acknowledged again, their ack could be lost
+	lane->acks[lane->numacks++] = index;
+
+	if( lane->inreceived == lane->intotal )
+	{
+		lane->indone = true;
+		Mem_Free( lane->inmask );
+		lane->inmask = NULL;
+
+		chan->incomingready[FRAG_FILE_STREAM] = true;
+		MsgDev( D_NOTE, "\nincoming is complete, %i blocks waiting\n", total );
+	}
+
+	if( lane->indone || lane->numacks == FILELANE_MAX_ACKS )
+		Netchan_FlushLaneAcks( chan );
+}
+
+/*
+==============================
+Netchan_ProcessLaneAck
+
+==============================
+*/
+static void Netchan_ProcessLaneAck( netchan_t *chan, sizebuf_t *msg, uint id )
+{
+	filelane_t	*lane = &chan->filelane;
+	int		i, cum, count, index;
+
+	cum = BF_ReadWord( msg );
+	count = BF_ReadByte( msg );
+
+	if( BF_CheckOverflow( msg ) || !lane->blocks || id != lane->outid )
+		return;
+
+	cum = min( cum, lane->nextblock );
+
+	for( i = lane->cumacked; i < cum; i++ )
+		Netchan_AckLaneBlock( chan, i );
+
+	for( i = 0; i < count; i++ )
+	{
+		index = BF_ReadWord( msg );
+
+		if( BF_CheckOverflow( msg ))
+			break;
+
+		if( index < lane->nextblock )
+			Netchan_AckLaneBlock( chan, index );
+	}
+
+	if( lane->numacked == lane->numblocks )
+	{
+		MsgDev( D_NOTE, "Netchan_ProcessFileLane: transfer %i is complete\n", lane->outid );
+		Netchan_FinishFileLane( chan );
+	}
+}
+
+/*
+==============================
+Netchan_ProcessFileLane
+
+called when net_message is a FILELANE_SIGNATURE
+packet from remote_address
+==============================
+*/
+void Netchan_ProcessFileLane( netchan_t *chan, sizebuf_t *msg )
+{
+	int	type;
+	uint	key, id;
+
+	if( !chan->filelane.enabled )
+		return;
+
+	BF_Clear( msg );
+	BF_ReadLong( msg ); // skip the signature
+	type = BF_ReadByte( msg );
+	key = (uint)BF_ReadLong( msg );
+	id = (uint)BF_ReadLong( msg );
+
+	if( BF_CheckOverflow( msg ))
+		return;
+
+	if( key != chan->filelane.key )
+	{
+		MsgDev( D_NOTE, "Netchan_ProcessFileLane: bad key from %s\n", NET_AdrToString( chan->remote_address ));
+		return;
+	}
+
+	Netchan_AddFlowSample( chan, FLOW_INCOMING, BF_GetMaxBytes( msg ) + UDP_HEADER_SIZE );
+	chan->total_received += BF_GetMaxBytes( msg );
+	chan->total_received_uncompressed += BF_GetMaxBytes( msg );
+
+	switch( type )
+	{
+	case LANE_DATA:
+		Netchan_ProcessLaneData( chan, msg, id );
+		break;
+	case LANE_ACK:
+		Netchan_ProcessLaneAck( chan, msg, id );
+		break;
+	default:
+		MsgDev( D_WARN, "Netchan_ProcessFileLane: bad packet type %i from %s\n", type, NET_AdrToString( chan->remote_address ));
+		break;
+	}
+}
+
+/*
+==============================
+Netchan_UpdateFileLaneRate
+
+called from Netchan_UpdateFlow. The rate grows while the lane
+is limited by it, and drops at most once per round trip when
+blocks are lost, but not below the measured delivery rate
+==============================
+*/
+void Netchan_UpdateFileLaneRate( netchan_t *chan )
+{
+	filelane_t	*lane = &chan->filelane;
+	double		interval, maxrate, rtt;
+
+	if( !lane->blocks )
+		return;
+
+	interval = host.realtime - lane->lastestimate;
+	if( interval < FLOW_INTERVAL )
+		return;
+
+	lane->lastestimate = host.realtime;
+	maxrate = lane->maxrate ? lane->maxrate : FILELANE_MAXRATE;
+	rtt = lane->srtt ? max( lane->srtt, 0.01 ) : lane->rto;
+
+	lane->delivered = ( FLOW_AVG ) * lane->delivered + ( 1.0 - FLOW_AVG ) * ( lane->ackedbytes / interval );
+
+	if( lane->lost )
+	{
+		if( host.realtime >= lane->nextdecrease )
+		{
+			lane->rate = max( lane->rate * 0.5, lane->delivered * 0.85 );
+			lane->ssthresh = lane->rate;
+			lane->nextdecrease = host.realtime + rtt;
+		}
+	}
+	else if( lane->limited )
+	{
+		if( !lane->ssthresh || lane->rate < lane->ssthresh )
+			lane->rate += lane->rate * min( interval / rtt, 1.0 );	// doubles every round trip
+		else lane->rate += FILELANE_BLOCKSIZE * interval / ( rtt * rtt );	// one more block per round trip
+	}
+
+	lane->rate = bound( FILELANE_MINRATE, lane->rate, maxrate );
+	lane->ackedbytes = 0;
+	lane->lost = 0;
+	lane->limited = false;
+}
+
+/*
+==============================
+Netchan_FileLaneActive
+
+==============================
+*/
+qboolean Netchan_FileLaneActive( netchan_t *chan )
+{
+	if( !chan->filelane.enabled )
+		return false;
+
+	return ( chan->filelane.blocks || chan->waitlist[FRAG_FILE_STREAM] );
+}
+
+/*
+==============================
+Netchan_TransmitFileLane
+
+called every frame, sends pending
+acks and paced file blocks
+==============================
+*/
+void Netchan_TransmitFileLane( netchan_t *chan )
+{
+	filelane_t	*lane = &chan->filelane;
+	laneblock_t	*block;
+	int		i, size, resend, timeouts = 0;
+	double		burst;
+
+	if( !lane->enabled )
+		return;
+
+	Netchan_FlushLaneAcks( chan );
+
+	if( !lane->blocks && !Netchan_StartFileLane( chan ))
+		return;
+
+	Netchan_UpdateFlow( chan );
+
+	// refill credit at current rate
+	burst = max( lane->rate * ( host.frametime + LANE_BURST ), FILELANE_BLOCKSIZE * 2 );
+	lane->credit += ( host.realtime - lane->lastcredit ) * lane->rate;
+	lane->credit = min( lane->credit, burst );
+	lane->lastcredit = host.realtime;
+
+	// find lost blocks
+	for( i = lane->cumacked; i < lane->nextblock; i++ )
+	{
+		block = &lane->blocks[i];
+
+		if( block->acked || !block->sendtime )
+			continue;
+
+		if( host.realtime - block->sendtime > lane->rto )
+			timeouts++;
+		else if( block->sendtime + lane->srtt * 0.25 >= lane->ackedsendtime )
+			continue; // nothing sent after it was acknowledged yet
+
+		block->sendtime = 0.0;
+		block->retries++;
+		lane->lost++;
+	}
+
+	if( timeouts ) lane->rto = min( lane->rto * 2.0, LANE_MAX_RTO );
+
+	resend = lane->cumacked;
+
+	while( lane->credit > 0.0 )
+	{
+		// retransmissions go first
+		while( resend < lane->nextblock && ( lane->blocks[resend].acked || lane->blocks[resend].sendtime ))
+			resend++;
+
+		if( resend < lane->nextblock )
+			i = resend++;
+		else if( lane->nextblock < lane->numblocks && lane->nextblock - lane->cumacked < FILELANE_WINDOW )
+			i = lane->nextblock++;
+		else break;
+
+		if( !( size = Netchan_SendLaneBlock( chan, i )))
+			return;
+
+		lane->credit -= size;
+	}
+
+	// had more to send than the rate allowed
+	if( lane->credit <= 0.0 )
+		lane->limited = true;
+}
@@ -87,6 +87,15 @@ NET
 #define NET_EXT_HUFF		(1U<<0)
 #define NET_EXT_SPLIT		(1U<<1)
 #define NET_EXT_SPLITHUFF	(1U<<2)
+#define NET_EXT_FILELANE	(1U<<3)
+
+// file lane: file transfers are sent out of the sequenced channel
+#define FILELANE_SIGNATURE	0xFFFFFFFD
+#define FILELANE_BLOCKSIZE	1200		// payload of one lane block, fits into a single ethernet frame
+#define FILELANE_WINDOW	512		// max blocks in flight
+#define FILELANE_MAX_ACKS	64		// acks collected before they are flushed
+#define FILELANE_MINRATE	8192		// bytes per second
+#define FILELANE_MAXRATE	1048576		// default ceiling when owner doesn't set maxrate
 
 // message data
 typedef struct
@@ -113,18 +122,39 @@ typedef struct fragbuf_s
 	sizebuf_t		frag_message;	// message buffer where raw data is stored
 	byte		frag_message_buf[FRAGMENT_SIZE];	// the actual data sits here
 	qboolean		isfile;		// is this a file buffer?
-	qboolean		isbuffer;		// is this file buffer from memory ( custom decal, etc. ).
-	char		filename[CS_SIZE];	// name of the file to save out on remote host
-	int		foffset;		// offset in file from which to read data  
-	int		size;		// size of data to read at that offset
 } fragbuf_t;
 
+#define FRAGFILE_WINDOW		16384	// read window of file transfer
+
+// file on disk, shared by all transfers that send it
+typedef struct fragfile_s
+{
+	struct fragfile_s	*next;
+	char		filename[CS_SIZE];
+	file_t		*handle;
+	byte		*data;		// inflated copy of compressed pack entry
+	int		size;
+	int		refcount;
+} fragfile_t;
+
 // Waiting list of fragbuf chains
 typedef struct fragbufwaiting_s
 {
 	struct fragbufwaiting_s	*next;	// next chain in waiting list
 	int		fragbufcount;	// number of buffers in this chain
 	fragbuf_t		*fragbufs;	// the actual buffers
+
+	// file transfers build their buffers only when they are sent
+	char		filename[CS_SIZE];	// name of the file to save out on remote host
+	fragfile_t	*file;		// data is read from the shared file
+	byte		*data;		// or from a private copy of memory buffer
+	int		size;		// size of data
+	int		chunksize;
+	int		firstsize;	// first buffer starts with filename and holds less data
+	int		nextfrag;		// next buffer to build
+	byte		*window;		// last data read from the file
+	int		winoffset;
+	int		winlength;
 } fragbufwaiting_t;
 
 
@@ -164,6 +194,55 @@ typedef struct netsplit_s
 	integer64 total_received_uncompressed;
 } netsplit_t;
 
+typedef struct
+{
+	double		sendtime;		// zero if never sent or considered lost
+	short		retries;
+	byte		acked;
+} laneblock_t;
+
+typedef struct
+{
+	qboolean		enabled;		// negotiated with NET_EXT_FILELANE
+	uint		key;		// secret given by server on connect, carried by every lane packet
+
+	// outgoing transfer
+	uint		outid;		// id of current outgoing transfer
+	fragbufwaiting_t	*source;		// blocks are built from it when sent
+	laneblock_t	*blocks;
+	int		numblocks;
+	int		numacked;
+	int		cumacked;		// first block that isn't acknowledged
+	int		nextblock;	// first block that was never sent
+
+	// pacing and bandwidth estimation
+	double		rate;		// bytes per second
+	double		ssthresh;
+	double		maxrate;		// ceiling, set by the owner of the channel
+	double		delivered;	// average acknowledged bytes per second
+	double		credit;
+	double		lastcredit;
+	double		lastestimate;
+	double		nextdecrease;
+	double		srtt, rttvar, rto;
+	double		ackedsendtime;	// send time of the latest acknowledged block
+	int		ackedbytes;	// since last estimate
+	int		lost;		// since last estimate
+	qboolean		limited;		// transfer was limited by the rate since last estimate
+
+	// incoming transfer
+	uint		inid;
+	byte		*inmask;		// received blocks
+	int		intotal;
+	int		inreceived;
+	int		incum;		// first block that wasn't received
+	qboolean		indone;
+	fragbuf_t		*intail;		// last buffer in incomingbufs[FRAG_FILE_STREAM]
+	word		acks[FILELANE_MAX_ACKS];
+	int		numacks;
+	qboolean		ackpending;
+} filelane_t;
+
 // Network Connection Channel
 typedef struct netchan_s
 {
@@ -209,6 +288,7 @@ typedef struct netchan_s
 	uint		reliable_fragid[MAX_STREAMS];		// buffer id for each waiting fragment
 
 	fragbuf_t		*fragbufs[MAX_STREAMS];	// the current fragment being set
+	fragbufwaiting_t	*fragsource[MAX_STREAMS];	// file transfer the fragments are built from
 	int		fragbufcount[MAX_STREAMS];	// the total number of fragments in this stream
 
 	short		frag_startpos[MAX_STREAMS];	// position in outgoing buffer where frag data starts
@@ -234,6 +314,8 @@ typedef struct netchan_s
 	unsigned int	maxpacket;
 	unsigned int	splitid;
 	netsplit_t netsplit;
+
+	filelane_t	filelane;		// out of band file transfers
 } netchan_t;
 
 extern netadr_t		net_from;
@@ -263,6 +345,11 @@ void Netchan_FragSend( netchan_t *chan );
 void Netchan_Clear( netchan_t *chan );
 void Netchan_ReportFlow( netchan_t *chan );
 
+// file lane
+void Netchan_ProcessFileLane( netchan_t *chan, sizebuf_t *msg );
+void Netchan_TransmitFileLane( netchan_t *chan );
+qboolean Netchan_FileLaneActive( netchan_t *chan );
+
 // packet splitting
 qboolean NetSplit_GetLong(netsplit_t *ns, netadr_t *from, byte *data, size_t *length , qboolean decompress );
 
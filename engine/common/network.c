@@ -30,10 +30,18 @@ GNU General Public License for more details.
 // Errors handling
 #include <errno.h>
 #include <fcntl.h>
+#include <unistd.h>
+#include <signal.h>
+#if defined(__linux__) && !defined(__EMSCRIPTEN__)
+// zero-copy file transfer for http server
+#include <sys/sendfile.h>
+#define HAVE_SENDFILE
+#endif
 #endif
 #include "common.h"
 #include "mathlib.h"
 #include "netchan.h"
+#include "menu_int.h"
 
 #define PORT_ANY		-1
 #define MAX_LOOPBACK	4
@@ -65,6 +73,8 @@ static int (_stdcall *pConnect)( SOCKET s, const struct sockaddr *name, int name
 static int (_stdcall *pGetSockName)( SOCKET s, struct sockaddr *name, int *namelen );
 static int (_stdcall *pSend)( SOCKET s, const char *buf, int len, int flags );
 static int (_stdcall *pRecv)( SOCKET s, char *buf, int len, int flags );
+static int (_stdcall *pListen)( SOCKET s, int backlog );
+static SOCKET (_stdcall *pAccept)( SOCKET s, struct sockaddr *addr, int *addrlen );
 static int (_stdcall *pGetHostName)( char *name, int namelen );
 #ifdef HAVE_GETADDRINFO // todo: add definitions for msvc6
 int (_stdcall *pGetAddrInfo)(const char *, const char *, const struct addrinfo *, struct addrinfo **);
@@ -79,6 +89,8 @@ static dllfunc_t winsock_funcs[] =
 { "bind", (void **) &pBind },
 { "send", (void **) &pSend },
 { "recv", (void **) &pRecv },
+{ "listen", (void **) &pListen },
+{ "accept", (void **) &pAccept },
 { "ntohs", (void **) &pNtohs },
 { "htons", (void **) &pHtons },
 { "ntohl", (void **) &pNtohl },
@@ -151,6 +163,8 @@ void NET_FreeWinSock( void )
 #define pGetHs
 #define pRecv recv
 #define pSend send
+#define pListen listen
+#define pAccept accept
 #define pInet_Ntoa inet_ntoa
 #define pNtohs ntohs
 #define pGetHostByName gethostbyname
@@ -1725,15 +1739,26 @@ void NET_Restart_f( void )
 
 HTTP downloader
 
+Files are spread over several keep-alive connections,
+each carrying a short pipeline of HTTP/1.1 requests.
+Partial files are kept as .incomplete and resumed
+with range requests.
+
 =================================================
 */
 
+#define HTTP_MAX_CONNECTIONS	8
+#define HTTP_MAX_PIPELINE	8
+#define HTTP_MAX_RETRIES	3
+
 typedef struct httpserver_s
 {
 	char host[256];
 	int port;
 	char path[PATH_MAX];
 	qboolean needfree;
+	qboolean resolved; // addr is valid, do not ask resolver again
+	struct sockaddr addr;
 	struct httpserver_s *next;
 
 } httpserver_t;
@@ -1741,41 +1766,74 @@ typedef struct httpserver_s
 enum connectionstate
 {
 	HTTP_FREE = 0,
-	HTTP_OPENED,
-	HTTP_SOCKET,
-	HTTP_NS_RESOLVED,
+	HTTP_RESOLVING,
+	HTTP_CONNECTING,
 	HTTP_CONNECTED,
-	HTTP_REQUEST,
-	HTTP_REQUEST_SENT,
-	HTTP_RESPONSE_RECEIVED,
+};
+
+enum filestate
+{
+	HTTP_QUEUED = 0,	// waiting for connection
+	HTTP_REQUESTED,	// request is in pipeline, waiting for response
+	HTTP_RECEIVING,	// response header received, writing body
 };
 
 typedef struct httpfile_s
 {
 	httpserver_t *server;
+	struct httpconn_s *conn; // connection which carries request
 	char path[PATH_MAX];
 	file_t *file;
-	int socket;
 	int size;
 	int downloaded;
-	int lastchecksize;
-	float checktime;
-	float blocktime;
+	int resumed; // bytes of .incomplete file requested to skip
+	int retries;
 	int id;
-	enum connectionstate state;
+	enum filestate state;
 	qboolean process;
+	qboolean noresume;
 	struct httpfile_s *next;
 } httpfile_t;
 
+typedef struct httpconn_s
+{
+	httpserver_t *server;
+	int socket;
+	enum connectionstate state;
+
+	// requests in order they were sent, response always belongs to first
+	httpfile_t *pipeline[HTTP_MAX_PIPELINE];
+	int pipelined;
+
+	// requests which are not sent yet
+	char query[BUFSIZ];
+	int query_length, bytes_sent;
+
+	// response header of first pipelined file
+	char header[BUFSIZ];
+	int header_size;
+
+	int remaining; // body bytes left, -1 if until close
+	qboolean inbody;
+	qboolean discard; // body of failed response, skip it
+	qboolean keepalive;
+	float blocktime;
+} httpconn_t;
+
 struct http_static_s
 {
 	// file and server lists
 	httpfile_t *first_file, *last_file;
 	httpserver_t *first_server, *last_server;
 
-	 // query or response
-	char buf[BUFSIZ];
-	int header_size, query_length, bytes_sent;
+	httpconn_t conns[HTTP_MAX_CONNECTIONS];
+
+	// progress
+	int completed, failed;
+	int lastchecksize, recvbytes;
+	float checktime;
+	double speedtime;
+	float speed;
 } http;
 
 
@@ -1785,8 +1843,8 @@ int downloadfileid, downloadcount;
 convar_t *http_useragent;
 convar_t *http_autoremove;
 convar_t *http_timeout;
-
-
+convar_t *http_maxconnections;
+convar_t *http_pipeline;
 
 /*
 ========================
@@ -1807,46 +1865,77 @@ void HTTP_ClearCustomServers( void )
 	}
 }
 
+/*
+==============
+HTTP_UnlinkFile
+
+Remove file from queue and free it
+==============
+*/
+static void HTTP_UnlinkFile( httpfile_t *file )
+{
+	httpfile_t *prev = NULL, *cur = http.first_file;
+
+	while( cur && cur != file )
+	{
+		prev = cur;
+		cur = cur->next;
+	}
+
+	ASSERT( cur );
+
+	if( prev )
+		prev->next = file->next;
+	else http.first_file = file->next;
+
+	if( http.last_file == file )
+		http.last_file = prev;
+
+	if( !http.first_file )
+		Cvar_SetFloat( "scr_download", -1 );
+
+	Mem_Free( file );
+}
+
 /*
 ==============
 HTTP_FreeFile
 
 Skip to next server/file, free list node if necessary
+File must be already detached from connection
 ==============
 */
 void HTTP_FreeFile( httpfile_t *file, qboolean error )
 {
 	char incname[256];
 
-	// Allways close file and socket
+	// Allways close file
 	if( file->file )
 		FS_Close( file->file );
 
 	file->file = NULL;
-
-	if( file->socket != -1 )
-		pCloseSocket( file->socket );
-
-	file->socket = -1;
+	file->conn = NULL;
 
 	Q_snprintf( incname, 256, "downloaded/%s.incomplete", file->path );
 	if( error )
 	{
 		// Switch to next fastdl server if present
-		if( file->server && ( file->state > HTTP_FREE ) )
+		if( file->server && ( file->server = file->server->next ))
 		{
-			file->server = file->server->next;
-			file->state = HTTP_FREE; // Reset download state, HTTP_Run() will open file again
+			file->state = HTTP_QUEUED; // HTTP_Run() will request it again
+			file->retries = 0;
 			return;
 		}
 
-		// Called because there was no servers to download, free file now
+		// There was no more servers to download, free file now
 		if( http_autoremove->integer == 1 ) // remove broken file
 			FS_Delete( incname );
 		else // autoremove disabled, keep file
 			Msg( "HTTP: Cannot download %s from any server. "
 				"You may remove %s now\n", file->path, incname ); // Warn about trash file
 
+		http.failed++;
+
 		if( file->process )
 			CL_ProcessFile( false, file->path ); // Process file, increase counter
 	}
@@ -1858,596 +1947,1851 @@ void HTTP_FreeFile( httpfile_t *file, qboolean error )
 		Q_snprintf( name, 256, "downloaded/%s", file->path );
 		FS_Rename( incname, name );
 
+		http.completed++;
+
 		if( file->process )
 			CL_ProcessFile( true, name );
 		else
 			Msg ( "HTTP: Successfully downloaded %s, processing disabled!\n", name );
 	}
-	// Now free list node
-	if( http.first_file == file )
-	{
-		// Now only first_file is changing progress
-		Cvar_SetFloat( "scr_download", -1 );
-
-		if( http.last_file == http.first_file )
-			http.last_file = http.first_file = 0;
-		else
-			http.first_file = file->next;
-		Mem_Free( file );
-	}
-	else if( file->next )
-	{
-		httpfile_t *tmp = http.first_file, *tmp2;
-
-		while( tmp && ( tmp->next != file ) )
-			tmp = tmp->next;
 
-		ASSERT( tmp );
-
-		tmp2 = tmp->next;
-
-		if( tmp2 )
-		{
-			tmp->next = tmp2->next;
-			Mem_Free( tmp2 );
-		}
-		else
-			tmp->next = 0;
-	}
-	else file->id = -1; // Tail file
+	HTTP_UnlinkFile( file );
 }
 
 /*
 ==============
-HTTP_Run
+HTTP_DetachFile
 
-Download next file block if download quered.
-Call every frame
+Remove first file from connection pipeline
 ==============
 */
-void HTTP_Run( void )
+static httpfile_t *HTTP_DetachFile( httpconn_t *conn )
 {
-	int res;
-	char buf[BUFSIZ+1];
-	char *begin = 0;
-	httpfile_t *curfile = http.first_file; // download is single-threaded now, but can be rewrited
-	httpserver_t *server;
-	float frametime;
-	struct sockaddr addr;
+	httpfile_t *file = conn->pipeline[0];
 
-	if( !curfile )
-		return;
+	conn->pipelined--;
+	Q_memmove( conn->pipeline, conn->pipeline + 1, conn->pipelined * sizeof( httpfile_t * ));
+	conn->pipeline[conn->pipelined] = NULL;
 
-	if( curfile->id == -1) // Tail file
-		return;
+	if( file->file )
+		FS_Close( file->file );
 
-	server = curfile->server;
+	file->file = NULL;
+	file->conn = NULL;
+	file->state = HTTP_QUEUED;
 
-	if( !server )
-	{
-		Msg( "HTTP: No servers to download %s!\n", curfile->path );
-		HTTP_FreeFile( curfile, true );
-		return;
-	}
+	return file;
+}
 
-	if( !curfile->file ) // state == 0
-	{
-		char name[PATH_MAX];
+/*
+==============
+HTTP_WouldBlock
 
-		Msg( "HTTP: Starting download %s from %s\n", curfile->path, server->host );
-		Cbuf_AddText( va( "menu_connectionprogress dl \"%s\" \"%s%s\" %d %d \"(starting)\"\n", curfile->path, server->host, server->path, downloadfileid, downloadcount ) );
-		Q_snprintf( name, PATH_MAX, "downloaded/%s.incomplete", curfile->path );
+Non-blocking socket operation should be repeated later
+==============
+*/
+static qboolean HTTP_WouldBlock( void )
+{
+#ifdef _WIN32
+	int err = pWSAGetLastError();
 
-		curfile->file = FS_Open( name, "wb", true );
+	return err == WSAEWOULDBLOCK || err == WSAENOTCONN || err == WSAEINPROGRESS;
+#else
+	return errno == EWOULDBLOCK || errno == EAGAIN || errno == ENOTCONN || errno == EINPROGRESS;
+#endif
+}
 
-		if( !curfile->file )
-		{
-			Msg( "HTTP: Cannot open %s!\n", name );
-			HTTP_FreeFile( curfile, true );
-			return;
-		}
+/*
+==============
+HTTP_OpenConnection
+==============
+*/
+static void HTTP_OpenConnection( httpconn_t *conn, httpserver_t *server )
+{
+	dword mode;
 
-		curfile->state = HTTP_OPENED;
-		curfile->blocktime = 0;
-		curfile->downloaded = 0;
-		curfile->lastchecksize = 0;
-		curfile->checktime = 0;
-	}
+	Q_memset( conn, 0, sizeof( *conn ));
+	conn->server = server;
+	conn->keepalive = true;
+	conn->socket = pSocket( AF_INET, SOCK_STREAM, IPPROTO_TCP );
 
-	if( curfile->state < HTTP_SOCKET ) // Socket is not created
+	if( conn->socket < 0 )
 	{
-		dword mode;
-
-		curfile->socket = pSocket( AF_INET, SOCK_STREAM, IPPROTO_TCP );
+		conn->socket = -1;
+		return;
+	}
 
-		// Now set non-blocking mode
-		// You may skip this if not supported by system,
-		// but download will lock engine, maybe you will need to add manual returns
+	// Now set non-blocking mode
+	// You may skip this if not supported by system,
+	// but download will lock engine, maybe you will need to add manual returns
 #if defined(_WIN32) || defined(__APPLE__) || defined(__FreeBSD__) || defined __EMSCRIPTEN__
-		mode = 1;
-		pIoctlSocket( curfile->socket, FIONBIO, &mode );
+	mode = 1;
+	pIoctlSocket( conn->socket, FIONBIO, &mode );
 #else
-		// SOCK_NONBLOCK is not portable, so use fcntl
-		fcntl( curfile->socket, F_SETFL, fcntl( curfile->socket, F_GETFL, 0 ) | O_NONBLOCK );
+	// SOCK_NONBLOCK is not portable, so use fcntl
+	fcntl( conn->socket, F_SETFL, fcntl( conn->socket, F_GETFL, 0 ) | O_NONBLOCK );
 #endif
-		curfile->state = HTTP_SOCKET;
-	}
-
-	if( curfile->state < HTTP_NS_RESOLVED )
-	{
-		res = NET_StringToSockaddr( va( "%s:%d", server->host, server->port ), &addr, true );
+	conn->state = HTTP_RESOLVING;
+}
 
-		if( res == 2 )
-			return; // skip to next frame
+/*
+==============
+HTTP_CloseConnection
 
-		if( !res )
-		{
-			Msg( "HTTP: Failed to resolve server address for %s!\n", server->host );
-			HTTP_FreeFile( curfile, true ); // Cannot connect
-			return;
-		}
-		curfile->state = HTTP_NS_RESOLVED;
-	}
+Close socket and put all pipelined files back to queue.
+Partial files will be resumed on next request
+==============
+*/
+static void HTTP_CloseConnection( httpconn_t *conn, qboolean penalty )
+{
+	int i;
 
-	if( curfile->state < HTTP_CONNECTED ) // Connection not enstabilished
-	{
+	if( conn->socket != -1 )
+		pCloseSocket( conn->socket );
 
+	conn->socket = -1;
+	conn->state = HTTP_FREE;
 
-		res = pConnect( curfile->socket, &addr, sizeof( struct sockaddr ) );
+	for( i = 0; conn->pipelined; i++ )
+	{
+		httpfile_t *file = HTTP_DetachFile( conn );
 
-		if( res )
+		// only first file was answered, others are just not served yet
+		if( i == 0 && penalty && ++file->retries > HTTP_MAX_RETRIES )
 		{
-#ifdef _WIN32
-			if( pWSAGetLastError() == WSAEINPROGRESS || pWSAGetLastError() == WSAEWOULDBLOCK )
-#elif defined(__APPLE__) || defined(__FreeBSD__) || defined __EMSCRIPTEN__
-			if( errno == EINPROGRESS || errno == EWOULDBLOCK )
-#else
-			if( errno == EINPROGRESS ) // Should give EWOOLDBLOCK if try recv too soon
-#endif
-				curfile->state = HTTP_CONNECTED;
-			else
-			{
-				Msg( "HTTP: Cannot connect to server: %s\n", NET_ErrorString( ) );
-				HTTP_FreeFile( curfile, true ); // Cannot connect
-				return;
-			}
-			return; // skip to next frame
+			Msg( "HTTP: Too many retries for %s on %s\n", file->path, file->server->host );
+			HTTP_FreeFile( file, true );
 		}
-		curfile->state = HTTP_CONNECTED;
-	}
-
-	if( curfile->state < HTTP_REQUEST ) // Request not formatted
-	{
-		http.query_length = Q_snprintf( http.buf, BUFSIZ,
-			"GET %s%s HTTP/1.0\r\n"
-			"Host: %s\r\n"
-			"User-Agent: %s\r\n\r\n", server->path,
-			curfile->path, server->host, http_useragent->string );
-		http.header_size = 0;
-		http.bytes_sent = 0;
-		curfile->state = HTTP_REQUEST;
 	}
 
-	if( curfile->state < HTTP_REQUEST_SENT ) // Request not sent
-	{
-		while( http.bytes_sent < http.query_length )
-		{
-			Cbuf_AddText( va( "menu_connectionprogress dl \"%s\" \"%s%s\" %d %d \"(sending request)\"\n", curfile->path, server->host, server->path, downloadfileid, downloadcount ) );
+	Q_memset( conn, 0, sizeof( *conn ));
+	conn->socket = -1;
+}
 
-			res = pSend( curfile->socket, http.buf + http.bytes_sent, http.query_length - http.bytes_sent, 0 );
-			if( res < 0 )
-			{
-#ifdef _WIN32
-				if( pWSAGetLastError() != WSAEWOULDBLOCK && pWSAGetLastError() != WSAENOTCONN )
-#elif defined(__APPLE__) || defined(__FreeBSD__) || defined __EMSCRIPTEN__
-				if( errno != EWOULDBLOCK && errno != ENOTCONN )
-#else
-				if( errno != EWOULDBLOCK )
-#endif
-				{
-					Msg( "HTTP: Failed to send request: %s\n", NET_ErrorString() );
-					HTTP_FreeFile( curfile, true );
-					return;
-				}
-				// increase counter when blocking
-				curfile->blocktime += host.frametime;
+/*
+==============
+HTTP_FailConnection
 
-				if( curfile->blocktime > http_timeout->value )
-				{
-					Msg( "HTTP: Timeout on request send:\n%s\n", http.buf );
-					HTTP_FreeFile( curfile, true );
-					return;
-				}
-				return;
-			}
-			else
-			{
-				http.bytes_sent += res;
-				curfile->blocktime = 0;
-			}
-		}
+Server is unavailable, skip all pipelined files to next server
+==============
+*/
+static void HTTP_FailConnection( httpconn_t *conn )
+{
+	while( conn->pipelined )
+		HTTP_FreeFile( HTTP_DetachFile( conn ), true );
 
-		Msg( "HTTP: Request sent!\n");
-		Q_memset( http.buf, 0, BUFSIZ );
-		curfile->state = HTTP_REQUEST_SENT;
-	}
+	HTTP_CloseConnection( conn, false );
+}
 
-	frametime = host.frametime; // save frametime to reset it after first iteration
+/*
+==============
+HTTP_QueueRequest
 
-	while( ( res = pRecv( curfile->socket, buf, BUFSIZ, 0 ) ) > 0) // if we got there, we are receiving data
-	{
-		//MsgDev(D_INFO,"res: %d\n", res);
-		curfile->blocktime = 0;
+Append request to connection pipeline
+==============
+*/
+static qboolean HTTP_QueueRequest( httpconn_t *conn, httpfile_t *file )
+{
+	httpserver_t *server = conn->server;
+	char range[64], host[300], *incname;
+	int len;
 
-		if( curfile->state < HTTP_RESPONSE_RECEIVED ) // Response still not received
-		{
-			buf[res] = 0; // string break to search \r\n\r\n
-			Q_memcpy( http.buf + http.header_size, buf, res );
-			//MsgDev( D_INFO, "%s\n", buf );
-			begin = Q_strstr( http.buf, "\r\n\r\n" );
-			if( begin ) // Got full header
-			{
-				int cutheadersize = begin - http.buf + 4; // after that begin of data
-				char *length;
+	incname = va( "downloaded/%s.incomplete", file->path );
+	file->resumed = file->noresume ? 0 : FS_FileSize( incname, true );
 
-				Msg( "HTTP: Got response!\n" );
+	// already complete or broken, download it again
+	if( file->size > 0 && file->resumed >= file->size )
+		file->resumed = 0;
 
-				if( !Q_strstr(http.buf, "200 OK") )
-				{
-					*begin = 0; // cut string to print out response
-					Msg( "HTTP: Bad response:\n%s\n", http.buf );
-					HTTP_FreeFile( curfile, true );
-					return;
-				}
+	if( file->resumed > 0 )
+		Q_snprintf( range, sizeof( range ), "Range: bytes=%d-\r\n", file->resumed );
+	else range[0] = 0;
 
-				// print size
-				length = Q_stristr(http.buf, "Content-Length: ");
-				if( length )
-				{
-					int size = Q_atoi( length += 16 );
+	if( server->port != 80 )
+		Q_snprintf( host, sizeof( host ), "%s:%d", server->host, server->port );
+	else Q_strncpy( host, server->host, sizeof( host ));
 
-					Msg( "HTTP: File size is %d\n", size );
-					Cbuf_AddText( va( "menu_connectionprogress dl \"%s\" \"%s%s\" %d %d \"(file size is %s)\"\n", curfile->path, server->host, server->path, downloadfileid, downloadcount, Q_pretifymem( size, 1 ) ) );
+	// drop already sent part
+	if( conn->bytes_sent )
+	{
+		conn->query_length -= conn->bytes_sent;
+		Q_memmove( conn->query, conn->query + conn->bytes_sent, conn->query_length );
+		conn->bytes_sent = 0;
+	}
 
-					if( ( curfile->size != -1 ) && ( curfile->size != size ) ) // check size if specified, not used
-						MsgDev( D_WARN, "Server reports wrong file size!\n" );
+	len = Q_snprintf( conn->query + conn->query_length, sizeof( conn->query ) - conn->query_length,
+		"GET %s%s HTTP/1.1\r\n"
+		"Host: %s\r\n"
+		"User-Agent: %s\r\n"
+		"Connection: keep-alive\r\n"
+		"%s\r\n", server->path, file->path, host, http_useragent->string, range );
 
-					curfile->size = size;
-				}
+	if( len < 0 || len >= (int)sizeof( conn->query ) - conn->query_length )
+	{
+		conn->query[conn->query_length] = 0;
+		return false; // try again when previous requests are sent
+	}
 
-				if( curfile->size == -1 )
-				{
-					// Usually fastdl's reports file size if link is correct
-					Msg( "HTTP: File size is unknown!\n" );
-					HTTP_FreeFile( curfile, true );
-					return;
-				}
+	conn->query_length += len;
+	conn->pipeline[conn->pipelined++] = file;
+	file->conn = conn;
+	file->state = HTTP_REQUESTED;
 
-				curfile->state = HTTP_RESPONSE_RECEIVED; // got response, let's start download
-				begin += 4;
+	if( file->resumed > 0 )
+		MsgDev( D_NOTE, "HTTP: Resuming %s from %s\n", file->path, Q_pretifymem( file->resumed, 1 ));
 
-				// Write remaining message part
-				if( res - cutheadersize - http.header_size > 0 )
-				{
-					int ret = FS_Write( curfile->file, begin, res - cutheadersize - http.header_size );
+	Msg( "HTTP: Starting download %s from %s\n", file->path, server->host );
 
-					if( ret != res - cutheadersize - http.header_size ) // could not write file
-					{
-						// close it and go to next
-						Msg( "HTTP: Write failed for %s!\n", curfile->path );
-						curfile->state = HTTP_FREE;
-						HTTP_FreeFile( curfile, true );
-						return;
-					}
-					curfile->downloaded += ret;
-				}
-			}
-			http.header_size += res;
-		}
-		else if( res > 0 )
-		{
-			// data download
-			int ret = FS_Write( curfile->file, buf, res );
+	return true;
+}
 
-			if ( ret != res )
-			{
-				// close it and go to next
-				Msg( "HTTP: Write failed for %s!\n", curfile->path );
-				curfile->state = HTTP_FREE;
-				HTTP_FreeFile( curfile, true );
-				return;
-			}
+/*
+==============
+HTTP_SendQuery
 
-			curfile->downloaded += ret;
-			curfile->lastchecksize += ret;
-			curfile->checktime += frametime;
-			frametime = 0; // only first iteration increases time, 
+Send as much of pending requests as socket accepts
+==============
+*/
+static qboolean HTTP_SendQuery( httpconn_t *conn )
+{
+	while( conn->bytes_sent < conn->query_length )
+	{
+		int res = pSend( conn->socket, conn->query + conn->bytes_sent, conn->query_length - conn->bytes_sent, 0 );
 
-			// as after it will run in same frame
-			if( curfile->checktime > 5 )
+		if( res < 0 )
+		{
+			if( !HTTP_WouldBlock( ))
 			{
-				curfile->checktime = 0;
-				Msg( "HTTP: %f KB/s\n", (float)curfile->lastchecksize / ( 5.0 * 1024 ) );
-				Cbuf_AddText( va( "menu_connectionprogress dl \"%s\" \"%s%s\" %d %d \"(file size is %s, speed is %.2f KB/s)\"\n", curfile->path, server->host, server->path, downloadfileid, downloadcount, Q_pretifymem( curfile->size, 1 ), (float)curfile->lastchecksize / ( 5.0 * 1024 ) ) );
-				curfile->lastchecksize = 0;
+				Msg( "HTTP: Failed to send request: %s\n", NET_ErrorString() );
+				return false;
 			}
+			break;
 		}
-	}
 
-	if( curfile->size > 0 )
-		Cvar_SetFloat( "scr_download", (float)curfile->downloaded / curfile->size * 100 );
-
-	if( curfile->size > 0 && curfile->downloaded >= curfile->size )
-	{
-		HTTP_FreeFile( curfile, false ); // success
-		return;
+		conn->bytes_sent += res;
+		conn->state = HTTP_CONNECTED;
 	}
-	else // if it is not blocking, inform user about problem
-#ifdef _WIN32
-	if( pWSAGetLastError() != WSAEWOULDBLOCK )
-#else
-	if( errno != EWOULDBLOCK )
-#endif
-		Msg( "HTTP: Problem downloading %s:\n%s\n", curfile->path, NET_ErrorString() );
-	else
-		curfile->blocktime += host.frametime;
-
-	curfile->checktime += frametime;
 
-	if( curfile->blocktime > http_timeout->value )
-	{
-		Msg( "HTTP: Timeout on receiving data!\n");
-		HTTP_FreeFile( curfile, true );
-		return;
-	}
+	return true;
 }
 
 /*
-===================
-HTTP_AddDownload
+==============
+HTTP_FindHeader
 
-Add new download to end of queue
-===================
+Return value of header field, or NULL
+==============
 */
-void HTTP_AddDownload( char *path, int size, qboolean process )
+static const char *HTTP_FindHeader( const char *header, const char *field )
 {
-	httpfile_t *httpfile = Mem_Alloc( net_mempool, sizeof( httpfile_t ) );
+	int len = Q_strlen( field );
+	const char *line = header;
 
-	MsgDev( D_INFO, "File %s queued to download\n", path );
+	while(( line = Q_strstr( line, "\r\n" )))
+	{
+		line += 2;
 
-	httpfile->size = size;
-	httpfile->downloaded = 0;
-	httpfile->socket = -1;
-	Q_strncpy ( httpfile->path, path, sizeof( httpfile->path ) );
+		if( !Q_strnicmp( line, field, len ) && line[len] == ':' )
+		{
+			line += len + 1;
 
-	if( http.last_file )
-	{
-		// Add next to last download
-		httpfile->id = http.last_file->id + 1;
-		http.last_file->next= httpfile;
-		http.last_file = httpfile;
-	}
-	else
-	{
-		// It will be the only download
-		httpfile->id = 0;
-		http.last_file = http.first_file = httpfile;
+			while( *line == ' ' || *line == '\t' )
+				line++;
+
+			return line;
+		}
 	}
 
-	httpfile->file = NULL;
-	httpfile->next = NULL;
-	httpfile->state = HTTP_FREE;
-	httpfile->server = http.first_server;
-	httpfile->process = process;
+	return NULL;
 }
 
 /*
-===============
-HTTP_Download_f
+==============
+HTTP_FinishFile
 
-Console wrapper
-===============
+Body of first pipelined file is complete
+==============
 */
-static void HTTP_Download_f( void )
+static void HTTP_FinishFile( httpconn_t *conn )
 {
-	if( Cmd_Argc() < 2 )
+	httpfile_t *file = HTTP_DetachFile( conn );
+
+	if( file->size > 0 && file->downloaded != file->size )
 	{
-		Msg("Use download <gamedir_path>\n");
+		Msg( "HTTP: Got %d bytes of %s, expected %d\n", file->downloaded, file->path, file->size );
+		file->noresume = true;
+		HTTP_FreeFile( file, true );
 		return;
 	}
 
-	HTTP_AddDownload( Cmd_Argv( 1 ), -1, false );
+	HTTP_FreeFile( file, false );
 }
 
 /*
 ==============
-HTTP_ParseURL
+HTTP_ParseHeader
+
+Process response header of first pipelined file.
+Return false if connection cannot be used anymore
 ==============
 */
-httpserver_t *HTTP_ParseURL( const char *url )
+static qboolean HTTP_ParseHeader( httpconn_t *conn )
 {
-	httpserver_t *server;
-	int i;
+	httpfile_t *file = conn->pipeline[0];
+	httpserver_t *server = conn->server;
+	const char *value;
+	int status, minor;
 
-	url = Q_strstr( url, "http://" );
+	if( Q_strncmp( conn->header, "HTTP/1.", 7 ))
+	{
+		Msg( "HTTP: Bad response:\n%s\n", conn->header );
+		HTTP_FreeFile( HTTP_DetachFile( conn ), true );
+		return false;
+	}
 
-	if( !url )
+	minor = conn->header[7] - '0';
+	status = Q_atoi( conn->header + 9 );
+
+	// HTTP/1.0 servers close connection unless asked otherwise
+	value = HTTP_FindHeader( conn->header, "Connection" );
+
+	if( value )
+		conn->keepalive = !Q_strnicmp( value, "keep-alive", 10 ) || ( minor > 0 && Q_strnicmp( value, "close", 5 ));
+	else conn->keepalive = ( minor > 0 );
+
+	value = HTTP_FindHeader( conn->header, "Transfer-Encoding" );
+
+	if( value && Q_strnicmp( value, "identity", 8 ))
+	{
+		// fastdl serves static files, so this should not happen
+		Msg( "HTTP: Unsupported transfer encoding for %s\n", file->path );
+		HTTP_FreeFile( HTTP_DetachFile( conn ), true );
+		return false;
+	}
+
+	value = HTTP_FindHeader( conn->header, "Content-Length" );
+	conn->remaining = value ? Q_atoi( value ) : -1;
+
+	// body is delimited by end of connection
+	if( conn->remaining < 0 )
+		conn->keepalive = false;
+
+	conn->inbody = true;
+	conn->discard = true;
+
+	if( status == 206 && file->resumed > 0 )
+	{
+		int start = -1, total = -1;
+
+		value = HTTP_FindHeader( conn->header, "Content-Range" );
+
+		if( value && !Q_strnicmp( value, "bytes ", 6 ))
+		{
+			const char *slash = Q_strchr( value, '/' );
+
+			start = Q_atoi( value + 6 );
+
+			if( slash && slash[1] != '*' )
+				total = Q_atoi( slash + 1 );
+		}
+
+		if( start != file->resumed )
+		{
+			// server ignored our range, request whole file again
+			MsgDev( D_WARN, "HTTP: Bad range for %s, restarting\n", file->path );
+			file->noresume = true;
+			HTTP_DetachFile( conn );
+			return true;
+		}
+
+		file->file = FS_Open( va( "downloaded/%s.incomplete", file->path ), "ab", true );
+		file->downloaded = file->resumed;
+
+		if( total < 0 && conn->remaining >= 0 )
+			total = file->resumed + conn->remaining;
+
+		if( total >= 0 )
+		{
+			if( ( file->size != -1 ) && ( file->size != total ) )
+				MsgDev( D_WARN, "Server reports wrong file size!\n" );
+			file->size = total;
+		}
+	}
+	else if( status == 200 )
+	{
+		if( file->resumed > 0 )
+			MsgDev( D_NOTE, "HTTP: %s does not support resume, restarting %s\n", server->host, file->path );
+
+		file->file = FS_Open( va( "downloaded/%s.incomplete", file->path ), "wb", true );
+		file->downloaded = 0;
+
+		if( conn->remaining >= 0 )
+		{
+			if( ( file->size != -1 ) && ( file->size != conn->remaining ) ) // check size if specified, not used
+				MsgDev( D_WARN, "Server reports wrong file size!\n" );
+
+			file->size = conn->remaining;
+		}
+	}
+	else if( status == 416 && file->resumed > 0 )
+	{
+		// .incomplete file is longer than remote one
+		MsgDev( D_WARN, "HTTP: Range not satisfiable for %s, restarting\n", file->path );
+		file->noresume = true;
+		HTTP_DetachFile( conn );
+		return true;
+	}
+	else
+	{
+		char *end = Q_strstr( conn->header, "\r\n" );
+
+		if( end ) *end = 0; // cut string to print out status line
+		Msg( "HTTP: Bad response for %s:\n%s\n", file->path, conn->header );
+		HTTP_FreeFile( HTTP_DetachFile( conn ), true );
+		return true;
+	}
+
+	if( !file->file )
+	{
+		Msg( "HTTP: Cannot open downloaded/%s.incomplete!\n", file->path );
+		HTTP_FreeFile( HTTP_DetachFile( conn ), true );
+		return true;
+	}
+
+	conn->discard = false;
+	file->state = HTTP_RECEIVING;
+	file->retries = 0;
+
+	Msg( "HTTP: File size is %d\n", file->size );
+	Cbuf_AddText( va( "menu_connectionprogress dl \"%s\" \"%s%s\" %d %d \"(file size is %s)\"\n", file->path, server->host, server->path, downloadfileid, downloadcount, Q_pretifymem( file->size, 1 ) ) );
+
+	return true;
+}
+
+/*
+==============
+HTTP_ProcessData
+
+Split received stream to pipelined responses.
+Return false if connection cannot be used anymore
+==============
+*/
+static qboolean HTTP_ProcessData( httpconn_t *conn, const char *data, int len )
+{
+	while( len > 0 )
+	{
+		if( conn->inbody )
+		{
+			int size = len;
+
+			if( conn->remaining >= 0 && size > conn->remaining )
+				size = conn->remaining;
+
+			if( !conn->discard )
+			{
+				httpfile_t *file = conn->pipeline[0];
+
+				if( FS_Write( file->file, data, size ) != size )
+				{
+					// close it and go to next
+					Msg( "HTTP: Write failed for %s!\n", file->path );
+					HTTP_FreeFile( HTTP_DetachFile( conn ), true );
+					return false;
+				}
+
+				file->downloaded += size;
+				http.lastchecksize += size;
+			}
+
+			data += size;
+			len -= size;
+
+			if( conn->remaining >= 0 && ( conn->remaining -= size ) == 0 )
+			{
+				if( !conn->discard )
+					HTTP_FinishFile( conn );
+
+				conn->inbody = false;
+
+				if( !conn->keepalive )
+					return false;
+			}
+		}
+		else
+		{
+			int start = max( conn->header_size - 3, 0 );
+			int size = min( len, (int)sizeof( conn->header ) - 1 - conn->header_size );
+			char *end;
+
+			if( !conn->pipelined )
+			{
+				MsgDev( D_WARN, "HTTP: Unexpected data from %s\n", conn->server->host );
+				return false;
+			}
+
+			Q_memcpy( conn->header + conn->header_size, data, size );
+			conn->header_size += size;
+			conn->header[conn->header_size] = 0;
+
+			end = Q_strstr( conn->header + start, "\r\n\r\n" );
+
+			if( !end )
+			{
+				if( conn->header_size == sizeof( conn->header ) - 1 )
+				{
+					Msg( "HTTP: Response header is too long!\n" );
+					HTTP_FreeFile( HTTP_DetachFile( conn ), true );
+					return false;
+				}
+				return true;
+			}
+
+			// return body part back to stream
+			size -= conn->header_size - ( end - conn->header + 4 );
+			data += size;
+			len -= size;
+			*end = 0;
+			conn->header_size = 0;
+
+			if( !HTTP_ParseHeader( conn ))
+				return false;
+
+			// empty body
+			if( conn->remaining == 0 )
+			{
+				if( !conn->discard )
+					HTTP_FinishFile( conn );
+
+				conn->inbody = false;
+
+				if( !conn->keepalive )
+					return false;
+			}
+		}
+	}
+
+	return true;
+}
+
+/*
+==============
+HTTP_ProcessConnection
+==============
+*/
+static void HTTP_ProcessConnection( httpconn_t *conn )
+{
+	httpserver_t *server = conn->server;
+	char buf[BUFSIZ];
+	int res;
+
+	if( conn->state == HTTP_RESOLVING )
+	{
+		if( !server->resolved )
+		{
+			res = NET_StringToSockaddr( va( "%s:%d", server->host, server->port ), &server->addr, true );
+
+			if( res == 2 )
+			{
+				conn->blocktime += host.frametime;
+
+				if( conn->blocktime > http_timeout->value )
+				{
+					Msg( "HTTP: Timeout on resolving %s!\n", server->host );
+					HTTP_FailConnection( conn );
+				}
+				return; // skip to next frame
+			}
+
+			if( !res )
+			{
+				Msg( "HTTP: Failed to resolve server address for %s!\n", server->host );
+				HTTP_FailConnection( conn );
+				return;
+			}
+
+			server->resolved = true;
+		}
+
+		res = pConnect( conn->socket, &server->addr, sizeof( struct sockaddr ));
+
+		if( res && !HTTP_WouldBlock( ))
+		{
+			Msg( "HTTP: Cannot connect to server: %s\n", NET_ErrorString( ) );
+			HTTP_FailConnection( conn );
+			return;
+		}
+
+		// Should give EWOULDBLOCK if try recv too soon
+		conn->state = res ? HTTP_CONNECTING : HTTP_CONNECTED;
+		conn->blocktime = 0;
+	}
+
+	if( !HTTP_SendQuery( conn ))
+	{
+		HTTP_CloseConnection( conn, true );
+		return;
+	}
+
+	while(( res = pRecv( conn->socket, buf, sizeof( buf ), 0 )) > 0 )
+	{
+		conn->state = HTTP_CONNECTED;
+		conn->blocktime = 0;
+		http.recvbytes += res;
+
+		if( !HTTP_ProcessData( conn, buf, res ))
+		{
+			HTTP_CloseConnection( conn, false );
+			return;
+		}
+	}
+
+	if( res == 0 )
+	{
+		// body is delimited by end of connection
+		if( conn->inbody && conn->remaining < 0 && !conn->discard )
+			HTTP_FinishFile( conn );
+
+		HTTP_CloseConnection( conn, conn->pipelined != 0 );
+		return;
+	}
+
+	if( !HTTP_WouldBlock( ))
+	{
+		Msg( "HTTP: Problem downloading from %s:\n%s\n", server->host, NET_ErrorString() );
+		HTTP_CloseConnection( conn, true );
+		return;
+	}
+
+	if( conn->pipelined )
+		conn->blocktime += host.frametime;
+
+	if( conn->blocktime > http_timeout->value )
+	{
+		Msg( "HTTP: Timeout on receiving data!\n" );
+
+		// skip stalled file to next server, others may be ok
+		HTTP_FreeFile( HTTP_DetachFile( conn ), true );
+		HTTP_CloseConnection( conn, false );
+	}
+}
+
+/*
+==============
+HTTP_PickConnection
+
+Find connection for request to server.
+New connections are preferred over deep pipelines
+==============
+*/
+static httpconn_t *HTTP_PickConnection( httpserver_t *server )
+{
+	int maxconns = bound( 1, http_maxconnections->integer, HTTP_MAX_CONNECTIONS );
+	int maxpipeline = bound( 1, http_pipeline->integer, HTTP_MAX_PIPELINE );
+	httpconn_t *best = NULL, *freeconn = NULL;
+	int i, active = 0;
+
+	for( i = 0; i < HTTP_MAX_CONNECTIONS; i++ )
+	{
+		httpconn_t *conn = &http.conns[i];
+
+		if( conn->state == HTTP_FREE )
+		{
+			if( !freeconn )
+				freeconn = conn;
+			continue;
+		}
+
+		active++;
+
+		if( conn->server != server || !conn->keepalive || conn->pipelined >= maxpipeline )
+			continue;
+
+		if( !best || conn->pipelined < best->pipelined )
+			best = conn;
+	}
+
+	if( best && !best->pipelined )
+		return best;
+
+	if( freeconn && active < maxconns )
+	{
+		HTTP_OpenConnection( freeconn, server );
+
+		if( freeconn->state != HTTP_FREE )
+			return freeconn;
+	}
+
+	return best;
+}
+
+/*
+==============
+HTTP_UpdateProgress
+==============
+*/
+static void HTTP_UpdateProgress( void )
+{
+	httpfile_t *file, *current = NULL;
+	int downloaded = 0, size = 0;
+	double elapsed = host.realtime - http.speedtime;
+
+	if( elapsed >= 1.0 )
+	{
+		http.speed = http.recvbytes / elapsed;
+		http.speedtime = host.realtime;
+		http.recvbytes = 0;
+	}
+
+	for( file = http.first_file; file; file = file->next )
+	{
+		if( file->state != HTTP_RECEIVING || file->size <= 0 )
+			continue;
+
+		if( !current )
+			current = file;
+
+		downloaded += file->downloaded;
+		size += file->size;
+	}
+
+	if( !current )
+		return;
+
+	Cvar_SetFloat( "scr_download", (float)downloaded / size * 100 );
+
+	http.checktime += host.frametime;
+
+	if( http.checktime > 5 )
+	{
+		float speed = (float)http.lastchecksize / ( http.checktime * 1024 );
+
+		Msg( "HTTP: %f KB/s\n", speed );
+		Cbuf_AddText( va( "menu_connectionprogress dl \"%s\" \"%s%s\" %d %d \"(file size is %s, speed is %.2f KB/s)\"\n", current->path, current->server->host, current->server->path, downloadfileid, downloadcount, Q_pretifymem( current->size, 1 ), speed ) );
+		http.checktime = 0;
+		http.lastchecksize = 0;
+	}
+}
+
+/*
+==============
+HTTP_Run
+
+Distribute queued files over connections and receive data.
+Call every frame
+==============
+*/
+void HTTP_Run( void )
+{
+	httpfile_t *file, *next;
+	int i;
+
+	for( i = 0; i < HTTP_MAX_CONNECTIONS; i++ )
+	{
+		if( http.conns[i].state != HTTP_FREE )
+			HTTP_ProcessConnection( &http.conns[i] );
+	}
+
+	if( !http.first_file )
+		return;
+
+	for( file = http.first_file; file; file = next )
+	{
+		httpconn_t *conn;
+
+		next = file->next;
+
+		if( file->state != HTTP_QUEUED )
+			continue;
+
+		if( !file->server )
+		{
+			Msg( "HTTP: No servers to download %s!\n", file->path );
+			HTTP_FreeFile( file, true );
+			continue;
+		}
+
+		if(( conn = HTTP_PickConnection( file->server )))
+			HTTP_QueueRequest( conn, file );
+	}
+
+	for( i = 0; i < HTTP_MAX_CONNECTIONS; i++ )
+	{
+		httpconn_t *conn = &http.conns[i];
+
+		if( conn->state == HTTP_FREE )
+			continue;
+
+		// nothing to do for idle connections
+		if( !conn->pipelined )
+			HTTP_CloseConnection( conn, false );
+		else if( conn->state >= HTTP_CONNECTING && !HTTP_SendQuery( conn ))
+			HTTP_CloseConnection( conn, true );
+	}
+
+	HTTP_UpdateProgress();
+}
+
+/*
+===================
+HTTP_GetDownloadStatus
+
+Fill progress for menu, returns number of unfinished files
+===================
+*/
+int HTTP_GetDownloadStatus( ui_downloadstatus_t *status )
+{
+	httpfile_t *file;
+	int i;
+
+	Q_memset( status, 0, sizeof( *status ));
+
+	for( file = http.first_file; file; file = file->next )
+	{
+		if( file->state == HTTP_QUEUED )
+		{
+			status->queued++;
+			continue;
+		}
+
+		status->active++;
+
+		if( file->state != HTTP_RECEIVING )
+			continue;
+
+		if( !status->current[0] )
+			Q_strncpy( status->current, file->path, sizeof( status->current ));
+
+		status->received += file->downloaded;
+
+		if( file->size > 0 )
+			status->total += file->size;
+	}
+
+	for( i = 0; i < HTTP_MAX_CONNECTIONS; i++ )
+	{
+		if( http.conns[i].state != HTTP_FREE )
+			status->connections++;
+	}
+
+	status->completed = http.completed;
+	status->failed = http.failed;
+	status->speed = http.first_file ? http.speed : 0.0f;
+
+	return status->queued + status->active;
+}
+
+/*
+===================
+HTTP_AddDownload
+
+Add new download to end of queue
+===================
+*/
+void HTTP_AddDownload( char *path, int size, qboolean process )
+{
+	httpfile_t *httpfile = Mem_Alloc( net_mempool, sizeof( httpfile_t ) );
+
+	MsgDev( D_INFO, "File %s queued to download\n", path );
+
+	httpfile->size = size;
+	httpfile->downloaded = 0;
+	Q_strncpy ( httpfile->path, path, sizeof( httpfile->path ) );
+
+	if( http.last_file )
+	{
+		// Add next to last download
+		httpfile->id = http.last_file->id + 1;
+		http.last_file->next= httpfile;
+		http.last_file = httpfile;
+	}
+	else
+	{
+		// It will be the only download
+		httpfile->id = 0;
+		http.last_file = http.first_file = httpfile;
+		http.completed = http.failed = 0;
+		http.speedtime = host.realtime;
+		http.recvbytes = 0;
+	}
+
+	httpfile->file = NULL;
+	httpfile->next = NULL;
+	httpfile->state = HTTP_QUEUED;
+	httpfile->server = http.first_server;
+	httpfile->process = process;
+}
+
+/*
+===============
+HTTP_Download_f
+
+Console wrapper
+===============
+*/
+static void HTTP_Download_f( void )
+{
+	if( Cmd_Argc() < 2 )
+	{
+		Msg("Use download <gamedir_path>\n");
+		return;
+	}
+
+	HTTP_AddDownload( Cmd_Argv( 1 ), -1, false );
+}
+
+/*
+==============
+HTTP_ParseURL
+==============
+*/
+httpserver_t *HTTP_ParseURL( const char *url )
+{
+	httpserver_t *server;
+	int i;
+
+	url = Q_strstr( url, "http://" );
+
+	if( !url )
+		return NULL;
+
+	url += 7;
+	server = Mem_Alloc( net_mempool, sizeof( httpserver_t ) );
+	i = 0;
+
+	while( *url && ( *url != ':' ) && ( *url != '/' ) && ( *url != '\r' ) && ( *url != '\n' ) )
+	{
+		if( i > sizeof( server->host ) )
+			return NULL;
+
+		server->host[i++] = *url++;
+	}
+
+	server->host[i] = 0;
+
+	if( *url == ':' )
+	{
+		server->port = Q_atoi( ++url );
+
+		while( *url && ( *url != '/' ) && ( *url != '\r' ) && ( *url != '\n' ) )
+			url++;
+	}
+	else
+		server->port = 80;
+
+	i = 0;
+
+	while( *url && ( *url != '\r' ) && ( *url != '\n' ) )
+	{
+		if( i > sizeof( server->path ) )
+			return NULL;
+
+		server->path[i++] = *url++;
+	}
+
+	server->path[i] = 0;
+	server->next = NULL;
+	server->needfree = false;
+
+	return server;
+}
+
+/*
+=======================
+HTTP_AddCustomServer
+=======================
+*/
+void HTTP_AddCustomServer( const char *url )
+{
+	httpserver_t *server = HTTP_ParseURL( url );
+
+	if( !server )
+	{
+		MsgDev ( D_ERROR, "\"%s\" is not valid url!\n", url );
+		return;
+	}
+
+	server->needfree = true;
+	server->next = http.first_server;
+	http.first_server = server;
+}
+
+/*
+=======================
+HTTP_AddCustomServer_f
+=======================
+*/
+void HTTP_AddCustomServer_f( void )
+{
+	if( Cmd_Argc() == 2 )
+	{
+		HTTP_AddCustomServer( Cmd_Argv( 1 ) );
+	}
+}
+
+/*
+============
+HTTP_Clear_f
+
+Clear all queue
+============
+*/
+void HTTP_Clear_f( void )
+{
+	int i;
+
+	for( i = 0; i < HTTP_MAX_CONNECTIONS; i++ )
+	{
+		if( http.conns[i].state != HTTP_FREE )
+			HTTP_CloseConnection( &http.conns[i], false );
+	}
+
+	http.last_file = NULL;
+	downloadfileid = downloadcount = 0;
+
+	while( http.first_file )
+	{
+		httpfile_t *file = http.first_file;
+
+		http.first_file = http.first_file->next;
+
+		if( file->file )
+			FS_Close( file->file );
+
+		Mem_Free( file );
+	}
+}
+
+/*
+==============
+HTTP_StopFile
+
+Take file away from its connection
+==============
+*/
+static void HTTP_StopFile( httpfile_t *file )
+{
+	httpconn_t *conn = file->conn;
+
+	if( !conn )
+		return;
+
+	// response stream can't be resynchronized, so drop connection
+	// other pipelined files will be requested again
+	while( conn->pipeline[0] != file )
+		HTTP_DetachFile( conn );
+
+	HTTP_DetachFile( conn );
+	HTTP_CloseConnection( conn, false );
+}
+
+/*
+==============
+HTTP_Cancel_f
+
+Stop current download, skip to next file
+==============
+*/
+void HTTP_Cancel_f( void )
+{
+	httpfile_t *file = http.first_file;
+
+	if( !file )
+		return;
+
+	HTTP_StopFile( file );
+
+	// if download even not started, it will be removed completely
+	file->server = NULL;
+	HTTP_FreeFile( file, true );
+}
+
+/*
+=============
+HTTP_Skip_f
+
+Stop current download, skip to next server
+=============
+*/
+void HTTP_Skip_f( void )
+{
+	httpfile_t *file = http.first_file;
+
+	if( !file )
+		return;
+
+	HTTP_StopFile( file );
+	HTTP_FreeFile( file, true );
+}
+
+/*
+=============
+HTTP_List_f
+
+Print all pending downloads to console
+=============
+*/
+void HTTP_List_f( void )
+{
+	httpfile_t *file = http.first_file;
+	int i;
+
+	while( file )
+	{
+		if ( file->server )
+			Msg ( "\t%d %d http://%s:%d/%s%s %d\n", file->id, file->state,
+				file->server->host, file->server->port, file->server->path,
+				file->path, file->downloaded );
+		else
+			Msg ( "\t%d %d (no server) %s\n", file->id, file->state, file->path );
+
+		file = file->next;
+	}
+
+	for( i = 0; i < HTTP_MAX_CONNECTIONS; i++ )
+	{
+		httpconn_t *conn = &http.conns[i];
+
+		if( conn->state != HTTP_FREE )
+			Msg( "\tconnection %d: %s:%d, state %d, %d requests\n", i,
+				conn->server->host, conn->server->port, conn->state, conn->pipelined );
+	}
+}
+
+/*
+================
+HTTP_ResetProcessState
+
+When connected to new server, all old files should not increase counter
+================
+*/
+void HTTP_ResetProcessState( void )
+{
+	httpfile_t *file = http.first_file;
+
+	while( file )
+	{
+		file->process = false;
+		file = file->next;
+	}
+}
+
+/*
+=================================================
+
+HTTP file server
+
+Serves resources of current map to fast download clients,
+so game server does not need separate web server.
+Only files from server resource list are available
+
+=================================================
+*/
+
+#define HTTPSV_MAX_CLIENTS	32
+#define HTTPSV_CHUNK	16384	// read size for files which can't be sent directly
+#define HTTPSV_TIMEOUT	20
+
+typedef struct httpsvclient_s
+{
+	int socket;	// -1 if slot is free
+	uint ip;
+	double lastactive;
+
+	// received requests, may contain several pipelined ones
+	char request[1024];
+	int request_size;
+
+	// response header, request is answered when it is not empty
+	char header[256];
+	int header_size, header_sent;
+
+	// response body
+	file_t *file;	// file in pack, or system does not have sendfile
+#ifdef HAVE_SENDFILE
+	int fd;		// disk file for sendfile, -1 if not used
+#endif
+	fs_offset_t offset;
+	int remaining;	// body bytes not sent yet
+	byte *chunk;	// read from file but not sent yet
+	int chunk_size, chunk_sent;
+	qboolean keepalive;
+} httpsvclient_t;
+
+typedef struct httpsvaddr_s
+{
+	uint ip;
+	int connections;	// slot is free if zero
+	float tokens;	// bytes which can be sent now
+} httpsvaddr_t;
+
+static struct
+{
+	int socket;	// listening socket, -1 if closed
+	int port;
+	qboolean failed;	// don't try to reopen same port every frame
+	httpsvclient_t clients[HTTPSV_MAX_CLIENTS];
+	httpsvaddr_t addrs[HTTPSV_MAX_CLIENTS];
+	float tokens;	// shared by all addresses
+	int first;	// client served first in this frame
+} httpsv;
+
+static convar_t *httpsv_enable;
+static convar_t *httpsv_port;
+static convar_t *httpsv_address;
+static convar_t *httpsv_rate;
+static convar_t *httpsv_maxrate;
+static convar_t *httpsv_maxconnections;
+
+/*
+==============
+HTTP_ServerAddr
+
+Find rate limiter for address
+==============
+*/
+static httpsvaddr_t *HTTP_ServerAddr( uint ip, qboolean create )
+{
+	httpsvaddr_t *empty = NULL;
+	int i;
+
+	for( i = 0; i < HTTPSV_MAX_CLIENTS; i++ )
+	{
+		httpsvaddr_t *addr = &httpsv.addrs[i];
+
+		if( !addr->connections )
+		{
+			if( !empty )
+				empty = addr;
+			continue;
+		}
+
+		if( addr->ip == ip )
+			return addr;
+	}
+
+	if( !create || !empty )
 		return NULL;
 
-	url += 7;
-	server = Mem_Alloc( net_mempool, sizeof( httpserver_t ) );
-	i = 0;
+	empty->ip = ip;
+	empty->tokens = 0;
+
+	return empty;
+}
+
+/*
+==============
+HTTP_ServerClientName
+==============
+*/
+static const char *HTTP_ServerClientName( httpsvclient_t *cl )
+{
+	struct in_addr in;
+
+	in.s_addr = cl->ip;
+
+	return pInet_Ntoa( in );
+}
+
+/*
+==============
+HTTP_ServerEndResponse
+==============
+*/
+static void HTTP_ServerEndResponse( httpsvclient_t *cl )
+{
+	if( cl->file )
+		FS_Close( cl->file );
+	cl->file = NULL;
+
+#ifdef HAVE_SENDFILE
+	if( cl->fd != -1 )
+		close( cl->fd );
+	cl->fd = -1;
+#endif
+	cl->remaining = 0;
+	cl->chunk_size = cl->chunk_sent = 0;
+	cl->header_size = cl->header_sent = 0;
+}
+
+/*
+==============
+HTTP_ServerDropClient
+==============
+*/
+static void HTTP_ServerDropClient( httpsvclient_t *cl )
+{
+	httpsvaddr_t *addr = HTTP_ServerAddr( cl->ip, false );
+
+	HTTP_ServerEndResponse( cl );
+
+	if( cl->chunk )
+		Mem_Free( cl->chunk );
+
+	pCloseSocket( cl->socket );
+
+	if( addr )
+		addr->connections--;
+
+	Q_memset( cl, 0, sizeof( *cl ));
+	cl->socket = -1;
+#ifdef HAVE_SENDFILE
+	cl->fd = -1;
+#endif
+}
+
+/*
+==============
+HTTP_ServerHasFile
+
+Response body is opened
+==============
+*/
+static qboolean HTTP_ServerHasFile( httpsvclient_t *cl )
+{
+#ifdef HAVE_SENDFILE
+	if( cl->fd != -1 )
+		return true;
+#endif
+	return cl->file != NULL;
+}
+
+/*
+==============
+HTTP_ServerResponse
+
+Format response header
+==============
+*/
+static void HTTP_ServerResponse( httpsvclient_t *cl, const char *status, int length, const char *range )
+{
+	cl->header_size = Q_snprintf( cl->header, sizeof( cl->header ),
+		"HTTP/1.1 %s\r\n"
+		"Server: xash3d\r\n"
+		"Content-Type: application/octet-stream\r\n"
+		"Content-Length: %d\r\n"
+		"%s"
+		"Connection: %s\r\n\r\n", status, length, range, cl->keepalive ? "keep-alive" : "close" );
+	cl->header_sent = 0;
+}
+
+/*
+==============
+HTTP_ServerOpenFile
+
+Open requested resource, return size or -1
+==============
+*/
+static int HTTP_ServerOpenFile( httpsvclient_t *cl, const char *path )
+{
+#ifdef HAVE_SENDFILE
+	const char *diskpath = FS_GetDiskPath( path, true );
+
+	// loose files are sent by kernel directly
+	if( diskpath && ( cl->fd = open( diskpath, O_RDONLY )) != -1 )
+	{
+		int size = (int)lseek( cl->fd, 0, SEEK_END );
+
+		if( size >= 0 )
+			return size;
+
+		close( cl->fd );
+		cl->fd = -1;
+	}
+#endif
+	if(( cl->file = FS_Open( path, "rb", true )))
+		return (int)FS_FileLength( cl->file );
+
+	return -1;
+}
+
+/*
+==============
+HTTP_ServerDecodePath
+
+Strip query and decode escaped characters.
+Return false for paths outside of game directory
+==============
+*/
+static qboolean HTTP_ServerDecodePath( char *path )
+{
+	char *in = path, *out = path;
+
+	if( *in++ != '/' )
+		return false;
+
+	while( *in && *in != '?' && *in != '#' )
+	{
+		if( *in == '%' && in[1] && in[2] )
+		{
+			*out++ = (char)Q_atoi( va( "0x%c%c", in[1], in[2] ));
+			in += 3;
+		}
+		else *out++ = *in++;
+	}
+
+	*out = 0;
+
+	return path[0] && !Q_strstr( path, ".." ) && !Q_strchr( path, '\\' ) && !Q_strchr( path, ':' );
+}
+
+/*
+==============
+HTTP_ServerParseRequest
+
+Answer first complete request from buffer.
+Return false if there is no complete request yet
+==============
+*/
+static qboolean HTTP_ServerParseRequest( httpsvclient_t *cl )
+{
+	char method[16], path[1024], *end;
+	const char *value;
+	int size, start = 0, last = -1, minor = 0, len;
+	qboolean head;
+
+	if( !( end = Q_strstr( cl->request, "\r\n\r\n" )))
+		return false;
+
+	*end = 0;
+	len = end - cl->request + 4;
 
-	while( *url && ( *url != ':' ) && ( *url != '/' ) && ( *url != '\r' ) && ( *url != '\n' ) )
-	{
-		if( i > sizeof( server->host ) )
-			return NULL;
+	// request line: method, path and version
+	if( sscanf( cl->request, "%15s %1023s HTTP/1.%d", method, path, &minor ) < 2 )
+		method[0] = 0;
 
-		server->host[i++] = *url++;
-	}
+	head = !Q_strcmp( method, "HEAD" );
 
-	server->host[i] = 0;
+	value = HTTP_FindHeader( cl->request, "Connection" );
 
-	if( *url == ':' )
-	{
-		server->port = Q_atoi( ++url );
+	if( value )
+		cl->keepalive = !Q_strnicmp( value, "keep-alive", 10 ) || ( minor > 0 && Q_strnicmp( value, "close", 5 ));
+	else cl->keepalive = ( minor > 0 );
 
-		while( *url && ( *url != '/' ) && ( *url != '\r' ) && ( *url != '\n' ) )
-			url++;
+	if( !head && Q_strcmp( method, "GET" ))
+	{
+		cl->keepalive = false;
+		HTTP_ServerResponse( cl, "501 Not Implemented", 0, "" );
+	}
+	else if( !HTTP_ServerDecodePath( path ) || !SV_IsResourceListed( path ))
+	{
+		MsgDev( D_NOTE, "HTTP server: %s requested %s, not found\n", HTTP_ServerClientName( cl ), path );
+		HTTP_ServerResponse( cl, "404 Not Found", 0, "" );
+	}
+	else if(( size = HTTP_ServerOpenFile( cl, path )) < 0 )
+	{
+		HTTP_ServerResponse( cl, "404 Not Found", 0, "" );
 	}
 	else
-		server->port = 80;
+	{
+		value = HTTP_FindHeader( cl->request, "Range" );
 
-	i = 0;
+		if( value && !Q_strnicmp( value, "bytes=", 6 ))
+		{
+			value += 6;
 
-	while( *url && ( *url != '\r' ) && ( *url != '\n' ) )
-	{
-		if( i > sizeof( server->path ) )
-			return NULL;
+			if( *value == '-' )
+			{
+				// suffix range, last N bytes of file,
+				// zero length suffix can't be satisfied
+				last = Q_atoi( value + 1 );
+				start = ( last > 0 ) ? max( size - last, 0 ) : size;
+				last = size - 1;
+			}
+			else
+			{
+				start = Q_atoi( value );
+				value = Q_strchr( value, '-' );
 
-		server->path[i++] = *url++;
+				if( value && value[1] >= '0' && value[1] <= '9' )
+					last = Q_atoi( value + 1 );
+
+				if( last < 0 || last >= size )
+					last = size - 1;
+			}
+
+			if( start < 0 || start >= size || last < start )
+			{
+				HTTP_ServerEndResponse( cl );
+				HTTP_ServerResponse( cl, "416 Range Not Satisfiable", 0, va( "Content-Range: bytes */%d\r\n", size ));
+			}
+			else HTTP_ServerResponse( cl, "206 Partial Content", last - start + 1,
+				va( "Content-Range: bytes %d-%d/%d\r\n", start, last, size ));
+		}
+		else
+		{
+			last = size - 1;
+			HTTP_ServerResponse( cl, "200 OK", size, "" );
+		}
+
+		if( HTTP_ServerHasFile( cl ))
+		{
+			MsgDev( D_NOTE, "HTTP server: sending %s to %s\n", path, HTTP_ServerClientName( cl ));
+
+			cl->offset = start;
+			cl->remaining = head ? 0 : last - start + 1;
+
+			if( cl->file && start )
+				FS_Seek( cl->file, start, SEEK_SET );
+		}
 	}
 
-	server->path[i] = 0;
-	server->next = NULL;
-	server->needfree = false;
+	// keep pipelined requests
+	cl->request_size -= len;
+	Q_memmove( cl->request, cl->request + len, cl->request_size );
+	cl->request[cl->request_size] = 0;
 
-	return server;
+	return true;
 }
 
 /*
-=======================
-HTTP_AddCustomServer
-=======================
+==============
+HTTP_ServerSendBody
+
+Send as much as rate limits allow.
+Return false if connection is broken
+==============
 */
-void HTTP_AddCustomServer( const char *url )
+static qboolean HTTP_ServerSendBody( httpsvclient_t *cl, httpsvaddr_t *addr )
 {
-	httpserver_t *server = HTTP_ParseURL( url );
-
-	if( !server )
+	while( cl->remaining > 0 )
 	{
-		MsgDev ( D_ERROR, "\"%s\" is not valid url!\n", url );
-		return;
+		int size = cl->remaining, res;
+
+		if( httpsv_rate->value > 0 )
+			size = min( size, (int)addr->tokens );
+
+		if( httpsv_maxrate->value > 0 )
+			size = min( size, (int)httpsv.tokens );
+
+		if( size <= 0 )
+		{
+			cl->lastactive = host.realtime; // throttled, not stalled
+			return true;
+		}
+
+#ifdef HAVE_SENDFILE
+		if( cl->fd != -1 )
+		{
+			off_t offset = cl->offset;
+
+			res = sendfile( cl->socket, cl->fd, &offset, size );
+
+			// file was truncated
+			if( res == 0 )
+				return false;
+		}
+		else
+#endif
+		{
+			if( cl->chunk_sent == cl->chunk_size )
+			{
+				if( !cl->chunk )
+					cl->chunk = Mem_Alloc( net_mempool, HTTPSV_CHUNK );
+
+				cl->chunk_size = FS_Read( cl->file, cl->chunk, min( cl->remaining, HTTPSV_CHUNK ));
+				cl->chunk_sent = 0;
+
+				if( cl->chunk_size <= 0 )
+					return false;
+			}
+
+			size = min( size, cl->chunk_size - cl->chunk_sent );
+			res = pSend( cl->socket, cl->chunk + cl->chunk_sent, size, 0 );
+
+			if( res > 0 )
+				cl->chunk_sent += res;
+		}
+
+		if( res < 0 )
+			return HTTP_WouldBlock( );
+
+		cl->offset += res;
+		cl->remaining -= res;
+		cl->lastactive = host.realtime;
+		addr->tokens -= res;
+		httpsv.tokens -= res;
 	}
 
-	server->needfree = true;
-	server->next = http.first_server;
-	http.first_server = server;
+	return true;
 }
 
 /*
-=======================
-HTTP_AddCustomServer_f
-=======================
+==============
+HTTP_ServeClient
+
+Receive requests and send responses.
+Return false if connection should be closed
+==============
 */
-void HTTP_AddCustomServer_f( void )
+static qboolean HTTP_ServeClient( httpsvclient_t *cl, httpsvaddr_t *addr )
 {
-	if( Cmd_Argc() == 2 )
+	while( true )
 	{
-		HTTP_AddCustomServer( Cmd_Argv( 1 ) );
+		int res;
+
+		// request answered, send response
+		if( cl->header_size )
+		{
+			while( cl->header_sent < cl->header_size )
+			{
+				res = pSend( cl->socket, cl->header + cl->header_sent, cl->header_size - cl->header_sent, 0 );
+
+				if( res < 0 )
+					return HTTP_WouldBlock( );
+
+				cl->header_sent += res;
+				cl->lastactive = host.realtime;
+			}
+
+			if( !HTTP_ServerSendBody( cl, addr ))
+				return false;
+
+			if( cl->remaining )
+				return true;
+
+			HTTP_ServerEndResponse( cl );
+
+			if( !cl->keepalive )
+				return false;
+		}
+
+		if( HTTP_ServerParseRequest( cl ))
+			continue;
+
+		if( cl->request_size == sizeof( cl->request ) - 1 )
+			return false; // request header is too long
+
+		res = pRecv( cl->socket, cl->request + cl->request_size, sizeof( cl->request ) - 1 - cl->request_size, 0 );
+
+		if( res == 0 )
+			return false;
+
+		if( res < 0 )
+			return HTTP_WouldBlock( );
+
+		cl->request_size += res;
+		cl->request[cl->request_size] = 0;
+		cl->lastactive = host.realtime;
 	}
 }
 
 /*
-============
-HTTP_Clear_f
-
-Clear all queue
-============
+==============
+HTTP_ServerOpen
+==============
 */
-void HTTP_Clear_f( void )
+static qboolean HTTP_ServerOpen( int port )
 {
-	http.last_file = NULL;
-	downloadfileid = downloadcount = 0;
+	struct sockaddr_in addr;
+	dword _true = 1;
+	int sock;
 
-	while( http.first_file )
+	Q_memset( &addr, 0, sizeof( addr ));
+
+	if(( sock = pSocket( PF_INET, SOCK_STREAM, IPPROTO_TCP )) < 0 )
 	{
-		httpfile_t *file = http.first_file;
+		MsgDev( D_ERROR, "HTTP server: socket = %s\n", NET_ErrorString( ));
+		return false;
+	}
 
-		http.first_file = http.first_file->next;
+	pIoctlSocket( sock, FIONBIO, &_true );
+#ifndef _WIN32
+	// allow restart while old connections are in TIME_WAIT
+	pSetSockopt( sock, SOL_SOCKET, SO_REUSEADDR, (char *)&_true, sizeof( _true ));
 
-		if( file->file )
-			FS_Close( file->file );
+	// writing to connection closed by client must not kill server
+	signal( SIGPIPE, SIG_IGN );
+#endif
 
-		if( file->socket != -1 )
-			pCloseSocket ( file->socket );
+	if( !net_ip->string[0] || !Q_stricmp( net_ip->string, "localhost" ))
+		addr.sin_addr.s_addr = INADDR_ANY;
+	else NET_StringToSockaddr( net_ip->string, (struct sockaddr *)&addr, false );
 
-		Mem_Free( file );
+	addr.sin_family = AF_INET;
+	addr.sin_port = pHtons((short)port);
+
+	if( pBind( sock, (void *)&addr, sizeof( addr )) < 0 || pListen( sock, HTTPSV_MAX_CLIENTS ) < 0 )
+	{
+		MsgDev( D_ERROR, "HTTP server: can't listen on port %d: %s\n", port, NET_ErrorString( ));
+		pCloseSocket( sock );
+		return false;
 	}
+
+	httpsv.socket = sock;
+	MsgDev( D_INFO, "HTTP server is listening on port %d\n", port );
+
+	return true;
 }
 
 /*
 ==============
-HTTP_Cancel_f
+HTTP_ServerShutdown
 
-Stop current download, skip to next file
+Close listening socket and all transfers
 ==============
 */
-void HTTP_Cancel_f( void )
+void HTTP_ServerShutdown( void )
 {
-	if( !http.first_file )
-		return;
+	int i;
 
-	// if download even not started, it will be removed completely
-	http.first_file->state = HTTP_FREE;
-	HTTP_FreeFile( http.first_file, true );
+	for( i = 0; i < HTTPSV_MAX_CLIENTS; i++ )
+	{
+		if( httpsv.clients[i].socket != -1 )
+			HTTP_ServerDropClient( &httpsv.clients[i] );
+	}
+
+	if( httpsv.socket != -1 )
+		pCloseSocket( httpsv.socket );
+
+	httpsv.socket = -1;
+	httpsv.failed = false;
 }
 
 /*
-=============
-HTTP_Skip_f
-
-Stop current download, skip to next server
-=============
+==============
+HTTP_ServerAccept
+==============
 */
-void HTTP_Skip_f( void )
+static void HTTP_ServerAccept( void )
 {
-	if( http.first_file )
-		HTTP_FreeFile( http.first_file, true );
+	struct sockaddr_in from;
+	socklen_t fromlen = sizeof( from );
+	int sock, i;
+
+	while(( sock = pAccept( httpsv.socket, (struct sockaddr *)&from, &fromlen )) >= 0 )
+	{
+		httpsvaddr_t *addr = HTTP_ServerAddr( from.sin_addr.s_addr, true );
+		httpsvclient_t *cl = NULL;
+		dword _true = 1;
+
+		for( i = 0; i < HTTPSV_MAX_CLIENTS; i++ )
+		{
+			if( httpsv.clients[i].socket == -1 )
+			{
+				cl = &httpsv.clients[i];
+				break;
+			}
+		}
+
+		if( !cl || !addr || addr->connections >= max( 1, httpsv_maxconnections->integer ))
+		{
+			pCloseSocket( sock );
+			fromlen = sizeof( from );
+			continue;
+		}
+
+		pIoctlSocket( sock, FIONBIO, &_true );
+
+		cl->socket = sock;
+		cl->ip = from.sin_addr.s_addr;
+		cl->lastactive = host.realtime;
+		addr->connections++;
+		fromlen = sizeof( from );
+	}
 }
 
 /*
-=============
-HTTP_List_f
+==============
+HTTP_ServerFrame
 
-Print all pending downloads to console
-=============
+Accept connections and send files, called every server frame
+==============
 */
-void HTTP_List_f( void )
+void HTTP_ServerFrame( void )
 {
-	httpfile_t *file = http.first_file;
+	struct sockaddr_in addr;
+	socklen_t addrlen = sizeof( addr );
+	float burst;
+	int i, port;
 
-	while( file )
+	if( !httpsv_enable->integer || noip || !ip_sockets[NS_SERVER] )
 	{
-		if( file->id == -1 )
-			Msg ( "\t(empty)\n");
-		else if ( file->server )
-			Msg ( "\t%d %d http://%s:%d/%s%s %d\n", file->id, file->state,
-				file->server->host, file->server->port, file->server->path,
-				file->path, file->downloaded );
-		else
-			Msg ( "\t%d %d (no server) %s\n", file->id, file->state, file->path );
+		if( httpsv.socket != -1 || httpsv.failed )
+			HTTP_ServerShutdown();
+		return;
+	}
 
-		file = file->next;
+	// same number as game port by default
+	if( !( port = httpsv_port->integer ))
+	{
+		if( pGetSockName( ip_sockets[NS_SERVER], (struct sockaddr *)&addr, &addrlen ))
+			return;
+		port = pNtohs( addr.sin_port );
+	}
+
+	if( port != httpsv.port )
+	{
+		HTTP_ServerShutdown();
+		httpsv.port = port;
+	}
+
+	if( httpsv.socket == -1 )
+	{
+		if( httpsv.failed || !HTTP_ServerOpen( port ))
+		{
+			httpsv.failed = true;
+			return;
+		}
+	}
+
+	HTTP_ServerAccept();
+
+	// refill rate limiters, allow short bursts
+	if( httpsv_maxrate->value > 0 )
+	{
+		burst = max( httpsv_maxrate->value * 0.25f, HTTPSV_CHUNK );
+		httpsv.tokens = min( httpsv.tokens + httpsv_maxrate->value * host.frametime, burst );
+	}
+	else httpsv.tokens = 0;
+
+	burst = max( httpsv_rate->value * 0.25f, HTTPSV_CHUNK );
+
+	for( i = 0; i < HTTPSV_MAX_CLIENTS; i++ )
+	{
+		httpsvaddr_t *addr = &httpsv.addrs[i];
+
+		if( !addr->connections )
+			continue;
+
+		if( httpsv_rate->value > 0 )
+			addr->tokens = min( addr->tokens + httpsv_rate->value * host.frametime, burst );
+		else addr->tokens = 0;
+	}
+
+	// rotate first client, so all of them get bandwidth
+	for( i = 0; i < HTTPSV_MAX_CLIENTS; i++ )
+	{
+		httpsvclient_t *cl = &httpsv.clients[( httpsv.first + i ) % HTTPSV_MAX_CLIENTS];
+
+		if( cl->socket == -1 )
+			continue;
+
+		if( !HTTP_ServeClient( cl, HTTP_ServerAddr( cl->ip, false )) || host.realtime - cl->lastactive > HTTPSV_TIMEOUT )
+			HTTP_ServerDropClient( cl );
 	}
+
+	httpsv.first = ( httpsv.first + 1 ) % HTTPSV_MAX_CLIENTS;
 }
 
 /*
-================
-HTTP_ResetProcessState
+==============
+HTTP_ServerURL
 
-When connected to new server, all old files should not increase counter
-================
+Address which is passed to clients as fastdl server
+==============
 */
-void HTTP_ResetProcessState( void )
+const char *HTTP_ServerURL( void )
 {
-	httpfile_t *file = http.first_file;
+	if( httpsv.socket == -1 )
+		return NULL;
 
-	while( file )
-	{
-		file->process = false;
-		file = file->next;
-	}
+	if( httpsv_address->string[0] )
+		return va( "http://%s:%d/", httpsv_address->string, httpsv.port );
+
+	if( net_local.type != NA_IP )
+		return NULL;
+
+	return va( "http://%s:%d/", NET_BaseAdrToString( net_local ), httpsv.port );
 }
 
 /*
@@ -2458,12 +3802,24 @@ HTTP_Init
 void HTTP_Init( void )
 {
 	char *serverfile, *line, token[1024];
+	int i;
 
 	http.last_server = NULL;
 
 	http.first_file = http.last_file = NULL;
-	http.buf[0] = 0;
-	http.header_size = 0;
+
+	for( i = 0; i < HTTP_MAX_CONNECTIONS; i++ )
+		http.conns[i].socket = -1;
+
+	httpsv.socket = -1;
+
+	for( i = 0; i < HTTPSV_MAX_CLIENTS; i++ )
+	{
+		httpsv.clients[i].socket = -1;
+#ifdef HAVE_SENDFILE
+		httpsv.clients[i].fd = -1;
+#endif
+	}
 
 	Cmd_AddCommand("http_download", &HTTP_Download_f, "Add file to download queue");
 	Cmd_AddCommand("http_skip", &HTTP_Skip_f, "Skip current download server");
@@ -2474,6 +3830,14 @@ void HTTP_Init( void )
 	http_useragent = Cvar_Get( "http_useragent", "xash3d", CVAR_ARCHIVE, "User-Agent string" );
 	http_autoremove = Cvar_Get( "http_autoremove", "1", CVAR_ARCHIVE, "Remove broken files" );
 	http_timeout = Cvar_Get( "http_timeout", "45", CVAR_ARCHIVE, "Timeout for http downloader" );
+	http_maxconnections = Cvar_Get( "http_maxconnections", "4", CVAR_ARCHIVE, "Maximum parallel connections for http downloader" );
+	http_pipeline = Cvar_Get( "http_pipeline", "4", CVAR_ARCHIVE, "Maximum pipelined requests per http connection" );
+	httpsv_enable = Cvar_Get( "sv_httpserver", "0", CVAR_ARCHIVE, "Serve resource list files over http for fast download" );
+	httpsv_port = Cvar_Get( "sv_httpserver_port", "0", CVAR_ARCHIVE, "TCP port of http server, same as game port if zero" );
+	httpsv_address = Cvar_Get( "sv_httpserver_address", "", CVAR_ARCHIVE, "Public address of http server passed to clients" );
+	httpsv_rate = Cvar_Get( "sv_httpserver_rate", "1048576", CVAR_ARCHIVE, "Maximum bytes per second for one client address, 0 for unlimited" );
+	httpsv_maxrate = Cvar_Get( "sv_httpserver_maxrate", "0", CVAR_ARCHIVE, "Maximum bytes per second for all clients, 0 for unlimited" );
+	httpsv_maxconnections = Cvar_Get( "sv_httpserver_maxconnections", "4", CVAR_ARCHIVE, "Maximum connections from one client address" );
 
 	// Read servers from fastdl.txt
 	line = serverfile = (char *)FS_LoadFile( "fastdl.txt", 0, false );
@@ -2508,6 +3872,7 @@ HTTP_Shutdown
 void HTTP_Shutdown( void )
 {
 	HTTP_Clear_f();
+	HTTP_ServerShutdown();
 
 	while( http.first_server )
 	{
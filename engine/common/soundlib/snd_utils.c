@@ -14,6 +14,20 @@ GNU General Public License for more details.
 */
 
 #include "soundlib.h"
+#include "mathlib.h"
+
+#if defined __SSE__ || defined _M_X64 || ( defined _M_IX86_FP && _M_IX86_FP >= 1 )
+#include <xmmintrin.h>
+#define XASH_SINC_SSE
+#elif defined __ARM_NEON || defined __ARM_NEON__
+#include <arm_neon.h>
+#define XASH_SINC_NEON
+#endif
+
+#define RESAMPLE_MAX_PHASES	512	// finer ratios use nearest phase
+#define RESAMPLE_CUTOFF	0.46	// of the lower rate, leaves some room for transition band
+
+convar_t	*snd_resample_quality;
 
 /*
 =============================================================================
@@ -61,6 +75,7 @@ void Sound_Init( void )
 {
 	// init pools
 	host.soundpool = Mem_AllocPool( "SoundLib Pool" );
+	snd_resample_quality = Cvar_Get( "snd_resample_quality", "2", CVAR_ARCHIVE, "load-time resampler: 0 - nearest sample, 1 - 8 taps, 2 - 16 taps, 3 - 32 taps sinc filter" );
 
 	// install image formats (can be re-install later by Sound_Setup)
 	switch( host.type )
@@ -162,6 +177,159 @@ void Sound_ConvertToSigned( const byte *data, int channels, int samples )
 	}
 }
 
+/*
+================
+Sound_DotProduct
+
+count must be a multiple of 4
+================
+*/
+static float Sound_DotProduct( const float *a, const float *b, int count )
+{
+	int	i;
+#if defined XASH_SINC_SSE
+	__m128	sum = _mm_setzero_ps();
+
+	for( i = 0; i < count; i += 4 )
+		sum = _mm_add_ps( sum, _mm_mul_ps( _mm_loadu_ps( a + i ), _mm_loadu_ps( b + i )));
+
+	sum = _mm_add_ps( sum, _mm_movehl_ps( sum, sum ));
+	sum = _mm_add_ss( sum, _mm_shuffle_ps( sum, sum, 1 ));
+
+	return _mm_cvtss_f32( sum );
+#elif defined XASH_SINC_NEON
+	float32x4_t	sum = vdupq_n_f32( 0.0f );
+	float32x2_t	half;
+
+	for( i = 0; i < count; i += 4 )
+		sum = vmlaq_f32( sum, vld1q_f32( a + i ), vld1q_f32( b + i ));
+
+	half = vadd_f32( vget_low_f32( sum ), vget_high_f32( sum ));
+
+	return vget_lane_f32( vpadd_f32( half, half ), 0 );
+#else
+	float	sum[4] = { 0.0f, 0.0f, 0.0f, 0.0f };
+
+	for( i = 0; i < count; i += 4 )
+	{
+		sum[0] += a[i+0] * b[i+0];
+		sum[1] += a[i+1] * b[i+1];
+		sum[2] += a[i+2] * b[i+2];
+		sum[3] += a[i+3] * b[i+3];
+	}
+
+	return ( sum[0] + sum[1] ) + ( sum[2] + sum[3] );
+#endif
+}
+
+/*
+================
+Sound_BuildSincTable
+
+Blackman-windowed sinc, one row of taps per phase,
+every row is normalized to unity gain
+================
+*/
+static float *Sound_BuildSincTable( int numphases, int taps, double cutoff )
+{
+	float	*table = Mem_Alloc( host.soundpool, numphases * taps * sizeof( float ));
+	int	half = taps / 2;
+	int	p, k;
+
+	for( p = 0; p < numphases; p++ )
+	{
+		float	*row = table + p * taps;
+		double	frac = (double)p / numphases;
+		double	sum = 0.0;
+
+		for( k = 0; k < taps; k++ )
+		{
+			// distance from output position to this input sample
+			double	x = ( k - half + 1 ) - frac;
+			double	h = 2.0 * cutoff;
+
+			if( x != 0.0 )
+				h = sin( 2.0 * M_PI * cutoff * x ) / ( M_PI * x );
+
+			if( fabs( x ) < half )
+				h *= 0.42 + 0.5 * cos( M_PI * x / half ) + 0.08 * cos( 2.0 * M_PI * x / half );
+			else h = 0.0;
+
+			row[k] = h;
+			sum += h;
+		}
+
+		for( k = 0; k < taps && sum != 0.0; k++ )
+			row[k] /= sum;
+	}
+
+	return table;
+}
+
+/*
+================
+Sound_ResampleSinc
+
+polyphase resampler for any rates ratio, output goes to sound.tempbuffer.
+Input is already signed. Looped sounds wrap filter tail to loop start
+================
+*/
+static void Sound_ResampleSinc( const byte *data, int insamples, int inwidth, int loopStart, int channels,
+	int inrate, int outrate, int outwidth, int outcount, int taps )
+{
+	int	l, m, a, b, numphases, half = taps / 2;
+	float	*table, *in;
+	int	i, j, c;
+
+	// reduce ratio, so 11k -> 44k has only 4 phases
+	for( a = inrate, b = outrate; b; )
+	{
+		int	t = a % b;
+		a = b;
+		b = t;
+	}
+
+	l = outrate / a;
+	m = inrate / a;
+	numphases = min( l, RESAMPLE_MAX_PHASES );
+
+	table = Sound_BuildSincTable( numphases, taps, RESAMPLE_CUTOFF * min( 1.0, (double)l / m ));
+	in = Mem_Alloc( host.soundpool, ( insamples + taps ) * sizeof( float ));
+
+	for( c = 0; c < channels; c++ )
+	{
+		// deinterleave to float, zeroes before start
+		for( j = 0; j < insamples; j++ )
+		{
+			if( inwidth == 2 ) in[half + j] = ((short *)data)[j * channels + c];
+			else in[half + j] = ((signed char *)data)[j * channels + c] * 256;
+		}
+
+		for( j = insamples + half; j < insamples + taps; j++ )
+		{
+			if( loopStart >= 0 && loopStart < insamples )
+				in[j] = in[half + loopStart + ( j - insamples - half ) % ( insamples - loopStart )];
+			else in[j] = 0.0f;
+		}
+
+		for( i = 0; i < outcount; i++ )
+		{
+			int64_t	t = (int64_t)i * m;
+			int	n = t / l;
+			int	phase = ( t % l ) * numphases / l;
+			int	sample = (int)floor( Sound_DotProduct( table + phase * taps, in + n + 1, taps ) + 0.5f );
+
+			sample = bound( -32768, sample, 32767 );
+
+			if( outwidth == 2 ) ((short *)sound.tempbuffer)[i * channels + c] = sample;
+			else ((signed char *)sound.tempbuffer)[i * channels + c] = sample >> 8;
+		}
+	}
+
+	Mem_Free( in );
+	Mem_Free( table );
+}
+
 /*
 ================
 Sound_ResampleInternal
@@ -174,6 +342,8 @@ qboolean Sound_ResampleInternal( wavdata_t *sc, int inrate, int inwidth, int out
 	float	stepscale;
 	int	outcount, srcsample;
 	int	i, sample, sample2, samplefrac, fracstep;
+	int	insamples = sc->samples;
+	int	inloop = sc->loopStart;
 	byte	*data;
 
 	data = sc->buffer;
@@ -192,6 +362,14 @@ qboolean Sound_ResampleInternal( wavdata_t *sc, int inrate, int inwidth, int out
 	{
 		Sound_ConvertToSigned( data, sc->channels, outcount );
 	}
+	else if( inrate != outrate && snd_resample_quality->integer > 0 && outcount > 0 )
+	{
+		int	taps = 8 << ( bound( 1, snd_resample_quality->integer, 3 ) - 1 );
+
+		Sound_ResampleSinc( data, insamples, inwidth, inloop, sc->channels, inrate, outrate, outwidth, outcount, taps );
+
+		MsgDev( D_NOTE, "Sound_Resample: from[%d bit %d kHz] to [%d bit %d kHz], %i taps\n", inwidth * 8, inrate, outwidth * 8, outrate, taps );
+	}
 	else
 	{
 		// general case
@@ -0,0 +1,586 @@
+/*
+threads.c - portable threading primitives and worker pool
+Copyright (C) 2018 FWGS
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+*/
+
+#include "common.h"
+#include "mathlib.h"
+
+#ifdef _WIN32
+#include <windows.h>
+#elif !defined __EMSCRIPTEN__
+#include <pthread.h>
+#include <unistd.h>
+#define XASH_PTHREADS
+#endif
+
+#if defined _WIN32 || defined XASH_PTHREADS
+#define XASH_THREADS
+#endif
+
+#define MAX_WORKERS		16
+#define MAX_JOBS		4096	// must be power of two
+#define MAX_JOBS_MASK	( MAX_JOBS - 1 )
+
+/*
+=============================================================================
+
+THREADING PRIMITIVES
+
+All objects must be created and destroyed from the main thread,
+because they are allocated from host mempool
+
+=============================================================================
+*/
+struct sys_mutex_s
+{
+#ifdef _WIN32
+	CRITICAL_SECTION	cs;
+#elif defined XASH_PTHREADS
+	pthread_mutex_t	mutex;
+#else
+	int		dummy;
+#endif
+};
+
+struct sys_semaphore_s
+{
+#ifdef _WIN32
+	HANDLE		sem;
+#elif defined XASH_PTHREADS
+	pthread_mutex_t	mutex;
+	pthread_cond_t	cond;
+	int		count;
+#else
+	int		count;
+#endif
+};
+
+struct sys_thread_s
+{
+	pfnThreadFunc	func;
+	void		*arg;
+#ifdef _WIN32
+	HANDLE		handle;
+#elif defined XASH_PTHREADS
+	pthread_t		handle;
+#endif
+};
+
+/*
+================
+Sys_CreateMutex
+
+mutex is recursive on all platforms
+(critical sections always are)
+================
+*/
+sys_mutex_t *Sys_CreateMutex( void )
+{
+	sys_mutex_t	*mutex = (sys_mutex_t *)Mem_Alloc( host.mempool, sizeof( sys_mutex_t ));
+
+#ifdef _WIN32
+	InitializeCriticalSection( &mutex->cs );
+#elif defined XASH_PTHREADS
+	pthread_mutexattr_t	attr;
+
+	pthread_mutexattr_init( &attr );
+	pthread_mutexattr_settype( &attr, PTHREAD_MUTEX_RECURSIVE );
+	pthread_mutex_init( &mutex->mutex, &attr );
+	pthread_mutexattr_destroy( &attr );
+#endif
+	return mutex;
+}
+
+/*
+================
+Sys_LockMutex
+================
+*/
+void Sys_LockMutex( sys_mutex_t *mutex )
+{
+#ifdef _WIN32
+	EnterCriticalSection( &mutex->cs );
+#elif defined XASH_PTHREADS
+	pthread_mutex_lock( &mutex->mutex );
+#endif
+}
+
+/*
+================
+Sys_UnlockMutex
+================
+*/
+void Sys_UnlockMutex( sys_mutex_t *mutex )
+{
+#ifdef _WIN32
+	LeaveCriticalSection( &mutex->cs );
+#elif defined XASH_PTHREADS
+	pthread_mutex_unlock( &mutex->mutex );
+#endif
+}
+
+/*
+================
+Sys_DestroyMutex
+================
+*/
+void Sys_DestroyMutex( sys_mutex_t *mutex )
+{
+	if( !mutex ) return;
+#ifdef _WIN32
+	DeleteCriticalSection( &mutex->cs );
+#elif defined XASH_PTHREADS
+	pthread_mutex_destroy( &mutex->mutex );
+#endif
+	Mem_Free( mutex );
+}
+
+/*
+================
+Sys_CreateSemaphore
+================
+*/
+sys_semaphore_t *Sys_CreateSemaphore( int count )
+{
+	sys_semaphore_t	*sem = (sys_semaphore_t *)Mem_Alloc( host.mempool, sizeof( sys_semaphore_t ));
+
+#ifdef _WIN32
+	sem->sem = CreateSemaphore( NULL, count, 0x7FFFFFFF, NULL );
+#elif defined XASH_PTHREADS
+	pthread_mutex_init( &sem->mutex, NULL );
+	pthread_cond_init( &sem->cond, NULL );
+	sem->count = count;
+#else
+	sem->count = count;
+#endif
+	return sem;
+}
+
+/*
+================
+Sys_PostSemaphore
+================
+*/
+void Sys_PostSemaphore( sys_semaphore_t *sem )
+{
+#ifdef _WIN32
+	ReleaseSemaphore( sem->sem, 1, NULL );
+#elif defined XASH_PTHREADS
+	pthread_mutex_lock( &sem->mutex );
+	sem->count++;
+	pthread_cond_signal( &sem->cond );
+	pthread_mutex_unlock( &sem->mutex );
+#else
+	sem->count++;
+#endif
+}
+
+/*
+================
+Sys_WaitSemaphore
+================
+*/
+void Sys_WaitSemaphore( sys_semaphore_t *sem )
+{
+#ifdef _WIN32
+	WaitForSingleObject( sem->sem, INFINITE );
+#elif defined XASH_PTHREADS
+	pthread_mutex_lock( &sem->mutex );
+	while( sem->count <= 0 )
+		pthread_cond_wait( &sem->cond, &sem->mutex );
+	sem->count--;
+	pthread_mutex_unlock( &sem->mutex );
+#else
+	sem->count--;
+#endif
+}
+
+/*
+================
+Sys_DestroySemaphore
+================
+*/
+void Sys_DestroySemaphore( sys_semaphore_t *sem )
+{
+	if( !sem ) return;
+#ifdef _WIN32
+	CloseHandle( sem->sem );
+#elif defined XASH_PTHREADS
+	pthread_cond_destroy( &sem->cond );
+	pthread_mutex_destroy( &sem->mutex );
+#endif
+	Mem_Free( sem );
+}
+
+#ifdef _WIN32
+static DWORD WINAPI Sys_ThreadStart( LPVOID arg )
+{
+	sys_thread_t	*thread = (sys_thread_t *)arg;
+
+	thread->func( thread->arg );
+	return 0;
+}
+#elif defined XASH_PTHREADS
+static void *Sys_ThreadStart( void *arg )
+{
+	sys_thread_t	*thread = (sys_thread_t *)arg;
+
+	thread->func( thread->arg );
+	return NULL;
+}
+#endif
+
+/*
+================
+Sys_CreateThread
+
+returns NULL if platform can't run threads
+================
+*/
+sys_thread_t *Sys_CreateThread( pfnThreadFunc func, void *arg )
+{
+#ifdef XASH_THREADS
+	sys_thread_t	*thread = (sys_thread_t *)Mem_Alloc( host.mempool, sizeof( sys_thread_t ));
+
+	thread->func = func;
+	thread->arg = arg;
+
+#ifdef _WIN32
+	thread->handle = CreateThread( NULL, 0, Sys_ThreadStart, thread, 0, NULL );
+	if( thread->handle )
+		return thread;
+#else
+	if( !pthread_create( &thread->handle, NULL, Sys_ThreadStart, thread ))
+		return thread;
+#endif
+	Mem_Free( thread );
+#endif
+	return NULL;
+}
+
+/*
+================
+Sys_JoinThread
+
+wait for thread termination and release it
+================
+*/
+void Sys_JoinThread( sys_thread_t *thread )
+{
+	if( !thread ) return;
+#ifdef _WIN32
+	WaitForSingleObject( thread->handle, INFINITE );
+	CloseHandle( thread->handle );
+#elif defined XASH_PTHREADS
+	pthread_join( thread->handle, NULL );
+#endif
+	Mem_Free( thread );
+}
+
+/*
+================
+Sys_MemoryBarrier
+
+full fence for single-producer lock-free queues
+================
+*/
+void Sys_MemoryBarrier( void )
+{
+#ifdef _WIN32
+	MemoryBarrier();
+#elif defined __GNUC__
+	__sync_synchronize();
+#endif
+}
+
+/*
+================
+Sys_NumCPUs
+================
+*/
+int Sys_NumCPUs( void )
+{
+#ifdef _WIN32
+	SYSTEM_INFO	info;
+
+	GetSystemInfo( &info );
+	return max( 1, (int)info.dwNumberOfProcessors );
+#elif defined XASH_PTHREADS && defined _SC_NPROCESSORS_ONLN
+	return max( 1, (int)sysconf( _SC_NPROCESSORS_ONLN ));
+#else
+	return 1;
+#endif
+}
+
+/*
+=============================================================================
+
+WORKER POOL
+
+Jobs can be grouped to wait for completion, only the main thread
+is allowed to add jobs and wait for them. Job functions must not
+touch engine state that is not protected by their owner
+
+=============================================================================
+*/
+typedef struct
+{
+	pfnJobFunc	func;
+	void		*data;
+	jobgroup_t	*group;
+} job_t;
+
+static struct
+{
+	sys_mutex_t	*lock;
+	sys_semaphore_t	*wakeup;		// posted once per added job
+	sys_semaphore_t	*done;		// posted when a waited group is finished
+	sys_thread_t	*workers[MAX_WORKERS];
+	int		numworkers;
+	qboolean		shutdown;
+
+	job_t		jobs[MAX_JOBS];
+	uint		head, tail;	// ring of pending jobs
+} jobpool;
+
+/*
+================
+Job_Finish
+
+must be called with pool locked
+================
+*/
+static void Job_Finish( jobgroup_t *group )
+{
+	if( !group ) return;
+
+	group->pending--;
+
+	if( !group->pending && group->waiting )
+	{
+		group->waiting = false;
+		Sys_PostSemaphore( jobpool.done );
+	}
+}
+
+/*
+================
+Job_Worker
+================
+*/
+static void Job_Worker( void *unused )
+{
+	while( 1 )
+	{
+		job_t	job;
+
+		Sys_WaitSemaphore( jobpool.wakeup );
+		Sys_LockMutex( jobpool.lock );
+
+		if( jobpool.head == jobpool.tail )
+		{
+			// stolen by main thread or shutdown request
+			qboolean	quit = jobpool.shutdown;
+
+			Sys_UnlockMutex( jobpool.lock );
+			if( quit ) return;
+			continue;
+		}
+
+		job = jobpool.jobs[jobpool.tail++ & MAX_JOBS_MASK];
+		Sys_UnlockMutex( jobpool.lock );
+
+		job.func( job.data );
+
+		Sys_LockMutex( jobpool.lock );
+		Job_Finish( job.group );
+		Sys_UnlockMutex( jobpool.lock );
+	}
+}
+
+/*
+================
+Job_Init
+
+-numthreads <n> overrides worker count, zero runs all jobs inline
+================
+*/
+void Job_Init( void )
+{
+	char	threads[32];
+	int	i, count;
+
+	if( jobpool.lock ) return;
+
+	count = Sys_NumCPUs() - 1;
+
+	if( Sys_GetParmFromCmdLine( "-numthreads", threads ))
+		count = Q_atoi( threads );
+
+	count = bound( 0, count, MAX_WORKERS );
+
+	jobpool.lock = Sys_CreateMutex();
+	jobpool.wakeup = Sys_CreateSemaphore( 0 );
+	jobpool.done = Sys_CreateSemaphore( 0 );
+	jobpool.head = jobpool.tail = 0;
+	jobpool.shutdown = false;
+	jobpool.numworkers = 0;
+
+	for( i = 0; i < count; i++ )
+	{
+		jobpool.workers[jobpool.numworkers] = Sys_CreateThread( Job_Worker, NULL );
+		if( !jobpool.workers[jobpool.numworkers] )
+			break;
+		jobpool.numworkers++;
+	}
+
+	MsgDev( D_NOTE, "Job_Init: %i worker threads\n", jobpool.numworkers );
+}
+
+/*
+================
+Job_Shutdown
+
+pending jobs are executed before shutdown
+================
+*/
+void Job_Shutdown( void )
+{
+	int	i;
+
+	if( !jobpool.lock ) return;
+
+	Sys_LockMutex( jobpool.lock );
+	jobpool.shutdown = true;
+	Sys_UnlockMutex( jobpool.lock );
+
+	// finish queued jobs on this thread
+	Job_Wait( NULL );
+
+	for( i = 0; i < jobpool.numworkers; i++ )
+		Sys_PostSemaphore( jobpool.wakeup );
+
+	for( i = 0; i < jobpool.numworkers; i++ )
+		Sys_JoinThread( jobpool.workers[i] );
+
+	Sys_DestroySemaphore( jobpool.done );
+	Sys_DestroySemaphore( jobpool.wakeup );
+	Sys_DestroyMutex( jobpool.lock );
+	Q_memset( &jobpool, 0, sizeof( jobpool ));
+}
+
+/*
+================
+Job_NumWorkers
+================
+*/
+int Job_NumWorkers( void )
+{
+	return jobpool.numworkers;
+}
+
+/*
+================
+Job_Add
+
+queue a job, it's executed immediately
+if there are no workers or queue is full
+================
+*/
+void Job_Add( jobgroup_t *group, pfnJobFunc func, void *data )
+{
+	if( !jobpool.lock || !jobpool.numworkers )
+	{
+		func( data );
+		return;
+	}
+
+	Sys_LockMutex( jobpool.lock );
+
+	if( jobpool.head - jobpool.tail >= MAX_JOBS )
+	{
+		Sys_UnlockMutex( jobpool.lock );
+		func( data );
+		return;
+	}
+
+	jobpool.jobs[jobpool.head & MAX_JOBS_MASK].func = func;
+	jobpool.jobs[jobpool.head & MAX_JOBS_MASK].data = data;
+	jobpool.jobs[jobpool.head & MAX_JOBS_MASK].group = group;
+	jobpool.head++;
+	if( group ) group->pending++;
+
+	Sys_UnlockMutex( jobpool.lock );
+	Sys_PostSemaphore( jobpool.wakeup );
+}
+
+/*
+================
+Job_Wait
+
+main thread helps to run queued jobs until the group is done,
+NULL group means wait for an empty queue
+================
+*/
+void Job_Wait( jobgroup_t *group )
+{
+	if( !jobpool.lock ) return;
+
+	Sys_LockMutex( jobpool.lock );
+
+	while( 1 )
+	{
+		if( jobpool.head != jobpool.tail )
+		{
+			job_t	job = jobpool.jobs[jobpool.tail++ & MAX_JOBS_MASK];
+
+			Sys_UnlockMutex( jobpool.lock );
+			job.func( job.data );
+			Sys_LockMutex( jobpool.lock );
+			Job_Finish( job.group );
+			continue;
+		}
+
+		if( !group || !group->pending )
+			break;
+
+		// remaining jobs are running on workers
+		group->waiting = true;
+		Sys_UnlockMutex( jobpool.lock );
+		Sys_WaitSemaphore( jobpool.done );
+		Sys_LockMutex( jobpool.lock );
+	}
+
+	Sys_UnlockMutex( jobpool.lock );
+}
+
+/*
+================
+Job_IsDone
+
+non-blocking check for group completion
+================
+*/
+qboolean Job_IsDone( jobgroup_t *group )
+{
+	qboolean	done;
+
+	if( !jobpool.lock ) return true;
+
+	Sys_LockMutex( jobpool.lock );
+	done = !group->pending;
+	Sys_UnlockMutex( jobpool.lock );
+
+	return done;
+}
@@ -172,6 +172,23 @@ typedef struct ui_textfuncs_s {
 	int (*pfnUtfMoveRight) ( char *str, int pos, int length );
 } ui_textfuncs_t;
 
+typedef struct ui_downloadstatus_s
+{
+	int	queued;		// files waiting for connection
+	int	active;		// files requested or being received
+	int	completed;	// files received since queue was started
+	int	failed;		// files which could not be received from any server
+	int	connections;	// opened connections
+	int	received;		// bytes received for active files
+	int	total;		// known size of active files
+	float	speed;		// bytes per second
+	char	current[64];	// one of files being received
+} ui_downloadstatus_t;
+
+typedef struct ui_downloadfuncs_s {
+	int (*pfnGetDownloadStatus)( ui_downloadstatus_t *status ); // returns number of unfinished files
+} ui_downloadfuncs_t;
+
 typedef struct
 {
 	int	(*pfnVidInit)( void );
@@ -196,6 +213,8 @@ typedef int (*MENUAPI)( UI_FUNCTIONS *pFunctionTable, ui_enginefuncs_t* engfuncs
 
 typedef int (*UITEXTAPI)( ui_textfuncs_t* engfuncs );
 
+typedef int (*UIDOWNLOADAPI)( ui_downloadfuncs_t* engfuncs );
+
 typedef void (*ADDTOUCHBUTTONTOLIST)( const char *name, const char *texture, const char *command, unsigned char *color, int flags );
 
 #define PLATFORM_UPDATE_PAGE "PlatformUpdatePage"
@@ -188,7 +188,7 @@ Makes sure dma.buffer is valid
 */
 void SNDDMA_BeginPainting( void )
 {
-	SDL_LockAudio( );
+	SDL_LockAudioDevice( sdl_dev );
 }
 
 /*
@@ -201,7 +201,7 @@ Also unlocks the dsound buffer
 */
 void SNDDMA_Submit( void )
 {
-	SDL_UnlockAudio( );
+	SDL_UnlockAudioDevice( sdl_dev );
 }
 
 /*
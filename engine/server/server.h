@@ -195,6 +195,16 @@ typedef struct
 	int  		first_entity;		// into the circular sv_packet_entities[]
 } client_frame_t;
 
+// per-client scheduling state of one entity, see SV_ScheduleEntities
+typedef struct
+{
+	float		weight;			// importance scaled by distance, this snapshot
+	float		accum;			// grows while the entity's changes are held back
+	int		starved;			// snapshots in a row the entity was held back
+	int		maxstarved;		// longest starvation seen
+	int		snapshot;			// last snapshot the entity was listed for
+} sv_entpriority_t;
+
 typedef struct sv_client_s
 {
 	cl_state_t	state;
@@ -240,6 +250,20 @@ typedef struct sv_client_s
 	float		latency;
 	float		ping;
 
+	// adaptive rate control, see SV_UpdateClientRate
+	int		userrate;			// rate requested in userinfo, upper bound
+	double		updateinterval;		// effective time between world updates
+	double		next_ratecheck;		// time to run the controller again
+	int		ratechokes;		// chokes since last check
+	float		minping;			// lowest ping seen recently, ms
+	double		minping_expire;		// time to forget minping
+	float		snapshotsize;		// average datagram size, bytes
+	int		maxentities;		// entity budget for one snapshot
+
+	sv_entpriority_t	*entpriority;		// [GI->max_edicts] for oversize snapshots
+	int		deferred;			// entity updates held back since connect
+	int		snapshotnum;		// counts snapshots, see sv_entpriority_t
+
 	int		listeners;		// 32 bits == MAX_CLIENTS (voice listeners)
 
 	edict_t		*edict;			// EDICT_NUM(clientnum+1)
@@ -288,18 +312,11 @@ typedef struct sv_client_s
 =============================================================================
 */
 
-// MAX_CHALLENGES is made large to prevent a denial
-// of service attack that could cycle all of them
-// out before legitimate users connected
-#define MAX_CHALLENGES	1024
-
-typedef struct
-{
-	netadr_t		adr;
-	int		challenge;
-	double		time;
-	qboolean		connected;
-} challenge_t;
+// challenges are derived from address and a secret, so
+// nothing is stored and there is no table to flood.
+// Secret is changed each CHALLENGE_LIFETIME seconds,
+// previous one is still accepted
+#define CHALLENGE_LIFETIME	60.0
 
 typedef struct
 {
@@ -399,7 +416,8 @@ typedef struct
 	entity_state_t	*baselines;		// [GI->max_edicts]
 
 	double		last_heartbeat;
-	challenge_t	challenges[MAX_CHALLENGES];	// to prevent invalid IPs from connecting
+	byte		challenge_secret[2][16];	// current and previous, to prevent invalid IPs from connecting
+	double		challenge_time;		// when current secret was made
 } server_static_t;
 
 //=============================================================================
@@ -454,6 +472,8 @@ extern	convar_t		*sv_skyangle;
 extern	convar_t		*sv_quakehulls;
 extern	convar_t		*sv_validate_changelevel;
 extern	convar_t		*sv_downloadurl;
+extern	convar_t		*sv_queryrate;
+extern	convar_t		*sv_queryburst;
 extern 	convar_t		*sv_skipshield; // HACK for shield (cstrike)
 extern	convar_t		*sv_trace_messages;
 extern	convar_t		*mp_consistency;
@@ -471,6 +491,11 @@ extern	convar_t		*mp_logfile;
 extern	convar_t		*sv_fixmulticast;
 extern	convar_t		*sv_allow_split;
 extern	convar_t		*sv_allow_compress;
+extern	convar_t		*sv_allow_filelane;
+extern	convar_t		*sv_filelane_rate;
+extern	convar_t		*sv_adaptiverate;
+extern	convar_t		*sv_minupdaterate;
+extern	convar_t		*sv_entitypriority;
 extern	convar_t		*sv_maxpacket;
 extern	convar_t		*sv_forcesimulating;
 extern  convar_t		*sv_password;
@@ -576,6 +601,9 @@ void SV_EndRedirect( void );
 void SV_RemoteCommand( netadr_t from, sizebuf_t *msg );
 int SV_CalcPing( sv_client_t *cl );
 void SV_UpdateResourceList( void );
+void SV_SendDownloadServers( sv_client_t *cl );
+void SV_InvalidateQueries( void );
+void SV_QueryStats_f( void );
 //
 // sv_cmds.c
 //
@@ -44,6 +44,117 @@ static int	g_userid = 1;
 
 static void SV_UserinfoChanged( sv_client_t *cl, const char *userinfo );
 
+/*
+=================
+SV_UpdateChallengeSecret
+
+Keep previous secret, so challenges given
+right before the change are still valid
+=================
+*/
+static void SV_UpdateChallengeSecret( void )
+{
+	MD5Context_t	ctx;
+	double		seed[2];
+	int		i, rnd;
+
+	if( svs.challenge_time && host.realtime - svs.challenge_time < CHALLENGE_LIFETIME )
+		return;
+
+	Q_memcpy( svs.challenge_secret[1], svs.challenge_secret[0], sizeof( svs.challenge_secret[0] ));
+
+	MD5Init( &ctx );
+	MD5Update( &ctx, svs.challenge_secret[1], sizeof( svs.challenge_secret[1] ));
+	for( i = 0; i < 4; i++ )
+	{
+		rnd = Com_RandomLong( 0, 0x7fffffff );
+		MD5Update( &ctx, (byte *)&rnd, sizeof( rnd ));
+	}
+	seed[0] = Sys_DoubleTime();
+	seed[1] = host.realtime;
+	MD5Update( &ctx, (byte *)seed, sizeof( seed ));
+	MD5Final( svs.challenge_secret[0], &ctx );
+
+	// first secret, nothing to keep
+	if( !svs.challenge_time )
+		Q_memcpy( svs.challenge_secret[1], svs.challenge_secret[0], sizeof( svs.challenge_secret[0] ));
+
+	svs.challenge_time = host.realtime;
+}
+
+/*
+=================
+SV_MakeChallenge
+
+Keyed hash of the address, same address
+gets the same challenge while secret lives
+=================
+*/
+static int SV_MakeChallenge( netadr_t from, int secret )
+{
+	MD5Context_t	ctx;
+	byte		digest[16];
+	int		challenge;
+
+	MD5Init( &ctx );
+	MD5Update( &ctx, svs.challenge_secret[secret], sizeof( svs.challenge_secret[secret] ));
+	if( from.type == NA_IPX || from.type == NA_BROADCAST_IPX )
+		MD5Update( &ctx, from.ipx, sizeof( from.ipx ));
+	else MD5Update( &ctx, from.ip, sizeof( from.ip ));
+	MD5Update( &ctx, (byte *)&from.port, sizeof( from.port ));
+	MD5Final( digest, &ctx );
+
+	Q_memcpy( &challenge, digest, sizeof( challenge ));
+
+	// zero is what bad or missing argument gives
+	return challenge ? challenge : 1;
+}
+
+/*
+=================
+SV_MakeLaneKey
+
+Secret of the client file lane, known
+only to the server and the client
+=================
+*/
+static uint SV_MakeLaneKey( void )
+{
+	MD5Context_t	ctx;
+	byte		digest[16];
+	double		seed;
+	int		rnd;
+	uint		key;
+
+	SV_UpdateChallengeSecret();
+
+	seed = Sys_DoubleTime();
+	rnd = Com_RandomLong( 0, 0x7fffffff );
+
+	MD5Init( &ctx );
+	MD5Update( &ctx, svs.challenge_secret[0], sizeof( svs.challenge_secret[0] ));
+	MD5Update( &ctx, (byte *)&seed, sizeof( seed ));
+	MD5Update( &ctx, (byte *)&rnd, sizeof( rnd ));
+	MD5Final( digest, &ctx );
+
+	Q_memcpy( &key, digest, sizeof( key ));
+
+	return key;
+}
+
+/*
+=================
+SV_CheckChallenge
+
+=================
+*/
+static qboolean SV_CheckChallenge( netadr_t from, int challenge )
+{
+	SV_UpdateChallengeSecret();
+
+	return challenge == SV_MakeChallenge( from, 0 ) || challenge == SV_MakeChallenge( from, 1 );
+}
+
 /*
 =================
 SV_GetChallenge
@@ -57,36 +168,10 @@ challenge, they must give a valid IP address.
 */
 void SV_GetChallenge( netadr_t from )
 {
-	int	i, oldest = 0;
-	double	oldestTime;
-
-	oldestTime = 0x7fffffff;
-
-	// see if we already have a challenge for this ip
-	for( i = 0; i < MAX_CHALLENGES; i++ )
-	{
-		if( !svs.challenges[i].connected && NET_CompareAdr( from, svs.challenges[i].adr ))
-			break;
-
-		if( svs.challenges[i].time < oldestTime )
-		{
-			oldestTime = svs.challenges[i].time;
-			oldest = i;
-		}
-	}
-
-	if( i == MAX_CHALLENGES )
-	{
-		// this is the first time this client has asked for a challenge
-		svs.challenges[oldest].challenge = ((uint)rand() << 16) ^ rand();
-		svs.challenges[oldest].adr = from;
-		svs.challenges[oldest].time = host.realtime;
-		svs.challenges[oldest].connected = false;
-		i = oldest;
-	}
+	SV_UpdateChallengeSecret();
 
 	// send it back
-	Netchan_OutOfBandPrint( NS_SERVER, svs.challenges[i].adr, "challenge %i", svs.challenges[i].challenge );
+	Netchan_OutOfBandPrint( NS_SERVER, from, "challenge %i", SV_MakeChallenge( from, 0 ));
 }
 
 /*
@@ -166,24 +251,14 @@ void SV_DirectConnect( netadr_t from )
 	{
 		const char *password;
 
-		for( i = 0; i < MAX_CHALLENGES; i++ )
-		{
-			if( NET_CompareAdr( from, svs.challenges[i].adr ))
-			{
-				if( challenge == svs.challenges[i].challenge )
-					break; // valid challenge
-			}
-		}
-
-		if( i == MAX_CHALLENGES )
+		if( !SV_CheckChallenge( from, challenge ))
 		{
 			Netchan_OutOfBandPrint( NS_SERVER, from, "%s\nNo or bad challenge for address.\n", errorpacket );
 			Netchan_OutOfBandPrint( NS_SERVER, from, "disconnect\n" );
 			return;
 		}
 
-		MsgDev( D_NOTE, "Client %i connecting with challenge %x\n", i, challenge );
-		svs.challenges[i].connected = true;
+		MsgDev( D_NOTE, "Client %s connecting with challenge %x\n", NET_AdrToString( from ), challenge );
 
 		password = sv_password->string;
 
@@ -271,6 +346,9 @@ gotnewcl:
 	if( newcl->frames )
 		Mem_Free( newcl->frames );
 	newcl->frames = (client_frame_t *)Z_Malloc( sizeof( client_frame_t ) * SV_UPDATE_BACKUP );
+	if( newcl->entpriority )
+		Mem_Free( newcl->entpriority );
+	newcl->entpriority = (sv_entpriority_t *)Z_Malloc( sizeof( sv_entpriority_t ) * GI->max_edicts );
 	newcl->userid = g_userid++;	// create unique userid
 	newcl->authentication_method = 2;
 
@@ -300,20 +378,29 @@ gotnewcl:
 			newcl->netchan.splitcompress = true, extensions |= NET_EXT_SPLITHUFF;
 	}
 
+	if( sv_allow_filelane->integer && ( requested_extensions & NET_EXT_FILELANE ))
+	{
+		extensions |= NET_EXT_FILELANE;
+		newcl->netchan.filelane.enabled = true;
+		newcl->netchan.filelane.key = SV_MakeLaneKey();
+	}
+
 	BF_Init( &newcl->datagram, "Datagram", newcl->datagram_buf, sizeof( newcl->datagram_buf )); // datagram buf
 	newcl->cl_updaterate = 0.05;	// 20 fps as default
+	newcl->maxentities = MAX_VISIBLE_PACKET - 1;
 
 	// parse some info from the info strings (this can override cl_updaterate)
 	SV_UserinfoChanged( newcl, userinfo );
 
 	// send the connect packet to the client
-	Netchan_OutOfBandPrint( NS_SERVER, from, "client_connect %d\n", extensions );
+	Netchan_OutOfBandPrint( NS_SERVER, from, "client_connect %d %i\n", extensions, newcl->netchan.filelane.key );
 
 	Log_Printf( "\"%s<%i><%s><>\" connected, address \"%s\"\n", Info_ValueForKey( userinfo, "name" ),
 				newcl->userid, SV_GetClientIDString( newcl ), NET_AdrToString( newcl->netchan.remote_address ) );
 
 	newcl->state = cs_connected;
 	newcl->lastmessage = host.realtime;
+	SV_InvalidateQueries();
 	newcl->lastconnect = host.realtime;
 	newcl->delta_sequence = -1;
 	newcl->resources_sent = 1;
@@ -418,6 +505,9 @@ edict_t *GAME_EXPORT SV_FakeConnect( const char *netname )
 	if( newcl->frames )
 		Mem_Free( newcl->frames );	// fakeclients doesn't have frames
 	newcl->frames = NULL;
+	if( newcl->entpriority )
+		Mem_Free( newcl->entpriority );
+	newcl->entpriority = NULL;
 
 	ent = EDICT_NUM( edictnum );
 	newcl->edict = ent;
@@ -441,6 +531,7 @@ edict_t *GAME_EXPORT SV_FakeConnect( const char *netname )
 	ent->v.flags |= FL_FAKECLIENT;	// mark it as fakeclient
 	newcl->state = cs_spawned;
 	newcl->lastmessage = host.realtime;	// don't timeout
+	SV_InvalidateQueries();
 	newcl->lastconnect = host.realtime;
 	newcl->sendinfo = true;
 
@@ -504,10 +595,14 @@ void SV_DropClient( sv_client_t *drop )
 	drop->hltv_proxy = false;
 	drop->state = cs_zombie; // become free in a few seconds
 	drop->name[0] = 0;
+	SV_InvalidateQueries();
 
 	if( drop->frames )
 		Mem_Free( drop->frames );	// fakeclients doesn't have frames
 	drop->frames = NULL;
+	if( drop->entpriority )
+		Mem_Free( drop->entpriority );
+	drop->entpriority = NULL;
 
 	if( NET_CompareBaseAdr( drop->netchan.remote_address, host.rd.address ) )
 		SV_EndRedirect();
@@ -759,6 +854,198 @@ qboolean SV_SetCurrentClient( sv_client_t *cl )
 	return true;
 }
 
+#define QUERY_MAX_AGE	1.0	// frags and pings are changed silently
+#define QUERY_BUCKETS	4096	// must be power of two
+
+enum
+{
+	QUERY_INFO = 0,
+	QUERY_STATUS,
+	QUERY_SOURCE_INFO,
+	QUERY_NET_RULES,
+	QUERY_NET_PLAYERS,
+	QUERY_NET_DETAILS,
+	QUERY_COUNT
+};
+
+typedef struct
+{
+	int		serial;		// sv_query.serial when built
+	double		time;
+	int		length;		// 0 if never built
+	byte		data[MAX_SYSPATH+4];// whole packet or netinfo string
+} sv_queryreply_t;
+
+// shared by all addresses that hash to it
+typedef struct
+{
+	float		tokens;
+	double		time;
+} sv_querybucket_t;
+
+typedef struct
+{
+	const char	*name;
+	int		length;
+	void		(*func)( netadr_t from, const char *args );
+} sv_querycmd_t;
+
+static struct
+{
+	int		serial;
+	string		hostname;		// not a serverinfo cvar, so
+	qboolean		password;		// these two are checked directly
+	sv_queryreply_t	replies[QUERY_COUNT];
+	sv_querybucket_t	buckets[QUERY_BUCKETS];
+
+	uint		received;
+	uint		cached;
+	uint		built;
+	uint		limited;
+} sv_query;
+
+/*
+================
+SV_InvalidateQueries
+
+Players, map or serverinfo was changed
+================
+*/
+void SV_InvalidateQueries( void )
+{
+	sv_query.serial++;
+}
+
+/*
+================
+SV_CachedQuery
+
+Returns reply that still can be sent
+================
+*/
+static sv_queryreply_t *SV_CachedQuery( int type, qboolean players )
+{
+	sv_queryreply_t	*reply = &sv_query.replies[type];
+	qboolean		password;
+
+	password = sv_password->string[0] && Q_stricmp( sv_password->string, "none" );
+
+	if( password != sv_query.password || Q_strncmp( hostname->string, sv_query.hostname, sizeof( sv_query.hostname )))
+	{
+		Q_strncpy( sv_query.hostname, hostname->string, sizeof( sv_query.hostname ));
+		sv_query.password = password;
+		SV_InvalidateQueries();
+	}
+
+	if( !reply->length || reply->serial != sv_query.serial )
+		return NULL;
+
+	if( players && host.realtime - reply->time >= QUERY_MAX_AGE )
+		return NULL;
+
+	sv_query.cached++;
+
+	return reply;
+}
+
+/*
+================
+SV_StoreQuery
+
+================
+*/
+static sv_queryreply_t *SV_StoreQuery( int type, const void *data, int length )
+{
+	sv_queryreply_t	*reply = &sv_query.replies[type];
+
+	length = min( length, sizeof( reply->data ));
+	Q_memcpy( reply->data, data, length );
+	reply->length = length;
+	reply->serial = sv_query.serial;
+	reply->time = host.realtime;
+	sv_query.built++;
+
+	return reply;
+}
+
+/*
+================
+SV_StoreQueryPrint
+
+Same packet as Netchan_OutOfBandPrint makes
+================
+*/
+static sv_queryreply_t *SV_StoreQueryPrint( int type, const char *format, ... )
+{
+	byte	packet[MAX_SYSPATH+4];
+	va_list	argptr;
+
+	*(int *)packet = -1;	// out of band
+
+	va_start( argptr, format );
+	Q_vsnprintf( (char *)packet + 4, MAX_SYSPATH, format, argptr );
+	va_end( argptr );
+
+	return SV_StoreQuery( type, packet, Q_strlen( (char *)packet + 4 ) + 4 );
+}
+
+/*
+================
+SV_QueryAllowed
+
+Token bucket for each source address
+================
+*/
+static qboolean SV_QueryAllowed( netadr_t from )
+{
+	sv_querybucket_t	*bucket;
+	float		burst;
+	uint		ip;
+
+	if( sv_queryrate->value <= 0.0f || NET_IsLocalAddress( from ))
+		return true;
+
+	Q_memcpy( &ip, from.ip, sizeof( ip ));
+	bucket = &sv_query.buckets[( ip * 2654435761U ) >> 20 & ( QUERY_BUCKETS - 1 )];
+
+	burst = max( sv_queryburst->value, 1.0f );
+
+	// colliding address takes over the tokens that are left,
+	// so alternating sources can't get a fresh burst each time
+	if( bucket->time == 0.0 )
+	{
+		bucket->tokens = burst;
+	}
+	else
+	{
+		bucket->tokens += ( host.realtime - bucket->time ) * sv_queryrate->value;
+		bucket->tokens = min( bucket->tokens, burst );
+	}
+	bucket->time = host.realtime;
+
+	if( bucket->tokens < 1.0f )
+	{
+		sv_query.limited++;
+		return false;
+	}
+
+	bucket->tokens -= 1.0f;
+
+	return true;
+}
+
+/*
+================
+SV_QueryStats_f
+
+================
+*/
+void SV_QueryStats_f( void )
+{
+	Msg( "%u queries received, %u from cache, %u built, %u rate limited\n",
+		sv_query.received, sv_query.cached, sv_query.built, sv_query.limited );
+}
+
 /*
 ================
 SV_Status
@@ -768,7 +1055,12 @@ Responds with all the info that qplug or qspy can see
 */
 void SV_Status( netadr_t from )
 {
-	Netchan_OutOfBandPrint( NS_SERVER, from, "print\n%s", SV_StatusString( ));
+	sv_queryreply_t	*reply;
+
+	if(( reply = SV_CachedQuery( QUERY_STATUS, true )) == NULL )
+		reply = SV_StoreQueryPrint( QUERY_STATUS, "print\n%s", SV_StatusString( ));
+
+	NET_SendPacket( NS_SERVER, reply->length, reply->data, from );
 }
 
 /*
@@ -796,6 +1088,7 @@ void SV_Info( netadr_t from, int version )
 	int	i, count = 0;
 	char *gamedir = GI->gamefolder;
 	qboolean havePassword;
+	sv_queryreply_t	*reply;
 
 	// ignore in single player
 	if( sv_maxclients->integer == 1 || !svs.initialized )
@@ -807,6 +1100,11 @@ void SV_Info( netadr_t from, int version )
 	{
 		Q_snprintf( string, sizeof( string ), "%s: wrong version\n", hostname->string );
 	}
+	else if(( reply = SV_CachedQuery( QUERY_INFO, false )) != NULL )
+	{
+		NET_SendPacket( NS_SERVER, reply->length, reply->data, from );
+		return;
+	}
 	else
 	{
 		for( i = 0; i < sv_maxclients->integer; i++ )
@@ -826,6 +1124,10 @@ void SV_Info( netadr_t from, int version )
 
 		// a1ba: extend to password
 		Info_SetValueForKey( string, "password", havePassword ? "1" : "0", sizeof( string ));
+
+		reply = SV_StoreQueryPrint( QUERY_INFO, "info\n%s", string );
+		NET_SendPacket( NS_SERVER, reply->length, reply->data, from );
+		return;
 	}
 
 	Netchan_OutOfBandPrint( NS_SERVER, from, "info\n%s", string );
@@ -838,20 +1140,16 @@ SV_BuildNetAnswer
 Responds with long info for local and broadcast requests
 ================
 */
-void SV_BuildNetAnswer( netadr_t from )
+void SV_BuildNetAnswer( netadr_t from, int version, int context, int type )
 {
 	char	string[MAX_INFO_STRING], answer[512];
-	int	version, context, type;
 	int	i, count = 0;
+	sv_queryreply_t	*reply;
 
 	// ignore in single player
 	if( sv_maxclients->integer == 1 || !svs.initialized )
 		return;
 
-	version = Q_atoi( Cmd_Argv( 1 ));
-	context = Q_atoi( Cmd_Argv( 2 ));
-	type = Q_atoi( Cmd_Argv( 3 ));
-
 	if( version != PROTOCOL_VERSION )
 		return;
 
@@ -862,8 +1160,20 @@ void SV_BuildNetAnswer( netadr_t from )
 	}
 	else if( type == NETAPI_REQUEST_RULES )
 	{
+		if(( reply = SV_CachedQuery( QUERY_NET_RULES, false )) == NULL )
+		{
+			const char	*info = Cvar_Serverinfo( );
+			reply = SV_StoreQuery( QUERY_NET_RULES, info, Q_strlen( info ) + 1 );
+		}
+
 		// send serverinfo
-		Q_snprintf( answer, sizeof( answer ), "netinfo %i %i %s\n", context, type, Cvar_Serverinfo( ));
+		Q_snprintf( answer, sizeof( answer ), "netinfo %i %i %s\n", context, type, reply->data );
+		Netchan_OutOfBandPrint( NS_SERVER, from, answer ); // no info string
+	}
+	else if(( type == NETAPI_REQUEST_PLAYERS && ( reply = SV_CachedQuery( QUERY_NET_PLAYERS, true )) != NULL )
+		|| ( type == NETAPI_REQUEST_DETAILS && ( reply = SV_CachedQuery( QUERY_NET_DETAILS, false )) != NULL ))
+	{
+		Q_snprintf( answer, sizeof( answer ), "netinfo %i %i %s\n", context, type, reply->data );
 		Netchan_OutOfBandPrint( NS_SERVER, from, answer ); // no info string
 	}
 	else if( type == NETAPI_REQUEST_PLAYERS )
@@ -881,6 +1191,8 @@ void SV_BuildNetAnswer( netadr_t from )
 			}
 		}
 
+		SV_StoreQuery( QUERY_NET_PLAYERS, string, Q_strlen( string ) + 1 );
+
 		// send playernames
 		Q_snprintf( answer, sizeof( answer ), "netinfo %i %i %s\n", context, type, string );
 		Netchan_OutOfBandPrint( NS_SERVER, from, answer ); // no info string
@@ -904,6 +1216,7 @@ void SV_BuildNetAnswer( netadr_t from )
 
 		// a1ba: add password
 		Info_SetValueForKey( string, "password", havePassword ? "1" : "0", sizeof( string ) );
+		SV_StoreQuery( QUERY_NET_DETAILS, string, Q_strlen( string ) + 1 );
 
 		// send serverinfo
 		Q_snprintf( answer, sizeof( answer ), "netinfo %i %i %s\n", context, type, string );
@@ -1436,17 +1749,7 @@ void SV_New_f( sv_client_t *cl )
 		}
 		else
 		{
-			// transfer fastdl servers list
-			if( *sv_downloadurl->string )
-			{
-				char *data = sv_downloadurl->string;
-				char token[256];
-				while( ( data = COM_ParseFile( data, token ) ) )
-				{
-					BF_WriteByte( &cl->netchan.message, svc_stufftext );
-					BF_WriteString( &cl->netchan.message, va( "http_addcustomserver %s\n", token ));
-				}
-			}
+			SV_SendDownloadServers( cl );
 			// request resource list
 			BF_WriteByte( &cl->netchan.message, svc_stufftext );
 			BF_WriteString( &cl->netchan.message, va( "cmd getresourcelist\n" ));
@@ -1594,19 +1897,54 @@ void SV_UpdateResourceList( void )
 
 /*
 =======================
-SV_SendResourceList
+SV_IsResourceListed
 
-NOTE: Sending the list of cached resources.
-g-cont. this is fucking big message!!! i've rewriting this code
+Check if file can be downloaded by clients
 =======================
 */
-void SV_SendResourceList_f( sv_client_t *cl )
+qboolean SV_IsResourceListed( const char *path )
 {
-	int		index = 0;
-	size_t		msg_size;
-	int msg_start, msg_end;
+	int i;
+
+	if( sv.state != ss_active )
+		return false;
+
+	if( !sv.resourcelistcache )
+		SV_UpdateResourceList();
+
+	for( i = 0; i < sv.reslist.rescount; i++ )
+	{
+		const char *name = path;
+
+		if( sv.reslist.restype[i] == t_world )
+			continue;
+
+		// sounds are listed without folder
+		if( sv.reslist.restype[i] == t_sound )
+		{
+			if( Q_strnicmp( path, "sound/", 6 ))
+				continue;
+			name += 6;
+		}
+
+		if( !Q_stricmp( sv.reslist.resnames[i], name ))
+			return true;
+	}
+
+	return false;
+}
+
+/*
+=======================
+SV_SendDownloadServers
+
+Pass fastdl servers list to client
+=======================
+*/
+void SV_SendDownloadServers( sv_client_t *cl )
+{
+	const char *url = HTTP_ServerURL();
 
-	// transfer fastdl servers list
 	if( *sv_downloadurl->string )
 	{
 		char *data = sv_downloadurl->string;
@@ -1618,6 +1956,30 @@ void SV_SendResourceList_f( sv_client_t *cl )
 		}
 	}
 
+	// servers are tried in reverse order, so built-in one goes first
+	if( url )
+	{
+		BF_WriteByte( &cl->netchan.message, svc_stufftext );
+		BF_WriteString( &cl->netchan.message, va( "http_addcustomserver %s\n", url ));
+	}
+}
+
+/*
+=======================
+SV_SendResourceList
+
+NOTE: Sending the list of cached resources.
+g-cont. this is fucking big message!!! i've rewriting this code
+=======================
+*/
+void SV_SendResourceList_f( sv_client_t *cl )
+{
+	int		index = 0;
+	size_t		msg_size;
+	int msg_start, msg_end;
+
+	SV_SendDownloadServers( cl );
+
 	// generate new resource list, if it's not cached
 	if ( !sv.resourcelistcache )
 		SV_UpdateResourceList();
@@ -2214,12 +2576,17 @@ static void SV_UserinfoChanged( sv_client_t *cl, const char *userinfo )
 			break;
 		}
 	}
+	SV_InvalidateQueries(); // names are shown in server browser
 
 	// rate command
 	val = Info_ValueForKey( cl->userinfo, "rate" );
 	if( Q_strlen( val ))
-		cl->netchan.rate = bound( MIN_RATE, Q_atoi( val ), MAX_RATE );
-	else cl->netchan.rate = DEFAULT_RATE;
+		i = bound( MIN_RATE, Q_atoi( val ), MAX_RATE );
+	else i = DEFAULT_RATE;
+
+	// adaptive rate control works below this, restart it from the top on change
+	if( cl->userrate != i )
+		cl->userrate = cl->netchan.rate = i;
 
 	// msg command
 	val = Info_ValueForKey( cl->userinfo, "msg" );
@@ -2257,6 +2624,9 @@ static void SV_UserinfoChanged( sv_client_t *cl, const char *userinfo )
 		cl->cl_updaterate = 1.0f / i;
 	}
 
+	// effective interval is never shorter than requested
+	cl->updateinterval = max( cl->updateinterval, cl->cl_updaterate );
+
 	model = Info_ValueForKey( cl->userinfo, "model" );
 
 	// apply custom playermodel
@@ -3265,6 +3635,13 @@ void SV_TSourceEngineQuery( netadr_t from )
 	sizebuf_t buf;
 	int count = 0, bots = 0, index;
 	int havePassword;
+	sv_queryreply_t *reply;
+
+	if(( reply = SV_CachedQuery( QUERY_SOURCE_INFO, false )) != NULL )
+	{
+		NET_SendPacket( NS_SERVER, reply->length, reply->data, from );
+		return;
+	}
 
 	if( svs.clients )
 	{
@@ -3351,9 +3728,79 @@ void SV_TSourceEngineQuery( netadr_t from )
 	BF_WriteByte( &buf, 0 ); // unsecure
 	BF_WriteByte( &buf, bots );
 #endif
+	// players count is cached too, it's invalidated with connects
+	if( svs.clients ) SV_StoreQuery( QUERY_SOURCE_INFO, BF_GetData( &buf ), BF_GetNumBytesWritten( &buf ));
 	NET_SendPacket( NS_SERVER, BF_GetNumBytesWritten( &buf ), BF_GetData( &buf ), from );
 }
 
+/*
+=================
+SV_QueryArg
+
+Same as Q_atoi( Cmd_Argv( n )) for the next argument
+=================
+*/
+static int SV_QueryArg( const char **args )
+{
+	const char	*s = *args;
+	int		value;
+
+	while( *s && (byte)*s <= ' ' ) s++;
+	value = Q_atoi( s );
+	while( (byte)*s > ' ' ) s++;
+	*args = s;
+
+	return value;
+}
+
+static void SV_QueryPing( netadr_t from, const char *args )
+{
+	SV_Ping( from );
+}
+
+static void SV_QueryStatus( netadr_t from, const char *args )
+{
+	SV_Status( from );
+}
+
+static void SV_QueryInfo( netadr_t from, const char *args )
+{
+	SV_Info( from, SV_QueryArg( &args ));
+}
+
+static void SV_QueryNetInfo( netadr_t from, const char *args )
+{
+	int	version, context, type;
+
+	version = SV_QueryArg( &args );
+	context = SV_QueryArg( &args );
+	type = SV_QueryArg( &args );
+
+	SV_BuildNetAnswer( from, version, context, type );
+}
+
+static void SV_QuerySourceEngine( netadr_t from, const char *args )
+{
+	SV_TSourceEngineQuery( from );
+}
+
+static void SV_QueryA2APing( netadr_t from, const char *args )
+{
+	Netchan_OutOfBandPrint( NS_SERVER, from, "j" );
+}
+
+// server browser requests, handled without tokenizing
+static const sv_querycmd_t sv_querycmds[] =
+{
+{ "ping",		4, SV_QueryPing },
+{ "status",	6, SV_QueryStatus },
+{ "info",		4, SV_QueryInfo },
+{ "netinfo",	7, SV_QueryNetInfo },
+{ "TSource",	7, SV_QuerySourceEngine },
+{ "i",		1, SV_QueryA2APing },
+{ NULL,		0, NULL },
+};
+
 /*
 =================
 SV_ConnectionlessPacket
@@ -3366,33 +3813,41 @@ connectionless packets.
 */
 void SV_ConnectionlessPacket( netadr_t from, sizebuf_t *msg )
 {
+	const sv_querycmd_t	*query;
 	char	*args;
 	char	*c, buf[MAX_SYSPATH];
 	int	len = sizeof( buf );
 
-	// prevent flooding from banned address
-	if( SV_CheckIP( &from ) )
-		return;
-
 	BF_Clear( msg );
 	BF_ReadLong( msg );// skip the -1 marker
 
 	args = BF_ReadStringLine( msg );
+
+	for( query = sv_querycmds; query->name; query++ )
+	{
+		if( args[0] != query->name[0] || Q_strncmp( args, query->name, query->length ) || (byte)args[query->length] > ' ' )
+			continue;
+
+		if( host.developer >= D_NOTE )
+			MsgDev( D_NOTE, "SV_ConnectionlessPacket: %s : %s\n", NET_AdrToString( from ), query->name );
+
+		sv_query.received++;
+
+		if( SV_QueryAllowed( from ))
+			query->func( from, args + query->length );
+		return;
+	}
+
 	Cmd_TokenizeString( args );
 
 	c = Cmd_Argv( 0 );
 	MsgDev( D_NOTE, "SV_ConnectionlessPacket: %s : %s\n", NET_AdrToString( from ), c );
 
-	if( !Q_strcmp( c, "ping" )) SV_Ping( from );
-	else if( !Q_strcmp( c, "ack" )) SV_Ack( from );
-	else if( !Q_strcmp( c, "status" )) SV_Status( from );
-	else if( !Q_strcmp( c, "info" )) SV_Info( from, Q_atoi( Cmd_Argv(1) ) );
+	if( !Q_strcmp( c, "ack" )) SV_Ack( from );
 	else if( !Q_strcmp( c, "getchallenge" )) SV_GetChallenge( from );
 	else if( !Q_strcmp( c, "connect" )) SV_DirectConnect( from );
 	else if( !Q_strcmp( c, "rcon" )) SV_RemoteCommand( from, msg );
-	else if( !Q_strcmp( c, "netinfo" )) SV_BuildNetAnswer( from );
 	else if( !Q_strcmp( c, "s")) SV_AddToMaster( from, msg );
-	else if( !Q_strcmp( c, "T" "Source" ) ) SV_TSourceEngineQuery( from );
 	else if( !Q_strcmp( c, "c" ) )
 	{
 		netadr_t to;
@@ -3621,7 +4076,7 @@ void SV_ExecuteClientMessage( sv_client_t *cl, sizebuf_t *msg )
 	frame = &cl->frames[cl->netchan.incoming_acknowledged & SV_UPDATE_MASK];
 
 	// raw ping doesn't factor in message interval, either
-	frame->ping_time = host.realtime - frame->senttime - cl->cl_updaterate;
+	frame->ping_time = host.realtime - frame->senttime - cl->updateinterval;
 
 	// on first frame ( no senttime ) don't skew ping
 	if( frame->senttime == 0.0f )
@@ -1096,6 +1096,46 @@ void SV_ClientInfo_f( void )
 	Info_Print( svs.currentPlayer->userinfo );
 }
 
+/*
+===========
+SV_SnapshotInfo_f
+
+Show entities starved by snapshot budget
+===========
+*/
+void SV_SnapshotInfo_f( void )
+{
+	sv_client_t	*cl;
+	sv_entpriority_t	*ep;
+	int		i, count = 0;
+
+	if( !SV_SetPlayer( )) return;
+
+	cl = svs.currentPlayer;
+
+	if( !cl->entpriority )
+	{
+		Msg( "%s doesn't receive snapshots\n", cl->name );
+		return;
+	}
+
+	Msg( "%s: %i entities max, %i updates deferred\n", cl->name, cl->maxentities, cl->deferred );
+	Msg( "num  starved maxstarved priority classname\n" );
+	Msg( "---- ------- ---------- -------- ---------\n" );
+
+	for( i = 1; i < svgame.numEntities; i++ )
+	{
+		ep = &cl->entpriority[i];
+		if( !ep->maxstarved ) continue;
+
+		Msg( "%4i %7i %10i %8.2f %s\n", i, ep->starved, ep->maxstarved, ep->accum + ep->weight,
+			EDICT_NUM( i )->free ? "<free>" : STRING( EDICT_NUM( i )->v.classname ));
+		count++;
+	}
+
+	Msg( "%i entities were held back\n", count );
+}
+
 /*
 ===========
 SV_ClientUserAgent_f
@@ -1327,6 +1367,7 @@ void SV_InitOperatorCommands( void )
 	Cmd_AddCommand( "localinfo", SV_LocalInfo_f, "print local info settings" );
 	Cmd_AddCommand( "clientinfo", SV_ClientInfo_f, "print user infostring (player num required)" );
 	Cmd_AddCommand( "clientuseragent", SV_ClientUserAgent_f, "print user agent (player num required)" );
+	Cmd_AddCommand( "snapshot_info", SV_SnapshotInfo_f, "show entities held back by snapshot budget (player num required)" );
 	Cmd_AddCommand( "playersonly", SV_PlayersOnly_f, "freezes physics, except for players" );
 
 	Cmd_AddCommand( "map", SV_Map_f, "start new level" );
@@ -1378,6 +1419,7 @@ void SV_KillOperatorCommands( void )
 	Cmd_RemoveCommand( "status" );
 	Cmd_RemoveCommand( "serverinfo" );
 	Cmd_RemoveCommand( "clientinfo" );
+	Cmd_RemoveCommand( "snapshot_info" );
 	Cmd_RemoveCommand( "playersonly" );
 
 	Cmd_RemoveCommand( "map" );
@@ -20,18 +20,39 @@ GNU General Public License for more details.
 typedef struct ipfilter_s
 {
 	float time;
-	float endTime; // -1 for permanent ban
-	struct ipfilter_s *next;
+	float endTime; // 0 for permanent ban
+	struct ipfilter_s *next; // masks that are not prefixes
+	struct ipfilter_s *child[2]; // radix tree, branch by next bit after prefix
 	uint mask;
 	uint ip;
+	int bits; // prefix length
+	qboolean active; // false for nodes that only join branches
 } ipfilter_t;
 
 ipfilter_t *ipfilter = NULL;
+ipfilter_t *iptree = NULL;
 
+// zone allocator walks all clumps, too slow for big lists
+#define IPFILTER_BLOCK	1024
+
+typedef struct ipblock_s
+{
+	struct ipblock_s *next;
+	ipfilter_t filters[IPFILTER_BLOCK];
+} ipblock_t;
+
+ipblock_t *ipblocks = NULL;
+ipfilter_t *ipfree = NULL;
+
+#define IPBIT( ip, bit ) ((( ip ) >> ( 31 - ( bit ))) & 1 )
+#define IPMASK( bits ) (( bits ) ? 0xFFFFFFFFU << ( 32 - ( bits )) : 0 )
 
 // TODO: Is IP filter really needed?
 // TODO: Make it IPv6 compatible, for future expansion
 
+#define ID_HASH_SIZE	1024
+#define ID_HASH_KEY	8 // max chars hashed
+
 typedef struct cidfilter_s
 {
 	float endTime;
@@ -39,94 +60,308 @@ typedef struct cidfilter_s
 	string id;
 } cidfilter_t;
 
-cidfilter_t *cidfilter = NULL;
+// ids are compared as prefixes, so hash only first
+// cidkeylen chars, it's never longer than any filter
+cidfilter_t *cidfilter[ID_HASH_SIZE];
+int cidkeylen = ID_HASH_KEY;
+
+static uint SV_HashID( const char *id, int len )
+{
+	uint hash = 2166136261U;
+
+	while( len-- && *id )
+		hash = ( hash ^ (byte)*id++ ) * 16777619U;
+
+	return hash & ( ID_HASH_SIZE - 1 );
+}
+
+static void SV_LinkID( cidfilter_t *filter )
+{
+	uint hash = SV_HashID( filter->id, cidkeylen );
+
+	filter->next = cidfilter[hash];
+	cidfilter[hash] = filter;
+}
+
+static void SV_RehashIDs( int keylen )
+{
+	cidfilter_t *list = NULL, *filter, *next;
+	int i;
+
+	for( i = 0; i < ID_HASH_SIZE; i++ )
+	{
+		for( filter = cidfilter[i]; filter; filter = next )
+		{
+			next = filter->next;
+			filter->next = list;
+			list = filter;
+		}
+		cidfilter[i] = NULL;
+	}
+
+	cidkeylen = keylen;
+
+	for( filter = list; filter; filter = next )
+	{
+		next = filter->next;
+		SV_LinkID( filter );
+	}
+}
 
 void SV_RemoveID( const char *id )
 {
-	cidfilter_t *filter, *prevfilter = NULL;
+	cidfilter_t *filter, **prev;
+
+	prev = &cidfilter[SV_HashID( id, cidkeylen )];
 
-	for( filter = cidfilter; filter; filter = filter->next )
+	for( filter = *prev; filter; prev = &filter->next, filter = filter->next )
 	{
 		if( Q_strcmp( filter->id, id ) )
-		{
-			prevfilter = filter;
 			continue;
-		}
 
-		if( filter == cidfilter )
+		*prev = filter->next;
+		Mem_Free( filter );
+		return;
+	}
+}
+
+static qboolean SV_CheckIDList( cidfilter_t **list, const char *id )
+{
+	int len1 = Q_strlen( id );
+	cidfilter_t *filter, **prev = list;
+
+	while(( filter = *prev ) != NULL )
+	{
+		int len2 = Q_strlen( filter->id );
+		int len = min( len1, len2 );
+
+		if( filter->endTime && host.realtime > filter->endTime )
 		{
-			cidfilter = cidfilter->next;
+			*prev = filter->next;
 			Mem_Free( filter );
-			return;
+			continue;
 		}
 
-		if( prevfilter )
-		prevfilter->next = filter->next;
-		Mem_Free( filter );
-		return;
+		if( !Q_strncmp( id, filter->id, len ) )
+			return true;
+
+		prev = &filter->next;
 	}
+
+	return false;
 }
 
-void SV_RemoveIP( uint ip, uint mask )
+qboolean SV_CheckID( const char *id )
 {
-	ipfilter_t *filter, *prevfilter = NULL;
+	int i;
 
-	for( filter = ipfilter; filter; filter = filter->next )
+	if( Q_strlen( id ) >= cidkeylen )
+		return SV_CheckIDList( &cidfilter[SV_HashID( id, cidkeylen )], id );
+
+	// shorter than the key, may match filter in any bucket
+	for( i = 0; i < ID_HASH_SIZE; i++ )
 	{
-		if( filter->ip != ip || mask != filter->mask )
+		if( SV_CheckIDList( &cidfilter[i], id ))
+			return true;
+	}
+
+	return false;
+}
+
+static int MaskToBits( uint mask )
+{
+	int bits = 0;
+
+	while( bits < 32 && IPBIT( mask, bits ))
+		bits++;
+
+	// not a prefix
+	if( mask != IPMASK( bits ))
+		return -1;
+
+	return bits;
+}
+
+static ipfilter_t *SV_NewIPFilter( void )
+{
+	ipfilter_t *filter;
+	int i;
+
+	if( !ipfree )
+	{
+		ipblock_t *block = Mem_Alloc( host.mempool, sizeof( ipblock_t ) );
+
+		block->next = ipblocks;
+		ipblocks = block;
+
+		for( i = IPFILTER_BLOCK - 1; i >= 0; i-- )
 		{
-			prevfilter = filter;
+			block->filters[i].next = ipfree;
+			ipfree = &block->filters[i];
+		}
+	}
+
+	filter = ipfree;
+	ipfree = filter->next;
+	Q_memset( filter, 0, sizeof( *filter ));
+
+	return filter;
+}
+
+static void SV_FreeIPFilter( ipfilter_t *filter )
+{
+	filter->next = ipfree;
+	ipfree = filter;
+}
+
+static ipfilter_t *SV_AllocIPFilter( uint ip, int bits )
+{
+	ipfilter_t *filter = SV_NewIPFilter();
+
+	filter->bits = bits;
+	filter->mask = IPMASK( bits );
+	filter->ip = ip & filter->mask;
+
+	return filter;
+}
+
+static ipfilter_t *SV_InsertIP( uint ip, uint mask )
+{
+	ipfilter_t **link = &iptree;
+	ipfilter_t *node, *filter, *glue;
+	int bits = MaskToBits( mask );
+	int common;
+
+	if( bits < 0 )
+	{
+		filter = SV_NewIPFilter();
+		filter->next = ipfilter;
+		ipfilter = filter;
+		filter->mask = mask;
+		filter->ip = ip;
+		filter->active = true;
+		return filter;
+	}
+
+	ip &= IPMASK( bits );
+
+	while(( node = *link ) != NULL )
+	{
+		// count same leading bits
+		for( common = 0; common < min( bits, node->bits ); common++ )
+		{
+			if( IPBIT( ip, common ) != IPBIT( node->ip, common ))
+				break;
+		}
+
+		if( common == node->bits )
+		{
+			if( bits == node->bits )
+			{
+				node->active = true;
+				return node;
+			}
+
+			link = &node->child[IPBIT( ip, node->bits )];
 			continue;
 		}
 
-		if( filter == ipfilter )
+		filter = SV_AllocIPFilter( ip, bits );
+		filter->active = true;
+
+		if( common == bits )
 		{
-			ipfilter = ipfilter->next;
-			Mem_Free( filter );
-			return;
+			// new filter covers this branch
+			filter->child[IPBIT( node->ip, bits )] = node;
+			*link = filter;
+			return filter;
 		}
 
-		if( prevfilter )
-			prevfilter->next = filter->next;
-		Mem_Free( filter );
-		return;
+		// split at first different bit
+		glue = SV_AllocIPFilter( ip, common );
+		glue->child[IPBIT( ip, common )] = filter;
+		glue->child[IPBIT( node->ip, common )] = node;
+		*link = glue;
+		return filter;
 	}
+
+	filter = SV_AllocIPFilter( ip, bits );
+	filter->active = true;
+	*link = filter;
+
+	return filter;
 }
 
-qboolean SV_CheckID( const char *id )
+void SV_RemoveIP( uint ip, uint mask )
 {
-	qboolean ret = false;
-	cidfilter_t *filter;
+	ipfilter_t *filter, **prev;
+	int bits = MaskToBits( mask );
 
-	for( filter = cidfilter; filter; filter = filter->next )
+	if( bits < 0 )
 	{
-		int len1 = Q_strlen( id ), len2 = Q_strlen( filter->id );
-		int len = min( len1, len2 );
+		for( prev = &ipfilter, filter = ipfilter; filter; prev = &filter->next, filter = filter->next )
+		{
+			if( filter->ip != ip || mask != filter->mask )
+				continue;
 
-		while( filter->endTime && host.realtime > filter->endTime )
+			*prev = filter->next;
+			SV_FreeIPFilter( filter );
+			return;
+		}
+		return;
+	}
+
+	ip &= mask;
+	prev = &iptree;
+
+	while(( filter = *prev ) != NULL )
+	{
+		if( filter->bits > bits || (( ip ^ filter->ip ) & filter->mask ))
+			return;
+
+		if( filter->bits < bits )
 		{
-			char *fid = filter->id;
-			filter = filter->next;
-			SV_RemoveID( fid );
-			if( !filter )
-				return false;
+			prev = &filter->child[IPBIT( ip, filter->bits )];
+			continue;
 		}
 
-		if( !Q_strncmp( id, filter->id, len ) )
+		if( filter->child[0] && filter->child[1] )
 		{
-			ret = true;
-			break;
+			// still joins two branches
+			filter->active = false;
+			filter->endTime = 0;
+			return;
 		}
-	}
 
-	return ret;
+		*prev = filter->child[0] ? filter->child[0] : filter->child[1];
+		SV_FreeIPFilter( filter );
+		return;
+	}
 }
 
 qboolean SV_CheckIP( netadr_t *addr )
 {
 	uint ip = addr->ip[0] << 24 | addr->ip[1] << 16 | addr->ip[2] << 8 | addr->ip[3];
-	qboolean ret = false;
-	ipfilter_t *filter;
+	ipfilter_t *filter, *expired = NULL;
+
+	for( filter = iptree; filter; filter = filter->child[IPBIT( ip, filter->bits )] )
+	{
+		if(( ip ^ filter->ip ) & filter->mask )
+			break;
+
+		if( filter->active )
+		{
+			if( !filter->endTime || host.realtime <= filter->endTime )
+				return true;
+			expired = filter;
+		}
+
+		if( filter->bits == 32 )
+			break;
+	}
+
+	if( expired )
+		SV_RemoveIP( expired->ip, expired->mask );
 
 	for( filter = ipfilter; filter; filter = filter->next )
 	{
@@ -134,20 +369,17 @@ qboolean SV_CheckIP( netadr_t *addr )
 		{
 			uint rip = filter->ip;
 			uint rmask = filter->mask;
-			SV_RemoveIP( rip, rmask );
 			filter = filter->next;
+			SV_RemoveIP( rip, rmask );
 			if( !filter )
 				return false;
 		}
 
 		if( (ip & filter->mask) == (filter->ip & filter->mask) )
-		{
-			ret = true;
-			break;
-		}
+			return true;
 	}
 
-	return ret;
+	return false;
 }
 
 void SV_BanID_f( void )
@@ -214,9 +446,11 @@ void SV_BanID_f( void )
 
 	filter = Mem_Alloc( host.mempool, sizeof( cidfilter_t ) );
 	filter->endTime = time;
-	filter->next = cidfilter;
 	Q_strncpy( filter->id, id, sizeof( filter->id ) );
-	cidfilter = filter;
+
+	if( Q_strlen( filter->id ) < cidkeylen )
+		SV_RehashIDs( Q_strlen( filter->id ));
+	SV_LinkID( filter );
 
 	if( cl && !Q_stricmp( Cmd_Argv( Cmd_Argc() - 1 ), "kick" ) )
 		Cbuf_AddText( va( "kick #%d \"Kicked and banned\"\n", cl->userid ) );
@@ -225,11 +459,13 @@ void SV_BanID_f( void )
 void SV_ListID_f( void )
 {
 	cidfilter_t *filter;
+	int i;
 
 	Msg( "id ban list\n" );
 	Msg( "-----------\n" );
 
-	for( filter = cidfilter; filter; filter = filter->next )
+	for( i = 0; i < ID_HASH_SIZE; i++ )
+	for( filter = cidfilter[i]; filter; filter = filter->next )
 	{
 		if( filter->endTime && host.realtime > filter->endTime )
 			continue; // no negative time
@@ -266,6 +502,7 @@ void SV_WriteID_f( void )
 {
 	file_t *f = FS_Open( Cvar_VariableString( "bannedcfgfile" ), "w", false );
 	cidfilter_t *filter;
+	int i;
 
 	if( !f )
 	{
@@ -278,9 +515,10 @@ void SV_WriteID_f( void )
 	FS_Printf( f, "//\t\t    %s - archive of id blacklist\n", Cvar_VariableString( "bannedcfgfile" ) );
 	FS_Printf( f, "//=======================================================================\n" );
 
-	for( filter = cidfilter; filter; filter = filter->next )
-		if( !filter->endTime ) // only permanent
-			FS_Printf( f, "banid 0 %s\n", filter->id );
+	for( i = 0; i < ID_HASH_SIZE; i++ )
+		for( filter = cidfilter[i]; filter; filter = filter->next )
+			if( !filter->endTime ) // only permanent
+				FS_Printf( f, "banid 0 %s\n", filter->id );
 
 	FS_Close( f );
 }
@@ -308,6 +546,15 @@ static qboolean StringToIP( const char *str, const char *maskstr, uint *outip, u
 		str++;
 	} while( i < 4 );
 
+	// a.b.c.d/bits
+	if( *str == '/' && ( !maskstr || !*maskstr ))
+	{
+		uint bits = bound( 0, Q_atoi( str + 1 ), 32 );
+		uint m = IPMASK( bits );
+
+		mask[0] = m >> 24, mask[1] = m >> 16, mask[2] = m >> 8, mask[3] = m;
+	}
+
 	i = 0;
 
 	if( !maskstr ||  *maskstr > '9' || *maskstr < '0' )
@@ -336,13 +583,22 @@ end:
 	return true;
 }
 #define IPARGS(ip) (ip >> 24) & 0xFF, (ip >> 16) & 0xFF, (ip >> 8) & 0xFF, ip & 0xFF
+static void SV_AddIP( uint ip, uint mask, float time )
+{
+	ipfilter_t *filter;
+
+	SV_RemoveIP( ip, mask );
+
+	filter = SV_InsertIP( ip, mask );
+	filter->endTime = time;
+}
+
 void SV_AddIP_f( void )
 {
 	float time = Q_atof( Cmd_Argv( 1 ) );
 	char *ipstr = Cmd_Argv( 2 );
 	char *maskstr = Cmd_Argv( 3 );
 	uint ip, mask;
-	ipfilter_t *filter;
 
 	if( time )
 		time = host.realtime + time * 60.0f;
@@ -353,15 +609,101 @@ void SV_AddIP_f( void )
 		return;
 	}
 
-	SV_RemoveIP( ip, mask );
+	SV_AddIP( ip, mask, time );
+}
 
-	filter = Mem_Alloc( host.mempool, sizeof( ipfilter_t ) );
-	filter->endTime = time;
-	filter->ip = ip;
-	filter->mask = mask;
-	filter->next = ipfilter;
+/*
+loadip [file]
 
-	ipfilter = filter;
+Same lines as writeip makes, or just "ip [mask]" and "ip/bits".
+Doesn't go through command buffer, so big lists can be loaded
+*/
+void SV_LoadIP_f( void )
+{
+	const char *filename = Cmd_Argc() > 1 ? Cmd_Argv( 1 ) : Cvar_VariableString( "listipcfgfile" );
+	char line[MAX_SYSPATH], ipstr[MAX_SYSPATH], maskstr[MAX_SYSPATH];
+	char *afile, *pfile, *end, *pline;
+	int count = 0, len;
+	float time;
+	uint ip, mask;
+
+	pfile = afile = (char *)FS_LoadFile( filename, NULL, false );
+
+	if( !afile )
+	{
+		MsgDev( D_ERROR, "Could not load %s\n", filename );
+		return;
+	}
+
+	for( ; *pfile; pfile = *end ? end + 1 : end )
+	{
+		end = pfile;
+		while( *end && *end != '\n' )
+			end++;
+
+		len = min( end - pfile, sizeof( line ) - 1 );
+		Q_memcpy( line, pfile, len );
+		line[len] = '\0';
+		time = 0.0f;
+
+		if(( pline = COM_ParseFile( line, ipstr )) == NULL )
+			continue; // empty or comment
+
+		if( !Q_strcmp( ipstr, "addip" ))
+		{
+			if(( pline = COM_ParseFile( pline, ipstr )) == NULL )
+				continue;
+
+			if(( time = Q_atof( ipstr )) != 0.0f )
+				time = host.realtime + time * 60.0f;
+
+			if(( pline = COM_ParseFile( pline, ipstr )) == NULL )
+				continue;
+		}
+
+		if( !COM_ParseFile( pline, maskstr ))
+			maskstr[0] = '\0';
+
+		if( !StringToIP( ipstr, maskstr, &ip, &mask ))
+			continue;
+
+		SV_AddIP( ip, mask, time );
+		count++;
+	}
+
+	Mem_Free( afile );
+
+	Msg( "%i IP filters loaded from %s\n", count, filename );
+}
+
+static void SV_PrintIP( ipfilter_t *filter, file_t *f )
+{
+	if( f )
+	{
+		if( !filter->endTime ) // only permanent
+			FS_Printf( f, "addip 0 %d.%d.%d.%d %d.%d.%d.%d\n", IPARGS(filter->ip), IPARGS(filter->mask) );
+		return;
+	}
+
+	if( filter->endTime && host.realtime > filter->endTime )
+		return; // no negative time
+
+	if( filter->endTime )
+		Msg( "%d.%d.%d.%d %d.%d.%d.%d expries in %f minutes\n", IPARGS( filter->ip ), IPARGS( filter->mask ), ( filter->endTime - host.realtime ) / 60.0f );
+	else
+		Msg( "%d.%d.%d.%d %d.%d.%d.%d permanent\n", IPARGS( filter->ip ), IPARGS( filter->mask ) );
+}
+
+static void SV_PrintIPTree( ipfilter_t *filter, file_t *f )
+{
+	if( !filter )
+		return;
+
+	if( filter->active )
+		SV_PrintIP( filter, f );
+
+	SV_PrintIPTree( filter->child[0], f );
+	SV_PrintIPTree( filter->child[1], f );
 }
 
 void SV_ListIP_f( void )
@@ -371,16 +713,10 @@ void SV_ListIP_f( void )
 	Msg( "ip ban list\n" );
 	Msg( "-----------\n" );
 
-	for( filter = ipfilter; filter; filter = filter->next )
-	{
-		if( filter->endTime && host.realtime > filter->endTime )
-			continue; // no negative time
+	SV_PrintIPTree( iptree, NULL );
 
-		if( filter->endTime )
-			Msg( "%d.%d.%d.%d %d.%d.%d.%d expries in %f minutes\n", IPARGS( filter->ip ), IPARGS( filter->mask ), ( filter->endTime - host.realtime ) / 60.0f );
-		else
-			Msg( "%d.%d.%d.%d %d.%d.%d.%d permanent\n", IPARGS( filter->ip ), IPARGS( filter->mask ) );
-	}
+	for( filter = ipfilter; filter; filter = filter->next )
+		SV_PrintIP( filter, NULL );
 }
 void SV_RemoveIP_f( void )
 {
@@ -411,9 +747,10 @@ void SV_WriteIP_f( void )
 	FS_Printf( f, "//\t\t    %s - archive of IP blacklist\n", Cvar_VariableString( "listipcfgfile" ) );
 	FS_Printf( f, "//=======================================================================\n" );
 
+	SV_PrintIPTree( iptree, f );
+
 	for( filter = ipfilter; filter; filter = filter->next )
-		if( !filter->endTime ) // only permanent
-			FS_Printf( f, "addip 0 %d.%d.%d.%d %d.%d.%d.%d\n", IPARGS(filter->ip), IPARGS(filter->mask) );
+		SV_PrintIP( filter, f );
 
 	FS_Close( f );
 }
@@ -428,29 +765,38 @@ void SV_InitFilter( void )
 	Cmd_AddCommand( "listip", SV_ListIP_f, "list current IP filter" );
 	Cmd_AddCommand( "removeip", SV_RemoveIP_f, "remove IP filter" );
 	Cmd_AddCommand( "writeip", SV_WriteIP_f, "write listip.cfg" );
+	Cmd_AddCommand( "loadip", SV_LoadIP_f, "load IP filters from listip.cfg or given file" );
 }
 
 void SV_ShutdownFilter( void )
 {
-	ipfilter_t *ipList, *ipNext;
+	ipblock_t *ipList, *ipNext;
 	cidfilter_t *cidList, *cidNext;
+	int i;
 
 	// should be called manually because banned.cfg is not executed by engine
 	//SV_WriteIP_f();
 	//SV_WriteID_f();
 
-	for( ipList = ipfilter; ipList; ipList = ipNext )
+	for( ipList = ipblocks; ipList; ipList = ipNext )
 	{
 		ipNext = ipList->next;
 		Mem_Free( ipList );
 	}
 
-	for( cidList = cidfilter; cidList; cidList = cidNext )
+	for( i = 0; i < ID_HASH_SIZE; i++ )
 	{
-		cidNext = cidList->next;
-		Mem_Free( cidList );
+		for( cidList = cidfilter[i]; cidList; cidList = cidNext )
+		{
+			cidNext = cidList->next;
+			Mem_Free( cidList );
+		}
+		cidfilter[i] = NULL;
 	}
 
-	cidfilter = NULL;
+	cidkeylen = ID_HASH_KEY;
 	ipfilter = NULL;
+	iptree = NULL;
+	ipblocks = NULL;
+	ipfree = NULL;
 }
@@ -22,8 +22,13 @@ typedef struct
 {
 	int		num_entities;
 	entity_state_t	entities[MAX_VISIBLE_PACKET];	
+	float		priority[MAX_VISIBLE_PACKET];	// when the list is full lowest is left out
 } sv_ents_t;
 
+#define PRIORITY_ALWAYS	1000000.0f	// players, view entity and attachments are never held back
+#define PRIORITY_FALLOFF	512.0f		// distance where entity weight halves
+#define PRIORITY_RESERVE	64		// bytes left for events and pings after entities
+
 static byte *clientpvs;	// FatPVS
 static byte *clientphs;	// FatPHS
 
@@ -49,6 +54,69 @@ static int SV_EntityNumbers( const void *a, const void *b )
 	return 1;
 }
 
+/*
+=============
+SV_EntityWeight
+
+how much the client cares about updates of this entity:
+importance by entity kind, falling off with distance from eyes
+=============
+*/
+static float SV_EntityWeight( edict_t *ent, edict_t *pClient, sv_client_t *cl, qboolean player )
+{
+	vec3_t	vieworg, center, delta;
+	float	importance = 1.0f;
+
+	// players, the view entity and anything attached to the client are never held back
+	if( player || ent == cl->pViewEntity || ent->v.aiment == pClient )
+		return PRIORITY_ALWAYS;
+
+	// monsters and movers the player may stand on matter more than decorations
+	if( ent->v.flags & FL_MONSTER )
+		importance = 3.0f;
+	else if( ent->v.movetype == MOVETYPE_PUSH || ent->v.movetype == MOVETYPE_PUSHSTEP )
+		importance = 2.0f;
+
+	VectorAdd( pClient->v.origin, pClient->v.view_ofs, vieworg );
+	VectorAverage( ent->v.absmin, ent->v.absmax, center );
+	VectorSubtract( center, vieworg, delta );
+
+	return importance * PRIORITY_FALLOFF / ( PRIORITY_FALLOFF + VectorLength( delta ));
+}
+
+/*
+=============
+SV_DeferEntity
+
+entity update was held back, it gets more
+priority for every snapshot it has to wait
+=============
+*/
+static void SV_DeferEntity( sv_client_t *cl, int num )
+{
+	sv_entpriority_t	*ep = &cl->entpriority[num];
+
+	ep->accum += ep->weight;
+	ep->starved++;
+	ep->maxstarved = max( ep->maxstarved, ep->starved );
+	cl->deferred++;
+}
+
+/*
+=============
+SV_EntitySent
+
+client is up to date with the entity
+=============
+*/
+static void SV_EntitySent( sv_client_t *cl, int num )
+{
+	sv_entpriority_t	*ep = &cl->entpriority[num];
+
+	ep->accum = 0.0f;
+	ep->starved = 0;
+}
+
 /*
 =============
 SV_AddEntitiesToPacket
@@ -63,7 +131,9 @@ static void SV_AddEntitiesToPacket( edict_t *pViewEnt, edict_t *pClient, client_
 	sv_client_t	*netclient;
 	sv_client_t	*cl = NULL;
 	entity_state_t	*state;
-	int		e, player;
+	int		e, i, player;
+	int		limit, lowest;
+	sv_entpriority_t	*ep;
 
 	// during an error shutdown message we may need to transmit
 	// the shutdown message after the server has shutdown, so
@@ -94,6 +164,9 @@ static void SV_AddEntitiesToPacket( edict_t *pViewEnt, edict_t *pClient, client_
 		cl->num_cameras = 0;
 	}
 
+	// adaptive rate control may shrink the snapshot below the protocol limit
+	limit = bound( 1, cl->maxentities, MAX_VISIBLE_PACKET - 1 );
+
 	svgame.dllFuncs.pfnSetupVisibility( pViewEnt, pClient, &clientpvs, &clientphs );
 	if( !clientpvs ) fullvis = true;
 
@@ -133,18 +206,39 @@ static void SV_AddEntitiesToPacket( edict_t *pViewEnt, edict_t *pClient, client_
 				}
 			}
 
-			// if we are full, silently discard entities
-			if( ents->num_entities < MAX_VISIBLE_PACKET - 1 )
+			ep = &cl->entpriority[e];
+			ep->weight = SV_EntityWeight( ent, pClient, cl, player );
+
+			// entity left the list or its edict was reused, start over
+			if( ep->snapshot != cl->snapshotnum - 1 )
+			{
+				ep->accum = 0.0f;
+				ep->starved = 0;
+			}
+			ep->snapshot = cl->snapshotnum;
+
+			if( ents->num_entities < limit )
 			{
+				ents->priority[ents->num_entities] = ep->accum + ep->weight;
 				ents->num_entities++;	// entity accepted
 				c_fullsend++;		// debug counter
-				
 			}
 			else
 			{
-				// visibility list is full
-				MsgDev( D_ERROR, "too many entities in visible packet list\n" );
-				break;
+				// list is full, the least important entity waits for a later snapshot
+				for( i = lowest = 0; i < ents->num_entities; i++ )
+				{
+					if( ents->priority[i] < ents->priority[lowest] )
+						lowest = i;
+				}
+
+				if( ep->accum + ep->weight > ents->priority[lowest] )
+				{
+					SV_DeferEntity( cl, ents->entities[lowest].number );
+					ents->entities[lowest] = *state;
+					ents->priority[lowest] = ep->accum + ep->weight;
+				}
+				else SV_DeferEntity( cl, e );
 			}
 		}
 
@@ -167,50 +261,165 @@ Encode a client frame onto the network channel
 
 =============================================================================
 */
+static float	sv_schedulekeys[MAX_VISIBLE_PACKET];
+
+/*
+=======================
+SV_EntityPriorities
+=======================
+*/
+static int SV_EntityPriorities( const void *a, const void *b )
+{
+	float	key1, key2;
+
+	key1 = sv_schedulekeys[*(int *)a];
+	key2 = sv_schedulekeys[*(int *)b];
+
+	if( key1 > key2 )
+		return -1;
+	return ( key1 < key2 );
+}
+
 /*
 =============
-SV_EmitPacketEntities
+SV_ScheduleEntities
 
-Writes a delta update of an entity_state_t list to the message->
+when entity deltas don't fit into the client packet, send the
+ones with highest accumulated priority and carry the rest
+forward with the state client already has, so they go out in
+a later snapshot instead of being cut off in index order
 =============
 */
-void SV_EmitPacketEntities( sv_client_t *cl, client_frame_t *to, sizebuf_t *msg )
+static void SV_ScheduleEntities( sv_client_t *cl, client_frame_t *from, int from_num_entities, client_frame_t *to, int budget )
 {
+	static byte	trial_buf[NET_MAX_PAYLOAD];
+	static entity_state_t	*base[MAX_VISIBLE_PACKET];
+	static int	cost[MAX_VISIBLE_PACKET];
+	static int	order[MAX_VISIBLE_PACKET];
 	entity_state_t	*oldent, *newent;
 	int		oldindex, newindex;
 	int		oldnum, newnum;
-	int		from_num_entities;
-	client_frame_t	*from;
+	int		i, count, total, startbit;
+	qboolean		fits;
+	sv_entpriority_t	*ep;
+	sizebuf_t		trial;
 
-	// this is the frame that we are going to delta update from
-	if( cl->delta_sequence != -1 )
+	BF_Init( &trial, "Trial", trial_buf, sizeof( trial_buf ));
+	budget *= 8;
+	total = 0;
+
+	// same walk as SV_WritePacketEntities, only measure every delta
+	for( newindex = oldindex = 0; newindex < to->num_entities || oldindex < from_num_entities; )
 	{
-		from = &cl->frames[cl->delta_sequence & SV_UPDATE_MASK];
-		from_num_entities = from->num_entities;
+		newent = &svs.packet_entities[(to->first_entity+newindex)%svs.num_client_entities];
+		oldent = &svs.packet_entities[(from ? from->first_entity+oldindex : 0)%svs.num_client_entities];
+		newnum = ( newindex < to->num_entities ) ? newent->number : MAX_ENTNUMBER;
+		oldnum = ( oldindex < from_num_entities ) ? oldent->number : MAX_ENTNUMBER;
+		startbit = BF_GetNumBitsWritten( &trial );
 
-		// the snapshot's entities may still have rolled off the buffer, though
-		if( from->first_entity <= svs.next_client_entities - svs.num_client_entities )
+		if( newnum > oldnum )
 		{
-			MsgDev( D_WARN, "%s: delta request from out of date entities.\n", cl->name );
-
-			from = NULL;
-			from_num_entities = 0;
+			// removes are small and always sent
+			MSG_WriteDeltaEntity( oldent, NULL, &trial, false, false, sv.time );
+			budget -= BF_GetNumBitsWritten( &trial ) - startbit;
+			oldindex++;
+			continue;
+		}
 
-			BF_WriteByte( msg, svc_packetentities );
-			BF_WriteWord( msg, to->num_entities );
+		if( newnum == oldnum )
+		{
+			MSG_WriteDeltaEntity( oldent, newent, &trial, false, SV_IsPlayerIndex( newnum ), sv.time );
+			base[newindex] = oldent;
+			oldindex++;
 		}
 		else
 		{
-			BF_WriteByte( msg, svc_deltapacketentities );
-			BF_WriteWord( msg, to->num_entities );
-			BF_WriteByte( msg, cl->delta_sequence );
+			MSG_WriteDeltaEntity( &svs.baselines[newnum], newent, &trial, true, SV_IsPlayerIndex( newnum ), sv.time );
+			base[newindex] = NULL;
 		}
+
+		cost[newindex] = BF_GetNumBitsWritten( &trial ) - startbit;
+		total += cost[newindex];
+		newindex++;
 	}
-	else
+
+	fits = ( total <= budget );
+
+	// collect what can wait, unchanged entities cost nothing
+	for( i = count = 0; i < to->num_entities; i++ )
+	{
+		newent = &svs.packet_entities[(to->first_entity+i)%svs.num_client_entities];
+		ep = &cl->entpriority[newent->number];
+
+		if( fits || !cost[i] || ep->weight >= PRIORITY_ALWAYS )
+		{
+			SV_EntitySent( cl, newent->number );
+			budget -= cost[i];
+			continue;
+		}
+
+		sv_schedulekeys[i] = ep->accum + ep->weight;
+		order[count++] = i;
+	}
+
+	if( !count ) return; // everything fits
+
+	qsort( order, count, sizeof( order[0] ), SV_EntityPriorities );
+
+	for( i = 0; i < count; i++ )
+	{
+		newent = &svs.packet_entities[(to->first_entity+order[i])%svs.num_client_entities];
+
+		// top one always goes, so nothing waits forever behind a huge delta
+		if( cost[order[i]] <= budget || i == 0 )
+		{
+			SV_EntitySent( cl, newent->number );
+			budget -= cost[order[i]];
+			continue;
+		}
+
+		SV_DeferEntity( cl, newent->number );
+
+		// client keeps the state it has, new entities stay out of this frame
+		if( base[order[i]] ) *newent = *base[order[i]];
+		else newent->number = -1;
+	}
+
+	// squeeze out left out entities, list order doesn't change
+	for( i = count = 0; i < to->num_entities; i++ )
 	{
-		from = NULL;
-		from_num_entities = 0;
+		newent = &svs.packet_entities[(to->first_entity+i)%svs.num_client_entities];
+		if( newent->number < 0 ) continue;
+
+		if( i != count )
+			svs.packet_entities[(to->first_entity+count)%svs.num_client_entities] = *newent;
+		count++;
+	}
+
+	to->num_entities = count;
+}
+
+/*
+=============
+SV_WritePacketEntities
 
+Writes a delta update of an entity_state_t list to the message->
+=============
+*/
+static void SV_WritePacketEntities( sv_client_t *cl, client_frame_t *from, int from_num_entities, client_frame_t *to, sizebuf_t *msg )
+{
+	entity_state_t	*oldent, *newent;
+	int		oldindex, newindex;
+	int		oldnum, newnum;
+
+	if( from )
+	{
+		BF_WriteByte( msg, svc_deltapacketentities );
+		BF_WriteWord( msg, to->num_entities );
+		BF_WriteByte( msg, cl->delta_sequence );
+	}
+	else
+	{
 		BF_WriteByte( msg, svc_packetentities );
 		BF_WriteWord( msg, to->num_entities );
 	}
@@ -279,6 +488,70 @@ void SV_EmitPacketEntities( sv_client_t *cl, client_frame_t *to, sizebuf_t *msg
 	BF_WriteWord( msg, 0 ); // end of packetentities
 }
 
+/*
+=============
+SV_EmitPacketEntities
+
+deltas are written once, entities are scheduled
+and written again only if they don't fit
+=============
+*/
+void SV_EmitPacketEntities( sv_client_t *cl, client_frame_t *to, sizebuf_t *msg )
+{
+	int		from_num_entities;
+	client_frame_t	*from = NULL;
+	int		i, budget, startbit;
+	entity_state_t	*state;
+
+	from_num_entities = 0;
+
+	// this is the frame that we are going to delta update from
+	if( cl->delta_sequence != -1 )
+	{
+		from = &cl->frames[cl->delta_sequence & SV_UPDATE_MASK];
+		from_num_entities = from->num_entities;
+
+		// the snapshot's entities may still have rolled off the buffer, though
+		if( from->first_entity <= svs.next_client_entities - svs.num_client_entities )
+		{
+			MsgDev( D_WARN, "%s: delta request from out of date entities.\n", cl->name );
+
+			from = NULL;
+			from_num_entities = 0;
+		}
+	}
+
+	if( !sv_entitypriority->integer || NET_IsLocalAddress( cl->netchan.remote_address ) || BF_CheckOverflow( msg ))
+	{
+		SV_WritePacketEntities( cl, from, from_num_entities, to, msg );
+		return;
+	}
+
+	// leave room for the multicast datagram appended after the snapshot
+	budget = cl->maxpayload - BF_GetNumBytesWritten( msg ) - BF_GetNumBytesWritten( &cl->datagram ) - PRIORITY_RESERVE;
+	startbit = BF_GetNumBitsWritten( msg );
+
+	SV_WritePacketEntities( cl, from, from_num_entities, to, msg );
+
+	// deltas don't fit, write them again with scheduled list
+	if( BF_CheckOverflow( msg ) || BF_GetNumBitsWritten( msg ) - startbit > budget * 8 )
+	{
+		BF_SeekToBit( msg, startbit );
+		msg->bOverflow = false; // rewound before the overflow
+
+		SV_ScheduleEntities( cl, from, from_num_entities, to, budget );
+		SV_WritePacketEntities( cl, from, from_num_entities, to, msg );
+		return;
+	}
+
+	// client is up to date with everything
+	for( i = 0; i < to->num_entities; i++ )
+	{
+		state = &svs.packet_entities[(to->first_entity+i)%svs.num_client_entities];
+		SV_EntitySent( cl, state->number );
+	}
+}
+
 /*
 =============
 SV_EmitEvents
@@ -556,6 +829,7 @@ void SV_WriteEntitiesToClient( sv_client_t *cl, sizebuf_t *msg )
 	send_pings = SV_ShouldUpdatePing( cl );
 
 	sv.net_framenum++;	// now all portal-through entities are invalidate
+	cl->snapshotnum++;
 	sv.hostflags &= ~SVF_PORTALPASS;
 
 	// clear everything in this snapshot
@@ -611,6 +885,83 @@ FRAME UPDATES
 
 ===============================================================================
 */
+#define RATE_CHECK_INTERVAL	0.5	// how often adaptive rate control runs
+#define RATE_MINPING_WINDOW	10.0	// how long lowest ping is trusted as the base round trip
+#define RATE_MAX_LOSS	5	// percent of lost updates treated as congestion
+#define RATE_MAX_QUEUEING	100.0f	// ms above base round trip treated as congestion
+#define RATE_MIN_ENTITIES	64	// never shrink the snapshot entity budget below this
+
+/*
+=======================
+SV_UpdateClientRate
+
+adjust the client's effective rate and update interval to
+measured loss, queueing delay and choke. Rate backs off
+multiplicatively under congestion and grows back additively
+up to the rate requested in userinfo. Update interval is
+stretched so the average snapshot fits into the rate instead
+of choking, and when it doesn't fit even at sv_minupdaterate
+the snapshot carries fewer entities.
+=======================
+*/
+static void SV_UpdateClientRate( sv_client_t *cl )
+{
+	double	interval, maxinterval;
+	float	loss, queueing, rate;
+	qboolean	congested;
+
+	if( !sv_adaptiverate->integer || NET_IsLocalAddress( cl->netchan.remote_address ))
+	{
+		cl->netchan.rate = cl->userrate;
+		cl->updateinterval = cl->cl_updaterate;
+		cl->maxentities = MAX_VISIBLE_PACKET - 1;
+		return;
+	}
+
+	if( host.realtime < cl->next_ratecheck )
+		return;
+
+	cl->next_ratecheck = host.realtime + RATE_CHECK_INTERVAL;
+
+	// client reports loss on its side, acks tell us about the rest
+	loss = max( SV_CalcPacketLoss( cl ), cl->packet_loss );
+
+	// lowest recent ping is the base round trip, anything above it is queued somewhere
+	if( cl->ping > 0.0f && ( cl->minping <= 0.0f || cl->ping < cl->minping || host.realtime > cl->minping_expire ))
+	{
+		cl->minping = cl->ping;
+		cl->minping_expire = host.realtime + RATE_MINPING_WINDOW;
+	}
+
+	queueing = cl->ping - cl->minping;
+	congested = ( loss > RATE_MAX_LOSS || queueing > max( RATE_MAX_QUEUEING, cl->minping ));
+
+	rate = cl->netchan.rate;
+
+	if( congested ) rate *= 0.75f;
+	else rate += cl->userrate * ( cl->ratechokes ? 0.1f : 0.05f );
+
+	cl->netchan.rate = bound( MIN_RATE, rate, cl->userrate );
+	cl->ratechokes = 0;
+
+	// send updates no faster than the average snapshot fits into the rate
+	maxinterval = max( 1.0 / max( sv_minupdaterate->value, 1.0f ), cl->cl_updaterate );
+	interval = cl->snapshotsize / cl->netchan.rate;
+	cl->updateinterval = bound( cl->cl_updaterate, interval, maxinterval );
+
+	// doesn't fit even at the lowest update rate, leave far entities out
+	if( interval > maxinterval )
+		cl->maxentities = max( cl->maxentities * 0.8f, RATE_MIN_ENTITIES );
+	else if( interval < maxinterval * 0.75 )
+		cl->maxentities = min( cl->maxentities + 16, MAX_VISIBLE_PACKET - 1 );
+
+	if( congested )
+	{
+		MsgDev( D_NOTE, "%s congested: loss %g%%, ping %g (base %g), rate %g, updaterate %g, entities %i\n", cl->name,
+			loss, cl->ping, cl->minping, cl->netchan.rate, 1.0 / cl->updateinterval, cl->maxentities );
+	}
+}
+
 /*
 =======================
 SV_SendClientDatagram
@@ -620,6 +971,8 @@ void SV_SendClientDatagram( sv_client_t *cl )
 {
 	byte    	msg_buf[NET_MAX_PAYLOAD];
 	sizebuf_t	msg;
+	flow_t	*flow;
+	int	size;
 
 	svs.currentPlayer = cl;
 	svs.currentPlayerNum = (cl - svs.clients);
@@ -649,6 +1002,13 @@ void SV_SendClientDatagram( sv_client_t *cl )
 
 	// send the datagram
 	Netchan_TransmitBits( &cl->netchan, BF_GetNumBitsWritten( &msg ), BF_GetData( &msg ));
+
+	// keep average size for adaptive rate control
+	flow = &cl->netchan.flow[FLOW_OUTGOING];
+	size = flow->stats[( flow->current - 1 ) & ( MAX_LATENT - 1 )].size;
+
+	if( cl->snapshotsize ) cl->snapshotsize += ( size - cl->snapshotsize ) * 0.125f;
+	else cl->snapshotsize = size;
 }
 
 /*
@@ -727,6 +1087,68 @@ void SV_UpdateToReliableMessages( void )
 	BF_Clear( &sv.datagram );
 }
 
+/*
+=======================
+SV_SendFileLanes
+
+shares sv_filelane_rate between clients that are downloading
+over the file lane. Clients that can't use their equal share
+leave the rest to others, each one may still grow by a quarter
+=======================
+*/
+static void SV_SendFileLanes( void )
+{
+	qboolean		satisfied[MAX_CLIENTS];
+	double		remaining, share, demand;
+	sv_client_t	*cl;
+	int		i, count, changed;
+
+	Q_memset( satisfied, 0, sizeof( satisfied ));
+	remaining = max( sv_filelane_rate->value, FILELANE_MINRATE );
+	count = 0;
+
+	for( i = 0, cl = svs.clients; i < sv_maxclients->integer; i++, cl++ )
+	{
+		if( !cl->state || cl->fakeclient || !Netchan_FileLaneActive( &cl->netchan ))
+			satisfied[i] = true;
+		else count++;
+	}
+
+	// max-min fair share
+	do
+	{
+		changed = false;
+		share = count ? remaining / count : remaining;
+
+		for( i = 0, cl = svs.clients; i < sv_maxclients->integer; i++, cl++ )
+		{
+			if( satisfied[i] ) continue;
+
+			demand = cl->netchan.filelane.rate * 1.25;
+			if( demand >= share ) continue;
+
+			cl->netchan.filelane.maxrate = demand;
+			satisfied[i] = true;
+			remaining -= demand;
+			changed = true;
+			count--;
+		}
+	} while( changed && count );
+
+	share = count ? remaining / count : remaining;
+
+	for( i = 0, cl = svs.clients; i < sv_maxclients->integer; i++, cl++ )
+	{
+		if( !cl->state || cl->fakeclient || !cl->netchan.filelane.enabled )
+			continue;
+
+		if( !satisfied[i] || !Netchan_FileLaneActive( &cl->netchan ))
+			cl->netchan.filelane.maxrate = max( share, FILELANE_MINRATE );
+
+		Netchan_TransmitFileLane( &cl->netchan );
+	}
+}
+
 /*
 =======================
 SV_SendClientMessages
@@ -804,13 +1226,17 @@ void SV_SendClientMessages( void )
 		if( !Netchan_CanPacket( &cl->netchan ))
 		{
 			cl->chokecount++;
+			cl->ratechokes++;
 			continue;
 		}
 
 		cl->send_message = false;
 
+		if( cl->state == cs_spawned )
+			SV_UpdateClientRate( cl );
+
 		// Now that we were able to send, reset timer to point to next possible send time.
-		cl->next_messagetime = host.realtime + host.frametime + cl->cl_updaterate;
+		cl->next_messagetime = host.realtime + host.frametime + cl->updateinterval;
 
 		if( cl->state == cs_spawned )
 		{
@@ -823,6 +1249,8 @@ void SV_SendClientMessages( void )
 		}
 	}
 
+	SV_SendFileLanes();
+
 	// reset current client
 	svs.currentPlayer = NULL;
 	svs.currentPlayerNum = 0;
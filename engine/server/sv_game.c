@@ -579,7 +579,6 @@ static void SV_AddToFatPVS( const vec3_t org, int type, mnode_t *node )
 			if( node->contents != CONTENTS_SOLID )
 			{
 				mleaf_t	*leaf;
-				int	i;
 
 				leaf = (mleaf_t *)node;			
 
@@ -589,8 +588,7 @@ static void SV_AddToFatPVS( const vec3_t org, int type, mnode_t *node )
 					vis = Mod_LeafPHS( leaf, sv.worldmodel );
 				else vis = Mod_DecompressVis( NULL ); // get full visibility
 
-				for( i = 0; i < fatbytes; i++ )
-					bitvector[i] |= vis[i];
+				Mod_OrVis( bitvector, vis, fatbytes );
 			}
 			return;
 		}
@@ -1492,7 +1490,7 @@ int SV_CheckClientPVS( int check, qboolean bMergePVS )
 	mleaf_t		*leaf;
 	vec3_t		view;
 	sv_client_t	*cl;
-	int		i, j, k;
+	int		i, k;
 	int		pvsbytes;
 
 	// cycle to the next one
@@ -1544,8 +1542,7 @@ int SV_CheckClientPVS( int check, qboolean bMergePVS )
 		if( leaf == NULL ) continue; // skip outside cameras
 		pvs = Mod_LeafPVS( leaf, sv.worldmodel );
 
-		for( j = 0; j < pvsbytes; j++ )
-			clientpvs[j] |= pvs[j];
+		Mod_OrVis( clientpvs, pvs, pvsbytes );
 	}
 
 	return i;
@@ -357,8 +357,11 @@ void SV_ActivateServer( void )
 	}
 	Log_Printf( "Started map \"%s\" (CRC \"0\")\n", STRING( svgame.globals->mapname ) );
 
+	MsgDev( D_INFO, "Level \"%s\" loaded in %.2f seconds\n", sv.name, Sys_DoubleTime() - svs.timestart );
+
 	if( Host_IsDedicated() )
 	{
+		FS_PrefetchFlush();
 		Mod_FreeUnused ();
 	}
 
@@ -427,6 +430,9 @@ void SV_DeactivateServer( void )
 		if( svs.clients[i].frames )
 			Mem_Free( svs.clients[i].frames );
 		svs.clients[i].frames = NULL;
+		if( svs.clients[i].entpriority )
+			Mem_Free( svs.clients[i].entpriority );
+		svs.clients[i].entpriority = NULL;
 	}
 
 	svgame.globals->maxEntities = GI->max_edicts;
@@ -490,6 +496,51 @@ void SV_LevelInit( const char *pMapName, char const *pOldLevel, char const *pLan
 	SV_FreeOldEntities ();
 }
 
+/*
+================
+SV_PrefetchResources
+
+queue the next map and resources of the
+previous level to background reading because
+most of them will be requested again
+================
+*/
+static void SV_PrefetchResources( const char *mapname )
+{
+	string	name;
+	int	i;
+
+	// drop anything that was left from previous level
+	FS_PrefetchFlush();
+
+	FS_MapFileBase( mapname, name );
+	FS_Prefetch( va( "maps/%s.bsp", name ));
+
+	// precache lists are still valid here, sv is wiped later
+	for( i = 2; i < MAX_MODELS && sv.model_precache[i][0]; i++ )
+	{
+		const char	*model = sv.model_precache[i];
+
+		// brush submodels and other maps are not needed
+		if( model[0] == '*' || !Q_strnicmp( model, "maps/", 5 ))
+			continue;
+		FS_Prefetch( model );
+	}
+
+	// dedicated server never loads sounds
+	if( Host_IsDedicated( ))
+		return;
+
+	for( i = 1; i < MAX_SOUNDS && sv.sound_precache[i][0]; i++ )
+	{
+		const char	*sample = sv.sound_precache[i];
+
+		if( sample[0] == '*' || sample[0] == '!' )
+			continue;
+		FS_Prefetch( va( "sound/%s", sample ));
+	}
+}
+
 /*
 ================
 SV_SpawnServer
@@ -541,6 +592,8 @@ qboolean SV_SpawnServer( const char *mapname, const char *startspot )
 	Log_Printf( "Loading map \"%s\"\n", mapname );
 	Log_PrintServerVars();
 
+	SV_PrefetchResources( mapname );
+
 	sv.state = ss_dead;
 	Host_SetServerState( sv.state );
 	Q_memset( &sv, 0, sizeof( sv ));	// wipe the entire per-level structure
@@ -589,6 +642,7 @@ qboolean SV_SpawnServer( const char *mapname, const char *startspot )
 
 	// make sure what server name doesn't contain path and extension
 	FS_MapFileBase( mapname, sv.name );
+	SV_InvalidateQueries();
 
 
 	if( startspot )
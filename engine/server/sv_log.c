@@ -20,11 +20,28 @@ GNU General Public License for more details.
 #include "errno.h"
 #include <time.h>
 
+#define LOG_RING_SIZE	(1<<18)	// must be power of two
+#define LOG_RING_MASK	( LOG_RING_SIZE - 1 )
+#define LOG_FLUSH_MSEC	20	// writer thread collects lines for this time
+
 convar_t *mp_logfile;
 convar_t *mp_logecho;
 convar_t *sv_log_singleplayer;
 convar_t *sv_log_onefile;
 
+// game thread puts lines, writer thread writes them to svs.log.file
+static struct
+{
+	sys_thread_t	*thread;
+	volatile qboolean	running;
+	volatile int	head;	// moved by game thread only
+	volatile int	tail;	// moved by writer thread only
+	char		ring[LOG_RING_SIZE];
+
+	time_t		stamptime;	// timestamp is formatted once per second
+	char		stamp[32];
+} log_writer;
+
 void Log_InitCvars ( void )
 {
 	mp_logfile = Cvar_Get( "mp_logfile", "1", CVAR_ARCHIVE, "log server information in the log file" );
@@ -34,23 +51,118 @@ void Log_InitCvars ( void )
 	sv_log_onefile = Cvar_Get( "sv_log_onefile", "0", CVAR_ARCHIVE, "logs server information to only one file" );
 }
 
+static void Log_WriteRing( void )
+{
+	int head = log_writer.head;
+	int tail = log_writer.tail;
+
+	Sys_MemoryBarrier();
+
+	if( head == tail )
+		return;
+
+	if( head < tail )
+	{
+		FS_Write( svs.log.file, log_writer.ring + tail, LOG_RING_SIZE - tail );
+		tail = 0;
+	}
+
+	FS_Write( svs.log.file, log_writer.ring + tail, head - tail );
+
+	Sys_MemoryBarrier();
+	log_writer.tail = head;
+}
+
+static void Log_WriterThread( void *unused )
+{
+	while( 1 )
+	{
+		qboolean running = log_writer.running;
+
+		Log_WriteRing();
+
+		// everything before stop is written now
+		if( !running )
+			break;
+
+		Sys_Sleep( LOG_FLUSH_MSEC );
+	}
+}
+
+static void Log_StartWriter( void )
+{
+	log_writer.head = log_writer.tail = 0;
+	log_writer.running = true;
+	log_writer.thread = Sys_CreateThread( Log_WriterThread, NULL );
+
+	// write directly then
+	if( !log_writer.thread )
+		log_writer.running = false;
+}
+
+static void Log_StopWriter( void )
+{
+	if( !log_writer.thread )
+		return;
+
+	log_writer.running = false;
+	Sys_JoinThread( log_writer.thread );
+	log_writer.thread = NULL;
+}
+
+static void Log_Write( const char *string, int len )
+{
+	int head = log_writer.head;
+	int part;
+
+	if( !log_writer.thread )
+	{
+		FS_Write( svs.log.file, string, len );
+		return;
+	}
+
+	// wait for disk rather than lose the line
+	while( LOG_RING_SIZE - 1 - (( head - log_writer.tail ) & LOG_RING_MASK ) < len )
+		Sys_Sleep( 1 );
+
+	part = min( len, LOG_RING_SIZE - head );
+	Q_memcpy( log_writer.ring + head, string, part );
+	Q_memcpy( log_writer.ring, string + part, len - part );
+
+	Sys_MemoryBarrier();
+	log_writer.head = ( head + len ) & LOG_RING_MASK;
+}
+
+static const char *Log_Timestamp( void )
+{
+	time_t ltime;
+	struct tm *today;
+
+	time( &ltime );
+
+	if( ltime != log_writer.stamptime || !log_writer.stamp[0] )
+	{
+		today = localtime( &ltime );
+		Q_snprintf( log_writer.stamp, sizeof( log_writer.stamp ), "L %02i/%02i/%04i - %02i:%02i:%02i: ", today->tm_mon + 1, today->tm_mday, today->tm_year + 1900, today->tm_hour, today->tm_min, today->tm_sec );
+		log_writer.stamptime = ltime;
+	}
+
+	return log_writer.stamp;
+}
+
 void Log_Printf( const char *fmt, ... )
 {
 	va_list argptr;
 	char string[ MAX_SYSPATH ];
-	time_t ltime;
-
-	struct tm *today;
+	int len;
 
 	if ( !svs.log.network_logging && !svs.log.active )
 		return;
 
-	time( &ltime );
-	today = localtime( &ltime );
+	len = Q_strncpy( string, Log_Timestamp(), sizeof( string ));
 
 	va_start( argptr, fmt );
-	Q_snprintf( string,sizeof( string ), "L %02i/%02i/%04i - %02i:%02i:%02i: ", today->tm_mon + 1, today->tm_mday, today->tm_year + 1900, today->tm_hour, today->tm_min, today->tm_sec );
-	Q_vsnprintf( &string[ Q_strlen( string ) ], sizeof( string ) - Q_strlen( string ), fmt, argptr );
+	Q_vsnprintf( &string[ len ], sizeof( string ) - len, fmt, argptr );
 	va_end( argptr );
 
 	if ( svs.log.network_logging )
@@ -64,7 +176,7 @@ void Log_Printf( const char *fmt, ... )
 		if( svs.log.file )
 		{
 			if ( mp_logfile->integer != 0 )
-				FS_Printf( svs.log.file, "%s", string );
+				Log_Write( string, Q_strlen( string ));
 		}
 	}
 }
@@ -91,6 +203,7 @@ void Log_Close( void )
 	if ( svs.log.file )
 	{
 		Log_Printf( "Log file closed\n" );
+		Log_StopWriter();
 		FS_Close( svs.log.file );
 	}
 	svs.log.file = NULL;
@@ -140,6 +253,7 @@ void Log_Open( void )
 				if ( fp )
 				{
 					svs.log.file = fp;
+					Log_StartWriter();
 
 					Con_Printf( "Server logging data to file %s\n", test_file );
 					Log_Printf( "Log file started (file \"%s\") (game \"%s\") (version \"%i/%s/%d\")\n", test_file, GI->gamefolder, PROTOCOL_VERSION, XASH_VERSION, Q_buildnum () );
@@ -90,10 +90,17 @@ convar_t	*sv_corpse_solid;
 convar_t	*sv_fixmulticast;
 convar_t	*sv_allow_split;
 convar_t	*sv_allow_compress;
+convar_t	*sv_allow_filelane;
+convar_t	*sv_filelane_rate;
+convar_t	*sv_adaptiverate;
+convar_t	*sv_minupdaterate;
+convar_t	*sv_entitypriority;
 convar_t	*sv_maxpacket;
 convar_t	*sv_forcesimulating;
 convar_t	*sv_nat;
 convar_t	*sv_password;
+convar_t	*sv_queryrate;
+convar_t	*sv_queryburst;
 convar_t	*sv_userinfo_enable_penalty;
 convar_t	*sv_userinfo_penalty_time;
 convar_t	*sv_userinfo_penalty_multiplier;
@@ -295,6 +302,7 @@ void SV_UpdateServerInfo( void )
 	if( !serverinfo->modified ) return;
 
 	Cvar_LookupVars( CVAR_SERVERINFO, NULL, NULL, (setpair_t)pfnUpdateServerInfo );
+	SV_InvalidateQueries();
 
 	serverinfo->modified = false;
 }
@@ -353,6 +361,10 @@ void SV_ReadPackets( void )
 
 	while( NET_GetPacket( NS_SERVER, &net_from, net_message_buffer, &curSize ))
 	{
+		// drop banned traffic before anything is parsed
+		if( SV_CheckIP( &net_from ))
+			continue;
+
 		if( !svs.initialized )
 		{
 			BF_Init( &net_message, "ClientPacket", net_message_buffer, curSize );
@@ -405,6 +417,28 @@ void SV_ReadPackets( void )
 			if( !NetSplit_GetLong( &cl->netchan.netsplit, &net_from, net_message_buffer, &curSize, false ) )
 				continue;
 		}
+		if( LittleLong(*((int *)&net_message_buffer)) == FILELANE_SIGNATURE )
+		{
+			// find client with this address and enabled file lane
+			for( i = 0, cl = svs.clients; i < sv_maxclients->integer; i++, cl++ )
+			{
+				if( cl->state == cs_free || cl->fakeclient || !cl->netchan.filelane.enabled )
+					continue;
+
+				if( NET_CompareAdr( net_from, cl->netchan.remote_address ))
+					break;
+			}
+
+			if( i < sv_maxclients->integer )
+			{
+				BF_Init( &net_message, "FileLane", net_message_buffer, curSize );
+				Netchan_ProcessFileLane( &cl->netchan, &net_message );
+
+				if( Netchan_CopyFileFragments( &cl->netchan, &net_message ))
+					SV_ProcessFile( cl, cl->netchan.incomingfilename );
+			}
+			continue;
+		}
 		BF_Init( &net_message, "ClientPacket", net_message_buffer, curSize );
 
 		// check for connectionless packet (0xffffffff) first
@@ -701,6 +735,9 @@ void Host_ServerFrame( void )
 
 	// send a heartbeat to the master if needed
 	Master_Heartbeat ();
+
+	// serve fast download requests
+	HTTP_ServerFrame ();
 }
 
 //============================================================================
@@ -989,6 +1026,11 @@ void SV_Init( void )
 	sv_fixmulticast = Cvar_Get( "sv_fixmulticast", "1", CVAR_ARCHIVE, "do not send multicast to not spawned clients" );
 	sv_allow_compress = Cvar_Get( "sv_allow_compress", "1", CVAR_ARCHIVE, "allow Huffman compression on server" );
 	sv_allow_split= Cvar_Get( "sv_allow_split", "1", CVAR_ARCHIVE, "allow splitting packets on server" );
+	sv_allow_filelane = Cvar_Get( "sv_allow_filelane", "1", CVAR_ARCHIVE, "allow sending files over separate paced lane" );
+	sv_filelane_rate = Cvar_Get( "sv_filelane_rate", "1048576", CVAR_ARCHIVE, "total upload rate for file lane transfers, shared between downloading clients" );
+	sv_adaptiverate = Cvar_Get( "sv_adaptiverate", "1", CVAR_ARCHIVE, "adjust client rate and update rate to measured loss, latency and choke" );
+	sv_minupdaterate = Cvar_Get( "sv_minupdaterate", "10", CVAR_ARCHIVE, "lowest update rate adaptive rate control may fall back to" );
+	sv_entitypriority = Cvar_Get( "sv_entitypriority", "1", CVAR_ARCHIVE, "send most important entity updates first when snapshot exceeds client packet size" );
 	sv_maxpacket = Cvar_Get( "sv_maxpacket", "2000", CVAR_ARCHIVE, "limit cl_maxpacket for all clients" );
 	sv_forcesimulating = Cvar_Get( "sv_forcesimulating", DEFAULT_SV_FORCESIMULATING, 0, "forcing world simulating when server don't have active players" );
 	sv_nat = Cvar_Get( "sv_nat", "0", 0, "enable NAT bypass for this server" );
@@ -1000,6 +1042,8 @@ void SV_Init( void )
 	sv_allow_noinputdevices = Cvar_Get( "sv_allow_noinputdevices", "1", CVAR_ARCHIVE, "allow connect from old versions without useragent" );
 
 	sv_password = Cvar_Get( "sv_password", "", CVAR_PROTECTED, "server password. Leave blank or set to \"none\" if none" );
+	sv_queryrate = Cvar_Get( "sv_queryrate", "10", CVAR_ARCHIVE, "max server browser queries per second from one address, 0 disables limit" );
+	sv_queryburst = Cvar_Get( "sv_queryburst", "20", CVAR_ARCHIVE, "max server browser queries at once from one address" );
 
 	sv_userinfo_enable_penalty = Cvar_Get( "sv_userinfo_enable_penalty", "1", CVAR_ARCHIVE, "enable penalty time for too fast userinfo updates(name, model, etc)" );
 	sv_userinfo_penalty_time = Cvar_Get( "sv_userinfo_penalty_time", "0.3", CVAR_ARCHIVE, "initial penalty time" );
@@ -1010,6 +1054,7 @@ void SV_Init( void )
 
 	Cmd_AddCommand( "logaddress", SV_SetLogAddress_f, "sets address and port for remote logging host" );
 	Cmd_AddCommand( "log", SV_ServerLog_f, "enables logging to file" );
+	Cmd_AddCommand( "querystats", SV_QueryStats_f, "show server browser query counters" );
 
 #ifdef XASH_64BIT
 	Cmd_AddCommand( "str64stats", SV_PrintStr64Stats_f, "show 64 bit string pool stats" );
@@ -1095,6 +1140,8 @@ void SV_Shutdown( qboolean reconnect )
 	if( public_server->integer && sv_maxclients->integer != 1 )
 		Master_Shutdown();
 
+	HTTP_ServerShutdown();
+
 	Sequence_PurgeEntries( true ); // clear Sequence
 
 	SV_DeactivateServer ();
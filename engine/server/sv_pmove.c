@@ -957,6 +957,8 @@ void SV_SetupMoveInterpolant( sv_client_t *cl )
 	if( lerp_msec > 0.1f )
 		lerp_msec = 0.1f;
 
+	// client interpolates with its own updaterate,
+	// it doesn't know about server side stretching
 	if( lerp_msec < cl->cl_updaterate )
 		lerp_msec = cl->cl_updaterate;
 